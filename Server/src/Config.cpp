@@ -22,6 +22,7 @@
 
 #include "Config.h"
 #include "kafka/KafkaTopicSelector.h"
+#include "kafka/ColumnProjection.h"
 
 /*********************************************************************//**
  * Constructor for class
@@ -40,6 +41,7 @@ Config::Config() {
     bind_ipv4           = "";
     bind_ipv6           = "";
     heartbeat_interval  = 60 * 5;        // Default is 5 minutes
+    shutdown_drain_timeout = 15;
     kafka_brokers       = "localhost:9092";
     tx_max_bytes        = 1000000;
     rx_max_bytes        = 100000000;
@@ -49,11 +51,39 @@ Config::Config() {
     q_buf_max_ms        = 1000;         // Default is 1 sec
     msg_send_max_retry  = 2;
     retry_backoff_ms    = 100;
+    ctrl_lane_enabled   = true;
+    ctrl_q_buf_max_msgs = 10000;
+    ctrl_q_buf_max_ms   = 5;
+    kafka_mock_brokers  = 0;
+    kafka_delivery_reports = false;
+    kafka_native_headers = false;
+    kafka_normalized_prefixes = false;
+    produce_batch_msgs  = 64;
+    topic_idle_timeout  = 600;
+    kafka_stats_interval_ms = 0;
+    autotune_enabled    = false;
+    autotune_interval   = 10;
+    autotune_linger_min_ms  = 5;
+    autotune_linger_max_ms  = 1000;
+    autotune_batch_min_msgs = 100;
+    autotune_batch_max_msgs = 10000;
+    autotune_latency_ms = 500;
+    stat_report_window_ms = 0;
+    stat_report_suppress = false;
     compression         = "snappy";
     max_concurrent_routers = 2;
     initial_router_time = 60;
     calculate_baseline  = true;
     pat_enabled		= false;
+    metrics_interval    = 0;
+    stage_accounting    = false;
+    lag_threshold       = 300;
+    rib_enabled         = false;
+    rib_query_socket    = "/var/run/openbmpd.rib.sock";
+    coalesce_window_ms  = 0;
+    coalesce_max_pending = 100000;
+    filter_default_drop = false;
+    projection_skip_attrs = 0;
     bzero(admin_id, sizeof(admin_id));
 
     /*
@@ -68,6 +98,7 @@ Config::Config() {
     topic_names_map[MSGBUS_TOPIC_VAR_BMP_RAW]          = MSGBUS_TOPIC_BMP_RAW;
     topic_names_map[MSGBUS_TOPIC_VAR_BASE_ATTRIBUTE]   = MSGBUS_TOPIC_BASE_ATTRIBUTE;
     topic_names_map[MSGBUS_TOPIC_VAR_UNICAST_PREFIX]   = MSGBUS_TOPIC_UNICAST_PREFIX;
+    topic_names_map[MSGBUS_TOPIC_VAR_UNICAST_PREFIX_STATE] = "";           // Disabled unless configured
     topic_names_map[MSGBUS_TOPIC_VAR_LS_NODE]          = MSGBUS_TOPIC_LS_NODE;
     topic_names_map[MSGBUS_TOPIC_VAR_LS_LINK]          = MSGBUS_TOPIC_LS_LINK;
     topic_names_map[MSGBUS_TOPIC_VAR_LS_PREFIX]        = MSGBUS_TOPIC_LS_PREFIX;
@@ -105,6 +136,16 @@ void Config::load(const char *cfg_filename) {
                         parseKafka(node);
                     else if (key.compare("mapping") == 0)
                         parseMapping(node);
+                    else if (key.compare("metrics") == 0)
+                        parseMetrics(node);
+                    else if (key.compare("rib") == 0)
+                        parseRib(node);
+                    else if (key.compare("coalesce") == 0)
+                        parseCoalesce(node);
+                    else if (key.compare("filter") == 0)
+                        parseFilter(node);
+                    else if (key.compare("projection") == 0)
+                        parseProjection(node);
 
                     else if (debug_general)
                         std::cout << "   Config: Key " << key << " Type " << node.Type() << std::endl;
@@ -126,10 +167,42 @@ void Config::load(const char *cfg_filename) {
         throw err.what();
     }
 
+    // Projection depends on the enabled topics, which can be anywhere in the file
+    ColumnProjection::compile(*this);
+
     if (debug_general)
         std::cout << "---| Done Loading configuration file |------------------------- " << std::endl;
 }
 
+/*********************************************************************//**
+ * Take the settings that can change without a restart from a reloaded config
+ *
+ *      Debug flags, topic variables and names, router/peer group matching and column
+ *      projection.  All other settings, e.g. the kafka producer settings, keep their
+ *      running value until restart.
+ *
+ * \param [in] loaded           Config loaded from the file
+ ***********************************************************************/
+void Config::applyReloadable(const Config &loaded) {
+    debug_general = loaded.debug_general;
+    debug_bgp     = loaded.debug_bgp;
+    debug_bmp     = loaded.debug_bmp;
+    debug_msgbus  = loaded.debug_msgbus;
+
+    topic_vars_map  = loaded.topic_vars_map;
+    topic_names_map = loaded.topic_names_map;
+
+    match_router_group_by_name = loaded.match_router_group_by_name;
+    match_router_group_by_ip   = loaded.match_router_group_by_ip;
+    match_peer_group_by_name   = loaded.match_peer_group_by_name;
+    match_peer_group_by_ip     = loaded.match_peer_group_by_ip;
+    match_peer_group_by_asn    = loaded.match_peer_group_by_asn;
+
+    projection_map        = loaded.projection_map;
+    projection_blank      = loaded.projection_blank;
+    projection_skip_attrs = loaded.projection_skip_attrs;
+}
+
 /**
  * Parse the base configuration
  *
@@ -245,6 +318,23 @@ void Config::parseBase(const YAML::Node &node) {
         }
     }
 
+    if (node["shutdown"]) {
+        if (node["shutdown"]["drain_timeout"]) {
+            try {
+                shutdown_drain_timeout = node["shutdown"]["drain_timeout"].as<int>();
+
+                if (shutdown_drain_timeout < 1 || shutdown_drain_timeout > 300)
+                    throw "invalid shutdown drain timeout not within range of 1 - 300)";
+
+                if (debug_general)
+                    std::cout << "   Config: shutdown drain timeout: " << shutdown_drain_timeout << std::endl;
+
+            } catch (YAML::TypedBadConversion<int> err) {
+                printWarning("shutdown.drain_timeout is not of type int", node["shutdown"]["drain_timeout"]);
+            }
+        }
+    }
+
     if (node["startup"]) {
         if (node["startup"]["max_concurrent_routers"]) {
             try {
@@ -535,6 +625,75 @@ void Config::parseKafka(const YAML::Node &node) {
         }
     }
 
+    if (node["statistics.interval.ms"]) {
+        try {
+            kafka_stats_interval_ms = node["statistics.interval.ms"].as<int>();
+
+            if (kafka_stats_interval_ms < 0 || kafka_stats_interval_ms > 86400000)
+                throw "invalid kafka statistics.interval.ms, should be in range 0 - 86400000";
+
+            if (debug_general)
+                std::cout << "   Config: kafka statistics interval in ms: " << kafka_stats_interval_ms << std::endl;
+
+        } catch (YAML::TypedBadConversion<int> err) {
+            printWarning("kafka.statistics.interval.ms is not of type int", node["statistics.interval.ms"]);
+        }
+    }
+
+    if (node["produce_batch"]) {
+        try {
+            produce_batch_msgs = node["produce_batch"].as<int>();
+
+            if (produce_batch_msgs < 1 || produce_batch_msgs > 10000)
+                throw "invalid kafka produce_batch, should be in range 1 - 10000";
+
+            if (debug_general)
+                std::cout << "   Config: kafka produce batch messages: " << produce_batch_msgs << std::endl;
+
+        } catch (YAML::TypedBadConversion<int> err) {
+            printWarning("kafka.produce_batch is not of type int", node["produce_batch"]);
+        }
+    }
+
+    if (node["topic_idle_timeout"]) {
+        try {
+            topic_idle_timeout = node["topic_idle_timeout"].as<int>();
+
+            if (topic_idle_timeout < 0 || topic_idle_timeout > 86400)
+                throw "invalid kafka topic_idle_timeout, should be in range 0 - 86400";
+
+            if (debug_general)
+                std::cout << "   Config: kafka topic idle timeout: " << topic_idle_timeout << std::endl;
+
+        } catch (YAML::TypedBadConversion<int> err) {
+            printWarning("kafka.topic_idle_timeout is not of type int", node["topic_idle_timeout"]);
+        }
+    }
+
+    if (node["native_headers"]) {
+        try {
+            kafka_native_headers = node["native_headers"].as<bool>();
+
+            if (debug_general)
+                std::cout << "   Config: kafka native headers: " << kafka_native_headers << std::endl;
+
+        } catch (YAML::TypedBadConversion<bool> err) {
+            printWarning("kafka.native_headers is not of type boolean", node["native_headers"]);
+        }
+    }
+
+    if (node["normalized_prefixes"]) {
+        try {
+            kafka_normalized_prefixes = node["normalized_prefixes"].as<bool>();
+
+            if (debug_general)
+                std::cout << "   Config: kafka normalized prefixes: " << kafka_normalized_prefixes << std::endl;
+
+        } catch (YAML::TypedBadConversion<bool> err) {
+            printWarning("kafka.normalized_prefixes is not of type boolean", node["normalized_prefixes"]);
+        }
+    }
+
     if (node["compression.codec"]  && 
         node["compression.codec"].Type() == YAML::NodeType::Scalar) {
         try {
@@ -554,11 +713,226 @@ void Config::parseKafka(const YAML::Node &node) {
         }
     }
 
+    if (node["control_lane"] && node["control_lane"].Type() == YAML::NodeType::Map) {
+        parseControlLane(node["control_lane"]);
+    }
+
+    if (node["autotune"] && node["autotune"].Type() == YAML::NodeType::Map) {
+        parseAutotune(node["autotune"]);
+    }
+
+    if (node["stats_report"] && node["stats_report"].Type() == YAML::NodeType::Map) {
+        parseStatReport(node["stats_report"]);
+    }
+
     if (node["topics"] && node["topics"].Type() == YAML::NodeType::Map) {
         parseTopics(node["topics"]);
     }
 }
 
+/**
+ * Parse the kafka control lane configuration
+ *
+ * \param [in] node     Reference to the yaml NODE
+ */
+void Config::parseControlLane(const YAML::Node &node) {
+    if (node["enable"]) {
+        try {
+            ctrl_lane_enabled = node["enable"].as<bool>();
+
+            if (debug_general)
+                std::cout << "   Config: kafka control lane enable: " << ctrl_lane_enabled << std::endl;
+
+        } catch (YAML::TypedBadConversion<bool> err) {
+            printWarning("kafka.control_lane.enable is not of type boolean", node["enable"]);
+        }
+    }
+
+    if (node["queue.buffering.max.messages"]) {
+        try {
+            ctrl_q_buf_max_msgs = node["queue.buffering.max.messages"].as<int>();
+
+            if (ctrl_q_buf_max_msgs < 1 or ctrl_q_buf_max_msgs > 10000000)
+                throw "invalid kafka control lane queue.buffering.max.messages, should be in range 1 - 10000000";
+
+            if (debug_general)
+                std::cout << "   Config: kafka control lane queue buffering max messages: "
+                          << ctrl_q_buf_max_msgs << std::endl;
+
+        } catch (YAML::TypedBadConversion<int> err) {
+            printWarning("kafka.control_lane.queue.buffering.max.messages is not of type int",
+                         node["queue.buffering.max.messages"]);
+        }
+    }
+
+    if (node["queue.buffering.max.ms"]) {
+        try {
+            ctrl_q_buf_max_ms = node["queue.buffering.max.ms"].as<int>();
+
+            if (ctrl_q_buf_max_ms < 0 or ctrl_q_buf_max_ms > 900000)
+                throw "invalid kafka control lane queue.buffering.max.ms, should be in range 0 - 900000";
+
+            if (debug_general)
+                std::cout << "   Config: kafka control lane queue buffering max time in ms: "
+                          << ctrl_q_buf_max_ms << std::endl;
+
+        } catch (YAML::TypedBadConversion<int> err) {
+            printWarning("kafka.control_lane.queue.buffering.max.ms is not of type int",
+                         node["queue.buffering.max.ms"]);
+        }
+    }
+}
+
+
+/**
+ * Parse the kafka batching autotune configuration
+ *
+ * \param [in] node     Reference to the yaml NODE
+ */
+void Config::parseAutotune(const YAML::Node &node) {
+    if (node["enable"]) {
+        try {
+            autotune_enabled = node["enable"].as<bool>();
+
+            if (debug_general)
+                std::cout << "   Config: kafka autotune enable: " << autotune_enabled << std::endl;
+
+        } catch (YAML::TypedBadConversion<bool> err) {
+            printWarning("kafka.autotune.enable is not of type boolean", node["enable"]);
+        }
+    }
+
+    if (node["interval"]) {
+        try {
+            autotune_interval = node["interval"].as<int>();
+
+            if (autotune_interval < 1 or autotune_interval > 3600)
+                throw "invalid kafka autotune interval, should be in range 1 - 3600";
+
+            if (debug_general)
+                std::cout << "   Config: kafka autotune interval in seconds: " << autotune_interval << std::endl;
+
+        } catch (YAML::TypedBadConversion<int> err) {
+            printWarning("kafka.autotune.interval is not of type int", node["interval"]);
+        }
+    }
+
+    if (node["linger.min.ms"]) {
+        try {
+            autotune_linger_min_ms = node["linger.min.ms"].as<int>();
+
+            if (autotune_linger_min_ms < 0 or autotune_linger_min_ms > 900000)
+                throw "invalid kafka autotune linger.min.ms, should be in range 0 - 900000";
+
+            if (debug_general)
+                std::cout << "   Config: kafka autotune min linger in ms: " << autotune_linger_min_ms << std::endl;
+
+        } catch (YAML::TypedBadConversion<int> err) {
+            printWarning("kafka.autotune.linger.min.ms is not of type int", node["linger.min.ms"]);
+        }
+    }
+
+    if (node["linger.max.ms"]) {
+        try {
+            autotune_linger_max_ms = node["linger.max.ms"].as<int>();
+
+            if (autotune_linger_max_ms < 0 or autotune_linger_max_ms > 900000)
+                throw "invalid kafka autotune linger.max.ms, should be in range 0 - 900000";
+
+            if (debug_general)
+                std::cout << "   Config: kafka autotune max linger in ms: " << autotune_linger_max_ms << std::endl;
+
+        } catch (YAML::TypedBadConversion<int> err) {
+            printWarning("kafka.autotune.linger.max.ms is not of type int", node["linger.max.ms"]);
+        }
+    }
+
+    if (node["batch.min.messages"]) {
+        try {
+            autotune_batch_min_msgs = node["batch.min.messages"].as<int>();
+
+            if (autotune_batch_min_msgs < 1 or autotune_batch_min_msgs > 1000000)
+                throw "invalid kafka autotune batch.min.messages, should be in range 1 - 1000000";
+
+            if (debug_general)
+                std::cout << "   Config: kafka autotune min batch messages: " << autotune_batch_min_msgs << std::endl;
+
+        } catch (YAML::TypedBadConversion<int> err) {
+            printWarning("kafka.autotune.batch.min.messages is not of type int", node["batch.min.messages"]);
+        }
+    }
+
+    if (node["batch.max.messages"]) {
+        try {
+            autotune_batch_max_msgs = node["batch.max.messages"].as<int>();
+
+            if (autotune_batch_max_msgs < 1 or autotune_batch_max_msgs > 1000000)
+                throw "invalid kafka autotune batch.max.messages, should be in range 1 - 1000000";
+
+            if (debug_general)
+                std::cout << "   Config: kafka autotune max batch messages: " << autotune_batch_max_msgs << std::endl;
+
+        } catch (YAML::TypedBadConversion<int> err) {
+            printWarning("kafka.autotune.batch.max.messages is not of type int", node["batch.max.messages"]);
+        }
+    }
+
+    if (node["latency.target.ms"]) {
+        try {
+            autotune_latency_ms = node["latency.target.ms"].as<int>();
+
+            if (autotune_latency_ms < 1 or autotune_latency_ms > 3600000)
+                throw "invalid kafka autotune latency.target.ms, should be in range 1 - 3600000";
+
+            if (debug_general)
+                std::cout << "   Config: kafka autotune latency target in ms: " << autotune_latency_ms << std::endl;
+
+        } catch (YAML::TypedBadConversion<int> err) {
+            printWarning("kafka.autotune.latency.target.ms is not of type int", node["latency.target.ms"]);
+        }
+    }
+
+    if (autotune_linger_min_ms > autotune_linger_max_ms)
+        throw "invalid kafka autotune linger bounds, linger.min.ms is larger than linger.max.ms";
+
+    if (autotune_batch_min_msgs > autotune_batch_max_msgs)
+        throw "invalid kafka autotune batch bounds, batch.min.messages is larger than batch.max.messages";
+}
+
+/**
+ * Parse the kafka stats report coalescing configuration
+ *
+ * \param [in] node     Reference to the yaml NODE
+ */
+void Config::parseStatReport(const YAML::Node &node) {
+    if (node["window_ms"]) {
+        try {
+            stat_report_window_ms = node["window_ms"].as<int>();
+
+            if (stat_report_window_ms < 0 or stat_report_window_ms > 60000)
+                throw "invalid kafka stats_report window_ms, should be in range 0 - 60000";
+
+            if (debug_general)
+                std::cout << "   Config: kafka stats report window ms: " << stat_report_window_ms << std::endl;
+
+        } catch (YAML::TypedBadConversion<int> err) {
+            printWarning("kafka.stats_report.window_ms is not of type int", node["window_ms"]);
+        }
+    }
+
+    if (node["suppress_unchanged"]) {
+        try {
+            stat_report_suppress = node["suppress_unchanged"].as<bool>();
+
+            if (debug_general)
+                std::cout << "   Config: kafka stats report suppress unchanged: " << stat_report_suppress << std::endl;
+
+        } catch (YAML::TypedBadConversion<bool> err) {
+            printWarning("kafka.stats_report.suppress_unchanged is not of type boolean", node["suppress_unchanged"]);
+        }
+    }
+}
+
 
 
 /**
@@ -726,6 +1100,286 @@ void Config::parseMapping(const YAML::Node &node) {
     }
 }
 
+/**
+ * Parse the metrics configuration
+ *
+ * \param [in] node     Reference to the yaml NODE
+ */
+void Config::parseMetrics(const YAML::Node &node) {
+    if (node["interval"]) {
+        try {
+            metrics_interval = node["interval"].as<int>();
+
+            if (metrics_interval < 0 || metrics_interval > 86400)
+                throw "invalid metrics interval not within range of 0 - 86400)";
+
+            if (debug_general)
+                std::cout << "   Config: metrics interval: " << metrics_interval << std::endl;
+
+        } catch (YAML::TypedBadConversion<int> err) {
+            printWarning("metrics.interval is not of type int", node["interval"]);
+        }
+    }
+
+    if (node["stage_accounting"]) {
+        try {
+            stage_accounting = node["stage_accounting"].as<bool>();
+
+            if (debug_general)
+                std::cout << "   Config: metrics stage_accounting: " << stage_accounting << std::endl;
+
+        } catch (YAML::TypedBadConversion<bool> err) {
+            printWarning("metrics.stage_accounting is not of type bool", node["stage_accounting"]);
+        }
+    }
+
+    if (node["lag_threshold"]) {
+        try {
+            lag_threshold = node["lag_threshold"].as<int>();
+
+            if (lag_threshold < 0 || lag_threshold > 86400)
+                throw "invalid metrics lag_threshold not within range of 0 - 86400)";
+
+            if (debug_general)
+                std::cout << "   Config: metrics lag threshold: " << lag_threshold << std::endl;
+
+        } catch (YAML::TypedBadConversion<int> err) {
+            printWarning("metrics.lag_threshold is not of type int", node["lag_threshold"]);
+        }
+    }
+}
+
+/**
+ * Parse the local RIB configuration
+ *
+ * \param [in] node     Reference to the yaml NODE
+ */
+void Config::parseRib(const YAML::Node &node) {
+    if (node["enable"]) {
+        try {
+            rib_enabled = node["enable"].as<bool>();
+
+            if (debug_general)
+                std::cout << "   Config: rib enable: " << rib_enabled << std::endl;
+
+        } catch (YAML::TypedBadConversion<bool> err) {
+            printWarning("rib.enable is not of type bool", node["enable"]);
+        }
+    }
+
+    if (node["query_socket"]) {
+        try {
+            rib_query_socket = node["query_socket"].as<std::string>();
+
+            if (rib_query_socket.length() == 0 or rib_query_socket.length() >= 108)
+                throw "invalid rib query_socket, path must be 1 - 107 characters";
+
+            if (debug_general)
+                std::cout << "   Config: rib query socket: " << rib_query_socket << std::endl;
+
+        } catch (YAML::TypedBadConversion<std::string> err) {
+            printWarning("rib.query_socket is not of type string", node["query_socket"]);
+        }
+    }
+}
+
+/**
+ * Parse the prefix flap coalescing configuration
+ *
+ * \param [in] node     Reference to the yaml NODE
+ */
+void Config::parseCoalesce(const YAML::Node &node) {
+    if (node["window_ms"]) {
+        try {
+            coalesce_window_ms = node["window_ms"].as<int>();
+
+            if (coalesce_window_ms < 0 or coalesce_window_ms > 60000)
+                throw "invalid coalesce window_ms, should be in range of 0 - 60000";
+
+            if (debug_general)
+                std::cout << "   Config: coalesce window ms: " << coalesce_window_ms << std::endl;
+
+        } catch (YAML::TypedBadConversion<int> err) {
+            printWarning("coalesce.window_ms is not of type int", node["window_ms"]);
+        }
+    }
+
+    if (node["max_pending"]) {
+        try {
+            coalesce_max_pending = node["max_pending"].as<int>();
+
+            if (coalesce_max_pending < 1000 or coalesce_max_pending > 10000000)
+                throw "invalid coalesce max_pending, should be in range of 1000 - 10000000";
+
+            if (debug_general)
+                std::cout << "   Config: coalesce max pending: " << coalesce_max_pending << std::endl;
+
+        } catch (YAML::TypedBadConversion<int> err) {
+            printWarning("coalesce.max_pending is not of type int", node["max_pending"]);
+        }
+    }
+}
+
+/**
+ * Parse the ingest filter configuration
+ *
+ * \param [in] node     Reference to the yaml NODE
+ */
+void Config::parseFilter(const YAML::Node &node) {
+    static const struct {
+        const char  *name;
+        uint32_t    bit;
+    } afi_safi_names[] = {
+            { "ipv4_unicast",           FILTER_IPV4_UNICAST },
+            { "ipv6_unicast",           FILTER_IPV6_UNICAST },
+            { "ipv4_labeled_unicast",   FILTER_IPV4_LABELED_UNICAST },
+            { "ipv6_labeled_unicast",   FILTER_IPV6_LABELED_UNICAST },
+            { "ipv4_vpn",               FILTER_IPV4_VPN },
+            { "ipv6_vpn",               FILTER_IPV6_VPN },
+            { "evpn",                   FILTER_EVPN },
+            { "bgp_ls",                 FILTER_BGP_LS },
+            { NULL,                     0 }
+    };
+
+    if (node["default"]) {
+        try {
+            std::string value = node["default"].as<std::string>();
+
+            if (value.compare("drop") == 0)
+                filter_default_drop = true;
+            else if (value.compare("accept") == 0)
+                filter_default_drop = false;
+            else
+                throw "invalid filter default, should be accept or drop";
+
+            if (debug_general)
+                std::cout << "   Config: filter default: " << value << std::endl;
+
+        } catch (YAML::TypedBadConversion<std::string> err) {
+            printWarning("filter.default is not of type string", node["default"]);
+        }
+    }
+
+    if (not node["rules"])
+        return;
+
+    if (node["rules"].Type() != YAML::NodeType::Sequence)
+        throw "Invalid filter.rules, should be of type list/sequence";
+
+    for (std::size_t i = 0; i < node["rules"].size(); i++) {
+        const YAML::Node &cur_node = node["rules"][i];
+
+        if (cur_node.Type() != YAML::NodeType::Map)
+            continue;
+
+        if (filter_rules.size() >= FILTER_MAX_RULES)
+            throw "Too many filter.rules, max is 64";
+
+        filter_rule rule;
+        rule.drop = true;
+        rule.afi_safi = 0;
+
+        if (cur_node["name"])
+            rule.name = cur_node["name"].as<std::string>();
+        else
+            rule.name = "rule" + std::to_string(filter_rules.size() + 1);
+
+        if (debug_general)
+            std::cout << "   Config: filter.rules name = " << rule.name << std::endl;
+
+        if (cur_node["action"]) {
+            std::string action = cur_node["action"].as<std::string>();
+
+            if (action.compare("accept") == 0)
+                rule.drop = false;
+            else if (action.compare("drop") != 0)
+                throw "Invalid filter.rules.action, should be accept or drop";
+        }
+
+        if (cur_node["prefix_range"] and cur_node["prefix_range"].Type() == YAML::NodeType::Sequence) {
+            std::map<std::string, std::list<match_type_ip>> prefix_map;
+
+            parsePrefixList(cur_node["prefix_range"], rule.name, prefix_map);
+            rule.prefixes = prefix_map[rule.name];
+
+        } else if (cur_node["prefix_range"])
+            throw "Invalid filter.rules.prefix_range, should be of type list/sequence";
+
+        if (cur_node["afi_safi"] and cur_node["afi_safi"].Type() == YAML::NodeType::Sequence) {
+            for (std::size_t n = 0; n < cur_node["afi_safi"].size(); n++) {
+                std::string name = cur_node["afi_safi"][n].as<std::string>();
+                int idx;
+
+                for (idx = 0; afi_safi_names[idx].name != NULL; idx++) {
+                    if (name.compare(afi_safi_names[idx].name) == 0)
+                        break;
+                }
+
+                if (afi_safi_names[idx].name == NULL)
+                    throw "Invalid filter.rules.afi_safi, unknown AFI/SAFI name";
+
+                rule.afi_safi |= afi_safi_names[idx].bit;
+            }
+
+        } else if (cur_node["afi_safi"])
+            throw "Invalid filter.rules.afi_safi, should be of type list/sequence";
+
+        if (cur_node["peer_asn"] and cur_node["peer_asn"].Type() == YAML::NodeType::Sequence) {
+            for (std::size_t n = 0; n < cur_node["peer_asn"].size(); n++) {
+                try {
+                    rule.peer_asn.push_back(cur_node["peer_asn"][n].as<std::uint32_t>());
+
+                } catch (YAML::TypedBadConversion<std::uint32_t> err) {
+                    printWarning("filter.rules.peer_asn int parse error. ASN must be uint32: ",
+                                 cur_node["peer_asn"][n]);
+                }
+            }
+
+        } else if (cur_node["peer_asn"])
+            throw "Invalid filter.rules.peer_asn, should be of type list/sequence";
+
+        if (debug_general)
+            std::cout << "   Config: filter rule " << rule.name << (rule.drop ? " drop" : " accept")
+                      << " prefixes=" << rule.prefixes.size() << " afi_safi=0x" << std::hex << rule.afi_safi
+                      << std::dec << " peer_asns=" << rule.peer_asn.size() << std::endl;
+
+        filter_rules.push_back(rule);
+    }
+}
+
+/**
+ * Parse the column projection configuration
+ *
+ *      Keys are topic vars (or "default") with the list of attribute columns to keep.
+ *
+ * \param [in] node     Reference to the yaml NODE
+ */
+void Config::parseProjection(const YAML::Node &node) {
+    for (YAML::const_iterator it = node.begin(); it != node.end(); ++it) {
+        std::string topic_var = it->first.as<std::string>();
+
+        if (it->second.Type() != YAML::NodeType::Sequence)
+            throw "Invalid projection, columns should be of type list/sequence";
+
+        std::list<std::string> &columns = projection_map[topic_var];
+        columns.clear();
+
+        for (std::size_t i = 0; i < it->second.size(); i++) {
+            std::string name = it->second[i].as<std::string>();
+
+            if (not ColumnProjection::isColumn(topic_var, name)) {
+                std::cout << "   Config: projection " << topic_var << " has no column " << name << std::endl;
+                throw "Invalid projection column, see the column names in openbmpd.conf";
+            }
+
+            columns.push_back(name);
+        }
+
+        if (debug_general)
+            std::cout << "   Config: projection " << topic_var << ": " << columns.size() << " columns" << std::endl;
+    }
+}
+
 /**
  * Parse matching regexp list and update the provided map with compiled expressions
  *
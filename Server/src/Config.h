@@ -18,6 +18,7 @@
 #include <boost/exception/all.hpp>
 
 #define MAX_THREADS 200
+#define FILTER_MAX_RULES 64             // Max number of ingest filter rules
 
 using namespace boost::xpressive;
 
@@ -48,6 +49,7 @@ public:
     bool        debug_msgbus;
 
     int         heartbeat_interval;      ///< Heartbeat interval in seconds for collector updates
+    int         shutdown_drain_timeout;  ///< Seconds to drain all producers on shutdown, after that messages are dropped
     int   	tx_max_bytes;            ///< Maximum transmit message size
     int 	rx_max_bytes;            ///< Maximum receive  message size
     int 	session_timeout;         ///< Client session timeout
@@ -57,12 +59,41 @@ public:
     int         q_buf_max_ms;		 ///< Max time for buffering msgs in queue
     int         msg_send_max_retry;      ///< No. of times to resend failed msgs
     int         retry_backoff_ms;        ///< Backoff time before resending msgs  
+    bool        ctrl_lane_enabled;       ///< Indicates if control topics use their own producer
+    int         ctrl_q_buf_max_msgs;     ///< Max msgs allowed in the control producer queue
+    int         ctrl_q_buf_max_ms;       ///< Max time for buffering msgs in the control producer queue
+    int         kafka_mock_brokers;      ///< Use a librdkafka mock cluster with this many brokers, zero disables (benchmark)
+    bool        kafka_delivery_reports;  ///< Indicates if delivery reports are counted in the msgbus.delivery.* metrics
+    bool        kafka_native_headers;    ///< Indicates if message headers are Kafka record headers instead of a text preamble
+    bool        kafka_normalized_prefixes; ///< Indicates if unicast_prefix rows reference the base_attribute by hash only
+    int         produce_batch_msgs;      ///< Max bulk messages per topic submitted in one batch, one disables batching
+    int         topic_idle_timeout;      ///< Seconds a topic handle is kept unused before it is released, zero keeps all
+    int         kafka_stats_interval_ms; ///< librdkafka statistics interval for the kafka.* metrics, zero disables
+    bool        autotune_enabled;        ///< Indicates if the bulk producer batching is tuned at runtime
+    int         autotune_interval;       ///< Interval in seconds between batching decisions
+    int         autotune_linger_min_ms;  ///< Min queue.buffering.max.ms of the tuned bulk producer
+    int         autotune_linger_max_ms;  ///< Max queue.buffering.max.ms of the tuned bulk producer
+    int         autotune_batch_min_msgs; ///< Min batch.num.messages of the tuned bulk producer
+    int         autotune_batch_max_msgs; ///< Max batch.num.messages of the tuned bulk producer
+    int         autotune_latency_ms;     ///< Delivery latency target in ms after the initial RIB dump
+    int         stat_report_window_ms;   ///< Window in ms stats reports of a router are held for one message, zero disables
+    bool        stat_report_suppress;    ///< Indicates if stats reports with unchanged counters are not sent
     std::string compression;		 ///< Compression to use :none, gzip, snappy
     int         max_concurrent_routers;  ///<Maximum allowed routers that can connect
     int         initial_router_time;     ///<Initial time in allowing another concurrent router
     bool        calculate_baseline;      ///<Indicates if router baseline time should be calculated
     bool        pat_enabled;             ///<Indicates if router hash needs to be based on INIT message instead of source IP
 
+    int         metrics_interval;        ///< Interval in seconds to log the metrics report, zero disables
+    bool        stage_accounting;        ///< Indicates if per pipeline stage allocation/CPU accounting is enabled
+    int         lag_threshold;           ///< Seconds a router or peer can lag behind real time before it is behind, zero disables
+
+    bool        rib_enabled;             ///< Indicates if the local RIB and query service are enabled
+    std::string rib_query_socket;        ///< Unix socket path of the local RIB query service
+
+    int         coalesce_window_ms;      ///< Per prefix flap coalescing window in milliseconds, zero disables
+    int         coalesce_max_pending;    ///< Max prefixes held per router connection while coalescing
+
     /**
      * matching structs and maps
      */
@@ -76,6 +107,41 @@ public:
         uint8_t     bits;                                       ///< bits to match
     };
 
+    /**
+     * Ingest filter AFI/SAFI bits
+     */
+    enum filter_afi_safi {
+        FILTER_IPV4_UNICAST             = 0x01,
+        FILTER_IPV6_UNICAST             = 0x02,
+        FILTER_IPV4_LABELED_UNICAST     = 0x04,
+        FILTER_IPV6_LABELED_UNICAST     = 0x08,
+        FILTER_IPV4_VPN                 = 0x10,
+        FILTER_IPV6_VPN                 = 0x20,
+        FILTER_EVPN                     = 0x40,
+        FILTER_BGP_LS                   = 0x80
+    };
+
+    /**
+     * Ingest filter rule, rules are evaluated in order and the first match is used
+     */
+    struct filter_rule {
+        std::string             name;           ///< Rule name, used for the hit counter
+        bool                    drop;           ///< Drop matching routes, accept if false
+        uint32_t                afi_safi;       ///< filter_afi_safi bits to match, zero matches all
+        std::list<uint32_t>     peer_asn;       ///< Peer ASNs to match, empty matches all
+        std::list<match_type_ip> prefixes;      ///< Prefix ranges to match, empty matches all
+    };
+
+    bool                        filter_default_drop;    ///< Drop routes that don't match a rule
+    std::list<filter_rule>      filter_rules;           ///< Ingest filter rules, filter is disabled if empty
+
+    /**
+     * Column projection, see ColumnProjection
+     */
+    std::map<std::string, std::list<std::string>> projection_map;   ///< Attribute columns to keep by topic var or "default"
+    std::map<std::string, uint64_t> projection_blank;   ///< Columns to blank by topic var, bit N is column N
+    uint64_t                    projection_skip_attrs;  ///< Path attribute types not decoded, bit N is type N
+
     /**
      * Matching router group map - used to regex/ip match the router to group name
      */
@@ -110,12 +176,6 @@ public:
     std::map<std::string, std::string> topic_names_map;
     typedef std::map<std::string, std::string>::iterator topic_names_map_iter;
 
-    /**
-     * map for router baseline times
-     */
-    std::map<std::string, float> router_baseline_time;
-    typedef std::map<std::string, float>::iterator router_baseline_time_iter;
-
     /*********************************************************************//**
      * Constructor for class
      ***********************************************************************/
@@ -128,6 +188,17 @@ public:
      ***********************************************************************/
     void load(const char *cfg_filename);
 
+    /*********************************************************************//**
+     * Take the settings that can change without a restart from a reloaded config
+     *
+     *      Debug flags, topic variables and names, router/peer group matching and column
+     *      projection.  All other settings, e.g. the kafka producer settings, keep their
+     *      running value until restart.
+     *
+     * \param [in] loaded           Config loaded from the file
+     ***********************************************************************/
+    void applyReloadable(const Config &loaded);
+
 private:
     /**
      * Parse the base configuration
@@ -157,6 +228,27 @@ private:
      */
     void parseTopics(const YAML::Node &node);
 
+    /**
+     * Parse the kafka control lane configuration
+     *
+     * \param [in] node     Reference to the yaml NODE
+     */
+    void parseControlLane(const YAML::Node &node);
+
+    /**
+     * Parse the kafka batching autotune configuration
+     *
+     * \param [in] node     Reference to the yaml NODE
+     */
+    void parseAutotune(const YAML::Node &node);
+
+    /**
+     * Parse the kafka stats report coalescing configuration
+     *
+     * \param [in] node     Reference to the yaml NODE
+     */
+    void parseStatReport(const YAML::Node &node);
+
     /**
      * Parse the mapping configuration
      *
@@ -164,6 +256,41 @@ private:
      */
     void parseMapping(const YAML::Node &node);
 
+    /**
+     * Parse the metrics configuration
+     *
+     * \param [in] node     Reference to the yaml NODE
+     */
+    void parseMetrics(const YAML::Node &node);
+
+    /**
+     * Parse the local RIB configuration
+     *
+     * \param [in] node     Reference to the yaml NODE
+     */
+    void parseRib(const YAML::Node &node);
+
+    /**
+     * Parse the prefix flap coalescing configuration
+     *
+     * \param [in] node     Reference to the yaml NODE
+     */
+    void parseCoalesce(const YAML::Node &node);
+
+    /**
+     * Parse the ingest filter configuration
+     *
+     * \param [in] node     Reference to the yaml NODE
+     */
+    void parseFilter(const YAML::Node &node);
+
+    /**
+     * Parse the column projection configuration
+     *
+     * \param [in] node     Reference to the yaml NODE
+     */
+    void parseProjection(const YAML::Node &node);
+
     /**
      * Parse matching prefix_range list and update the provided map with compiled expressions
      *
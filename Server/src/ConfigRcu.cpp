@@ -0,0 +1,126 @@
+/*
+ * Copyright (c) 2013-2016 Cisco Systems, Inc. and others.  All rights reserved.
+ *
+ * This program and the accompanying materials are made available under the
+ * terms of the Eclipse Public License v1.0 which accompanies this distribution,
+ * and is available at http://www.eclipse.org/legal/epl-v10.html
+ *
+ */
+
+#include <list>
+#include <mutex>
+#include <set>
+
+#include "ConfigRcu.h"
+#include "Metrics.h"
+
+std::atomic<Config *> ConfigRcu::current_cfg(NULL);
+std::atomic<uint64_t> ConfigRcu::generation(0);
+
+/**
+ * Retired config
+ */
+struct retired_cfg {
+    Config      *cfg;                           ///< Config, NULL if not owned
+    uint64_t    gen;                            ///< Generation that replaced it
+};
+
+static std::mutex rcu_mutex;                    ///< Protects the readers and retired lists
+static std::set<ConfigRcu::Reader *> readers;   ///< Registered readers
+static std::list<retired_cfg> retired;          ///< Retired configs, oldest first
+static bool initial_owned = false;              ///< Indicates if the current config is owned
+
+/**
+ * Register the reader, it uses the current config
+ */
+ConfigRcu::Reader::Reader() : seen(generation.load(std::memory_order_acquire)) {
+    std::lock_guard<std::mutex> lock(rcu_mutex);
+
+    readers.insert(this);
+}
+
+/**
+ * Unregister the reader, the session has ended
+ */
+ConfigRcu::Reader::~Reader() {
+    std::lock_guard<std::mutex> lock(rcu_mutex);
+
+    readers.erase(this);
+}
+
+/**
+ * Set the initial config, not owned
+ *
+ * \param [in] cfg      Config loaded at startup
+ */
+void ConfigRcu::init(Config *cfg) {
+    std::lock_guard<std::mutex> lock(rcu_mutex);
+
+    current_cfg.store(cfg, std::memory_order_release);
+    initial_owned = false;
+}
+
+/**
+ * Publish a new config, the previous one is retired
+ *
+ *      The pointer is swapped before the generation is incremented, so a reader that sees the
+ *      new generation also sees the new config.
+ *
+ * \param [in] cfg      Config to publish, owned from now on
+ */
+void ConfigRcu::publish(Config *cfg) {
+    static Metrics::Counter &m_reloads = Metrics::get("config.reloads");
+
+    std::lock_guard<std::mutex> lock(rcu_mutex);
+
+    retired_cfg old;
+    old.cfg = current_cfg.exchange(cfg, std::memory_order_acq_rel);
+    old.gen = generation.fetch_add(1, std::memory_order_acq_rel) + 1;
+
+    if (not initial_owned)
+        old.cfg = NULL;                         // The initial config is not freed
+
+    initial_owned = true;
+    retired.push_back(old);
+
+    m_reloads.fetch_add(1, std::memory_order_relaxed);
+}
+
+/**
+ * Free the retired configs no reader can still use, called by the server thread
+ *
+ * \return number of configs freed
+ */
+size_t ConfigRcu::reclaim() {
+    static Metrics::Counter &m_retired = Metrics::get("config.retired");
+
+    std::lock_guard<std::mutex> lock(rcu_mutex);
+
+    if (retired.empty())
+        return 0;
+
+    // Oldest generation a reader may still use
+    uint64_t oldest = generation.load(std::memory_order_acquire);
+
+    for (std::set<Reader *>::iterator it = readers.begin(); it != readers.end(); ++it) {
+        uint64_t seen = (*it)->seen.load(std::memory_order_acquire);
+
+        if (seen < oldest)
+            oldest = seen;
+    }
+
+    size_t freed = 0;
+
+    while (not retired.empty() and retired.front().gen <= oldest) {
+        if (retired.front().cfg != NULL) {
+            delete retired.front().cfg;
+            ++freed;
+        }
+
+        retired.pop_front();
+    }
+
+    m_retired.store(retired.size(), std::memory_order_relaxed);
+
+    return freed;
+}
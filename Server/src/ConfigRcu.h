@@ -0,0 +1,106 @@
+/*
+ * Copyright (c) 2013-2016 Cisco Systems, Inc. and others.  All rights reserved.
+ *
+ * This program and the accompanying materials are made available under the
+ * terms of the Eclipse Public License v1.0 which accompanies this distribution,
+ * and is available at http://www.eclipse.org/legal/epl-v10.html
+ *
+ */
+
+#ifndef OPENBMP_CONFIGRCU_H
+#define OPENBMP_CONFIGRCU_H
+
+#include <atomic>
+#include <cstdint>
+
+#include "Config.h"
+
+/**
+ * \class   ConfigRcu
+ *
+ * \brief   Publishes reloaded configs to the router sessions, read-copy-update style
+ * \details
+ *      The server thread loads a new Config off the hot path and publishes it with an atomic
+ *      pointer swap.  Each router session has a Reader, checked once per socket read (a chunk
+ *      of up to BMP_STREAM_READ_SIZE bytes) with a single atomic load.  When the generation
+ *      changed, the session switches to the current config between reads, after the complete
+ *      messages of the previous read were processed, and acknowledges the generation.
+ *
+ *      A replaced config is retired, and freed by reclaim() once every registered reader has
+ *      acknowledged a later generation, so a session never sees its config freed under it.
+ *      The initial config is not owned and never freed.
+ */
+class ConfigRcu {
+public:
+    /**
+     * Reader of the published config, one per router session
+     *
+     *      Registered on construction and unregistered on destruction, both by the server
+     *      thread.  changed() and acknowledge() are called by the session only.
+     */
+    class Reader {
+    public:
+        Reader();
+        ~Reader();
+
+        /**
+         * Check if a config was published since the last acknowledge
+         *
+         * \param [out] gen     Generation to acknowledge after switching to current()
+         *
+         * \return true if changed
+         */
+        bool changed(uint64_t &gen) const {
+            gen = generation.load(std::memory_order_acquire);
+            return gen != seen.load(std::memory_order_relaxed);
+        }
+
+        /**
+         * Acknowledge the switch to the config of a generation, the session no longer uses older configs
+         *
+         * \param [in] gen      Generation from changed()
+         */
+        void acknowledge(uint64_t gen) {
+            seen.store(gen, std::memory_order_release);
+        }
+
+    private:
+        friend class ConfigRcu;
+
+        std::atomic<uint64_t>   seen;           ///< Last acknowledged generation
+    };
+
+    /**
+     * Set the initial config, not owned
+     *
+     * \param [in] cfg      Config loaded at startup
+     */
+    static void init(Config *cfg);
+
+    /**
+     * Publish a new config, the previous one is retired
+     *
+     * \param [in] cfg      Config to publish, owned from now on
+     */
+    static void publish(Config *cfg);
+
+    /**
+     * Current config
+     */
+    static Config *current() {
+        return current_cfg.load(std::memory_order_acquire);
+    }
+
+    /**
+     * Free the retired configs no reader can still use, called by the server thread
+     *
+     * \return number of configs freed
+     */
+    static size_t reclaim();
+
+private:
+    static std::atomic<Config *>    current_cfg;        ///< Published config
+    static std::atomic<uint64_t>    generation;         ///< Incremented on each publish
+};
+
+#endif //OPENBMP_CONFIGRCU_H
@@ -0,0 +1,43 @@
+/*
+ * Copyright (c) 2013-2016 Cisco Systems, Inc. and others.  All rights reserved.
+ *
+ * This program and the accompanying materials are made available under the
+ * terms of the Eclipse Public License v1.0 which accompanies this distribution,
+ * and is available at http://www.eclipse.org/legal/epl-v10.html
+ *
+ */
+#ifndef HASHKEY_H_
+#define HASHKEY_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <sys/types.h>
+
+/**
+ * Binary hash ID (MD5) for use as a key in maps
+ *
+ *      Avoids the printed (hex string) form of the hash IDs for in memory tables.
+ */
+struct hash_key {
+    uint64_t    v[2];
+
+    hash_key() { v[0] = v[1] = 0; }
+    explicit hash_key(const u_char *hash_id) { memcpy(v, hash_id, sizeof(v)); }
+
+    bool operator==(const hash_key &other) const { return v[0] == other.v[0] and v[1] == other.v[1]; }
+    bool operator!=(const hash_key &other) const { return not (*this == other); }
+    bool operator<(const hash_key &other) const {
+        return memcmp(v, other.v, sizeof(v)) < 0;           // Same order as the printed form
+    }
+};
+
+/**
+ * Hasher for hash_key in unordered containers
+ */
+struct hash_key_hasher {
+    // MD5 is already uniformly distributed, folding it is sufficient
+    size_t operator()(const hash_key &key) const { return key.v[0] ^ key.v[1]; }
+};
+
+#endif /* HASHKEY_H_ */
@@ -0,0 +1,472 @@
+/*
+ * Copyright (c) 2013-2016 Cisco Systems, Inc. and others.  All rights reserved.
+ *
+ * This program and the accompanying materials are made available under the
+ * terms of the Eclipse Public License v1.0 which accompanies this distribution,
+ * and is available at http://www.eclipse.org/legal/epl-v10.html
+ *
+ */
+
+#include <cinttypes>
+#include <cstdio>
+#include <sys/time.h>
+
+#include "LocalRib.h"
+#include "Metrics.h"
+#include "md5.h"
+
+/*
+ * RIB size gauges
+ */
+static Metrics::Counter &m_peers    = Metrics::get("rib.peers");
+static Metrics::Counter &m_prefixes = Metrics::get("rib.prefixes");
+static Metrics::Counter &m_paths    = Metrics::get("rib.paths");
+static Metrics::Counter &m_attrs    = Metrics::get("rib.attrs");
+
+/**
+ * Constructor for class
+ *
+ * \param [in] logPtr   Pointer to Logger instance
+ */
+LocalRib::LocalRib(Logger *logPtr) {
+    logger = logPtr;
+}
+
+LocalRib::~LocalRib() {
+    std::lock_guard<std::mutex> lock(peers_mutex);
+    std::lock_guard<std::mutex> attrs_lock(attrs_mutex);
+
+    for (std::map<hash_key, peer_rib *>::iterator it = peers.begin(); it != peers.end(); ++it) {
+        it->second->mutex.lock();
+        releasePeer(it->second);
+        it->second->mutex.unlock();
+        delete it->second;
+    }
+
+    peers.clear();
+    m_peers.store(0, std::memory_order_relaxed);
+}
+
+/**
+ * Update the RIB of a peer
+ *
+ * \param [in] peer         Peer object, hash_id and router_hash_id must be set
+ * \param [in] router_ip    Router IP in printed form
+ * \param [in] rib          Rib entries, hash_id must be set
+ * \param [in] attr         Path attributes, NULL for withdrawn
+ * \param [in] withdrawn    True if the prefixes are withdrawn
+ */
+void LocalRib::update(MsgBusInterface::obj_bgp_peer &peer, const std::string &router_ip,
+                      std::vector<MsgBusInterface::obj_rib> &rib, MsgBusInterface::obj_path_attr *attr,
+                      bool withdrawn) {
+
+    if (not withdrawn and attr == NULL)
+        return;
+
+    hash_key peer_hash(peer.hash_id);
+    peer_rib *p_rib;
+
+    /*
+     * Find or add the peer, lock is handed over from the peer map to the peer
+     */
+    {
+        std::lock_guard<std::mutex> lock(peers_mutex);
+
+        std::map<hash_key, peer_rib *>::iterator it = peers.find(peer_hash);
+        if (it != peers.end()) {
+            p_rib = it->second;
+
+        } else if (withdrawn) {
+            return;                                 // Nothing to withdraw
+
+        } else {
+            p_rib = new peer_rib;
+            p_rib->hash = peer_hash;
+            p_rib->router_hash = hash_key(peer.router_hash_id);
+            MsgBusInterface::hash_toStr(peer.hash_id, p_rib->hash_str);
+            MsgBusInterface::hash_toStr(peer.router_hash_id, p_rib->router_hash_str);
+            p_rib->router_ip = router_ip;
+            p_rib->peer_addr = peer.peer_addr;
+            p_rib->peer_as = peer.peer_as;
+            p_rib->isPrePolicy = peer.isPrePolicy;
+            p_rib->isAdjIn = peer.isAdjIn;
+
+            peers[peer_hash] = p_rib;
+            m_peers.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        p_rib->mutex.lock();
+    }
+
+    std::lock_guard<std::mutex> peer_lock(p_rib->mutex, std::adopt_lock);
+    std::lock_guard<std::mutex> attrs_lock(attrs_mutex);
+
+    uint32_t ts_secs = peer.timestamp_secs;
+    uint32_t ts_us = peer.timestamp_us;
+
+    if (ts_secs <= 1000) {                          // Same as MsgBusInterface::getTimestamp()
+        timeval tv;
+        gettimeofday(&tv, NULL);
+        ts_secs = tv.tv_sec;
+        ts_us = tv.tv_usec;
+    }
+
+    rib_attr *r_attr = withdrawn ? NULL : internAttr(*attr);
+
+    int64_t prefixes = 0, paths = 0;
+
+    for (size_t i = 0; i < rib.size(); i++) {
+        PrefixTrie<rib_paths> &trie = rib[i].isIPv4 ? p_rib->v4 : p_rib->v6;
+
+        if (not withdrawn) {
+            size_t count = trie.size();
+            rib_paths &r_paths = trie.insert(rib[i].prefix_bin, rib[i].prefix_len);
+            prefixes += trie.size() - count;
+
+            rib_path *path = NULL;
+            for (size_t p = 0; p < r_paths.size(); p++) {
+                if (r_paths[p].path_id == rib[i].path_id) {
+                    path = &r_paths[p];
+                    break;
+                }
+            }
+
+            if (path == NULL) {
+                r_paths.push_back(rib_path());
+                path = &r_paths.back();
+                path->path_id = rib[i].path_id;
+                path->attr = NULL;
+                ++paths;
+            }
+
+            if (path->attr != r_attr) {
+                if (path->attr != NULL)
+                    releaseAttr(path->attr);
+
+                path->attr = r_attr;
+                ++r_attr->refs;
+            }
+
+            path->hash = hash_key(rib[i].hash_id);
+            path->timestamp_secs = ts_secs;
+            path->timestamp_us = ts_us;
+
+            char labels[BGP_LABELS_STRLEN];
+            path->labels.assign(labels, bgp::labelsToStr(rib[i].labels, labels, sizeof(labels)));
+
+        } else {
+            rib_paths *r_paths = trie.find(rib[i].prefix_bin, rib[i].prefix_len);
+            if (r_paths == NULL)
+                continue;
+
+            for (rib_paths::iterator it = r_paths->begin(); it != r_paths->end(); ++it) {
+                if (it->path_id == rib[i].path_id) {
+                    releaseAttr(it->attr);
+                    r_paths->erase(it);
+                    --paths;
+                    break;
+                }
+            }
+
+            if (r_paths->empty()) {
+                trie.erase(rib[i].prefix_bin, rib[i].prefix_len);
+                --prefixes;
+            }
+        }
+    }
+
+    // Attributes are not referenced if the update had no prefixes
+    if (r_attr != NULL and r_attr->refs == 0) {
+        attrs.erase(r_attr->key);
+        delete r_attr;
+        m_attrs.fetch_sub(1, std::memory_order_relaxed);
+    }
+
+    m_prefixes.fetch_add(prefixes, std::memory_order_relaxed);
+    m_paths.fetch_add(paths, std::memory_order_relaxed);
+}
+
+/**
+ * Remove the RIB of a peer
+ *
+ * \param [in] peer_hash    Peer hash_id
+ */
+void LocalRib::removePeer(const hash_key &peer_hash) {
+    peer_rib *p_rib;
+
+    {
+        std::lock_guard<std::mutex> lock(peers_mutex);
+
+        std::map<hash_key, peer_rib *>::iterator it = peers.find(peer_hash);
+        if (it == peers.end())
+            return;
+
+        p_rib = it->second;
+        peers.erase(it);
+        m_peers.fetch_sub(1, std::memory_order_relaxed);
+
+        // Wait for queries in progress on the peer
+        p_rib->mutex.lock();
+    }
+
+    LOG_INFO("rib: removing peer %s (%s), prefixes v4=%lu v6=%lu", p_rib->peer_addr.c_str(),
+             p_rib->hash_str.c_str(), p_rib->v4.size(), p_rib->v6.size());
+
+    {
+        std::lock_guard<std::mutex> attrs_lock(attrs_mutex);
+        releasePeer(p_rib);
+    }
+
+    p_rib->mutex.unlock();
+    delete p_rib;
+}
+
+/**
+ * Remove the RIB of all peers of a router
+ *
+ * \param [in] router_hash  Router hash_id
+ */
+void LocalRib::removeRouter(const hash_key &router_hash) {
+    std::vector<hash_key> router_peers;
+
+    {
+        std::lock_guard<std::mutex> lock(peers_mutex);
+
+        for (std::map<hash_key, peer_rib *>::iterator it = peers.begin(); it != peers.end(); ++it) {
+            if (it->second->router_hash == router_hash)
+                router_peers.push_back(it->first);
+        }
+    }
+
+    for (size_t i = 0; i < router_peers.size(); i++)
+        removePeer(router_peers[i]);
+}
+
+/**
+ * Get a summary of the peers
+ *
+ * \param [out] peers_list  List of peers, ordered by peer hash
+ */
+void LocalRib::listPeers(std::vector<peer_summary> &peers_list) {
+    std::lock_guard<std::mutex> lock(peers_mutex);
+
+    for (std::map<hash_key, peer_rib *>::iterator it = peers.begin(); it != peers.end(); ++it) {
+        peer_rib *p_rib = it->second;
+        peer_summary summary;
+
+        summary.hash = p_rib->hash;
+        summary.hash_str = p_rib->hash_str;
+        summary.router_hash_str = p_rib->router_hash_str;
+        summary.router_ip = p_rib->router_ip;
+        summary.peer_addr = p_rib->peer_addr;
+        summary.peer_as = p_rib->peer_as;
+
+        std::lock_guard<std::mutex> peer_lock(p_rib->mutex);
+        summary.v4_prefixes = p_rib->v4.size();
+        summary.v6_prefixes = p_rib->v6.size();
+
+        peers_list.push_back(summary);
+    }
+}
+
+/**
+ * Lookup a prefix in the RIB of a peer
+ *
+ * \param [in] peer_hash    Peer hash_id
+ * \param [in] isIPv4       True if IPv4, false if IPv6
+ * \param [in] prefix       Prefix or address (binary, network byte order)
+ * \param [in] prefix_len   Prefix length
+ * \param [in] exact        True for exact match, false for longest match
+ * \param [in] cb           Callback called for each path of the matched prefix
+ *
+ * \return false if the peer was not found
+ */
+bool LocalRib::lookup(const hash_key &peer_hash, bool isIPv4, const u_char *prefix, int prefix_len, bool exact,
+                      row_callback cb) {
+    peer_rib *p_rib = lockPeer(peer_hash);
+    if (p_rib == NULL)
+        return false;
+
+    std::lock_guard<std::mutex> peer_lock(p_rib->mutex, std::adopt_lock);
+
+    PrefixTrie<rib_paths> &trie = isIPv4 ? p_rib->v4 : p_rib->v6;
+
+    rib_row row;
+    u_char match_prefix[16] = { 0 };
+    rib_paths *r_paths;
+
+    row.peer = p_rib;
+    row.isIPv4 = isIPv4;
+    row.prefix = match_prefix;
+
+    if (exact) {
+        r_paths = trie.find(prefix, prefix_len);
+        memcpy(match_prefix, prefix, isIPv4 ? 4 : 16);
+        row.prefix_len = prefix_len;
+    } else {
+        r_paths = trie.longestMatch(prefix, prefix_len, match_prefix, &row.prefix_len);
+    }
+
+    if (r_paths != NULL) {
+        for (size_t i = 0; i < r_paths->size(); i++) {
+            row.path = &(*r_paths)[i];
+            if (not cb(row))
+                break;
+        }
+    }
+
+    return true;
+}
+
+/**
+ * Walk the prefixes of a peer in prefix order
+ *
+ * \param [in]     peer_hash    Peer hash_id
+ * \param [in]     isIPv4       True to walk IPv4 prefixes, false for IPv6
+ * \param [in/out] cursor       Resume position, updated to the last prefix walked
+ * \param [in]     cb           Callback called for each path
+ * \param [out]    done         True if all prefixes have been walked
+ *
+ * \return false if the peer was not found
+ */
+bool LocalRib::walk(const hash_key &peer_hash, bool isIPv4, walk_cursor &cursor, row_callback cb, bool &done) {
+    peer_rib *p_rib = lockPeer(peer_hash);
+    if (p_rib == NULL)
+        return false;
+
+    std::lock_guard<std::mutex> peer_lock(p_rib->mutex, std::adopt_lock);
+
+    PrefixTrie<rib_paths> &trie = isIPv4 ? p_rib->v4 : p_rib->v6;
+
+    rib_row row;
+    row.peer = p_rib;
+    row.isIPv4 = isIPv4;
+
+    done = trie.walk([&](const u_char *prefix, int prefix_len, rib_paths &r_paths) {
+        bool more = true;
+
+        row.prefix = prefix;
+        row.prefix_len = prefix_len;
+
+        for (size_t i = 0; i < r_paths.size(); i++) {
+            row.path = &r_paths[i];
+            more = cb(row) and more;
+        }
+
+        cursor.valid = true;
+        memcpy(cursor.prefix, prefix, isIPv4 ? 4 : 16);
+        cursor.prefix_len = prefix_len;
+
+        return more;
+
+    }, cursor.valid ? cursor.prefix : NULL, cursor.prefix_len);
+
+    return true;
+}
+
+/**
+ * Find and lock a peer
+ *
+ * \param [in] peer_hash    Peer hash_id
+ *
+ * \return Locked peer or NULL if not found, caller must unlock the peer mutex
+ */
+LocalRib::peer_rib *LocalRib::lockPeer(const hash_key &peer_hash) {
+    std::lock_guard<std::mutex> lock(peers_mutex);
+
+    std::map<hash_key, peer_rib *>::iterator it = peers.find(peer_hash);
+    if (it == peers.end())
+        return NULL;
+
+    it->second->mutex.lock();
+    return it->second;
+}
+
+/**
+ * Get the interned attributes for a base attribute, adding them if needed
+ *
+ *      Interned by a digest of the base attribute hash and all fields.  The base attribute
+ *      hash alone doesn't cover e.g. the cluster list and large communities.
+ *
+ * \param [in] attr         Path attributes
+ *
+ * \return Interned attributes
+ */
+LocalRib::rib_attr *LocalRib::internAttr(MsgBusInterface::obj_path_attr &attr) {
+    // Same format as the unicast_prefix fields
+    char buf[80000];
+    int len = snprintf(buf, sizeof(buf),
+             "%s\t%s\t%" PRIu16 "\t%" PRIu32 "\t%s\t%" PRIu32 "\t%" PRIu32 "\t%s\t%s\t%s\t%s\t%d\t%d\t%s",
+             attr.origin, attr.as_path.c_str(), attr.as_path_count, attr.origin_as, attr.next_hop, attr.med,
+             attr.local_pref, attr.aggregator, attr.community_list.c_str(), attr.ext_community_list.c_str(),
+             attr.cluster_list.c_str(), attr.atomic_agg, attr.nexthop_isIPv4, attr.originator_id);
+
+    if (len >= (int)sizeof(buf))
+        len = sizeof(buf) - 1;
+
+    MD5 hash;
+    hash.update(attr.hash_id, 16);
+    hash.update((unsigned char *) buf, len + 1);            // With the NULL as separator
+    hash.update((unsigned char *) attr.large_community_list.c_str(), attr.large_community_list.length());
+    hash.finalize();
+
+    unsigned char *hash_raw = hash.raw_digest();
+    hash_key key(hash_raw);
+    delete[] hash_raw;
+
+    std::unordered_map<hash_key, rib_attr *, hash_key_hasher>::iterator it = attrs.find(key);
+    if (it != attrs.end())
+        return it->second;
+
+    rib_attr *r_attr = new rib_attr;
+    r_attr->hash = hash_key(attr.hash_id);
+    r_attr->key = key;
+    r_attr->refs = 0;
+    r_attr->fields.assign(buf, len);
+    r_attr->large_communities = attr.large_community_list;
+
+    attrs[key] = r_attr;
+    m_attrs.fetch_add(1, std::memory_order_relaxed);
+
+    return r_attr;
+}
+
+/**
+ * Release a reference to interned attributes, freed when not referenced
+ *
+ * \param [in] attr         Interned attributes
+ */
+void LocalRib::releaseAttr(rib_attr *attr) {
+    if (--attr->refs > 0)
+        return;
+
+    attrs.erase(attr->key);
+    delete attr;
+    m_attrs.fetch_sub(1, std::memory_order_relaxed);
+}
+
+/**
+ * Release all paths of a peer
+ *
+ * \param [in] p_rib        Peer RIB
+ */
+void LocalRib::releasePeer(peer_rib *p_rib) {
+    uint64_t paths = 0;
+
+    auto release = [&](const u_char *prefix, int prefix_len, rib_paths &r_paths) {
+        for (size_t i = 0; i < r_paths.size(); i++)
+            releaseAttr(r_paths[i].attr);
+
+        paths += r_paths.size();
+        return true;
+    };
+
+    p_rib->v4.walk(release);
+    p_rib->v6.walk(release);
+
+    m_prefixes.fetch_sub(p_rib->v4.size() + p_rib->v6.size(), std::memory_order_relaxed);
+    m_paths.fetch_sub(paths, std::memory_order_relaxed);
+
+    p_rib->v4.clear();
+    p_rib->v6.clear();
+}
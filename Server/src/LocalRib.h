@@ -0,0 +1,247 @@
+/*
+ * Copyright (c) 2013-2016 Cisco Systems, Inc. and others.  All rights reserved.
+ *
+ * This program and the accompanying materials are made available under the
+ * terms of the Eclipse Public License v1.0 which accompanies this distribution,
+ * and is available at http://www.eclipse.org/legal/epl-v10.html
+ *
+ */
+#ifndef LOCALRIB_H_
+#define LOCALRIB_H_
+
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "MsgBusInterface.hpp"
+#include "Logger.h"
+#include "HashKey.h"
+#include "PrefixTrie.hpp"
+
+/**
+ * \class   LocalRib
+ *
+ * \brief   In collector per peer unicast RIB
+ * \details
+ *      Keeps the unicast prefixes currently advertised by every peer of every connected
+ *      router so that they can be queried (see RibQueryServer) without replaying the
+ *      unicast_prefix topic.  Prefixes are stored in a per peer and address family
+ *      PrefixTrie; path attributes are interned by base attribute hash_id and shared by
+ *      all paths that reference them.
+ *
+ *      Updates come from the message bus (router threads), queries from the query server
+ *      threads.  The peer map, each peer and the attribute table have their own lock and
+ *      are always locked in that order.
+ */
+class LocalRib {
+public:
+    /**
+     * Interned path attributes
+     */
+    struct rib_attr {
+        hash_key    hash;                       ///< Base attribute hash_id
+        hash_key    key;                        ///< Intern key, digest of the hash and all fields
+        uint32_t    refs;                       ///< Number of paths referencing the attributes
+        std::string fields;                     ///< unicast_prefix TSV fields origin through originator id
+        std::string large_communities;          ///< Large community list
+    };
+
+    /**
+     * Path of a prefix, a prefix has more than one path with add-paths
+     */
+    struct rib_path {
+        uint32_t    path_id;                    ///< Add path ID, zero if not used
+        hash_key    hash;                       ///< Rib hash_id
+        rib_attr    *attr;                      ///< Interned attributes
+        uint32_t    timestamp_secs;             ///< Time of the last update
+        uint32_t    timestamp_us;
+        std::string labels;                     ///< Labels in printed form
+    };
+
+    typedef std::vector<rib_path> rib_paths;
+
+    /**
+     * RIB of a peer
+     */
+    struct peer_rib {
+        hash_key    hash;                       ///< Peer hash_id
+        hash_key    router_hash;                ///< Router hash_id
+        std::string hash_str;                   ///< Peer hash_id in printed form
+        std::string router_hash_str;            ///< Router hash_id in printed form
+        std::string router_ip;                  ///< Router IP in printed form
+        std::string peer_addr;                  ///< Peer IP in printed form
+        uint32_t    peer_as;                    ///< Peer ASN
+        bool        isPrePolicy;
+        bool        isAdjIn;
+
+        PrefixTrie<rib_paths> v4;               ///< IPv4 prefixes
+        PrefixTrie<rib_paths> v6;               ///< IPv6 prefixes
+
+        std::mutex  mutex;                      ///< Protects the tries
+
+        peer_rib() : v4(32), v6(128) { }
+    };
+
+    /**
+     * Peer summary as returned by listPeers()
+     */
+    struct peer_summary {
+        hash_key    hash;
+        std::string hash_str;
+        std::string router_hash_str;
+        std::string router_ip;
+        std::string peer_addr;
+        uint32_t    peer_as;
+        size_t      v4_prefixes;
+        size_t      v6_prefixes;
+    };
+
+    /**
+     * Row passed to query callbacks, only valid for the duration of the callback
+     */
+    struct rib_row {
+        const peer_rib  *peer;
+        const u_char    *prefix;                ///< Prefix (binary, network byte order)
+        int             prefix_len;
+        bool            isIPv4;
+        const rib_path  *path;
+    };
+
+    /**
+     * Query row callback, return false to stop after the current prefix
+     */
+    typedef std::function<bool (const rib_row &row)> row_callback;
+
+    /**
+     * Resume position of a walk
+     */
+    struct walk_cursor {
+        bool        valid;                      ///< False to start at the first prefix
+        u_char      prefix[16];                 ///< Last prefix walked
+        int         prefix_len;
+    };
+
+    /**
+     * Constructor for class
+     *
+     * \param [in] logPtr   Pointer to Logger instance
+     */
+    LocalRib(Logger *logPtr);
+    ~LocalRib();
+
+    /**
+     * Update the RIB of a peer
+     *
+     * \param [in] peer         Peer object, hash_id and router_hash_id must be set
+     * \param [in] router_ip    Router IP in printed form
+     * \param [in] rib          Rib entries, hash_id must be set
+     * \param [in] attr         Path attributes, NULL for withdrawn
+     * \param [in] withdrawn    True if the prefixes are withdrawn
+     */
+    void update(MsgBusInterface::obj_bgp_peer &peer, const std::string &router_ip,
+                std::vector<MsgBusInterface::obj_rib> &rib, MsgBusInterface::obj_path_attr *attr, bool withdrawn);
+
+    /**
+     * Remove the RIB of a peer
+     *
+     * \param [in] peer_hash    Peer hash_id
+     */
+    void removePeer(const hash_key &peer_hash);
+
+    /**
+     * Remove the RIB of all peers of a router
+     *
+     * \param [in] router_hash  Router hash_id
+     */
+    void removeRouter(const hash_key &router_hash);
+
+    /**
+     * Get a summary of the peers
+     *
+     * \param [out] peers_list  List of peers, ordered by peer hash
+     */
+    void listPeers(std::vector<peer_summary> &peers_list);
+
+    /**
+     * Lookup a prefix in the RIB of a peer
+     *
+     * \param [in] peer_hash    Peer hash_id
+     * \param [in] isIPv4       True if IPv4, false if IPv6
+     * \param [in] prefix       Prefix or address (binary, network byte order)
+     * \param [in] prefix_len   Prefix length
+     * \param [in] exact        True for exact match, false for longest match
+     * \param [in] cb           Callback called for each path of the matched prefix
+     *
+     * \return false if the peer was not found
+     */
+    bool lookup(const hash_key &peer_hash, bool isIPv4, const u_char *prefix, int prefix_len, bool exact,
+                row_callback cb);
+
+    /**
+     * Walk the prefixes of a peer in prefix order
+     *
+     *      The peer is locked while walking, callers should stop the walk periodically and
+     *      resume it using the cursor.
+     *
+     * \param [in]     peer_hash    Peer hash_id
+     * \param [in]     isIPv4       True to walk IPv4 prefixes, false for IPv6
+     * \param [in/out] cursor       Resume position, updated to the last prefix walked
+     * \param [in]     cb           Callback called for each path
+     * \param [out]    done         True if all prefixes have been walked
+     *
+     * \return false if the peer was not found
+     */
+    bool walk(const hash_key &peer_hash, bool isIPv4, walk_cursor &cursor, row_callback cb, bool &done);
+
+private:
+    Logger          *logger;                    ///< Logging class pointer
+
+    std::mutex      peers_mutex;                ///< Protects the peers map
+    std::map<hash_key, peer_rib *> peers;       ///< Peer RIBs, key is the peer hash_id
+
+    std::mutex      attrs_mutex;                ///< Protects the attrs map and attribute ref counts
+    std::unordered_map<hash_key, rib_attr *, hash_key_hasher> attrs;    ///< Interned attributes by rib_attr::key
+
+    /**
+     * Find and lock a peer
+     *
+     * \param [in] peer_hash    Peer hash_id
+     *
+     * \return Locked peer or NULL if not found, caller must unlock the peer mutex
+     */
+    peer_rib *lockPeer(const hash_key &peer_hash);
+
+    /**
+     * Get the interned attributes for a base attribute, adding them if needed
+     *
+     *      attrs_mutex must be locked.  Reference count is not incremented.
+     *
+     * \param [in] attr         Path attributes
+     *
+     * \return Interned attributes
+     */
+    rib_attr *internAttr(MsgBusInterface::obj_path_attr &attr);
+
+    /**
+     * Release a reference to interned attributes, freed when not referenced
+     *
+     *      attrs_mutex must be locked.
+     *
+     * \param [in] attr         Interned attributes
+     */
+    void releaseAttr(rib_attr *attr);
+
+    /**
+     * Release all paths of a peer
+     *
+     *      Peer and attrs_mutex must be locked.
+     *
+     * \param [in] p_rib        Peer RIB
+     */
+    void releasePeer(peer_rib *p_rib);
+};
+
+#endif /* LOCALRIB_H_ */
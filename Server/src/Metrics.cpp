@@ -0,0 +1,74 @@
+/*
+ * Copyright (c) 2013-2016 Cisco Systems, Inc. and others.  All rights reserved.
+ *
+ * This program and the accompanying materials are made available under the
+ * terms of the Eclipse Public License v1.0 which accompanies this distribution,
+ * and is available at http://www.eclipse.org/legal/epl-v10.html
+ *
+ */
+
+#include <cinttypes>
+#include <mutex>
+
+#include "Metrics.h"
+
+static std::mutex registry_mutex;                   ///< Protects the metrics registry map
+
+/**
+ * Registry of metrics, key is the metric name
+ *
+ *      Function local so that metrics can be registered during static initialization.
+ */
+std::map<std::string, Metrics::Counter *> &Metrics::registry() {
+    static std::map<std::string, Counter *> metrics;
+    return metrics;
+}
+
+/**
+ * Get (register if needed) a metric by name
+ *
+ * \param [in] name     Metric name
+ *
+ * \return Reference to the metric value, valid for the life of the process
+ */
+Metrics::Counter &Metrics::get(const std::string &name) {
+    std::lock_guard<std::mutex> lock(registry_mutex);
+
+    std::map<std::string, Counter *>::iterator it = registry().find(name);
+    if (it != registry().end())
+        return *it->second;
+
+    Counter *value = new Counter(0);
+    registry()[name] = value;
+
+    return *value;
+}
+
+/**
+ * Copy the current value of all metrics
+ *
+ * \param [out] values  Map of metric name to value, sorted by name
+ */
+void Metrics::snapshot(std::map<std::string, uint64_t> &values) {
+    std::lock_guard<std::mutex> lock(registry_mutex);
+
+    for (std::map<std::string, Counter *>::iterator it = registry().begin(); it != registry().end(); ++it)
+        values[it->first] = it->second->load(std::memory_order_relaxed);
+}
+
+/**
+ * Log all metrics with a non-zero value
+ *
+ * \param [in] logger   Logger to write the report to
+ */
+void Metrics::report(Logger *logger) {
+    std::map<std::string, uint64_t> values;
+    snapshot(values);
+
+    LOG_INFO("Metrics report: %d registered", (int)values.size());
+
+    for (std::map<std::string, uint64_t>::iterator it = values.begin(); it != values.end(); ++it) {
+        if (it->second > 0)
+            LOG_INFO("   %s = %" PRIu64, it->first.c_str(), it->second);
+    }
+}
@@ -0,0 +1,65 @@
+/*
+ * Copyright (c) 2013-2016 Cisco Systems, Inc. and others.  All rights reserved.
+ *
+ * This program and the accompanying materials are made available under the
+ * terms of the Eclipse Public License v1.0 which accompanies this distribution,
+ * and is available at http://www.eclipse.org/legal/epl-v10.html
+ *
+ */
+#ifndef METRICS_H_
+#define METRICS_H_
+
+#include <atomic>
+#include <cstdint>
+#include <map>
+#include <string>
+
+#include "Logger.h"
+
+/**
+ * \class   Metrics
+ *
+ * \brief   Process wide registry of named collector metrics
+ * \details
+ *      Metrics are 64bit atomic values that are registered by name on first use.  A
+ *      metric is never removed, so the returned reference can (and should) be cached
+ *      by the caller instead of looking it up per message.
+ *
+ *      Names are dotted, lower case and grouped by component, e.g. "stage.bgp_parse.allocs".
+ *      Counters are only incremented; gauges are set with store().
+ */
+class Metrics {
+public:
+    typedef std::atomic<uint64_t> Counter;
+
+    /**
+     * Get (register if needed) a metric by name
+     *
+     * \param [in] name     Metric name
+     *
+     * \return Reference to the metric value, valid for the life of the process
+     */
+    static Counter &get(const std::string &name);
+
+    /**
+     * Copy the current value of all metrics
+     *
+     * \param [out] values  Map of metric name to value, sorted by name
+     */
+    static void snapshot(std::map<std::string, uint64_t> &values);
+
+    /**
+     * Log all metrics with a non-zero value
+     *
+     * \param [in] logger   Logger to write the report to
+     */
+    static void report(Logger *logger);
+
+private:
+    /**
+     * Registry of metrics, key is the metric name
+     */
+    static std::map<std::string, Counter *> &registry();
+};
+
+#endif /* METRICS_H_ */
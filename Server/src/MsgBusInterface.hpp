@@ -19,6 +19,10 @@
 #include <ctime>
 #include <sys/time.h>
 
+#include "bgp_common.h"
+
+class Config;
+
 /**
  * \class   MsgBusInterface
  *
@@ -235,14 +239,13 @@ public:
         uint8_t     prefix_bin[16];         ///< Prefix in binary form
         uint8_t     prefix_bcast_bin[16];   ///< Broadcast address/last address in binary form
         uint32_t    path_id;                ///< Add path ID - zero if not used
-        char        labels[255];            ///< Labels delimited by comma
+        bgp::label_stack labels;            ///< MPLS labels, printed only when serialized
+        uint32_t    flap_count;             ///< Updates coalesced into this entry, zero if not coalesced
     };
 
     /// Rib extended with Route Distinguisher
     struct obj_route_distinguisher {
-        std::string     rd_administrator_subfield;
-        std::string     rd_assigned_number;
-        uint8_t         rd_type;
+        bgp::route_distinguisher rd;        ///< Route distinguisher, printed only when serialized
     };
     
     /// Rib extended with vpn specific fields
@@ -599,6 +602,40 @@ public:
      *****************************************************************/
     virtual void send_bmp_raw(u_char *r_hash, obj_bgp_peer &peer, u_char *data, size_t data_len) = 0;
 
+    /*****************************************************************//**
+     * \brief       Set the initial RIB dump state of the router
+     *
+     * \details     Called by the reader after each route monitoring message.  Implementations
+     *              may use it to favour throughput during the dump, the default ignores it.
+     *
+     * \param[in]   active     True while the router is in its initial RIB dump
+     *****************************************************************/
+    virtual void setRibDump(bool active) { };
+
+    /*****************************************************************//**
+     * \brief       Time until the message bus needs service()
+     *
+     * \details     The reader waits for the next message at most this long while idle.
+     *
+     * \returns     Milliseconds, zero if due now, -1 if no service is needed
+     *****************************************************************/
+    virtual int msUntilService() { return -1; };
+
+    /*****************************************************************//**
+     * \brief       Submit held messages and serve callbacks, called when msUntilService() is due
+     *****************************************************************/
+    virtual void service() { };
+
+    /*****************************************************************//**
+     * \brief       Switch to a reloaded config, see ConfigRcu
+     *
+     * \details     Called by the reader between messages.  The previous config may be freed
+     *              after this returns, so no pointer to it may be kept.
+     *
+     * \param[in]   cfg        Reloaded config
+     *****************************************************************/
+    virtual void setConfig(Config *cfg) { };
+
 
     /* ---------------------------------------------------------------------------
      * Commonly used methods
@@ -0,0 +1,383 @@
+/*
+ * Copyright (c) 2013-2016 Cisco Systems, Inc. and others.  All rights reserved.
+ *
+ * This program and the accompanying materials are made available under the
+ * terms of the Eclipse Public License v1.0 which accompanies this distribution,
+ * and is available at http://www.eclipse.org/legal/epl-v10.html
+ *
+ */
+#ifndef PREFIXTRIE_HPP_
+#define PREFIXTRIE_HPP_
+
+#include <cstdint>
+#include <cstring>
+#include <sys/types.h>
+
+/**
+ * \class   PrefixTrie
+ *
+ * \brief   Path compressed binary (patricia) trie of IP prefixes
+ * \details
+ *      Stores a value per prefix.  Prefixes are in network byte order binary form; a trie
+ *      holds one address family (max_bits of 32 for IPv4 or 128 for IPv6).  Bits beyond
+ *      the prefix length are ignored.
+ *
+ *      Nodes without a value (glue) are only created where two prefixes diverge, so the
+ *      number of nodes is less than two times the number of prefixes.
+ *
+ *      The trie is not thread safe, callers must serialize access.
+ *
+ * \tparam  T   Value type, must be default constructible
+ */
+template <typename T>
+class PrefixTrie {
+public:
+    /**
+     * Constructor
+     *
+     * \param [in] max_bits     Address length in bits, 32 for IPv4 or 128 for IPv6
+     */
+    explicit PrefixTrie(int max_bits = 128) {
+        this->max_bits = max_bits > 128 ? 128 : max_bits;
+        root = NULL;
+        count = 0;
+    }
+
+    ~PrefixTrie() {
+        clear();
+    }
+
+    /**
+     * Number of prefixes (nodes with a value)
+     */
+    size_t size() const {
+        return count;
+    }
+
+    /**
+     * Remove all prefixes
+     */
+    void clear() {
+        freeNode(root);
+        root = NULL;
+        count = 0;
+    }
+
+    /**
+     * Get the value of a prefix, adding the prefix (default value) if not present
+     *
+     * \param [in] addr     Prefix address (binary, network byte order)
+     * \param [in] len      Prefix length in bits
+     *
+     * \return Reference to the value
+     */
+    T &insert(const u_char *addr, int len) {
+        if (len > max_bits)
+            len = max_bits;
+
+        if (root == NULL) {
+            root = newNode(addr, len, NULL);
+            root->has_value = true;
+            ++count;
+            return root->value;
+        }
+
+        // Walk down to the closest node
+        node *cur = root;
+        while (cur->len < len) {
+            node *next = cur->child[bitSet(addr, cur->len)];
+            if (next == NULL)
+                break;
+            cur = next;
+        }
+
+        int check_len = cur->len < len ? cur->len : len;
+        int differ = firstDiffBit(addr, cur->addr, check_len);
+
+        // Move up to the node where the new prefix belongs
+        while (cur->parent != NULL and cur->parent->len >= differ)
+            cur = cur->parent;
+
+        if (differ == len and cur->len == len) {       // Existing node
+            if (not cur->has_value) {
+                cur->has_value = true;
+                ++count;
+            }
+            return cur->value;
+        }
+
+        node *added = newNode(addr, len, NULL);
+        added->has_value = true;
+        ++count;
+
+        if (cur->len == differ) {                       // New child of cur
+            added->parent = cur;
+            cur->child[bitSet(addr, cur->len)] = added;
+
+        } else if (len == differ) {                     // New parent of cur
+            added->child[bitSet(cur->addr, len)] = cur;
+            added->parent = cur->parent;
+            replaceChild(cur, added);
+            cur->parent = added;
+
+        } else {                                        // Siblings under a new glue node
+            node *glue = newNode(addr, differ, cur->parent);
+            int bit = bitSet(addr, differ);
+            glue->child[bit] = added;
+            glue->child[!bit] = cur;
+            added->parent = glue;
+            replaceChild(cur, glue);
+            cur->parent = glue;
+        }
+
+        return added->value;
+    }
+
+    /**
+     * Find a prefix (exact match)
+     *
+     * \param [in] addr     Prefix address (binary, network byte order)
+     * \param [in] len      Prefix length in bits
+     *
+     * \return Pointer to the value or NULL if not found
+     */
+    T *find(const u_char *addr, int len) {
+        node *cur = findNode(addr, len);
+        return cur != NULL ? &cur->value : NULL;
+    }
+
+    /**
+     * Find the longest prefix that covers the address/prefix
+     *
+     * \param [in]  addr        Address (binary, network byte order)
+     * \param [in]  len         Length in bits, max_bits for a host address
+     * \param [out] match_addr  Matched prefix address, max_bits/8 bytes (can be NULL)
+     * \param [out] match_len   Matched prefix length (can be NULL)
+     *
+     * \return Pointer to the value or NULL if no prefix covers the address
+     */
+    T *longestMatch(const u_char *addr, int len, u_char *match_addr = NULL, int *match_len = NULL) {
+        node *best = NULL;
+
+        if (len > max_bits)
+            len = max_bits;
+
+        for (node *cur = root; cur != NULL and cur->len <= len; cur = cur->child[bitSet(addr, cur->len)]) {
+            if (firstDiffBit(addr, cur->addr, cur->len) < cur->len)
+                break;
+
+            if (cur->has_value)
+                best = cur;
+
+            if (cur->len == len)
+                break;
+        }
+
+        if (best == NULL)
+            return NULL;
+
+        if (match_addr != NULL)
+            memcpy(match_addr, best->addr, max_bits / 8);
+        if (match_len != NULL)
+            *match_len = best->len;
+
+        return &best->value;
+    }
+
+    /**
+     * Remove a prefix
+     *
+     * \param [in] addr     Prefix address (binary, network byte order)
+     * \param [in] len      Prefix length in bits
+     *
+     * \return true if the prefix was removed, false if not found
+     */
+    bool erase(const u_char *addr, int len) {
+        node *cur = findNode(addr, len);
+        if (cur == NULL)
+            return false;
+
+        --count;
+
+        // Node with two children stays as glue
+        if (cur->child[0] != NULL and cur->child[1] != NULL) {
+            cur->has_value = false;
+            cur->value = T();
+            return true;
+        }
+
+        node *child = cur->child[0] != NULL ? cur->child[0] : cur->child[1];
+        node *parent = cur->parent;
+
+        if (child != NULL) {                            // Replace the node by its only child
+            child->parent = parent;
+            replaceChild(cur, child);
+            delete cur;
+            return true;
+        }
+
+        // Leaf node
+        replaceChild(cur, NULL);
+        delete cur;
+
+        // Remove the parent if it's now a glue node with a single child
+        if (parent != NULL and not parent->has_value) {
+            child = parent->child[0] != NULL ? parent->child[0] : parent->child[1];
+            child->parent = parent->parent;
+            replaceChild(parent, child);
+            delete parent;
+        }
+
+        return true;
+    }
+
+    /**
+     * Walk the prefixes in order (address, then shorter prefix first)
+     *
+     *      Walk can be resumed after a given prefix, which allows callers to release
+     *      their lock between chunks of a large walk.
+     *
+     * \param [in] fn           Callback bool fn(const u_char *addr, int len, T &value), return false to stop
+     * \param [in] after_addr   Only walk prefixes ordered after this prefix, NULL to walk all
+     * \param [in] after_len    Prefix length of after_addr
+     *
+     * \return false if the walk was stopped by the callback
+     */
+    template <typename F>
+    bool walk(F fn, const u_char *after_addr = NULL, int after_len = 0) {
+        return walkNode(root, fn, after_addr, after_len);
+    }
+
+private:
+    struct node {
+        u_char      addr[16];                   ///< Prefix address, bits beyond len are zero
+        int         len;                        ///< Prefix length in bits
+        bool        has_value;                  ///< False if node is glue
+        node        *parent;
+        node        *child[2];                  ///< Children by the bit after len
+        T           value;
+    };
+
+    node        *root;
+    int         max_bits;                       ///< Address length in bits
+    size_t      count;                          ///< Number of prefixes
+
+    static int bitSet(const u_char *addr, int bit) {
+        return (addr[bit >> 3] >> (7 - (bit & 7))) & 1;
+    }
+
+    /**
+     * Get the first bit that differs between two addresses
+     *
+     * \return bit number, or max_len if the first max_len bits are equal
+     */
+    static int firstDiffBit(const u_char *a, const u_char *b, int max_len) {
+        int i;
+        for (i = 0; i * 8 < max_len; i++) {
+            if (a[i] != b[i]) {
+                int bit = i * 8;
+                for (u_char x = a[i] ^ b[i]; not (x & 0x80); x <<= 1)
+                    ++bit;
+
+                return bit < max_len ? bit : max_len;
+            }
+        }
+
+        return max_len;
+    }
+
+    node *newNode(const u_char *addr, int len, node *parent) {
+        node *n = new node();
+        memset(n->addr, 0, sizeof(n->addr));
+        memcpy(n->addr, addr, (len + 7) / 8);
+
+        if (len & 7)
+            n->addr[len / 8] &= 0xFF << (8 - (len & 7));
+
+        n->len = len;
+        n->has_value = false;
+        n->parent = parent;
+        n->child[0] = n->child[1] = NULL;
+        return n;
+    }
+
+    void freeNode(node *n) {
+        if (n == NULL)
+            return;
+
+        freeNode(n->child[0]);
+        freeNode(n->child[1]);
+        delete n;
+    }
+
+    /**
+     * Replace a node in its parent (or root) by another node
+     */
+    void replaceChild(node *old_node, node *new_node) {
+        node *parent = old_node->parent;
+
+        if (parent == NULL)
+            root = new_node;
+        else if (parent->child[0] == old_node)
+            parent->child[0] = new_node;
+        else
+            parent->child[1] = new_node;
+    }
+
+    node *findNode(const u_char *addr, int len) {
+        if (len > max_bits)
+            len = max_bits;
+
+        node *cur = root;
+        while (cur != NULL and cur->len < len)
+            cur = cur->child[bitSet(addr, cur->len)];
+
+        if (cur == NULL or cur->len != len or not cur->has_value or firstDiffBit(addr, cur->addr, len) < len)
+            return NULL;
+
+        return cur;
+    }
+
+    /**
+     * Compare the prefix order of a node subtree to the resume prefix
+     *
+     * \return -1 if the whole subtree is before, 1 if the whole subtree is after, 0 if only
+     *         the node itself is at or before the resume prefix
+     */
+    static int compareSubtree(const node *n, const u_char *addr, int len) {
+        int check_len = n->len < len ? n->len : len;
+        int differ = firstDiffBit(n->addr, addr, check_len);
+
+        if (differ < check_len)
+            return bitSet(n->addr, differ) ? 1 : -1;
+
+        return n->len > len ? 1 : 0;
+    }
+
+    template <typename F>
+    bool walkNode(node *n, F &fn, const u_char *after_addr, int after_len) {
+        if (n == NULL)
+            return true;
+
+        bool emit = true;
+
+        if (after_addr != NULL) {
+            int cmp = compareSubtree(n, after_addr, after_len);
+
+            if (cmp < 0)
+                return true;                            // Whole subtree was already walked
+            else if (cmp > 0)
+                after_addr = NULL;                      // Whole subtree is after, no more checks needed
+            else
+                emit = false;
+        }
+
+        if (emit and n->has_value and not fn((const u_char *)n->addr, n->len, n->value))
+            return false;
+
+        return walkNode(n->child[0], fn, after_addr, after_len) and
+               walkNode(n->child[1], fn, after_addr, after_len);
+    }
+};
+
+#endif /* PREFIXTRIE_HPP_ */
@@ -0,0 +1,608 @@
+/*
+ * Copyright (c) 2013-2016 Cisco Systems, Inc. and others.  All rights reserved.
+ *
+ * This program and the accompanying materials are made available under the
+ * terms of the Eclipse Public License v1.0 which accompanies this distribution,
+ * and is available at http://www.eclipse.org/legal/epl-v10.html
+ *
+ */
+
+#include <arpa/inet.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <sstream>
+#include <vector>
+
+#include "RibQueryServer.h"
+#include "Metrics.h"
+
+/**
+ * Parse a hash_id in printed form
+ *
+ * \param [in]  str     Hash in printed (hex) form
+ * \param [out] key     Binary hash
+ *
+ * \return true if valid
+ */
+static bool parseHash(const std::string &str, hash_key &key) {
+    u_char hash_id[16];
+
+    if (str.length() != 32)
+        return false;
+
+    for (int i = 0; i < 16; i++) {
+        char hex[3] = { str[i * 2], str[i * 2 + 1], 0 };
+        char *end;
+
+        hash_id[i] = strtoul(hex, &end, 16);
+        if (*end != 0)
+            return false;
+    }
+
+    key = hash_key(hash_id);
+    return true;
+}
+
+/**
+ * Parse a prefix or address in printed form (<ip>[/<len>])
+ *
+ * \param [in]  str     Prefix in printed form
+ * \param [out] addr    Binary address, 16 bytes
+ * \param [out] len     Prefix length, address length if not given
+ * \param [out] isIPv4  True if IPv4
+ *
+ * \return true if valid
+ */
+static bool parsePrefix(const std::string &str, u_char *addr, int &len, bool &isIPv4) {
+    std::string ip = str;
+    size_t slash = str.find('/');
+
+    memset(addr, 0, 16);
+
+    if (slash != std::string::npos)
+        ip = str.substr(0, slash);
+
+    if (inet_pton(AF_INET, ip.c_str(), addr) == 1)
+        isIPv4 = true;
+    else if (inet_pton(AF_INET6, ip.c_str(), addr) == 1)
+        isIPv4 = false;
+    else
+        return false;
+
+    int max_len = isIPv4 ? 32 : 128;
+    len = max_len;
+
+    if (slash != std::string::npos) {
+        char *end;
+        len = strtol(str.c_str() + slash + 1, &end, 10);
+
+        if (*end != 0 or end == str.c_str() + slash + 1 or len < 0 or len > max_len)
+            return false;
+    }
+
+    return true;
+}
+
+/**
+ * Constructor for class
+ *
+ * \param [in] logPtr   Pointer to Logger instance
+ * \param [in] cfg      Pointer to the config instance
+ * \param [in] rib      Local RIB to serve
+ */
+RibQueryServer::RibQueryServer(Logger *logPtr, Config *cfg, LocalRib *rib) {
+    logger = logPtr;
+    this->cfg = cfg;
+    this->rib = rib;
+    debug = cfg->debug_general;
+
+    sock = -1;
+    accept_thread = NULL;
+    running = false;
+    active_clients = 0;
+}
+
+RibQueryServer::~RibQueryServer() {
+    stop();
+}
+
+/**
+ * Create the socket and start accepting connections
+ */
+void RibQueryServer::start() {
+    sockaddr_un addr;
+
+    if (cfg->rib_query_socket.length() >= sizeof(addr.sun_path))
+        throw "rib query socket path is too long";
+
+    bzero(&addr, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, cfg->rib_query_socket.c_str(), sizeof(addr.sun_path) - 1);
+
+    if ((sock = socket(AF_UNIX, SOCK_STREAM, 0)) < 0)
+        throw "ERROR: Cannot open rib query socket.";
+
+    // Remove a stale socket from a previous run
+    unlink(addr.sun_path);
+
+    if (bind(sock, (struct sockaddr *) &addr, sizeof(addr)) < 0) {
+        close(sock);
+        sock = -1;
+        throw "ERROR: Cannot bind to rib query socket";
+    }
+
+    // RIB contents are only for the collector user/group
+    chmod(addr.sun_path, 0660);
+
+    if (listen(sock, RIB_QUERY_MAX_CLIENTS) < 0) {
+        close(sock);
+        sock = -1;
+        throw "ERROR: Cannot listen on rib query socket";
+    }
+
+    running = true;
+    accept_thread = new std::thread(&RibQueryServer::acceptLoop, this);
+
+    LOG_INFO("rib: query service listening on %s", cfg->rib_query_socket.c_str());
+}
+
+/**
+ * Stop accepting connections and wait for the active connections to end
+ */
+void RibQueryServer::stop() {
+    running = false;
+
+    if (accept_thread != NULL) {
+        accept_thread->join();
+        delete accept_thread;
+        accept_thread = NULL;
+    }
+
+    // Unblock connections waiting on a client that stopped reading
+    {
+        std::lock_guard<std::mutex> lock(clients_mutex);
+        for (std::set<int>::iterator it = client_fds.begin(); it != client_fds.end(); ++it)
+            shutdown(*it, SHUT_RDWR);
+    }
+
+    // Connections check the running flag at least every second
+    int waited = 0;
+    while (active_clients > 0 and waited < RIB_QUERY_STOP_WAIT_MS) {
+        usleep(10000);
+        waited += 10;
+    }
+
+    if (active_clients > 0)
+        LOG_WARN("rib: %d query connections did not end within %d ms", (int)active_clients, RIB_QUERY_STOP_WAIT_MS);
+
+    if (sock >= 0) {
+        close(sock);
+        sock = -1;
+        unlink(cfg->rib_query_socket.c_str());
+    }
+}
+
+/**
+ * Accept connections until stopped
+ */
+void RibQueryServer::acceptLoop() {
+    static Metrics::Counter &m_connections = Metrics::get("rib.query.connections");
+
+    pollfd pfd;
+    pfd.fd = sock;
+    pfd.events = POLLIN;
+
+    while (running) {
+        if (poll(&pfd, 1, 500) <= 0)
+            continue;
+
+        int fd = accept(sock, NULL, NULL);
+        if (fd < 0)
+            continue;
+
+        if (active_clients >= RIB_QUERY_MAX_CLIENTS) {
+            LOG_NOTICE("rib: query connection refused, max of %d connections reached", RIB_QUERY_MAX_CLIENTS);
+            const char *msg = "ERR\tToo many connections\n";
+            send(fd, msg, strlen(msg), MSG_NOSIGNAL);
+            close(fd);
+            continue;
+        }
+
+        ++active_clients;
+        m_connections.fetch_add(1, std::memory_order_relaxed);
+
+        {
+            std::lock_guard<std::mutex> lock(clients_mutex);
+            client_fds.insert(fd);
+        }
+
+        std::thread(&RibQueryServer::clientLoop, this, fd).detach();
+    }
+}
+
+/**
+ * Read and serve commands of a connection
+ *
+ * \param [in] fd       Connection socket, closed on return
+ */
+void RibQueryServer::clientLoop(int fd) {
+    client_state client;
+    client.fd = fd;
+    client.binary = false;
+    client.rows = 0;
+
+    // Timeouts so that the running flag is checked while idle or blocked on a slow client
+    timeval tv;
+    tv.tv_sec = 1;
+    tv.tv_usec = 0;
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+
+    SELF_DEBUG("rib: query connection %d opened", fd);
+
+    std::string line;
+    char buf[RIB_QUERY_MAX_LINE];
+    bool open = true;
+
+    while (running and open) {
+        ssize_t len = recv(fd, buf, sizeof(buf), 0);
+
+        if (len < 0 and (errno == EAGAIN or errno == EWOULDBLOCK or errno == EINTR))
+            continue;
+
+        if (len <= 0)
+            break;
+
+        for (ssize_t i = 0; i < len and open; i++) {
+            if (buf[i] == '\n') {
+                if (line.length() > 0 and line[line.length() - 1] == '\r')
+                    line.erase(line.length() - 1);
+
+                open = runCommand(client, line);
+                line.clear();
+
+            } else if (line.length() >= RIB_QUERY_MAX_LINE) {
+                addText(client, FRAME_ERROR, "Command line too long");
+                endResponse(client);
+                open = false;
+
+            } else {
+                line += buf[i];
+            }
+        }
+    }
+
+    SELF_DEBUG("rib: query connection %d closed", fd);
+
+    {
+        std::lock_guard<std::mutex> lock(clients_mutex);
+        client_fds.erase(fd);
+    }
+
+    close(fd);
+    --active_clients;
+}
+
+/**
+ * Run a command
+ *
+ * \param [in] client   Connection state
+ * \param [in] line     Command line
+ *
+ * \return false if the connection should be closed
+ */
+bool RibQueryServer::runCommand(client_state &client, const std::string &line) {
+    static Metrics::Counter &m_queries = Metrics::get("rib.query.commands");
+
+    std::istringstream ss(line);
+    std::vector<std::string> args;
+    std::string arg;
+
+    while (ss >> arg)
+        args.push_back(arg);
+
+    if (args.size() == 0)
+        return true;
+
+    m_queries.fetch_add(1, std::memory_order_relaxed);
+    SELF_DEBUG("rib: query %d command: %s", client.fd, line.c_str());
+
+    const std::string &cmd = args[0];
+
+    if (cmd == "quit") {
+        return false;
+
+    } else if (cmd == "format") {
+        if (args.size() == 2 and args[1] == "tsv")
+            client.binary = false;
+        else if (args.size() == 2 and args[1] == "binary")
+            client.binary = true;
+        else
+            addText(client, FRAME_ERROR, "Usage: format tsv|binary");
+
+        return endResponse(client);
+    }
+
+    /*
+     * Commands that take a peer hash ('*' for all peers)
+     */
+    std::vector<LocalRib::peer_summary> peers;
+    rib->listPeers(peers);
+
+    hash_key peer_hash;
+    bool all_peers = args.size() < 2 or args[1] == "*";
+
+    if (not all_peers and not parseHash(args[1], peer_hash)) {
+        addText(client, FRAME_ERROR, "Invalid peer hash: " + args[1]);
+        return endResponse(client);
+    }
+
+    if (cmd == "peers" or cmd == "count") {
+        char buf[512];
+
+        for (size_t i = 0; i < peers.size(); i++) {
+            if (not all_peers and peers[i].hash != peer_hash)
+                continue;
+
+            if (cmd == "peers")
+                snprintf(buf, sizeof(buf), "%s\t%s\t%s\t%s\t%" PRIu32 "\t%zu\t%zu",
+                         peers[i].hash_str.c_str(), peers[i].router_hash_str.c_str(), peers[i].router_ip.c_str(),
+                         peers[i].peer_addr.c_str(), peers[i].peer_as, peers[i].v4_prefixes, peers[i].v6_prefixes);
+            else
+                snprintf(buf, sizeof(buf), "%s\t%zu\t%zu", peers[i].hash_str.c_str(),
+                         peers[i].v4_prefixes, peers[i].v6_prefixes);
+
+            addText(client, FRAME_TEXT, buf);
+        }
+
+        return endResponse(client);
+
+    } else if (cmd == "exact" or cmd == "lpm") {
+        u_char addr[16];
+        int len;
+        bool isIPv4;
+
+        if (args.size() != 3 or not parsePrefix(args[2], addr, len, isIPv4)) {
+            addText(client, FRAME_ERROR, "Usage: " + cmd + " <peer hash>|* <prefix>[/<length>]");
+            return endResponse(client);
+        }
+
+        for (size_t i = 0; i < peers.size(); i++) {
+            if (not all_peers and peers[i].hash != peer_hash)
+                continue;
+
+            rib->lookup(peers[i].hash, isIPv4, addr, len, cmd == "exact", [&](const LocalRib::rib_row &row) {
+                addRow(client, row);
+                return true;
+            });
+        }
+
+        return endResponse(client);
+
+    } else if (cmd == "dump") {
+        if (all_peers or args.size() > 3 or (args.size() == 3 and args[2] != "ipv4" and args[2] != "ipv6")) {
+            addText(client, FRAME_ERROR, "Usage: dump <peer hash> [ipv4|ipv6]");
+            return endResponse(client);
+        }
+
+        if (args.size() < 3 or args[2] == "ipv4") {
+            if (not dumpPeer(client, peer_hash, true))
+                return false;
+        }
+
+        if (args.size() < 3 or args[2] == "ipv6") {
+            if (not dumpPeer(client, peer_hash, false))
+                return false;
+        }
+
+        return endResponse(client);
+    }
+
+    addText(client, FRAME_ERROR, "Unknown command: " + cmd);
+    return endResponse(client);
+}
+
+/**
+ * Dump the prefixes of a peer
+ *
+ * \param [in] client       Connection state
+ * \param [in] peer_hash    Peer hash_id
+ * \param [in] isIPv4       True to dump IPv4 prefixes, false for IPv6
+ *
+ * \return false if the connection failed
+ */
+bool RibQueryServer::dumpPeer(client_state &client, const hash_key &peer_hash, bool isIPv4) {
+    LocalRib::walk_cursor cursor;
+    cursor.valid = false;
+    cursor.prefix_len = 0;
+
+    bool done = false;
+
+    /*
+     * Walk in chunks so that the peer is not locked while sending to the client
+     */
+    while (not done and running) {
+        if (not rib->walk(peer_hash, isIPv4, cursor, [&](const LocalRib::rib_row &row) {
+                addRow(client, row);
+                return client.out.length() < RIB_QUERY_CHUNK_SIZE;
+            }, done))
+            break;                                  // Peer removed
+
+        if (not flush(client))
+            return false;
+    }
+
+    return true;
+}
+
+/**
+ * Append a prefix row to the output buffer
+ *
+ * \param [in] client   Connection state
+ * \param [in] row      RIB row
+ */
+void RibQueryServer::addRow(client_state &client, const LocalRib::rib_row &row) {
+    const LocalRib::peer_rib *peer = row.peer;
+    const LocalRib::rib_path *path = row.path;
+
+    char prefix[46];
+    inet_ntop(row.isIPv4 ? AF_INET : AF_INET6, row.prefix, prefix, sizeof(prefix));
+
+    std::string rib_hash_str, path_hash_str;
+    MsgBusInterface::hash_toStr((const u_char *)path->hash.v, rib_hash_str);
+    MsgBusInterface::hash_toStr((const u_char *)path->attr->hash.v, path_hash_str);
+
+    ++client.rows;
+
+    if (client.binary) {
+        /*
+         * Binary record: hashes, prefix and path info in fixed positions, then the
+         * attribute fields, labels and large communities as TSV text
+         */
+        u_char rec[16 * 4 + 2 + 16 + 4 * 3];
+        u_char *ptr = rec;
+        uint32_t value;
+
+        memcpy(ptr, path->hash.v, 16);          ptr += 16;
+        memcpy(ptr, path->attr->hash.v, 16);    ptr += 16;
+        memcpy(ptr, peer->hash.v, 16);          ptr += 16;
+        memcpy(ptr, peer->router_hash.v, 16);   ptr += 16;
+        *ptr++ = row.isIPv4 ? 1 : 0;
+        *ptr++ = row.prefix_len;
+        memset(ptr, 0, 16);
+        memcpy(ptr, row.prefix, row.isIPv4 ? 4 : 16);
+        ptr += 16;
+
+        value = htonl(path->path_id);           memcpy(ptr, &value, 4); ptr += 4;
+        value = htonl(path->timestamp_secs);    memcpy(ptr, &value, 4); ptr += 4;
+        value = htonl(path->timestamp_us);      memcpy(ptr, &value, 4); ptr += 4;
+
+        std::string text = path->attr->fields + "\t" + path->labels + "\t" + path->attr->large_communities;
+
+        value = htonl(1 + sizeof(rec) + text.length());
+        client.out.append((char *)&value, 4);
+        client.out += (char) FRAME_ROW;
+        client.out.append((char *)rec, sizeof(rec));
+        client.out += text;
+        return;
+    }
+
+    /*
+     * TSV in the unicast_prefix format
+     */
+    char ts[48];
+    time_t secs = path->timestamp_secs;
+    tm tm_buf;
+    strftime(ts, sizeof(ts), "%Y-%m-%d %H:%M:%S", gmtime_r(&secs, &tm_buf));
+
+    char buf[512];
+    snprintf(buf, sizeof(buf), "add\t0\t%s\t%s\t%s\t%s\t%s\t%s\t%" PRIu32 "\t%s.%06u\t%s\t%d\t%d\t",
+             rib_hash_str.c_str(), peer->router_hash_str.c_str(), peer->router_ip.c_str(), path_hash_str.c_str(),
+             peer->hash_str.c_str(), peer->peer_addr.c_str(), peer->peer_as, ts, path->timestamp_us,
+             prefix, row.prefix_len, row.isIPv4);
+
+    client.out += buf;
+    client.out += path->attr->fields;
+
+    snprintf(buf, sizeof(buf), "\t%" PRIu32 "\t%s\t%d\t%d\t", path->path_id, path->labels.c_str(),
+             peer->isPrePolicy, peer->isAdjIn);
+
+    client.out += buf;
+    client.out += path->attr->large_communities;
+    client.out += "\t0\n";
+}
+
+/**
+ * Append a text row (or error) to the output buffer
+ *
+ * \param [in] client   Connection state
+ * \param [in] type     FRAME_TEXT or FRAME_ERROR
+ * \param [in] text     Row text without the newline
+ */
+void RibQueryServer::addText(client_state &client, FRAME_TYPES type, const std::string &text) {
+    if (client.binary) {
+        uint32_t len = htonl(1 + text.length());
+        client.out.append((char *)&len, 4);
+        client.out += (char) type;
+        client.out += text;
+
+    } else {
+        if (type == FRAME_ERROR)
+            client.out += "ERR\t";
+
+        client.out += text;
+        client.out += '\n';
+    }
+
+    if (type == FRAME_TEXT)
+        ++client.rows;
+}
+
+/**
+ * Append the end of response and send the output buffer
+ *
+ * \param [in] client   Connection state
+ *
+ * \return false if the connection failed
+ */
+bool RibQueryServer::endResponse(client_state &client) {
+    if (client.binary) {
+        uint32_t value = htonl(5);
+        client.out.append((char *)&value, 4);
+        client.out += (char) FRAME_END;
+
+        value = htonl(client.rows);
+        client.out.append((char *)&value, 4);
+
+    } else {
+        char buf[32];
+        snprintf(buf, sizeof(buf), "END\t%" PRIu32 "\n", client.rows);
+        client.out += buf;
+    }
+
+    client.rows = 0;
+
+    return flush(client);
+}
+
+/**
+ * Send and clear the output buffer
+ *
+ * \param [in] client   Connection state
+ *
+ * \return false if the connection failed
+ */
+bool RibQueryServer::flush(client_state &client) {
+    size_t pos = 0;
+
+    while (pos < client.out.length()) {
+        ssize_t sent = send(client.fd, client.out.data() + pos, client.out.length() - pos, MSG_NOSIGNAL);
+
+        if (sent < 0) {
+            if (errno == EINTR)
+                continue;
+
+            // Send timed out, keep waiting on the client unless stopping
+            if ((errno == EAGAIN or errno == EWOULDBLOCK) and running)
+                continue;
+
+            client.out.clear();
+            return false;
+        }
+
+        pos += sent;
+    }
+
+    client.out.clear();
+    return true;
+}
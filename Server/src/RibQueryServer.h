@@ -0,0 +1,169 @@
+/*
+ * Copyright (c) 2013-2016 Cisco Systems, Inc. and others.  All rights reserved.
+ *
+ * This program and the accompanying materials are made available under the
+ * terms of the Eclipse Public License v1.0 which accompanies this distribution,
+ * and is available at http://www.eclipse.org/legal/epl-v10.html
+ *
+ */
+#ifndef RIBQUERYSERVER_H_
+#define RIBQUERYSERVER_H_
+
+#include <atomic>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+
+#include "Config.h"
+#include "Logger.h"
+#include "LocalRib.h"
+
+#define RIB_QUERY_MAX_CLIENTS       8           // Maximum number of concurrent query connections
+#define RIB_QUERY_MAX_LINE          1024        // Maximum length of a query command line
+#define RIB_QUERY_CHUNK_SIZE        65536       // Bytes of rows formatted per peer lock while dumping
+#define RIB_QUERY_STOP_WAIT_MS      5000        // Max time stop() waits for connections to end
+
+/**
+ * \class   RibQueryServer
+ *
+ * \brief   Local RIB query service over a Unix stream socket
+ * \details
+ *      Serves exact/longest match lookups, per peer dumps and prefix counts from the
+ *      LocalRib.  Commands are text lines; results are streamed as unicast_prefix TSV
+ *      rows or as binary records.  See docs/RIB_QUERY.md for the protocol.
+ *
+ *      Each connection is served by its own thread, up to RIB_QUERY_MAX_CLIENTS.
+ */
+class RibQueryServer {
+public:
+    /**
+     * Binary mode frame types
+     */
+    enum FRAME_TYPES {
+        FRAME_ROW       = 'R',                  ///< Prefix row (binary record)
+        FRAME_TEXT      = 'T',                  ///< Text row (peers/count)
+        FRAME_END       = 'E',                  ///< End of response, payload is the row count
+        FRAME_ERROR     = 'X'                   ///< Error, payload is the error text
+    };
+
+    /**
+     * Constructor for class
+     *
+     * \param [in] logPtr   Pointer to Logger instance
+     * \param [in] cfg      Pointer to the config instance
+     * \param [in] rib      Local RIB to serve
+     */
+    RibQueryServer(Logger *logPtr, Config *cfg, LocalRib *rib);
+    ~RibQueryServer();
+
+    /**
+     * Create the socket and start accepting connections
+     *
+     *      Throws const char * on error
+     */
+    void start();
+
+    /**
+     * Stop accepting connections and wait for the active connections to end
+     *
+     *      Open connections are shut down so that blocked sends/reads return;
+     *      the wait is limited to RIB_QUERY_STOP_WAIT_MS.
+     */
+    void stop();
+
+private:
+    Logger          *logger;                    ///< Logging class pointer
+    Config          *cfg;                       ///< Pointer to config instance
+    LocalRib        *rib;                       ///< Local RIB
+    bool            debug;                      ///< debug flag to indicate debugging
+
+    int             sock;                       ///< Listening socket
+    std::thread     *accept_thread;             ///< Thread accepting connections
+
+    std::atomic<bool>   running;                ///< Cleared to stop the server
+    std::atomic<int>    active_clients;         ///< Number of connections being served
+
+    std::mutex          clients_mutex;          ///< Protects client_fds
+    std::set<int>       client_fds;             ///< Sockets of the connections being served
+
+    /**
+     * Per connection state
+     */
+    struct client_state {
+        int             fd;                     ///< Connection socket
+        bool            binary;                 ///< True if results are sent in binary format
+        std::string     out;                    ///< Output buffer
+        uint32_t        rows;                   ///< Rows in the current response
+    };
+
+    /**
+     * Accept connections until stopped
+     */
+    void acceptLoop();
+
+    /**
+     * Read and serve commands of a connection
+     *
+     * \param [in] fd       Connection socket, closed on return
+     */
+    void clientLoop(int fd);
+
+    /**
+     * Run a command
+     *
+     * \param [in] client   Connection state
+     * \param [in] line     Command line
+     *
+     * \return false if the connection should be closed
+     */
+    bool runCommand(client_state &client, const std::string &line);
+
+    /**
+     * Dump the prefixes of a peer
+     *
+     * \param [in] client       Connection state
+     * \param [in] peer_hash    Peer hash_id
+     * \param [in] isIPv4       True to dump IPv4 prefixes, false for IPv6
+     *
+     * \return false if the connection failed
+     */
+    bool dumpPeer(client_state &client, const hash_key &peer_hash, bool isIPv4);
+
+    /**
+     * Append a prefix row to the output buffer
+     *
+     * \param [in] client   Connection state
+     * \param [in] row      RIB row
+     */
+    void addRow(client_state &client, const LocalRib::rib_row &row);
+
+    /**
+     * Append a text row (or error) to the output buffer
+     *
+     * \param [in] client   Connection state
+     * \param [in] type     FRAME_TEXT or FRAME_ERROR
+     * \param [in] text     Row text without the newline
+     */
+    void addText(client_state &client, FRAME_TYPES type, const std::string &text);
+
+    /**
+     * Append the end of response and send the output buffer
+     *
+     * \param [in] client   Connection state
+     *
+     * \return false if the connection failed
+     */
+    bool endResponse(client_state &client);
+
+    /**
+     * Send and clear the output buffer
+     *
+     * \param [in] client   Connection state
+     *
+     * \return false if the connection failed
+     */
+    bool flush(client_state &client);
+};
+
+#endif /* RIBQUERYSERVER_H_ */
@@ -0,0 +1,58 @@
+/*
+ * Copyright (c) 2013-2016 Cisco Systems, Inc. and others.  All rights reserved.
+ *
+ * This program and the accompanying materials are made available under the
+ * terms of the Eclipse Public License v1.0 which accompanies this distribution,
+ * and is available at http://www.eclipse.org/legal/epl-v10.html
+ *
+ */
+
+#include <map>
+#include <mutex>
+
+#include "RouterBaseline.h"
+
+static std::mutex baseline_mutex;                       ///< Protects the baselines map
+static std::map<std::string, float> baselines;          ///< Baseline time in seconds by router hash
+
+/**
+ * Get the baseline time of a router
+ *
+ * \param [in]  hash    Router hash, binary form
+ * \param [out] secs    Baseline time in seconds
+ *
+ * \return true if the baseline of the router is known
+ */
+bool RouterBaseline::get(const std::string &hash, float &secs) {
+    std::lock_guard<std::mutex> lock(baseline_mutex);
+
+    std::map<std::string, float>::iterator it = baselines.find(hash);
+    if (it == baselines.end())
+        return false;
+
+    secs = it->second;
+    return true;
+}
+
+/**
+ * Set the baseline time of a router if not already known
+ *
+ * \param [in] hash     Router hash, binary form
+ * \param [in] secs     Baseline time in seconds
+ */
+void RouterBaseline::set(const std::string &hash, float secs) {
+    std::lock_guard<std::mutex> lock(baseline_mutex);
+
+    baselines.insert(std::make_pair(hash, secs));
+}
+
+/**
+ * Check if the baseline time of a router is known
+ *
+ * \param [in] hash     Router hash, binary form
+ */
+bool RouterBaseline::known(const std::string &hash) {
+    std::lock_guard<std::mutex> lock(baseline_mutex);
+
+    return baselines.find(hash) != baselines.end();
+}
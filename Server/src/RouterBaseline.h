@@ -0,0 +1,53 @@
+/*
+ * Copyright (c) 2013-2016 Cisco Systems, Inc. and others.  All rights reserved.
+ *
+ * This program and the accompanying materials are made available under the
+ * terms of the Eclipse Public License v1.0 which accompanies this distribution,
+ * and is available at http://www.eclipse.org/legal/epl-v10.html
+ *
+ */
+
+#ifndef OPENBMP_ROUTERBASELINE_H
+#define OPENBMP_ROUTERBASELINE_H
+
+#include <string>
+
+/**
+ * \class   RouterBaseline
+ *
+ * \brief   Initial RIB dump baseline time of each router (calculate_baseline)
+ * \details
+ *      Set by the router sessions when the initial RIB dump ends and read by the server
+ *      thread to limit the concurrent initial dumps.  Kept outside of Config so the
+ *      baselines survive config reloads, with its own lock as readers and the server
+ *      thread use it concurrently.
+ */
+class RouterBaseline {
+public:
+    /**
+     * Get the baseline time of a router
+     *
+     * \param [in]  hash    Router hash, binary form
+     * \param [out] secs    Baseline time in seconds
+     *
+     * \return true if the baseline of the router is known
+     */
+    static bool get(const std::string &hash, float &secs);
+
+    /**
+     * Set the baseline time of a router if not already known
+     *
+     * \param [in] hash     Router hash, binary form
+     * \param [in] secs     Baseline time in seconds
+     */
+    static void set(const std::string &hash, float secs);
+
+    /**
+     * Check if the baseline time of a router is known
+     *
+     * \param [in] hash     Router hash, binary form
+     */
+    static bool known(const std::string &hash);
+};
+
+#endif //OPENBMP_ROUTERBASELINE_H
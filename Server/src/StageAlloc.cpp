@@ -0,0 +1,53 @@
+/*
+ * Copyright (c) 2013-2016 Cisco Systems, Inc. and others.  All rights reserved.
+ *
+ * This program and the accompanying materials are made available under the
+ * terms of the Eclipse Public License v1.0 which accompanies this distribution,
+ * and is available at http://www.eclipse.org/legal/epl-v10.html
+ *
+ */
+
+#include <cstdlib>
+#include <new>
+
+#include "StageStats.h"
+
+/*
+ * Interposed global allocator
+ *
+ *      Counts allocations per stage when stage accounting is enabled.  Allocation itself
+ *      is left to malloc so that behavior matches the default operator new.
+ *
+ *      Only linked into openbmpd, the parser library leaves the process allocator alone.
+ */
+void *operator new(std::size_t size) {
+    if (StageStats::enabled)
+        StageStats::countAlloc(size);
+
+    if (size == 0)
+        size = 1;
+
+    void *ptr;
+    while ((ptr = std::malloc(size)) == NULL) {
+        std::new_handler handler = std::get_new_handler();
+
+        if (handler == NULL)
+            throw std::bad_alloc();
+
+        handler();
+    }
+
+    return ptr;
+}
+
+void *operator new[](std::size_t size) {
+    return operator new(size);
+}
+
+void operator delete(void *ptr) noexcept {
+    std::free(ptr);
+}
+
+void operator delete[](void *ptr) noexcept {
+    std::free(ptr);
+}
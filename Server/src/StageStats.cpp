@@ -0,0 +1,148 @@
+/*
+ * Copyright (c) 2013-2016 Cisco Systems, Inc. and others.  All rights reserved.
+ *
+ * This program and the accompanying materials are made available under the
+ * terms of the Eclipse Public License v1.0 which accompanies this distribution,
+ * and is available at http://www.eclipse.org/legal/epl-v10.html
+ *
+ */
+
+#include <ctime>
+#include <string>
+
+#include "StageStats.h"
+#include "Metrics.h"
+
+bool StageStats::enabled = false;
+
+/*
+ * Per thread accounting state
+ */
+static __thread int      tl_stage = StageStats::STAGE_NONE;     ///< Active stage
+static __thread int      tl_depth = 0;                          ///< Scope nesting depth
+static __thread uint64_t tl_cpu_mark = 0;                       ///< Thread CPU time when the active stage was last charged
+static __thread uint64_t tl_calls[StageStats::STAGE_MAX];       ///< Number of times the stage was entered
+static __thread uint64_t tl_cpu_ns[StageStats::STAGE_MAX];      ///< CPU nanoseconds charged to the stage
+static __thread uint64_t tl_allocs[StageStats::STAGE_MAX];      ///< Number of allocations made in the stage
+static __thread uint64_t tl_bytes[StageStats::STAGE_MAX];       ///< Bytes allocated in the stage
+
+/*
+ * Registered metrics, indexed by stage
+ */
+static Metrics::Counter *m_calls[StageStats::STAGE_MAX];
+static Metrics::Counter *m_cpu_ns[StageStats::STAGE_MAX];
+static Metrics::Counter *m_allocs[StageStats::STAGE_MAX];
+static Metrics::Counter *m_bytes[StageStats::STAGE_MAX];
+
+static const char *stage_names[StageStats::STAGE_MAX] = {
+        "none", "bmp_framing", "bgp_parse", "attr_decode", "hashing", "serialize", "produce" };
+
+/**
+ * Enable stage accounting
+ */
+void StageStats::enable() {
+    for (int i = STAGE_NONE + 1; i < STAGE_MAX; i++) {
+        std::string prefix = std::string("stage.") + stage_names[i];
+
+        m_calls[i]  = &Metrics::get(prefix + ".calls");
+        m_cpu_ns[i] = &Metrics::get(prefix + ".cpu_ns");
+        m_allocs[i] = &Metrics::get(prefix + ".allocs");
+        m_bytes[i]  = &Metrics::get(prefix + ".alloc_bytes");
+    }
+
+    enabled = true;
+}
+
+/**
+ * Get the stage name
+ *
+ * \param [in] stage    Stage
+ *
+ * \return Stage name as used in the metric names
+ */
+const char *StageStats::name(int stage) {
+    if (stage < STAGE_NONE || stage >= STAGE_MAX)
+        return "unknown";
+
+    return stage_names[stage];
+}
+
+/**
+ * Get the CPU time consumed by the calling thread
+ *
+ * \return CPU time in nanoseconds
+ */
+uint64_t StageStats::threadCpuNs() {
+    timespec ts;
+
+    if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts))
+        return 0;
+
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/**
+ * Count an allocation against the active stage of the calling thread
+ *
+ * \param [in] size     Number of bytes requested
+ */
+void StageStats::countAlloc(size_t size) {
+    if (tl_stage != STAGE_NONE) {
+        ++tl_allocs[tl_stage];
+        tl_bytes[tl_stage] += size;
+    }
+}
+
+/**
+ * Start a stage on the calling thread
+ *
+ * \param [in] stage    Stage to start
+ *
+ * \return previous stage
+ */
+int StageStats::enter(STAGES stage) {
+    uint64_t now = threadCpuNs();
+
+    if (tl_stage != STAGE_NONE)
+        tl_cpu_ns[tl_stage] += now - tl_cpu_mark;
+
+    int prev_stage = tl_stage;
+
+    tl_cpu_mark = now;
+    tl_stage = stage;
+    ++tl_calls[stage];
+    ++tl_depth;
+
+    return prev_stage;
+}
+
+/**
+ * End the active stage on the calling thread
+ *
+ * \param [in] prev_stage   Stage to restore as active
+ */
+void StageStats::leave(int prev_stage) {
+    uint64_t now = threadCpuNs();
+
+    tl_cpu_ns[tl_stage] += now - tl_cpu_mark;
+    tl_cpu_mark = now;
+    tl_stage = prev_stage;
+
+    if (--tl_depth > 0)
+        return;
+
+    /*
+     * Outermost scope ended, publish the thread values
+     */
+    for (int i = STAGE_NONE + 1; i < STAGE_MAX; i++) {
+        if (tl_calls[i] == 0)
+            continue;
+
+        m_calls[i]->fetch_add(tl_calls[i], std::memory_order_relaxed);
+        m_cpu_ns[i]->fetch_add(tl_cpu_ns[i], std::memory_order_relaxed);
+        m_allocs[i]->fetch_add(tl_allocs[i], std::memory_order_relaxed);
+        m_bytes[i]->fetch_add(tl_bytes[i], std::memory_order_relaxed);
+
+        tl_calls[i] = tl_cpu_ns[i] = tl_allocs[i] = tl_bytes[i] = 0;
+    }
+}
@@ -0,0 +1,121 @@
+/*
+ * Copyright (c) 2013-2016 Cisco Systems, Inc. and others.  All rights reserved.
+ *
+ * This program and the accompanying materials are made available under the
+ * terms of the Eclipse Public License v1.0 which accompanies this distribution,
+ * and is available at http://www.eclipse.org/legal/epl-v10.html
+ *
+ */
+#ifndef STAGESTATS_H_
+#define STAGESTATS_H_
+
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * \class   StageStats
+ *
+ * \brief   Per pipeline stage allocation and CPU time accounting
+ * \details
+ *      Code is marked with a StageStats::Scope for the stage it belongs to.  Scopes nest;
+ *      the innermost scope is the active stage and is charged with the thread CPU time
+ *      (CLOCK_THREAD_CPUTIME_ID) and the operator new calls/bytes made while it is active.
+ *      Time and allocations of a nested stage are not charged to the outer stage.
+ *
+ *      Accounting is off by default (metrics.stage_accounting).  When off, a scope costs
+ *      a single flag check and the operator new interposed by openbmpd (StageAlloc.cpp)
+ *      only adds the same check.  Programs linking only the parser library count no allocations.
+ *
+ *      Values are kept per thread and added to the Metrics registry when the outermost
+ *      scope ends, as stage.<name>.calls, .cpu_ns, .allocs and .alloc_bytes
+ */
+class StageStats {
+public:
+    /**
+     * Pipeline stages
+     */
+    enum STAGES {
+        STAGE_NONE = 0,                     ///< Not in a marked stage (not reported)
+        STAGE_BMP_FRAMING,                  ///< BMP header/message read and framing
+        STAGE_BGP_PARSE,                    ///< BGP message parse
+        STAGE_ATTR_DECODE,                  ///< BGP path attribute decode
+        STAGE_HASHING,                      ///< Hash ID generation
+        STAGE_SERIALIZE,                    ///< Message bus record serialization
+        STAGE_PRODUCE,                      ///< Message bus produce
+        STAGE_MAX
+    };
+
+    static bool enabled;                    ///< Indicates if stage accounting is enabled
+
+    /**
+     * Scoped stage marker
+     *
+     *      Active stage is set to the given stage for the life of the object.
+     */
+    class Scope {
+    public:
+        explicit Scope(STAGES stage) {
+            active = StageStats::enabled;
+            if (active)
+                prev_stage = StageStats::enter(stage);
+        }
+
+        ~Scope() {
+            if (active)
+                StageStats::leave(prev_stage);
+        }
+
+    private:
+        bool    active;                     ///< True if accounting was enabled when the scope started
+        int     prev_stage;                 ///< Stage to restore when the scope ends
+    };
+
+    /**
+     * Enable stage accounting
+     *
+     *      Registers the stage metrics.  Should be called before the reader threads are started.
+     */
+    static void enable();
+
+    /**
+     * Get the stage name
+     *
+     * \param [in] stage    Stage
+     *
+     * \return Stage name as used in the metric names
+     */
+    static const char *name(int stage);
+
+    /**
+     * Get the CPU time consumed by the calling thread
+     *
+     * \return CPU time in nanoseconds
+     */
+    static uint64_t threadCpuNs();
+
+    /**
+     * Count an allocation against the active stage of the calling thread
+     *
+     * \param [in] size     Number of bytes requested
+     */
+    static void countAlloc(size_t size);
+
+private:
+    /**
+     * Start a stage on the calling thread
+     *
+     * \param [in] stage    Stage to start
+     *
+     * \return previous stage
+     */
+    static int enter(STAGES stage);
+
+    /**
+     * End the active stage on the calling thread
+     *
+     * \param [in] prev_stage   Stage to restore as active
+     */
+    static void leave(int prev_stage);
+};
+
+#endif /* STAGESTATS_H_ */
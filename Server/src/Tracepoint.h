@@ -0,0 +1,48 @@
+/*
+ * Copyright (c) 2013-2016 Cisco Systems, Inc. and others.  All rights reserved.
+ *
+ * This program and the accompanying materials are made available under the
+ * terms of the Eclipse Public License v1.0 which accompanies this distribution,
+ * and is available at http://www.eclipse.org/legal/epl-v10.html
+ *
+ */
+#ifndef TRACEPOINT_H_
+#define TRACEPOINT_H_
+
+/*
+ * Static (USDT) tracepoints
+ *
+ *      Tracepoints are compiled in when cmake is run with -DENABLE_USDT=ON and <sys/sdt.h>
+ *      (systemtap-sdt-dev/systemtap-sdt-devel) is available.  An unattached probe is a single
+ *      nop instruction, so they are safe to leave enabled in production builds.
+ *
+ *      All probes use the provider name "openbmpd".  List them with:
+ *          bpftrace -l 'usdt:/usr/bin/openbmpd:*'
+ *
+ *      Example:
+ *          bpftrace -e 'usdt:/usr/bin/openbmpd:openbmpd:msgbus_queue_full { @[str(arg0)] = count(); }'
+ *
+ * Probes
+ *      bmp_msg             (int sock, int bmp_type, uint32_t bmp_len)
+ *      bgp_update          (char *peer_addr, size_t size, size_t advertised, size_t withdrawn)
+ *      msgbus_serialized   (char *topic_var, int rows, size_t msg_size)
+ *      msgbus_enqueue      (char *topic_var, size_t size, int outq_len)
+ *      msgbus_queue_full   (char *topic_var, int outq_len)
+ *      session_open        (char *router_ip, int sock)
+ *      session_close       (char *router_ip, int sock)
+ */
+#ifdef ENABLE_USDT
+    #include <sys/sdt.h>
+
+    #define OBMP_TRACE1(name, a1)                   DTRACE_PROBE1(openbmpd, name, a1)
+    #define OBMP_TRACE2(name, a1, a2)               DTRACE_PROBE2(openbmpd, name, a1, a2)
+    #define OBMP_TRACE3(name, a1, a2, a3)           DTRACE_PROBE3(openbmpd, name, a1, a2, a3)
+    #define OBMP_TRACE4(name, a1, a2, a3, a4)       DTRACE_PROBE4(openbmpd, name, a1, a2, a3, a4)
+#else
+    #define OBMP_TRACE1(name, a1)
+    #define OBMP_TRACE2(name, a1, a2)
+    #define OBMP_TRACE3(name, a1, a2, a3)
+    #define OBMP_TRACE4(name, a1, a2, a3, a4)
+#endif
+
+#endif /* TRACEPOINT_H_ */
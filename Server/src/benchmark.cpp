@@ -0,0 +1,355 @@
+/*
+ * Copyright (c) 2013-2016 Cisco Systems, Inc. and others.  All rights reserved.
+ *
+ * This program and the accompanying materials are made available under the
+ * terms of the Eclipse Public License v1.0 which accompanies this distribution,
+ * and is available at http://www.eclipse.org/legal/epl-v10.html
+ *
+ */
+
+#include <sys/socket.h>
+#include <sys/time.h>
+
+#include <cerrno>
+#include <chrono>
+#include <cinttypes>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <unistd.h>
+
+#include "benchmark.h"
+#include "BMPListener.h"
+#include "BMPReader.h"
+#include "FilterEngine.h"
+#include "MsgBusImpl_kafka.h"
+#include "StageStats.h"
+#include "Metrics.h"
+#include "md5.h"
+
+/**
+ * Append a BMP message (common header and body)
+ */
+static void putBmpMsg(std::string &out, uint8_t type, const std::string &body) {
+    put8(out, 3);                                       // Version
+    put32(out, 6 + body.size());
+    put8(out, type);
+    out.append(body);
+}
+
+/**
+ * Append the BMP per-peer header of the synthetic peer
+ */
+static void putPeerHdr(std::string &out, uint32_t timestamp) {
+    put8(out, 0);                                       // Global instance peer
+    put8(out, 0);                                       // IPv4, pre-policy Adj-RIB-In
+    out.append(8, '\0');                                // RD
+    out.append(12, '\0');
+    put32(out, BENCHMARK_SYNTHETIC_PEER_ADDR);
+    put32(out, BENCHMARK_SYNTHETIC_PEER_AS);
+    put32(out, BENCHMARK_SYNTHETIC_PEER_ADDR);          // BGP ID
+    put32(out, timestamp);
+    put32(out, 0);
+}
+
+/**
+ * Build a synthetic BMP stream
+ *
+ *      INIT, PEER_UP of one IPv4 peer, ROUTE_MON updates advertising distinct /24 prefixes and TERM.
+ *      Path attributes change on every update so each update is a new base attribute.
+ *
+ * \param [in]  prefixes    Number of prefixes to advertise
+ * \param [out] stream      Synthetic BMP stream
+ */
+static void buildSyntheticStream(uint64_t prefixes, std::string &stream) {
+    std::string body, bgp;
+    uint32_t ts = (uint32_t)time(NULL);
+
+    stream.clear();
+
+    // INIT with sysName/sysDescr
+    body.clear();
+    put16(body, 2); put16(body, 5); body.append("bench");
+    put16(body, 1); put16(body, 9); body.append("synthetic");
+    putBmpMsg(stream, 4, body);
+
+    // PEER_UP, both OPENs have the 4-octet ASN and IPv4 unicast capabilities
+    std::string open;
+    put8(open, 4);                                      // Version
+    put16(open, 23456);                                 // AS_TRANS
+    put16(open, 90);                                    // Hold time
+    put32(open, BENCHMARK_SYNTHETIC_PEER_ADDR);
+    put8(open, 16);                                     // Optional parameters length
+    put8(open, 2); put8(open, 6); put8(open, 65); put8(open, 4); put32(open, BENCHMARK_SYNTHETIC_PEER_AS);
+    put8(open, 2); put8(open, 6); put8(open, 1); put8(open, 4); put16(open, 1); put8(open, 0); put8(open, 1);
+
+    body.clear();
+    putPeerHdr(body, ts);
+    body.append(12, '\0');
+    put32(body, BENCHMARK_SYNTHETIC_PEER_ADDR + 1);     // Local address
+    put16(body, 179);
+    put16(body, 40000);
+    putBgpMsg(body, 1, open);
+    putBgpMsg(body, 1, open);
+    putBmpMsg(stream, 3, body);
+
+    // ROUTE_MON updates
+    for (uint64_t i = 0, update = 0; i < prefixes; update++) {
+        std::string attrs;
+
+        put8(attrs, 0x40); put8(attrs, 1); put8(attrs, 1); put8(attrs, 0);                 // ORIGIN igp
+        put8(attrs, 0x40); put8(attrs, 2); put8(attrs, 14);                                 // AS_PATH
+        put8(attrs, 2); put8(attrs, 3);
+        put32(attrs, BENCHMARK_SYNTHETIC_PEER_AS); put32(attrs, 64512 + update % 1000); put32(attrs, 65535 + update);
+        put8(attrs, 0x40); put8(attrs, 3); put8(attrs, 4); put32(attrs, BENCHMARK_SYNTHETIC_PEER_ADDR);  // NEXT_HOP
+        put8(attrs, 0x80); put8(attrs, 4); put8(attrs, 4); put32(attrs, update % 100);     // MED
+        put8(attrs, 0xC0); put8(attrs, 8); put8(attrs, 8);                                  // COMMUNITIES
+        put32(attrs, (BENCHMARK_SYNTHETIC_PEER_AS << 16) | 100); put32(attrs, (update % 65536) << 16 | 1);
+
+        bgp.clear();
+        put16(bgp, 0);                                  // Withdrawn routes length
+        put16(bgp, attrs.size());
+        bgp.append(attrs);
+
+        for (int n = 0; n < BENCHMARK_SYNTHETIC_PER_UPDATE and i < prefixes; n++, i++) {
+            uint32_t prefix = 0x01000000 + (uint32_t)((i % 0xDF0000) << 8);
+
+            put8(bgp, 24);
+            put8(bgp, prefix >> 24); put8(bgp, prefix >> 16); put8(bgp, prefix >> 8);
+        }
+
+        body.clear();
+        putPeerHdr(body, ts);
+        putBgpMsg(body, 2, bgp);
+        putBmpMsg(stream, 0, body);
+    }
+
+    // TERM, administratively closed
+    body.clear();
+    put16(body, 1); put16(body, 2); put16(body, 0);
+    putBmpMsg(stream, 5, body);
+}
+
+/**
+ * Write the recorded stream to the BMP reader socket
+ *
+ *      The reader uses recv(), so the file is fed through a socket pair instead of being read directly.
+ *
+ * \param [in]  file        Recorded or synthetic stream, opened for read
+ * \param [in]  sock        Write end of the socket pair, closed on return
+ * \param [out] bytes       Number of bytes written
+ */
+static void feedStream(std::istream *file, int sock, uint64_t *bytes) {
+    char buf[BENCHMARK_READ_BLOCK_SIZE];
+
+    *bytes = 0;
+
+    while (*file) {
+        file->read(buf, sizeof(buf));
+        ssize_t len = file->gcount();
+        ssize_t pos = 0;
+
+        while (pos < len) {
+            ssize_t sent = send(sock, buf + pos, len - pos, MSG_NOSIGNAL);
+
+            if (sent < 0) {
+                if (errno == EINTR)
+                    continue;
+
+                // Reader closed the connection (e.g. TERM message)
+                close(sock);
+                return;
+            }
+
+            pos += sent;
+            *bytes += sent;
+        }
+    }
+
+    shutdown(sock, SHUT_WR);
+    close(sock);
+}
+
+/**
+ * Run benchmark mode
+ *
+ * \param [in] cfg          Reference to the loaded configuration, collector hash must be set
+ * \param [in] logger       Logger pointer
+ * \param [in] filename     Recorded BMP stream filename, NULL to use a synthetic stream
+ * \param [in] synthetic    Number of prefixes in the synthetic stream
+ *
+ * \return exit code, zero on success
+ */
+int runBenchmark(Config &cfg, Logger *logger, const char *filename, uint64_t synthetic) {
+    std::ifstream recorded;
+    std::istringstream generated;
+    std::istream *stream = &recorded;
+    std::string source;
+
+    if (filename != NULL) {
+        recorded.open(filename, std::ios::in | std::ios::binary);
+
+        if (!recorded.is_open()) {
+            fprintf(stderr, "ERROR: Failed to open BMP stream file %s\n", filename);
+            return 2;
+        }
+
+        source = filename;
+
+    } else {
+        std::string data;
+        buildSyntheticStream(synthetic, data);
+        generated.str(data);
+        stream = &generated;
+
+        source = "synthetic, " + std::to_string(synthetic) + " prefixes";
+    }
+
+    // Produced messages are tracked to the delivery report
+    cfg.kafka_delivery_reports = true;
+
+    int sock_fds[2];
+    if (socketpair(PF_LOCAL, SOCK_STREAM, 0, sock_fds)) {
+        fprintf(stderr, "ERROR: Failed to create socket pair: %s\n", strerror(errno));
+        return 2;
+    }
+
+    StageStats::enable();
+
+    /*
+     * Setup the client as if the router connected
+     */
+    BMPListener::ClientInfo client;
+    bzero(&client, sizeof(client));
+    client.c_sock = sock_fds[0];
+    client.pipe_sock = sock_fds[0];
+    snprintf(client.c_ip, sizeof(client.c_ip), "127.0.0.1");
+    snprintf(client.c_port, sizeof(client.c_port), "0");
+    gettimeofday(&client.startTime, NULL);
+
+    MD5 hash;
+    hash.update((unsigned char *)source.c_str(), source.length());
+    hash.update((unsigned char *)cfg.c_hash_id, sizeof(cfg.c_hash_id));
+    hash.finalize();
+
+    unsigned char *hash_raw = hash.raw_digest();
+    memcpy(client.hash_id, hash_raw, 16);
+    delete[] hash_raw;
+
+    uint64_t bmp_msgs = 0;
+    uint64_t bytes = 0;
+
+    try {
+        msgBus_kafka *mbus = new msgBus_kafka(logger, &cfg, cfg.c_hash_id);
+
+        if (cfg.debug_msgbus)
+            mbus->enableDebug();
+
+        FilterEngine *filter = NULL;
+        if (cfg.filter_rules.size() > 0 or cfg.filter_default_drop)
+            filter = new FilterEngine(logger, &cfg);
+
+        BMPReader rBMP(logger, &cfg);
+        rBMP.setFilter(filter);
+
+        LOG_INFO("Benchmark replaying BMP stream from %s%s", source.c_str(),
+                 cfg.kafka_mock_brokers > 0 ? " to a kafka mock cluster" : "");
+
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        uint64_t start_cpu_ns = StageStats::threadCpuNs();
+
+        std::thread feeder(feedStream, stream, sock_fds[1], &bytes);
+
+        try {
+            while (rBMP.ReadIncomingMsg(&client, mbus))
+                ;
+
+        } catch (char const *str) {
+            // End of stream is reported as a connection close
+        }
+
+        bmp_msgs = rBMP.messageCount();
+
+        // Reader has closed its end of the socket pair (TERM or disconnect), feeder will stop
+        feeder.join();
+
+        double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        uint64_t cpu_ns = StageStats::threadCpuNs() - start_cpu_ns;
+        uint64_t prefixes = mbus->ribSeq;
+
+        // Wait for the queued messages to be delivered
+        mbus->flush(BENCHMARK_FLUSH_TIMEOUT_MS);
+        double drained = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        /*
+         * Print the results
+         */
+        std::map<std::string, uint64_t> metrics;
+        Metrics::snapshot(metrics);
+
+        printf("\nBenchmark: %s\n", source.c_str());
+        printf("  Bytes replayed     : %" PRIu64 "\n", bytes);
+        printf("  BMP messages       : %" PRIu64 "\n", bmp_msgs);
+        printf("  Unicast prefixes   : %" PRIu64 "\n", prefixes);
+        printf("  Elapsed            : %.3f sec (%.0f prefixes/sec)\n", elapsed,
+               elapsed > 0 ? prefixes / elapsed : 0);
+        printf("  Reader thread CPU  : %.3f sec\n\n", cpu_ns / 1e9);
+
+        uint64_t produced = metrics["msgbus.produced"];
+        uint64_t delivered = metrics["msgbus.delivery.delivered"];
+
+        printf("  Kafka producer%s:\n", cfg.kafka_mock_brokers > 0 ? " (mock cluster)" : "");
+        printf("    queue.buffering  : max.messages=%d max.kbytes=%d max.ms=%d compression=%s\n",
+               cfg.q_buf_max_msgs, cfg.q_buf_max_kbytes, cfg.q_buf_max_ms, cfg.compression.c_str());
+        printf("    Produced         : %" PRIu64 " msgs, %.1f MB (%.0f msgs/sec, %.1f MB/sec incl. drain)\n",
+               produced, metrics["msgbus.produced_bytes"] / (1024.0 * 1024),
+               drained > 0 ? produced / drained : 0,
+               drained > 0 ? metrics["msgbus.produced_bytes"] / (1024.0 * 1024) / drained : 0);
+        printf("    Queue full       : %" PRIu64 "\n", metrics["msgbus.queue_full"]);
+        printf("    Delivered        : %" PRIu64 ", failed %" PRIu64 ", drain %.3f sec\n",
+               delivered, metrics["msgbus.delivery.failed"], drained - elapsed);
+        printf("    Delivery latency : avg %.2f ms, max %.2f ms\n\n",
+               delivered > 0 ? metrics["msgbus.delivery.latency_us"] / 1000.0 / delivered : 0,
+               metrics["msgbus.delivery.latency_max_us"] / 1000.0);
+
+        double scale = 1;
+        if (prefixes > 0) {
+            scale = 1000000.0 / prefixes;
+            printf("  Per million prefixes:\n");
+        } else {
+            printf("  No unicast prefixes in the stream, showing totals:\n");
+        }
+
+        printf("    %-14s %14s %12s %14s %12s\n", "stage", "calls", "cpu ms", "allocs", "alloc MB");
+
+        for (int i = StageStats::STAGE_NONE + 1; i < StageStats::STAGE_MAX; i++) {
+            std::string prefix = std::string("stage.") + StageStats::name(i);
+
+            printf("    %-14s %14.0f %12.1f %14.0f %12.1f\n", StageStats::name(i),
+                   metrics[prefix + ".calls"] * scale,
+                   metrics[prefix + ".cpu_ns"] * scale / 1e6,
+                   metrics[prefix + ".allocs"] * scale,
+                   metrics[prefix + ".alloc_bytes"] * scale / (1024 * 1024));
+        }
+
+        printf("\n");
+        fflush(stdout);
+
+        delete mbus;
+
+        if (filter != NULL)
+            delete filter;
+
+    } catch (char const *str) {
+        LOG_ERR("Benchmark failed: %s", str);
+        close(sock_fds[0]);
+        close(sock_fds[1]);
+        return 2;
+    }
+
+    return 0;
+}
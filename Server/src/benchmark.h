@@ -0,0 +1,116 @@
+/*
+ * Copyright (c) 2013-2016 Cisco Systems, Inc. and others.  All rights reserved.
+ *
+ * This program and the accompanying materials are made available under the
+ * terms of the Eclipse Public License v1.0 which accompanies this distribution,
+ * and is available at http://www.eclipse.org/legal/epl-v10.html
+ *
+ */
+
+#ifndef BENCHMARK_H_
+#define BENCHMARK_H_
+
+#include <cstdint>
+#include <string>
+
+#include "Logger.h"
+#include "Config.h"
+
+#define BENCHMARK_READ_BLOCK_SIZE     65536       // Number of bytes read from the recorded stream per write
+#define BENCHMARK_FLUSH_TIMEOUT_MS    60000       // Max time to wait for the produced messages to be delivered
+
+#define BENCHMARK_SYNTHETIC_PEER_ADDR 0xC0000201  // Synthetic stream peer address, 192.0.2.1
+#define BENCHMARK_SYNTHETIC_PEER_AS   65001       // Synthetic stream peer ASN
+#define BENCHMARK_SYNTHETIC_PER_UPDATE 500        // Prefixes per update in the synthetic stream
+
+#define BENCHMARK_DECODER_ALLOC_ITERS 1000        // Iterations per decoder case run with allocation counting
+#define BENCHMARK_WORST_SIZE_FACTOR   8           // Large to small input size ratio of the worst case benchmark
+#define BENCHMARK_WORST_MAX_SCALING   2.0         // Max allowed growth of the time per byte from small to large input
+
+/*
+ * Append big endian values to a stream
+ */
+inline void put8(std::string &out, uint8_t value) {
+    out.push_back((char)value);
+}
+
+inline void put16(std::string &out, uint16_t value) {
+    put8(out, value >> 8);
+    put8(out, value);
+}
+
+inline void put32(std::string &out, uint32_t value) {
+    put16(out, value >> 16);
+    put16(out, value);
+}
+
+/**
+ * Append a BGP message (header and body)
+ */
+inline void putBgpMsg(std::string &out, uint8_t type, const std::string &body) {
+    out.append(16, (char)0xFF);                         // Marker
+    put16(out, 19 + body.size());
+    put8(out, type);
+    out.append(body);
+}
+
+/*
+ * BGP message builders shared by the benchmarks, see benchmark_decoders.cpp
+ */
+void putAttr(std::string &out, uint8_t flags, uint8_t type, const std::string &value);
+void putTlv(std::string &out, uint16_t type, const std::string &value);
+void putLsNodeDescr(std::string &out, uint16_t type, uint32_t router_id);
+void putLsLinkAttrs(std::string &out, uint32_t id);
+
+/**
+ * Run benchmark mode
+ *
+ * Replays a recorded BMP stream (raw bytes as sent by the router), or a synthetic stream,
+ * through the BMP reader, BGP parser and message bus as a single router connection.  Stage
+ * accounting is enabled and a per stage breakdown, normalized per million prefixes, is
+ * printed to stdout along with the producer throughput, queue full events and delivery
+ * latency.  Set Config::kafka_mock_brokers to produce to an in-process mock cluster.
+ *
+ * \param [in] cfg          Reference to the loaded configuration, collector hash must be set
+ * \param [in] logger       Logger pointer
+ * \param [in] filename     Recorded BMP stream filename, NULL to use a synthetic stream
+ * \param [in] synthetic    Number of prefixes in the synthetic stream
+ *
+ * \return exit code, zero on success
+ */
+int runBenchmark(Config &cfg, Logger *logger, const char *filename, uint64_t synthetic);
+
+/**
+ * Run the decoder microbenchmarks
+ *
+ * Runs each BMP/BGP decoder on realistic and worst case inputs, in process without a message
+ * bus, and prints ns/op, bytes/s and allocations/op per case to stdout.  Iterations are doubled
+ * until a case runs for at least min_ms; allocations are counted in a separate run of
+ * BENCHMARK_DECODER_ALLOC_ITERS iterations so that the accounting doesn't skew the timing.
+ *
+ * \param [in] logger       Logger pointer
+ * \param [in] min_ms       Minimum run time of each case in milliseconds
+ * \param [in] filter       Only run cases with names containing filter, NULL for all
+ *
+ * \return exit code, zero on success
+ */
+int runDecoderBenchmark(Logger *logger, uint32_t min_ms, const char *filter);
+
+/**
+ * Run the worst case (pathological input) benchmark
+ *
+ * Runs worst case UPDATEs (maximum AS paths with AS_SETs, packed /32 withdrawals, hundreds of
+ * extended communities, huge BGP-LS attributes and extended messages) through parseBGP and the
+ * kafka message bus serializers, with produce replaced by a discard.  Each case is run at a small
+ * and an 8x larger size and fails if the time per byte grows more than BENCHMARK_WORST_MAX_SCALING
+ * times, which catches quadratic behavior such as repeated string appends.
+ *
+ * \param [in] cfg          Reference to the loaded configuration, collector hash must be set
+ * \param [in] logger       Logger pointer
+ * \param [in] min_ms       Minimum run time of each case size in milliseconds
+ *
+ * \return exit code, zero if all cases are within the bound
+ */
+int runWorstCaseBenchmark(Config &cfg, Logger *logger, uint32_t min_ms);
+
+#endif /* BENCHMARK_H_ */
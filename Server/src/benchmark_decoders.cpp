@@ -0,0 +1,567 @@
+/*
+ * Copyright (c) 2013-2016 Cisco Systems, Inc. and others.  All rights reserved.
+ *
+ * This program and the accompanying materials are made available under the
+ * terms of the Eclipse Public License v1.0 which accompanies this distribution,
+ * and is available at http://www.eclipse.org/legal/epl-v10.html
+ *
+ */
+
+#include <sys/socket.h>
+
+#include <cerrno>
+#include <chrono>
+#include <cinttypes>
+#include <cstdio>
+#include <cstring>
+#include <list>
+#include <string>
+#include <unistd.h>
+
+#include "benchmark.h"
+#include "BMPReader.h"
+#include "parseBMP.h"
+#include "UpdateMsg.h"
+#include "ExtCommunity.h"
+#include "MPReachAttr.h"
+#include "MPUnReachAttr.h"
+#include "MPLinkState.h"
+#include "MPLinkStateAttr.h"
+#include "OpenMsg.h"
+#include "StageStats.h"
+#include "Metrics.h"
+
+using namespace bgp_msg;
+
+#define BENCH_PEER_ADDR     "192.0.2.1"
+#define BENCH_ROUTER_ADDR   "192.0.2.254"
+
+/**
+ * State shared by the decoder cases
+ */
+struct bench_ctx {
+    Logger                      *logger;
+    BMPReader::peer_info        peer_info;          ///< Peer info used by the update decoders (4-octet ASN, no add-path)
+    BMPReader::peer_info        open_peer_info;     ///< Peer info updated by the OPEN decoder
+    parseBMP::peer_hdr_cache    hdr_cache;          ///< Peer header cache as used by the BMP reader
+    int                         socks[2];           ///< Connected pair, messages are written to [1] and parsed from [0]
+};
+
+/**
+ * Decoder case
+ */
+struct bench_case {
+    const char  *name;
+    std::string data;                               ///< Input passed to the decoder on each iteration
+    void        (*run)(bench_ctx &ctx, std::string &data);
+};
+
+/**
+ * Append a path attribute, using the extended length when needed
+ */
+void putAttr(std::string &out, uint8_t flags, uint8_t type, const std::string &value) {
+    if (value.size() > 255) {
+        put8(out, flags | 0x10);
+        put8(out, type);
+        put16(out, value.size());
+    } else {
+        put8(out, flags);
+        put8(out, type);
+        put8(out, value.size());
+    }
+
+    out.append(value);
+}
+
+/**
+ * Build an update (without the BGP header) that only has path attributes
+ */
+static std::string buildAttrUpdate(const std::string &attrs) {
+    std::string update;
+
+    put16(update, 0);                               // Withdrawn length
+    put16(update, attrs.size());
+    update.append(attrs);
+
+    return update;
+}
+
+/**
+ * Append a BGP-LS TLV
+ */
+void putTlv(std::string &out, uint16_t type, const std::string &value) {
+    put16(out, type);
+    put16(out, value.size());
+    out.append(value);
+}
+
+/**
+ * Append a BGP-LS node descriptor (AS, BGP-LS ID and IS-IS router ID)
+ */
+void putLsNodeDescr(std::string &out, uint16_t type, uint32_t router_id) {
+    std::string descr, value;
+
+    value.clear(); put32(value, 65001);
+    putTlv(descr, MPLinkState::NODE_DESCR_AS, value);
+
+    value.clear(); put32(value, 0);
+    putTlv(descr, MPLinkState::NODE_DESCR_BGP_LS_ID, value);
+
+    value.clear(); put16(value, 0x1921); put32(value, router_id);
+    putTlv(descr, MPLinkState::NODE_DESCR_IGP_ROUTER_ID, value);
+
+    putTlv(out, type, descr);
+}
+
+/**
+ * Append a BGP-LS link attribute set (TE, metrics and name)
+ */
+void putLsLinkAttrs(std::string &out, uint32_t id) {
+    std::string value;
+
+    value.clear(); put32(value, 0x0A000000 + id);
+    putTlv(out, MPLinkStateAttr::ATTR_LINK_IPV4_ROUTER_ID_LOCAL, value);
+    putTlv(out, MPLinkStateAttr::ATTR_LINK_IPV4_ROUTER_ID_REMOTE, value);
+
+    value.clear(); put32(value, 0x1);
+    putTlv(out, MPLinkStateAttr::ATTR_LINK_ADMIN_GROUP, value);
+
+    value.clear(); put32(value, 0x4B3EBC20);                                        // 100Gbps as IEEE float bytes/s
+    putTlv(out, MPLinkStateAttr::ATTR_LINK_MAX_LINK_BW, value);
+    putTlv(out, MPLinkStateAttr::ATTR_LINK_MAX_RESV_BW, value);
+
+    value.clear();
+    for (int i = 0; i < 8; i++)
+        put32(value, 0x4B3EBC20);
+    putTlv(out, MPLinkStateAttr::ATTR_LINK_UNRESV_BW, value);
+
+    value.clear(); put32(value, 10);
+    putTlv(out, MPLinkStateAttr::ATTR_LINK_TE_DEF_METRIC, value);
+
+    value.clear(); put8(value, 0); put16(value, 10);
+    putTlv(out, MPLinkStateAttr::ATTR_LINK_IGP_METRIC, value);
+
+    putTlv(out, MPLinkStateAttr::ATTR_LINK_NAME, "et-0/0/1.0");
+}
+
+/**
+ * Append an OPEN capability parameter
+ */
+static void putCapParam(std::string &out, const std::string &caps) {
+    put8(out, 2);
+    put8(out, caps.size());
+    out.append(caps);
+}
+
+/**
+ * Append a multiprotocol capability
+ */
+static void putMpCap(std::string &out, uint16_t afi, uint8_t safi) {
+    put8(out, 1); put8(out, 4); put16(out, afi); put8(out, 0); put8(out, safi);
+}
+
+/**
+ * Build an OPEN message body with the given capability parameters
+ */
+static std::string buildOpen(const std::string &params) {
+    std::string open;
+
+    put8(open, 4);
+    put16(open, 23456);                             // AS_TRANS
+    put16(open, 90);
+    put32(open, 0xC0000201);
+    put8(open, params.size());
+    open.append(params);
+
+    return open;
+}
+
+/*
+ * Decoder runs, one per decoder entry point.  Each run decodes data once, the same way as the
+ * collector (e.g. a new parseBMP per message and a new parsed_update_data per update).
+ */
+static void runBmp(bench_ctx &ctx, std::string &data, bool cached) {
+    MsgBusInterface::obj_bgp_peer p_entry;
+
+    parseBMP *pBMP = new parseBMP(ctx.logger, &p_entry);
+    if (cached)
+        pBMP->setPeerHdrCache(&ctx.hdr_cache);
+
+    if (write(ctx.socks[1], data.data(), data.size()) != (ssize_t)data.size())
+        throw "Failed to write the BMP message to the socket pair";
+
+    pBMP->handleMessage(ctx.socks[0]);
+    pBMP->bufferBMPMessage(ctx.socks[0]);
+
+    delete pBMP;
+}
+
+static void runBmpHeader(bench_ctx &ctx, std::string &data) {
+    runBmp(ctx, data, false);
+}
+
+static void runBmpHeaderCached(bench_ctx &ctx, std::string &data) {
+    runBmp(ctx, data, true);
+}
+
+static void runUpdateAttrs(bench_ctx &ctx, std::string &data) {
+    UpdateMsg::parsed_update_data parsed_data;
+    UpdateMsg uMsg(ctx.logger, BENCH_PEER_ADDR, BENCH_ROUTER_ADDR, &ctx.peer_info);
+
+    uMsg.parseUpdateMsg((u_char *)data.data(), data.size(), parsed_data);
+}
+
+static void runExtCommunity(bench_ctx &ctx, std::string &data) {
+    UpdateMsg::parsed_update_data parsed_data;
+    ExtCommunity ec(ctx.logger, BENCH_PEER_ADDR);
+
+    ec.parseExtCommunities(data.size(), (u_char *)data.data(), parsed_data);
+}
+
+static void runMpReach(bench_ctx &ctx, std::string &data) {
+    UpdateMsg::parsed_update_data parsed_data;
+    MPReachAttr mp(ctx.logger, BENCH_PEER_ADDR, &ctx.peer_info);
+
+    mp.parseReachNlriAttr(data.size(), (u_char *)data.data(), parsed_data);
+}
+
+static void runMpUnReach(bench_ctx &ctx, std::string &data) {
+    UpdateMsg::parsed_update_data parsed_data;
+    MPUnReachAttr mp(ctx.logger, BENCH_PEER_ADDR, &ctx.peer_info);
+
+    mp.parseUnReachNlriAttr(data.size(), (u_char *)data.data(), parsed_data);
+}
+
+static void runLsAttr(bench_ctx &ctx, std::string &data) {
+    UpdateMsg::parsed_update_data parsed_data;
+    MPLinkStateAttr ls(ctx.logger, BENCH_PEER_ADDR, &parsed_data, false);
+
+    ls.parseAttrLinkState(data.size(), (u_char *)data.data());
+}
+
+static void runOpen(bench_ctx &ctx, std::string &data) {
+    std::list<std::string> capabilities;
+    std::string bgp_id;
+    uint32_t asn;
+    uint16_t hold_time;
+    OpenMsg oMsg(ctx.logger, BENCH_PEER_ADDR, &ctx.open_peer_info);
+
+    oMsg.parseOpenMsg((u_char *)data.data(), data.size(), false, asn, hold_time, bgp_id, capabilities);
+}
+
+/**
+ * Build the decoder cases
+ *
+ *      Each decoder has a realistic case (what a typical Internet/DC router sends) and, where
+ *      the input size is unbounded by the protocol, a worst case near the message size limit.
+ *
+ * \param [out] cases       Decoder cases
+ */
+static void buildCases(std::list<bench_case> &cases) {
+    std::string attr, value, data;
+
+    /*
+     * BMP common and per-peer header, route monitoring with a small update
+     */
+    {
+        std::string update, body, bgp;
+
+        put8(attr, 0x40); put8(attr, 1); put8(attr, 1); put8(attr, 0);                 // ORIGIN
+        update = buildAttrUpdate(attr);
+        put8(update, 24); put8(update, 203); put8(update, 0); put8(update, 113);       // 203.0.113.0/24
+
+        put8(body, 0); put8(body, 0);                                                   // Global, IPv4
+        body.append(8, '\0');                                                           // RD
+        body.append(12, '\0');
+        put32(body, 0xC0000201);
+        put32(body, 65001);
+        put32(body, 0xC0000201);
+        put32(body, 1500000000); put32(body, 0);
+
+        body.append(16, (char)0xFF);
+        put16(body, 19 + update.size());
+        put8(body, 2);
+        body.append(update);
+
+        put8(data, 3); put32(data, 6 + body.size()); put8(data, parseBMP::TYPE_ROUTE_MON);
+        data.append(body);
+
+        cases.push_back({ "bmp_header", data, runBmpHeader });
+        cases.push_back({ "bmp_header_cached", data, runBmpHeaderCached });
+    }
+
+    /*
+     * AS_PATH - typical 4-octet path and the longest path that fits a 4096 byte update
+     */
+    value.clear();
+    put8(value, 2); put8(value, 5);
+    put32(value, 65001); put32(value, 3356); put32(value, 1299); put32(value, 174); put32(value, 64512);
+    attr.clear(); putAttr(attr, 0x40, ATTR_TYPE_AS_PATH, value);
+    cases.push_back({ "as_path", buildAttrUpdate(attr), runUpdateAttrs });
+
+    value.clear();
+    for (int seg = 0; seg < 3; seg++) {
+        put8(value, 2); put8(value, 255);
+        for (int i = 0; i < 255; i++)
+            put32(value, 4200000000U + seg * 255 + i);
+    }
+    put8(value, 1); put8(value, 100);                                                   // AS_SET
+    for (int i = 0; i < 100; i++)
+        put32(value, 64512 + i);
+    attr.clear(); putAttr(attr, 0x40, ATTR_TYPE_AS_PATH, value);
+    cases.push_back({ "as_path_max", buildAttrUpdate(attr), runUpdateAttrs });
+
+    /*
+     * COMMUNITIES - a few tags and a 4096 byte update worth
+     */
+    value.clear();
+    for (int i = 0; i < 8; i++)
+        put32(value, (65001U << 16) | (100 + i));
+    attr.clear(); putAttr(attr, 0xC0, ATTR_TYPE_COMMUNITIES, value);
+    cases.push_back({ "communities", buildAttrUpdate(attr), runUpdateAttrs });
+
+    value.clear();
+    for (int i = 0; i < 1000; i++)
+        put32(value, (65001U << 16) | i);
+    attr.clear(); putAttr(attr, 0xC0, ATTR_TYPE_COMMUNITIES, value);
+    cases.push_back({ "communities_max", buildAttrUpdate(attr), runUpdateAttrs });
+
+    /*
+     * Extended communities - route targets and a mix of all decoded types
+     */
+    data.clear();
+    for (int i = 0; i < 4; i++) {
+        put8(data, 0x00); put8(data, 0x02); put16(data, 65001); put32(data, 100 + i);  // RT 2-octet AS
+    }
+    cases.push_back({ "ext_communities", data, runExtCommunity });
+
+    data.clear();
+    for (int i = 0; i < 100; i++) {
+        put8(data, 0x00); put8(data, 0x02); put16(data, 65001); put32(data, i);        // RT 2-octet AS
+        put8(data, 0x01); put8(data, 0x02); put32(data, 0xC0000201); put16(data, i);   // RT IPv4
+        put8(data, 0x02); put8(data, 0x02); put32(data, 4200000000U); put16(data, i);  // RT 4-octet AS
+        put8(data, 0x03); put8(data, 0x0b); put16(data, 0); put32(data, i);            // Color
+        put8(data, 0x06); put8(data, 0x00); put8(data, 0); put8(data, 0); put32(data, i);  // MAC mobility
+    }
+    cases.push_back({ "ext_communities_max", data, runExtCommunity });
+
+    /*
+     * MP_REACH/MP_UNREACH - IPv6 unicast, VPNv4 and IPv4 host withdrawals
+     */
+    data.clear();
+    put16(data, 2); put8(data, 1);
+    put8(data, 16); put32(data, 0x20010db8); put32(data, 0); put32(data, 0); put32(data, 1);
+    put8(data, 0);
+    for (int i = 0; i < 100; i++) {
+        put8(data, 48); put32(data, 0x20010db8); put16(data, i);
+    }
+    cases.push_back({ "mp_reach_ipv6", data, runMpReach });
+
+    data.clear();
+    put16(data, 1); put8(data, 128);
+    put8(data, 12); data.append(8, '\0'); put32(data, 0xC0000201);
+    put8(data, 0);
+    for (int i = 0; i < 100; i++) {
+        put8(data, 24 + 64 + 24);
+        put8(data, 0x03); put8(data, 0xE8); put8(data, 0x01);                          // Label 16000, BoS
+        put16(data, 0); put16(data, 65001); put32(data, 100);                           // RD 65001:100
+        put8(data, 10); put8(data, i); put8(data, 0);
+    }
+    cases.push_back({ "mp_reach_vpnv4", data, runMpReach });
+
+    data.clear();
+    put16(data, 2); put8(data, 1);
+    for (int i = 0; i < 100; i++) {
+        put8(data, 64); put32(data, 0x20010db8); put32(data, i);
+    }
+    cases.push_back({ "mp_unreach_ipv6", data, runMpUnReach });
+
+    data.clear();
+    put16(data, 1); put8(data, 1);
+    for (int i = 0; i < 800; i++) {
+        put8(data, 32); put32(data, 0x0A000000 + i);
+    }
+    cases.push_back({ "mp_unreach_ipv4_max", data, runMpUnReach });
+
+    /*
+     * EVPN - MAC/IP advertisement routes
+     */
+    data.clear();
+    put16(data, bgp::BGP_AFI_L2VPN); put8(data, bgp::BGP_SAFI_EVPN);
+    put8(data, 4); put32(data, 0xC0000201);
+    put8(data, 0);
+    for (int i = 0; i < 50; i++) {
+        put8(data, 2); put8(data, 37);
+        put16(data, 0); put16(data, 65001); put32(data, 100);                           // RD
+        data.append(10, '\0');                                                          // ESI
+        put32(data, 0);                                                                 // Ethernet tag
+        put8(data, 48); put16(data, 0x0050); put32(data, 0x56000000 + i);              // MAC
+        put8(data, 32); put32(data, 0x0A000000 + i);                                    // IP
+        put8(data, 0x03); put8(data, 0xE8); put8(data, 0x01);                          // Label
+    }
+    cases.push_back({ "evpn", data, runMpReach });
+
+    /*
+     * BGP-LS NLRI - node and link NLRI of an IS-IS level 2 topology
+     */
+    data.clear();
+    put16(data, bgp::BGP_AFI_BGPLS); put8(data, bgp::BGP_SAFI_BGPLS);
+    put8(data, 4); put32(data, 0xC0000201);
+    put8(data, 0);
+    for (int i = 0; i < 20; i++) {
+        std::string nlri;
+
+        put8(nlri, 2); put32(nlri, 0); put32(nlri, 0);                                 // IS-IS L2, ID
+        putLsNodeDescr(nlri, MPLinkState::NODE_DESCR_LOCAL_DESCR, i);
+        putTlv(data, MPLinkState::NLRI_TYPE_NODE, nlri);
+
+        nlri.clear();
+        put8(nlri, 2); put32(nlri, 0); put32(nlri, 0);
+        putLsNodeDescr(nlri, MPLinkState::NODE_DESCR_LOCAL_DESCR, i);
+        putLsNodeDescr(nlri, MPLinkState::NODE_DESCR_REMOTE_DESCR, i + 1);
+        value.clear(); put32(value, 0x0A000000 + i * 2);
+        putTlv(nlri, MPLinkState::LINK_DESCR_IPV4_INTF_ADDR, value);
+        value.clear(); put32(value, 0x0A000000 + i * 2 + 1);
+        putTlv(nlri, MPLinkState::LINK_DESCR_IPV4_NEI_ADDR, value);
+        putTlv(data, MPLinkState::NLRI_TYPE_LINK, nlri);
+    }
+    cases.push_back({ "ls_nlri", data, runMpReach });
+
+    /*
+     * BGP-LS attribute - one link and a maximum size attribute set
+     */
+    data.clear();
+    putLsLinkAttrs(data, 1);
+    cases.push_back({ "ls_attr", data, runLsAttr });
+
+    data.clear();
+    for (int i = 0; data.size() < 65000; i++)
+        putLsLinkAttrs(data, i);
+    cases.push_back({ "ls_attr_max", data, runLsAttr });
+
+    /*
+     * OPEN capabilities - typical PE and the maximum parameter length filled with MP capabilities
+     */
+    {
+        std::string caps, params;
+
+        putMpCap(caps, bgp::BGP_AFI_IPV4, bgp::BGP_SAFI_UNICAST);
+        putMpCap(caps, bgp::BGP_AFI_IPV6, bgp::BGP_SAFI_UNICAST);
+        putMpCap(caps, bgp::BGP_AFI_IPV4, bgp::BGP_SAFI_MPLS);
+        putMpCap(caps, bgp::BGP_AFI_L2VPN, bgp::BGP_SAFI_EVPN);
+        put8(caps, 2); put8(caps, 0);                                                   // Route refresh
+        put8(caps, 64); put8(caps, 2); put16(caps, 120);                                // Graceful restart
+        put8(caps, 65); put8(caps, 4); put32(caps, 65001);                              // 4-octet ASN
+        put8(caps, 69); put8(caps, 4); put16(caps, 1); put8(caps, 1); put8(caps, 1);   // Add-path receive
+        putCapParam(params, caps);
+        cases.push_back({ "open_capabilities", buildOpen(params), runOpen });
+
+        params.clear();
+        for (int i = 0; i < 31; i++) {
+            caps.clear();
+            putMpCap(caps, i % 2 ? bgp::BGP_AFI_IPV6 : bgp::BGP_AFI_IPV4, bgp::BGP_SAFI_UNICAST);
+            putCapParam(params, caps);
+        }
+        cases.push_back({ "open_capabilities_max", buildOpen(params), runOpen });
+    }
+}
+
+/**
+ * Get the number of allocations counted by stage accounting
+ */
+static uint64_t countedAllocs() {
+    uint64_t allocs = 0;
+
+    for (int i = StageStats::STAGE_NONE + 1; i < StageStats::STAGE_MAX; i++)
+        allocs += Metrics::get(std::string("stage.") + StageStats::name(i) + ".allocs").load();
+
+    return allocs;
+}
+
+/**
+ * Run the decoder microbenchmarks
+ *
+ * \param [in] logger       Logger pointer
+ * \param [in] min_ms       Minimum run time of each case in milliseconds
+ * \param [in] filter       Only run cases with names containing filter, NULL for all
+ *
+ * \return exit code, zero on success
+ */
+int runDecoderBenchmark(Logger *logger, uint32_t min_ms, const char *filter) {
+    bench_ctx ctx;
+    std::list<bench_case> cases;
+
+    ctx.logger = logger;
+    ctx.peer_info.sent_four_octet_asn = ctx.peer_info.recv_four_octet_asn = true;
+    ctx.peer_info.using_2_octet_asn = false;
+    ctx.peer_info.endOfRIB = false;
+    ctx.open_peer_info = ctx.peer_info;
+    bzero(&ctx.hdr_cache, sizeof(ctx.hdr_cache));
+
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, ctx.socks)) {
+        printf("ERROR: Failed to create the socket pair: %s\n", strerror(errno));
+        return 1;
+    }
+
+    buildCases(cases);
+    StageStats::enable();
+
+    printf("%-24s %8s %12s %10s %10s %12s\n", "decoder", "bytes", "iterations", "ns/op", "MB/s", "allocs/op");
+
+    try {
+        for (std::list<bench_case>::iterator it = cases.begin(); it != cases.end(); ++it) {
+            if (filter != NULL and strstr(it->name, filter) == NULL)
+                continue;
+
+            // Timed run without stage accounting, doubling the iterations until the minimum time is reached
+            StageStats::enabled = false;
+
+            uint64_t iters = 1;
+            uint64_t elapsed_ns;
+
+            for (;;) {
+                std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+                for (uint64_t i = 0; i < iters; i++)
+                    it->run(ctx, it->data);
+
+                elapsed_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                        std::chrono::steady_clock::now() - start).count();
+
+                if (elapsed_ns >= (uint64_t)min_ms * 1000000ULL)
+                    break;
+
+                iters *= 2;
+            }
+
+            // Allocation run, charged to the BGP parse stage by the outer scope
+            StageStats::enabled = true;
+            uint64_t allocs = countedAllocs();
+
+            {
+                StageStats::Scope stage(StageStats::STAGE_BGP_PARSE);
+
+                for (int i = 0; i < BENCHMARK_DECODER_ALLOC_ITERS; i++)
+                    it->run(ctx, it->data);
+            }
+
+            allocs = countedAllocs() - allocs;
+
+            double ns_op = (double)elapsed_ns / iters;
+
+            printf("%-24s %8zu %12" PRIu64 " %10.1f %10.1f %12.1f\n", it->name, it->data.size(), iters, ns_op,
+                   it->data.size() * 1000.0 / ns_op, (double)allocs / BENCHMARK_DECODER_ALLOC_ITERS);
+        }
+
+    } catch (char const *str) {
+        printf("ERROR: %s\n", str);
+        close(ctx.socks[0]);
+        close(ctx.socks[1]);
+        return 1;
+    }
+
+    close(ctx.socks[0]);
+    close(ctx.socks[1]);
+
+    return 0;
+}
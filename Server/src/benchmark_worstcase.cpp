@@ -0,0 +1,313 @@
+/*
+ * Copyright (c) 2013-2016 Cisco Systems, Inc. and others.  All rights reserved.
+ *
+ * This program and the accompanying materials are made available under the
+ * terms of the Eclipse Public License v1.0 which accompanies this distribution,
+ * and is available at http://www.eclipse.org/legal/epl-v10.html
+ *
+ */
+
+#include <chrono>
+#include <cinttypes>
+#include <cstdio>
+#include <cstring>
+#include <string>
+
+#include "benchmark.h"
+#include "BMPReader.h"
+#include "parseBGP.h"
+#include "MsgBusImpl_kafka.h"
+#include "MPLinkState.h"
+
+using namespace bgp_msg;
+
+#define WORST_PEER_ADDR     0xC0000201              // 192.0.2.1
+#define WORST_PEER_AS       65001
+
+/**
+ * Message bus that serializes all records but discards them instead of producing
+ */
+class DiscardBus : public msgBus_kafka {
+public:
+    uint64_t    bytes;                              ///< Bytes serialized, without the message headers
+
+    DiscardBus(Logger *logPtr, Config *cfg, u_char *c_hash_id)
+            : msgBus_kafka(logPtr, cfg, c_hash_id), bytes(0) {
+    }
+
+protected:
+    void produce(const char *topic_var, char *msg, size_t msg_size, int rows,
+                 std::string key, const std::string *peer_group, uint32_t peer_asn) {
+        bytes += msg_size;
+    }
+};
+
+/**
+ * Worst case
+ */
+struct worst_case {
+    const char  *name;
+    uint32_t    count;                              ///< Element count of the small size, large is BENCHMARK_WORST_SIZE_FACTOR times
+    void        (*build)(uint32_t count, std::string &msg);     ///< Builds the BGP UPDATE (with header) for a count
+};
+
+/**
+ * Append the base path attributes (ORIGIN, short AS_PATH and NEXT_HOP)
+ */
+static void putBaseAttrs(std::string &attrs) {
+    std::string value;
+
+    value.clear(); put8(value, 0);
+    putAttr(attrs, 0x40, ATTR_TYPE_ORIGIN, value);
+
+    value.clear(); put8(value, 2); put8(value, 2); put32(value, WORST_PEER_AS); put32(value, 64512);
+    putAttr(attrs, 0x40, ATTR_TYPE_AS_PATH, value);
+
+    value.clear(); put32(value, WORST_PEER_ADDR);
+    putAttr(attrs, 0x40, ATTR_TYPE_NEXT_HOP, value);
+}
+
+/**
+ * Append an UPDATE message
+ */
+static void putUpdate(std::string &msg, const std::string &withdrawn, const std::string &attrs, const std::string &nlri) {
+    std::string update;
+
+    put16(update, withdrawn.size());
+    update.append(withdrawn);
+    put16(update, attrs.size());
+    update.append(attrs);
+    update.append(nlri);
+
+    putBgpMsg(msg, 2, update);
+}
+
+/*
+ * Worst case builders
+ */
+static void buildAsPathSets(uint32_t count, std::string &msg) {
+    std::string attrs, value, nlri;
+
+    // Alternate full AS_SEQUENCE and AS_SET segments
+    for (uint32_t i = 0, seg = 0; i < count; seg++) {
+        uint32_t seg_len = count - i > 255 ? 255 : count - i;
+
+        put8(value, seg % 2 ? 1 : 2);
+        put8(value, seg_len);
+
+        for (uint32_t n = 0; n < seg_len; n++, i++)
+            put32(value, 4200000000U + i);
+    }
+
+    put8(attrs, 0x40); put8(attrs, 1); put8(attrs, 1); put8(attrs, 0);
+    putAttr(attrs, 0x40, ATTR_TYPE_AS_PATH, value);
+    value.clear(); put32(value, WORST_PEER_ADDR);
+    putAttr(attrs, 0x40, ATTR_TYPE_NEXT_HOP, value);
+
+    put8(nlri, 24); put8(nlri, 203); put8(nlri, 0); put8(nlri, 113);
+    putUpdate(msg, "", attrs, nlri);
+}
+
+static void buildHostWithdrawals(uint32_t count, std::string &msg) {
+    std::string withdrawn;
+
+    for (uint32_t i = 0; i < count; i++) {
+        put8(withdrawn, 32); put32(withdrawn, 0x0A000000 + i);
+    }
+
+    putUpdate(msg, withdrawn, "", "");
+}
+
+static void buildExtCommunities(uint32_t count, std::string &msg) {
+    std::string attrs, value, nlri;
+
+    putBaseAttrs(attrs);
+
+    for (uint32_t i = 0; i < count; i++) {
+        put8(value, 0x00); put8(value, 0x02); put16(value, WORST_PEER_AS); put32(value, i);   // RT 2-octet AS
+    }
+    putAttr(attrs, 0xC0, ATTR_TYPE_EXT_COMMUNITY, value);
+
+    put8(nlri, 24); put8(nlri, 203); put8(nlri, 0); put8(nlri, 113);
+    putUpdate(msg, "", attrs, nlri);
+}
+
+static void buildLsAttrs(uint32_t count, std::string &msg) {
+    std::string attrs, value, nlri;
+
+    putBaseAttrs(attrs);
+
+    // MP_REACH with one IS-IS link
+    put16(value, bgp::BGP_AFI_BGPLS); put8(value, bgp::BGP_SAFI_BGPLS);
+    put8(value, 4); put32(value, WORST_PEER_ADDR);
+    put8(value, 0);
+
+    put8(nlri, 2); put32(nlri, 0); put32(nlri, 0);
+    putLsNodeDescr(nlri, MPLinkState::NODE_DESCR_LOCAL_DESCR, 1);
+    putLsNodeDescr(nlri, MPLinkState::NODE_DESCR_REMOTE_DESCR, 2);
+    putTlv(value, MPLinkState::NLRI_TYPE_LINK, nlri);
+    putAttr(attrs, 0x80, ATTR_TYPE_MP_REACH_NLRI, value);
+
+    value.clear();
+    for (uint32_t i = 0; i < count; i++)
+        putLsLinkAttrs(value, i);
+    putAttr(attrs, 0x80, ATTR_TYPE_BGP_LS, value);
+
+    putUpdate(msg, "", attrs, "");
+}
+
+static void buildExtendedNlri(uint32_t count, std::string &msg) {
+    std::string attrs, nlri;
+
+    putBaseAttrs(attrs);
+
+    for (uint32_t i = 0; i < count; i++) {
+        put8(nlri, 24); put8(nlri, 10 + (i >> 16)); put8(nlri, i >> 8); put8(nlri, i);
+    }
+
+    putUpdate(msg, "", attrs, nlri);
+}
+
+/*
+ * Worst cases, the large size must fit BGP_MAX_MSG_SIZE (RFC8654 extended messages)
+ */
+static const worst_case cases[] = {
+        { "as_path_sets",           125,    buildAsPathSets },          // 1000 ASNs at the large size
+        { "withdrawn_host_routes",  100,    buildHostWithdrawals },     // 4096 byte UPDATE at the large size
+        { "ext_communities",        60,     buildExtCommunities },
+        { "bgp_ls_attrs",           75,     buildLsAttrs },
+        { "extended_msg_nlri",      1600,   buildExtendedNlri },        // ~51KB UPDATE at the large size
+        { NULL, 0, NULL }
+};
+
+/**
+ * Run an UPDATE through parseBGP and the serializers, the same way as the BMP reader
+ */
+static void handleUpdate(Logger *logger, DiscardBus *mbus, MsgBusInterface::obj_bgp_peer &peer,
+                         BMPReader::peer_info &p_info, std::string &msg) {
+    parseBGP *pBGP = new parseBGP(logger, mbus, &peer, "192.0.2.254", &p_info);
+
+    if (pBGP->handleUpdate((u_char *)msg.data(), msg.size())) {
+        delete pBGP;
+        throw "Failed to parse the worst case update";
+    }
+
+    delete pBGP;
+}
+
+/**
+ * Time an UPDATE through parseBGP and the serializers
+ *
+ * \param [in] logger   Logger pointer
+ * \param [in] mbus     Message bus
+ * \param [in] peer     Peer entry
+ * \param [in] p_info   Peer info
+ * \param [in] msg      BGP UPDATE message
+ * \param [in] min_ms   Minimum run time in milliseconds
+ *
+ * \return nanoseconds per UPDATE
+ */
+static double timeUpdate(Logger *logger, DiscardBus *mbus, MsgBusInterface::obj_bgp_peer &peer,
+                         BMPReader::peer_info &p_info, std::string &msg, uint32_t min_ms) {
+    uint64_t iters = 1;
+    uint64_t elapsed_ns;
+
+    for (;;) {
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+        for (uint64_t i = 0; i < iters; i++)
+            handleUpdate(logger, mbus, peer, p_info, msg);
+
+        elapsed_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now() - start).count();
+
+        if (elapsed_ns >= (uint64_t)min_ms * 1000000ULL)
+            break;
+
+        iters *= 2;
+    }
+
+    return (double)elapsed_ns / iters;
+}
+
+/**
+ * Run the worst case (pathological input) benchmark
+ *
+ * \param [in] cfg          Reference to the loaded configuration, collector hash must be set
+ * \param [in] logger       Logger pointer
+ * \param [in] min_ms       Minimum run time of each case size in milliseconds
+ *
+ * \return exit code, zero if all cases are within the bound
+ */
+int runWorstCaseBenchmark(Config &cfg, Logger *logger, uint32_t min_ms) {
+    MsgBusInterface::obj_bgp_peer peer;
+    BMPReader::peer_info p_info;
+    int failed = 0;
+
+    bzero(&peer, sizeof(peer));
+    snprintf(peer.peer_addr, sizeof(peer.peer_addr), "192.0.2.1");
+    snprintf(peer.peer_bgp_id, sizeof(peer.peer_bgp_id), "192.0.2.1");
+    peer.peer_as = WORST_PEER_AS;
+    peer.isIPv4 = true;
+    memset(peer.hash_id, 0x11, sizeof(peer.hash_id));
+    memset(peer.router_hash_id, 0x22, sizeof(peer.router_hash_id));
+
+    p_info.sent_four_octet_asn = p_info.recv_four_octet_asn = true;
+    p_info.using_2_octet_asn = false;
+    p_info.endOfRIB = false;
+
+    // Records are never produced, the mock cluster only avoids connecting to the configured brokers
+    if (cfg.kafka_mock_brokers == 0)
+        cfg.kafka_mock_brokers = 1;
+
+    DiscardBus *mbus = NULL;
+
+    try {
+        mbus = new DiscardBus(logger, &cfg, cfg.c_hash_id);
+
+        printf("%-24s %8s %10s %8s %10s %12s %8s\n", "case", "bytes", "ns/byte", "bytes", "ns/byte",
+               "out/update", "scaling");
+
+        for (int c = 0; cases[c].name != NULL; c++) {
+            std::string small_msg, large_msg;
+
+            cases[c].build(cases[c].count, small_msg);
+            cases[c].build(cases[c].count * BENCHMARK_WORST_SIZE_FACTOR, large_msg);
+
+            if (large_msg.size() > BGP_MAX_MSG_SIZE)
+                throw "Worst case update is larger than the max BGP message size";
+
+            double small_ns = timeUpdate(logger, mbus, peer, p_info, small_msg, min_ms) / small_msg.size();
+            double large_ns = timeUpdate(logger, mbus, peer, p_info, large_msg, min_ms) / large_msg.size();
+
+            // Serialized bytes of one large update
+            mbus->bytes = 0;
+            handleUpdate(logger, mbus, peer, p_info, large_msg);
+
+            // Time per byte should be flat, quadratic work grows it with the size factor
+            double scaling = large_ns / small_ns;
+            bool ok = scaling <= BENCHMARK_WORST_MAX_SCALING;
+
+            if (not ok)
+                ++failed;
+
+            printf("%-24s %8zu %10.2f %8zu %10.2f %12" PRIu64 " %7.2fx %s\n", cases[c].name,
+                   small_msg.size(), small_ns, large_msg.size(), large_ns,
+                   mbus->bytes, scaling, ok ? "" : "FAIL");
+        }
+
+    } catch (char const *str) {
+        printf("ERROR: %s\n", str);
+        delete mbus;
+        return 1;
+    }
+
+    delete mbus;
+
+    if (failed) {
+        printf("%d case(s) exceeded the %.1fx time per byte bound\n", failed, BENCHMARK_WORST_MAX_SCALING);
+        return 1;
+    }
+
+    return 0;
+}
@@ -1,3 +1,5 @@
+#include <iomanip>
+
 #include "EVPN.h"
 
 namespace bgp_msg {
@@ -48,7 +50,7 @@ namespace bgp_msg {
         switch (type) {
             case 0: {
                 for (int i = 0; i < 9; i++) {
-                    result << std::hex << setfill('0') << setw(2) << (int) data_pointer[i];
+                    result << std::hex << std::setfill('0') << std::setw(2) << (int) data_pointer[i];
                 }
                 break;
             }
@@ -151,93 +153,15 @@ namespace bgp_msg {
      * \details
      *      Will parse the Route Distinguisher. Based on https://tools.ietf.org/html/rfc4364#section-4.2
      *
-     * \param [in/out]  data_pointer  Pointer to the beginning of Route Distinguisher
-     * \param [out]     rd_type                    Reference to RD type.
-     * \param [out]     rd_assigned_number         Reference to Assigned Number subfield
-     * \param [out]     rd_administrator_subfield  Reference to Administrator subfield
+     *      The RD is kept in binary form and only printed when serialized, see bgp::rdToStr()
+     *
+     * \param [in]      data_pointer  Pointer to the beginning of Route Distinguisher
+     * \param [out]     rd            Reference to the route distinguisher
      */
-    void EVPN::parseRouteDistinguisher(u_char *data_pointer, uint8_t *rd_type, std::string *rd_assigned_number,
-                                       std::string *rd_administrator_subfield) {
-        std::stringstream   val_ss;
-
-        data_pointer++;
-        *rd_type = *data_pointer;
-        data_pointer++;
-
-        switch (*rd_type) {
-            case 0: {
-                uint16_t administration_subfield;
-                bzero(&administration_subfield, 2);
-                memcpy(&administration_subfield, data_pointer, 2);
-
-                data_pointer += 2;
-
-                uint32_t assigned_number_subfield;
-                bzero(&assigned_number_subfield, 4);
-                memcpy(&assigned_number_subfield, data_pointer, 4);
-
-                bgp::SWAP_BYTES(&administration_subfield);
-                bgp::SWAP_BYTES(&assigned_number_subfield);
-
-                val_ss << assigned_number_subfield;
-
-                *rd_assigned_number = val_ss.str();
-
-                val_ss.str(std::string());
-                val_ss << administration_subfield;
-                *rd_administrator_subfield = val_ss.str();
-
-                break;
-            };
-
-            case 1: {
-                u_char administration_subfield[4];
-                bzero(&administration_subfield, 4);
-                memcpy(&administration_subfield, data_pointer, 4);
-
-                data_pointer += 4;
-
-                uint16_t assigned_number_subfield;
-                bzero(&assigned_number_subfield, 2);
-                memcpy(&assigned_number_subfield, data_pointer, 2);
-
-                bgp::SWAP_BYTES(&assigned_number_subfield);
-
-                char administration_subfield_chars[INET_ADDRSTRLEN];
-                inet_ntop(AF_INET, administration_subfield, administration_subfield_chars, INET_ADDRSTRLEN);
-
-                val_ss << assigned_number_subfield;
-                *rd_assigned_number = val_ss.str();
-
-                *rd_administrator_subfield = administration_subfield_chars;
-
-                break;
-            };
-
-            case 2: {
-                uint32_t administration_subfield;
-                bzero(&administration_subfield, 4);
-                memcpy(&administration_subfield, data_pointer, 4);
-
-                data_pointer += 4;
-
-                uint16_t assigned_number_subfield;
-                bzero(&assigned_number_subfield, 2);
-                memcpy(&assigned_number_subfield, data_pointer, 2);
-
-                bgp::SWAP_BYTES(&administration_subfield);
-                bgp::SWAP_BYTES(&assigned_number_subfield);
-
-                val_ss << assigned_number_subfield;
-                *rd_assigned_number = val_ss.str();
-
-                val_ss.str(std::string());
-                val_ss << administration_subfield;
-                *rd_administrator_subfield = val_ss.str();
-
-                break;
-            };
-        }
+    void EVPN::parseRouteDistinguisher(u_char *data_pointer, bgp::route_distinguisher *rd) {
+        // Only the low order octet of the two octet type is used
+        rd->type = data_pointer[1];
+        memcpy(rd->value, data_pointer + 2, sizeof(rd->value));
     }
 
     // TODO: Refactor this method as it's overloaded - each case statement can be its own method
@@ -265,6 +189,7 @@ namespace bgp_msg {
             //Cleanup variables in case of not modified
             tuple.mpls_label_1 = 0;
             tuple.mpls_label_2 = 0;
+            tuple.labels.count = 0;
             tuple.mac_len = 0;
             tuple.ip_len = 0;
 
@@ -279,12 +204,7 @@ namespace bgp_msg {
             int len = *data_pointer;
             data_pointer++;
 
-            parseRouteDistinguisher(
-                    data_pointer,
-                    &tuple.rd_type,
-                    &tuple.rd_assigned_number,
-                    &tuple.rd_administrator_subfield
-            );
+            parseRouteDistinguisher(data_pointer, &tuple.rd);
             data_pointer += 8;
 
             data_read += 10;
@@ -309,7 +229,7 @@ namespace bgp_msg {
                         std::stringstream ethernet_tag_id_stream;
 
                         for (int i = 0; i < 4; i++) {
-                            ethernet_tag_id_stream << std::hex << setfill('0') << setw(2) << (int) ethernet_id[i];
+                            ethernet_tag_id_stream << std::hex << std::setfill('0') << std::setw(2) << (int) ethernet_id[i];
                         }
 
                         tuple.ethernet_tag_id_hex = ethernet_tag_id_stream.str();
@@ -343,7 +263,7 @@ namespace bgp_msg {
                         std::stringstream ethernet_tag_id_stream;
 
                         for (int i = 0; i < 4; i++) {
-                            ethernet_tag_id_stream << std::hex << setfill('0') << setw(2) << (int) ethernet_id[i];
+                            ethernet_tag_id_stream << std::hex << std::setfill('0') << std::setw(2) << (int) ethernet_id[i];
                         }
 
                         tuple.ethernet_tag_id_hex = ethernet_tag_id_stream.str();
@@ -421,7 +341,7 @@ namespace bgp_msg {
                         std::stringstream ethernet_tag_id_stream;
 
                         for (int i = 0; i < 4; i++) {
-                            ethernet_tag_id_stream << std::hex << setfill('0') << setw(2) << (int) ethernet_id[i];
+                            ethernet_tag_id_stream << std::hex << std::setfill('0') << std::setw(2) << (int) ethernet_id[i];
                         }
 
                         tuple.ethernet_tag_id_hex = ethernet_tag_id_stream.str();
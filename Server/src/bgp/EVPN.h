@@ -57,13 +57,12 @@ namespace bgp_msg {
          * \details
          *      Will parse the Route Distinguisher. Based on https://tools.ietf.org/html/rfc4364#section-4.2
          *
-         * \param [in/out]  data_pointer  Pointer to the beginning of Route Distinguisher
-         * \param [out]     rd_type                    Reference to RD type.
-         * \param [out]     rd_assigned_number         Reference to Assigned Number subfield
-         * \param [out]     rd_administrator_subfield  Reference to Administrator subfield
+         *      The RD is kept in binary form and only printed when serialized, see bgp::rdToStr()
+         *
+         * \param [in]      data_pointer  Pointer to the beginning of Route Distinguisher
+         * \param [out]     rd            Reference to the route distinguisher
          */
-        static void parseRouteDistinguisher(u_char *data_pointer, uint8_t *rd_type, std::string *rd_assigned_number,
-                                       std::string *rd_administrator_subfield);
+        static void parseRouteDistinguisher(u_char *data_pointer, bgp::route_distinguisher *rd);
 
         /**
          * Parse all EVPN nlri's
@@ -0,0 +1,162 @@
+/*
+ * Copyright (c) 2013-2016 Cisco Systems, Inc. and others.  All rights reserved.
+ *
+ * This program and the accompanying materials are made available under the
+ * terms of the Eclipse Public License v1.0 which accompanies this distribution,
+ * and is available at http://www.eclipse.org/legal/epl-v10.html
+ *
+ */
+#include "FilterEngine.h"
+#include "Config.h"
+
+/**
+ * Constructor for class
+ *
+ * \param [in] logPtr   Pointer to Logger instance
+ * \param [in] cfg      Pointer to the config instance
+ */
+FilterEngine::FilterEngine(Logger *logPtr, Config *cfg) : v4(32), v6(128) {
+    logger = logPtr;
+
+    default_drop = cfg->filter_default_drop;
+    default_hits = &Metrics::get("filter.default.hits");
+
+    drop_mask = any_asn_mask = any_prefix_mask = any_route_mask = 0;
+    for (int i = 0; i < 8; i++)
+        afi_safi_masks[i] = 0;
+
+    for (std::list<Config::filter_rule>::iterator it = cfg->filter_rules.begin();
+            it != cfg->filter_rules.end() and rules.size() < FILTER_MAX_RULES; ++it) {
+        uint64_t bit = 1ULL << rules.size();
+
+        rule r;
+        r.name = it->name;
+        r.drop = it->drop;
+        r.hits = &Metrics::get("filter.rule." + it->name + ".hits");
+        rules.push_back(r);
+
+        if (it->drop)
+            drop_mask |= bit;
+
+        if (it->peer_asn.size() == 0)
+            any_asn_mask |= bit;
+        else {
+            for (std::list<uint32_t>::iterator a_it = it->peer_asn.begin(); a_it != it->peer_asn.end(); ++a_it)
+                asn_masks[*a_it] |= bit;
+        }
+
+        for (int i = 0; i < 8; i++) {
+            if (it->afi_safi == 0 or it->afi_safi & (1 << i))
+                afi_safi_masks[i] |= bit;
+        }
+
+        if (it->prefixes.size() == 0) {
+            any_prefix_mask |= bit;
+
+            if (it->afi_safi == 0)
+                any_route_mask |= bit;
+
+        } else {
+            for (std::list<Config::match_type_ip>::iterator p_it = it->prefixes.begin();
+                    p_it != it->prefixes.end(); ++p_it) {
+
+                if (p_it->isIPv4)
+                    v4.insert((u_char *)p_it->prefix, p_it->bits) |= bit;
+                else
+                    v6.insert((u_char *)p_it->prefix, p_it->bits) |= bit;
+            }
+        }
+    }
+
+    inheritCovering(v4);
+    inheritCovering(v6);
+
+    LOG_INFO("Ingest filter: %zu rules, %zu IPv4 and %zu IPv6 prefix ranges, default %s",
+             rules.size(), v4.size(), v6.size(), default_drop ? "drop" : "accept");
+}
+
+/**
+ * Add the rules of the covering ranges to each range
+ *
+ *      The walk is in prefix order, so covering ranges are updated before the ranges they cover.
+ *
+ * \param [in] trie     Prefix ranges
+ */
+void FilterEngine::inheritCovering(PrefixTrie<uint64_t> &trie) {
+    trie.walk([&trie](const u_char *addr, int len, uint64_t &value) -> bool {
+        if (len > 0) {
+            uint64_t *covering = trie.longestMatch(addr, len - 1);
+            if (covering != NULL)
+                value |= *covering;
+        }
+        return true;
+    });
+}
+
+/**
+ * Get the rules that can match routes of a peer
+ *
+ * \param [in] peer_asn     Peer ASN
+ *
+ * \return Rule mask to pass to dropsAll()/accept()
+ */
+uint64_t FilterEngine::peerRules(uint32_t peer_asn) {
+    std::unordered_map<uint32_t, uint64_t>::const_iterator it = asn_masks.find(peer_asn);
+
+    return it != asn_masks.end() ? any_asn_mask | it->second : any_asn_mask;
+}
+
+/**
+ * Check if all routes are dropped regardless of prefix and AFI/SAFI
+ *
+ * \param [in] peer_rules   Rules from peerRules()
+ *
+ * \return true if all routes of the peer are dropped
+ */
+bool FilterEngine::dropsAll(uint64_t peer_rules) const {
+    uint64_t any = peer_rules & any_route_mask;
+
+    // Rules after the first rule matching every route of the peer are never used
+    uint64_t used = any ? peer_rules & ((any & -any) | ((any & -any) - 1)) : peer_rules;
+
+    if (used & ~drop_mask)
+        return false;
+
+    return any ? true : default_drop;
+}
+
+/**
+ * Check if a route is accepted, counts the hit of the matching rule
+ *
+ * \param [in] peer_rules   Rules from peerRules()
+ * \param [in] afi_safi     Config::filter_afi_safi bit of the route
+ * \param [in] prefix       Prefix (binary, network byte order), NULL if the route has no prefix
+ * \param [in] prefix_len   Prefix length in bits
+ * \param [in] isIPv4       True if the prefix is IPv4
+ *
+ * \return true if accepted, false if dropped
+ */
+bool FilterEngine::accept(uint64_t peer_rules, uint32_t afi_safi, const u_char *prefix, int prefix_len,
+                          bool isIPv4) {
+    uint64_t match = peer_rules & afi_safi_masks[__builtin_ctz(afi_safi) & 7];
+    uint64_t prefix_rules = any_prefix_mask;
+
+    if (prefix != NULL and (match & ~any_prefix_mask)) {
+        uint64_t *ranges = isIPv4 ? v4.longestMatch(prefix, prefix_len) : v6.longestMatch(prefix, prefix_len);
+
+        if (ranges != NULL)
+            prefix_rules |= *ranges;
+    }
+
+    match &= prefix_rules;
+
+    if (match == 0) {
+        default_hits->fetch_add(1, std::memory_order_relaxed);
+        return not default_drop;
+    }
+
+    rule &r = rules[__builtin_ctzll(match)];
+    r.hits->fetch_add(1, std::memory_order_relaxed);
+
+    return not r.drop;
+}
@@ -0,0 +1,115 @@
+/*
+ * Copyright (c) 2013-2016 Cisco Systems, Inc. and others.  All rights reserved.
+ *
+ * This program and the accompanying materials are made available under the
+ * terms of the Eclipse Public License v1.0 which accompanies this distribution,
+ * and is available at http://www.eclipse.org/legal/epl-v10.html
+ *
+ */
+#ifndef FILTERENGINE_H_
+#define FILTERENGINE_H_
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "Logger.h"
+#include "Metrics.h"
+#include "PrefixTrie.hpp"
+
+class Config;
+
+/**
+ * \class   FilterEngine
+ *
+ * \brief   Ingest route filter compiled from the filter configuration
+ * \details
+ *      Decides if a route is accepted or dropped before it's sent to the message bus.
+ *      Rules (Config::filter_rules) match on prefix range, AFI/SAFI and peer ASN and are
+ *      evaluated in order, the first matching rule decides.
+ *
+ *      Rules are compiled to bit masks (one bit per rule): the rules a peer ASN can match,
+ *      the rules per AFI/SAFI and, per prefix range, the rules whose ranges cover it (stored
+ *      in an IPv4 and an IPv6 PrefixTrie).  A route is then matched with a longest match
+ *      lookup and a few mask operations.
+ *
+ *      The engine is read only once built and shared by all router threads.
+ */
+class FilterEngine {
+public:
+    /**
+     * Constructor for class
+     *
+     * \param [in] logPtr   Pointer to Logger instance
+     * \param [in] cfg      Pointer to the config instance
+     */
+    FilterEngine(Logger *logPtr, Config *cfg);
+
+    /**
+     * Get the rules that can match routes of a peer
+     *
+     * \param [in] peer_asn     Peer ASN
+     *
+     * \return Rule mask to pass to dropsAll()/accept()
+     */
+    uint64_t peerRules(uint32_t peer_asn);
+
+    /**
+     * Check if all routes are dropped regardless of prefix and AFI/SAFI
+     *
+     * \param [in] peer_rules   Rules from peerRules()
+     *
+     * \return true if all routes of the peer are dropped
+     */
+    bool dropsAll(uint64_t peer_rules) const;
+
+    /**
+     * Check if a route is accepted, counts the hit of the matching rule
+     *
+     * \param [in] peer_rules   Rules from peerRules()
+     * \param [in] afi_safi     Config::filter_afi_safi bit of the route
+     * \param [in] prefix       Prefix (binary, network byte order), NULL if the route has no prefix
+     * \param [in] prefix_len   Prefix length in bits
+     * \param [in] isIPv4       True if the prefix is IPv4
+     *
+     * \return true if accepted, false if dropped
+     */
+    bool accept(uint64_t peer_rules, uint32_t afi_safi, const u_char *prefix, int prefix_len, bool isIPv4);
+
+private:
+    /**
+     * Compiled rule
+     */
+    struct rule {
+        std::string         name;
+        bool                drop;
+        Metrics::Counter    *hits;              ///< Routes matched by the rule
+    };
+
+    Logger                  *logger;            ///< Logging class pointer
+
+    std::vector<rule>       rules;              ///< Rules in evaluation order, bit N of the masks is rules[N]
+    bool                    default_drop;       ///< Drop routes that don't match a rule
+    Metrics::Counter        *default_hits;      ///< Routes that didn't match a rule
+
+    uint64_t                drop_mask;          ///< Drop rules
+    uint64_t                any_asn_mask;       ///< Rules without a peer ASN list
+    uint64_t                any_prefix_mask;    ///< Rules without prefix ranges
+    uint64_t                any_route_mask;     ///< Rules without prefix ranges and AFI/SAFI (peer only rules)
+    uint64_t                afi_safi_masks[8];  ///< Rules by AFI/SAFI bit number
+
+    std::unordered_map<uint32_t, uint64_t> asn_masks;  ///< Rules by peer ASN
+
+    PrefixTrie<uint64_t>    v4;                 ///< Rules by IPv4 prefix range, including covering ranges
+    PrefixTrie<uint64_t>    v6;                 ///< Rules by IPv6 prefix range, including covering ranges
+
+    /**
+     * Add the rules of the covering ranges to each range
+     *
+     * \param [in] trie     Prefix ranges
+     */
+    static void inheritCovering(PrefixTrie<uint64_t> &trie);
+};
+
+#endif /* FILTERENGINE_H_ */
@@ -9,7 +9,6 @@
 
 #include "MPReachAttr.h"
 #include "MPLinkState.h"
-#include "BMPReader.h"
 #include "EVPN.h"
 #include <typeinfo>
 
@@ -27,7 +26,7 @@ namespace bgp_msg {
  * \param [in]     peer_info                Persistent Peer info pointer
  * \param [in]     enable_debug             Debug true to enable, false to disable
  */
-MPReachAttr::MPReachAttr(Logger *logPtr, std::string peerAddr, BMPReader::peer_info *peer_info, bool enable_debug)
+MPReachAttr::MPReachAttr(Logger *logPtr, std::string peerAddr, bgp::peer_info *peer_info, bool enable_debug)
     : debug{enable_debug}, logger{logPtr}, peer_info{peer_info} {
         this->peer_addr = peerAddr;
 }
@@ -240,7 +239,7 @@ void MPReachAttr::parseAfi_IPv4IPv6(bool isIPv4, mp_reach_nlri &nlri, UpdateMsg:
  * \param [out]  prefixes               Reference to a list<prefix_tuple> to be updated with entries
  */
 void MPReachAttr::parseNlriData_IPv4IPv6(bool isIPv4, u_char *data, uint16_t len,
-                                         BMPReader::peer_info * peer_info,
+                                         bgp::peer_info * peer_info,
                                          std::list<bgp::prefix_tuple> &prefixes) {
     u_char            ip_raw[16];
     char              ip_char[40];
@@ -253,6 +252,7 @@ void MPReachAttr::parseNlriData_IPv4IPv6(bool isIPv4, u_char *data, uint16_t len
     // TODO: Can extend this to support multicast, but right now we set it to unicast v4/v6
     tuple.type = isIPv4 ? bgp::PREFIX_UNICAST_V4 : bgp::PREFIX_UNICAST_V6;
     tuple.isIPv4 = isIPv4;
+    tuple.labels.count = 0;
 
     bool add_path_enabled = peer_info->add_path_capability.isAddPathEnabled(isIPv4 ? bgp::BGP_AFI_IPV4 : bgp::BGP_AFI_IPV6,
                                                                             bgp::BGP_SAFI_UNICAST);
@@ -310,7 +310,7 @@ void MPReachAttr::parseNlriData_IPv4IPv6(bool isIPv4, u_char *data, uint16_t len
  */
 template <typename PREFIX_TUPLE>
 void MPReachAttr::parseNlriData_LabelIPv4IPv6(bool isIPv4, u_char *data, uint16_t len,
-                                              BMPReader::peer_info * peer_info,
+                                              bgp::peer_info * peer_info,
                                               std::list<PREFIX_TUPLE> &prefixes) {
     u_char            ip_raw[16];
     char              ip_char[40];
@@ -362,8 +362,7 @@ void MPReachAttr::parseNlriData_LabelIPv4IPv6(bool isIPv4, u_char *data, uint16_
         // Parse RD if VPN
         if (isVPN and addr_bytes >= 8) {
             bgp::vpn_tuple *vtuple = (bgp::vpn_tuple *)&tuple;
-            EVPN::parseRouteDistinguisher(data, &vtuple->rd_type, &vtuple->rd_assigned_number,
-                                          &vtuple->rd_administrator_subfield);
+            EVPN::parseRouteDistinguisher(data, &vtuple->rd);
             data += 8;
             addr_bytes -= 8;
             read_size += 8;
@@ -396,16 +395,16 @@ void MPReachAttr::parseNlriData_LabelIPv4IPv6(bool isIPv4, u_char *data, uint16_
  * Decode label from NLRI data
  *
  * \details
- *      Decodes the labels from the NLRI data into labels string
+ *      Decodes the labels from the NLRI data into the binary label stack
  *
  * \param [in]   data                   Pointer to the start of the label + prefixes to be parsed
  * \param [in]   len                    Length of the data in bytes to be read
- * \param [out]  labels                 Reference to string that will be updated with labels delimited by comma
+ * \param [out]  labels                 Reference to label stack that will be updated with the labels
  *
- * \returns number of bytes read to decode the label(s) and updates string labels
+ * \returns number of bytes read to decode the label(s) and updates labels
  *
  */
-inline uint16_t MPReachAttr::decodeLabel(u_char *data, uint16_t len, std::string &labels) {
+inline uint16_t MPReachAttr::decodeLabel(u_char *data, uint16_t len, bgp::label_stack &labels) {
     int read_size = 0;
     typedef union {
         struct {
@@ -419,7 +418,7 @@ inline uint16_t MPReachAttr::decodeLabel(u_char *data, uint16_t len, std::string
 
     mpls_label label;
 
-    labels.clear();
+    labels.count = 0;
 
     u_char *data_ptr = data;
 
@@ -434,17 +433,14 @@ inline uint16_t MPReachAttr::decodeLabel(u_char *data, uint16_t len, std::string
         data_ptr += 3;
         read_size += 3;
 
-        ostringstream convert;
-        convert << label.decode.value;
-        labels.append(convert.str());
+        // Labels beyond the max are consumed but not kept
+        if (labels.count < BGP_MAX_LABELS)
+            labels.value[labels.count++] = label.decode.value;
 
         //printf("label data = %x\n", label.data);
         if (label.decode.bos == 1 or label.data == 0x80000000 /* withdrawn label as 32bits instead of 24 */
                 or label.data == 0 /* l3vpn seems to use zero instead of rfc3107 suggested value */) {
             break;               // Reached EoS
-
-        } else {
-            labels.append(",");
         }
     }
 
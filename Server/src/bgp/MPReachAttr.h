@@ -51,7 +51,7 @@ public:
      * \param [in]     peer_info                Persistent Peer info pointer
      * \param [in]     enable_debug             Debug true to enable, false to disable
      */
-    MPReachAttr(Logger *logPtr, std::string peerAddr, BMPReader::peer_info *peer_info, bool enable_debug=false);
+    MPReachAttr(Logger *logPtr, std::string peerAddr, bgp::peer_info *peer_info, bool enable_debug=false);
 
     virtual ~MPReachAttr();
 
@@ -82,7 +82,7 @@ public:
      * \param [out]  prefixes                   Reference to a list<prefix_tuple> to be updated with entries
      */
     static void parseNlriData_IPv4IPv6(bool isIPv4, u_char *data, uint16_t len,
-                                       BMPReader::peer_info *peer_info,
+                                       bgp::peer_info *peer_info,
                                        std::list<bgp::prefix_tuple> &prefixes);
 
     /**
@@ -99,29 +99,29 @@ public:
      */
     template <typename PREFIX_TUPLE>
     static void parseNlriData_LabelIPv4IPv6(bool isIPv4, u_char *data, uint16_t len,
-                                            BMPReader::peer_info *peer_info,
+                                            bgp::peer_info *peer_info,
                                             std::list<PREFIX_TUPLE> &prefixes);
 
     /**
      * Decode label from NLRI data
      *
      * \details
-     *      Decodes the labels from the NLRI data into labels string
+     *      Decodes the labels from the NLRI data into the binary label stack
      *
      * \param [in]   data                   Pointer to the start of the label + prefixes to be parsed
      * \param [in]   len                    Length of the data in bytes to be read
-     * \param [out]  labels                 Reference to string that will be updated with labels delimited by comma
+     * \param [out]  labels                 Reference to label stack that will be updated with the labels
      *
-     * \returns number of bytes read to decode the label(s) and updates string labels
+     * \returns number of bytes read to decode the label(s) and updates labels
      *
      */
-    static inline uint16_t decodeLabel(u_char *data, uint16_t len, std::string &labels);
+    static inline uint16_t decodeLabel(u_char *data, uint16_t len, bgp::label_stack &labels);
 
 private:
     bool                    debug;                  ///< debug flag to indicate debugging
     Logger                   *logger;               ///< Logging class pointer
     std::string             peer_addr;              ///< Printed form of the peer address for logging
-    BMPReader::peer_info    *peer_info;
+    bgp::peer_info          *peer_info;
 
     /**
      * MP Reach NLRI parse based on AFI
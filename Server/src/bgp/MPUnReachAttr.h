@@ -16,7 +16,7 @@
 
 #include "AddPathDataContainer.h"
 #include "MPReachAttr.h"
-#include "BMPReader.h"
+#include "PeerInfo.h"
 
 namespace bgp_msg {
 
@@ -50,7 +50,7 @@ public:
      * \param [in]     peer_info                Persistent Peer info pointer
      * \param [in]     enable_debug             Debug true to enable, false to disable
      */
-    MPUnReachAttr(Logger *logPtr, std::string peerAddr, BMPReader::peer_info *peer_info,
+    MPUnReachAttr(Logger *logPtr, std::string peerAddr, bgp::peer_info *peer_info,
                   bool enable_debug=false);
 
     virtual ~MPUnReachAttr();
@@ -73,7 +73,7 @@ private:
     bool                    debug;              ///< debug flag to indicate debugging
     Logger                  *logger;            ///< Logging class pointer
     std::string             peer_addr;          ///< Printed form of the peer address for logging
-    BMPReader::peer_info    *peer_info;         ///< Persistent Peer info pointer
+    bgp::peer_info          *peer_info;         ///< Persistent Peer info pointer
 
     /**
      * MP UnReach NLRI parse based on AFI
@@ -8,7 +8,6 @@
  */
 #include "OpenMsg.h"
 #include "AddPathDataContainer.h"
-#include "BMPReader.h"
 
 #include <string>
 #include <list>
@@ -28,7 +27,7 @@ namespace bgp_msg {
  * \param [in]     peer_info       Persistent peer information
  * \param [in]     enable_debug    Debug true to enable, false to disable
  */
-OpenMsg::OpenMsg(Logger *logPtr, std::string peerAddr, BMPReader::peer_info *peer_info, bool enable_debug) {
+OpenMsg::OpenMsg(Logger *logPtr, std::string peerAddr, bgp::peer_info *peer_info, bool enable_debug) {
         logger = logPtr;
         debug = enable_debug;
         this->peer_info = peer_info;
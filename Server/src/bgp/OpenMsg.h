@@ -14,7 +14,7 @@
 #include "bgp_common.h"
 
 #include <list>
-#include <bmp/BMPReader.h>
+#include "PeerInfo.h"
 #include "AddPathDataContainer.h"
 
 namespace bgp_msg {
@@ -133,7 +133,7 @@ public:
       * \param [in]     peer_info       Persistent peer information
       * \param [in]     enable_debug    Debug true to enable, false to disable
       */
-    OpenMsg(Logger *logPtr, std::string peerAddr, BMPReader::peer_info *peer_info, bool enable_debug=false);
+    OpenMsg(Logger *logPtr, std::string peerAddr, bgp::peer_info *peer_info, bool enable_debug=false);
     virtual ~OpenMsg();
 
     /**
@@ -161,7 +161,7 @@ private:
     bool                    debug;          ///< debug flag to indicate debugging
     Logger                  *logger;        ///< Logging class pointer
     std::string             peer_addr;      ///< Printed form of the peer address for logging
-    BMPReader::peer_info    *peer_info;     ///< Persistent Peer info pointer
+    bgp::peer_info          *peer_info;     ///< Persistent Peer info pointer
 
     /**
      * Parses capabilities from buffer
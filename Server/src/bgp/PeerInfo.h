@@ -0,0 +1,38 @@
+/*
+ * Copyright (c) 2013-2016 Cisco Systems, Inc. and others.  All rights reserved.
+ *
+ * This program and the accompanying materials are made available under the
+ * terms of the Eclipse Public License v1.0 which accompanies this distribution,
+ * and is available at http://www.eclipse.org/legal/epl-v10.html
+ *
+ */
+
+#ifndef PEERINFO_H_
+#define PEERINFO_H_
+
+#include <cstdint>
+#include <string>
+
+#include "AddPathDataContainer.h"
+
+namespace bgp {
+
+/**
+ * Persistent peer information structure
+ *
+ *   OPEN and other updates can add/change persistent peer information.  One entry is kept
+ *   per peer for the life of the peer session and passed to the BGP decoders.
+ */
+struct peer_info {
+    bool sent_four_octet_asn;                               ///< Indicates if 4 (true) or 2 (false) octet ASN is being used (sent cap)
+    bool recv_four_octet_asn;                               ///< Indicates if 4 (true) or 2 (false) octet ASN is being used (recv cap)
+    bool using_2_octet_asn;                                 ///< Indicates if peer is using two octet ASN format or not (true=2 octet, false=4 octet)
+    AddPathDataContainer add_path_capability;               ///< Stores data about Add Path capability
+    std::string peer_group;                                 ///< Peer group name of defined
+    bool endOfRIB;                                          ///< Indicates if End-Of-RIB marker is received
+    int64_t lag_ms;                                         ///< Lag of the last message from the peer, zero when down
+};
+
+} /* namespace bgp */
+
+#endif /* PEERINFO_H_ */
@@ -0,0 +1,327 @@
+/*
+ * Copyright (c) 2013-2016 Cisco Systems, Inc. and others.  All rights reserved.
+ *
+ * This program and the accompanying materials are made available under the
+ * terms of the Eclipse Public License v1.0 which accompanies this distribution,
+ * and is available at http://www.eclipse.org/legal/epl-v10.html
+ *
+ */
+#include <cstring>
+#include <ctime>
+
+#include "PrefixCoalescer.h"
+#include "Metrics.h"
+
+static Metrics::Counter &m_updates  = Metrics::get("coalesce.updates");
+static Metrics::Counter &m_emitted  = Metrics::get("coalesce.emitted");
+static Metrics::Counter &m_bypassed = Metrics::get("coalesce.bypassed");
+static Metrics::Counter &m_pending  = Metrics::get("coalesce.pending");
+
+/**
+ * Current monotonic time in milliseconds
+ */
+static uint64_t nowMs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+bool PrefixCoalescer::prefix_key::operator==(const prefix_key &other) const {
+    return memcmp(this, &other, sizeof(prefix_key)) == 0;
+}
+
+/**
+ * FNV-1a of the key, the peer hash alone is the same for all prefixes of a peer
+ */
+size_t PrefixCoalescer::prefix_key_hasher::operator()(const prefix_key &key) const {
+    const u_char *p = (const u_char *)&key;
+    uint64_t h = 14695981039346656037ULL;
+
+    for (size_t i = 0; i < sizeof(prefix_key); i++) {
+        h ^= p[i];
+        h *= 1099511628211ULL;
+    }
+
+    return (size_t)h;
+}
+
+/**
+ * Constructor for class
+ *
+ * \param [in] logPtr       Pointer to Logger instance
+ * \param [in] window_ms    Coalescing window in milliseconds
+ * \param [in] max_pending  Max prefixes held, updates of new prefixes bypass coalescing when reached
+ */
+PrefixCoalescer::PrefixCoalescer(Logger *logPtr, int window_ms, size_t max_pending) {
+    logger = logPtr;
+    this->max_pending = max_pending;
+
+    if (window_ms < 1)
+        window_ms = 1;
+
+    // Slot 'cur_tick' is always expired, the window can use the other slots
+    tick_ms = (window_ms + COALESCE_WHEEL_SLOTS - 2) / (COALESCE_WHEEL_SLOTS - 1);
+    window_ticks = (window_ms + tick_ms - 1) / tick_ms;
+
+    wheel.resize(COALESCE_WHEEL_SLOTS);
+    cur_tick = nowTick();
+}
+
+/**
+ * Destructor, pending prefixes are dropped; callers should flush() first
+ */
+PrefixCoalescer::~PrefixCoalescer() {
+    m_pending.fetch_sub(table.size(), std::memory_order_relaxed);
+
+    for (size_t i = 0; i < wheel.size(); i++) {
+        for (size_t j = 0; j < wheel[i].size(); j++)
+            delete wheel[i][j];
+    }
+}
+
+uint64_t PrefixCoalescer::nowTick() {
+    return nowMs() / tick_ms;
+}
+
+/**
+ * Add prefix updates, emits any pending prefixes that are due
+ *
+ * \param [in] mbus_ptr     Message bus to emit to
+ * \param [in] peer         Peer the prefixes are from
+ * \param [in] rib          Rib entries
+ * \param [in] attr         Path attributes, NULL for withdrawn
+ * \param [in] withdrawn    True if the prefixes are withdrawn
+ */
+void PrefixCoalescer::add(MsgBusInterface *mbus_ptr, MsgBusInterface::obj_bgp_peer &peer,
+                          std::vector<MsgBusInterface::obj_rib> &rib, MsgBusInterface::obj_path_attr *attr,
+                          bool withdrawn) {
+    expire(mbus_ptr);
+
+    peers[hash_key(peer.hash_id)] = peer;
+
+    std::shared_ptr<MsgBusInterface::obj_path_attr> attr_copy;
+    if (not withdrawn and attr != NULL)
+        attr_copy = std::make_shared<MsgBusInterface::obj_path_attr>(*attr);
+
+    std::vector<MsgBusInterface::obj_rib> bypass;
+    std::vector<pending_prefix *> &slot = wheel[(cur_tick + window_ticks) % COALESCE_WHEEL_SLOTS];
+    size_t added = 0;
+
+    prefix_key key;
+    memset(&key, 0, sizeof(key));
+    memcpy(key.peer_hash, peer.hash_id, sizeof(key.peer_hash));
+
+    for (size_t i = 0; i < rib.size(); i++) {
+        memcpy(key.prefix, rib[i].prefix_bin, sizeof(key.prefix));
+        key.path_id = rib[i].path_id;
+        key.prefix_len = rib[i].prefix_len;
+        key.isIPv4 = rib[i].isIPv4;
+
+        pending_prefix *p;
+        std::unordered_map<prefix_key, pending_prefix *, prefix_key_hasher>::iterator it = table.find(key);
+
+        if (it != table.end()) {
+            p = it->second;
+
+        } else if (table.size() >= max_pending) {
+            // Nothing pending for the prefix, so sending it now keeps the order
+            bypass.push_back(rib[i]);
+            continue;
+
+        } else {
+            p = new pending_prefix();
+            p->key = key;
+            p->done = false;
+            p->updates = 0;
+
+            table[key] = p;
+            slot.push_back(p);
+            ++added;
+        }
+
+        ++p->updates;
+        p->withdrawn = withdrawn;
+        p->timestamp_secs = peer.timestamp_secs;
+        p->timestamp_us = peer.timestamp_us;
+        p->rib = rib[i];
+        p->attr = attr_copy;
+    }
+
+    m_updates.fetch_add(rib.size(), std::memory_order_relaxed);
+    m_pending.fetch_add(added, std::memory_order_relaxed);
+
+    if (bypass.size() > 0) {
+        m_bypassed.fetch_add(bypass.size(), std::memory_order_relaxed);
+        m_emitted.fetch_add(bypass.size(), std::memory_order_relaxed);
+
+        mbus_ptr->update_unicastPrefix(peer, bypass, withdrawn ? NULL : attr,
+                                       withdrawn ? mbus_ptr->UNICAST_PREFIX_ACTION_DEL :
+                                                   mbus_ptr->UNICAST_PREFIX_ACTION_ADD);
+    }
+}
+
+/**
+ * Emit the pending prefixes that are due
+ *
+ * \param [in] mbus_ptr     Message bus to emit to
+ */
+void PrefixCoalescer::expire(MsgBusInterface *mbus_ptr) {
+    uint64_t now = nowTick();
+
+    if (now <= cur_tick)
+        return;
+
+    uint64_t ticks = now - cur_tick;
+    if (ticks > COALESCE_WHEEL_SLOTS)
+        ticks = COALESCE_WHEEL_SLOTS;
+
+    std::vector<pending_prefix *> due;
+
+    for (uint64_t t = cur_tick + 1; t <= cur_tick + ticks; t++) {
+        std::vector<pending_prefix *> &slot = wheel[t % COALESCE_WHEEL_SLOTS];
+
+        due.insert(due.end(), slot.begin(), slot.end());
+        slot.clear();
+    }
+
+    cur_tick = now;
+
+    emit(mbus_ptr, due);
+
+    for (size_t i = 0; i < due.size(); i++)
+        delete due[i];
+}
+
+/**
+ * Emit all pending prefixes of a peer
+ *
+ * \param [in] mbus_ptr     Message bus to emit to
+ * \param [in] peer_hash    Peer hash_id
+ */
+void PrefixCoalescer::flushPeer(MsgBusInterface *mbus_ptr, const u_char *peer_hash) {
+    std::vector<pending_prefix *> list;
+
+    // Wheel order is the order the prefixes were received
+    for (uint64_t t = cur_tick + 1; t <= cur_tick + COALESCE_WHEEL_SLOTS; t++) {
+        std::vector<pending_prefix *> &slot = wheel[t % COALESCE_WHEEL_SLOTS];
+
+        for (size_t i = 0; i < slot.size(); i++) {
+            if (not slot[i]->done and memcmp(slot[i]->key.peer_hash, peer_hash, sizeof(slot[i]->key.peer_hash)) == 0)
+                list.push_back(slot[i]);
+        }
+    }
+
+    // Entries stay in their slot marked done and are freed when the slot expires
+    emit(mbus_ptr, list);
+
+    peers.erase(hash_key(peer_hash));
+}
+
+/**
+ * Emit all pending prefixes
+ *
+ * \param [in] mbus_ptr     Message bus to emit to
+ */
+void PrefixCoalescer::flush(MsgBusInterface *mbus_ptr) {
+    std::vector<pending_prefix *> list;
+
+    for (uint64_t t = cur_tick + 1; t <= cur_tick + COALESCE_WHEEL_SLOTS; t++) {
+        std::vector<pending_prefix *> &slot = wheel[t % COALESCE_WHEEL_SLOTS];
+
+        list.insert(list.end(), slot.begin(), slot.end());
+        slot.clear();
+    }
+
+    emit(mbus_ptr, list);
+
+    for (size_t i = 0; i < list.size(); i++)
+        delete list[i];
+
+    peers.clear();
+}
+
+/**
+ * Time until the next pending prefixes are due
+ *
+ * \return milliseconds, -1 if nothing is pending
+ */
+int PrefixCoalescer::msUntilNextExpiry() {
+    if (table.size() == 0)
+        return -1;
+
+    uint64_t now = nowMs();
+
+    for (uint64_t t = cur_tick + 1; t <= cur_tick + COALESCE_WHEEL_SLOTS; t++) {
+        if (wheel[t % COALESCE_WHEEL_SLOTS].size() > 0)
+            return t * tick_ms > now ? (int)(t * tick_ms - now) : 0;
+    }
+
+    return 0;
+}
+
+/**
+ * Emit pending prefixes, consecutive prefixes with the same peer, attributes and time are sent together
+ *
+ *      Entries are removed from the table and marked done; entries already done are skipped.
+ *
+ * \param [in] mbus_ptr     Message bus to emit to
+ * \param [in] list         Pending prefixes to emit
+ */
+void PrefixCoalescer::emit(MsgBusInterface *mbus_ptr, std::vector<pending_prefix *> &list) {
+    std::vector<MsgBusInterface::obj_rib> rib;
+    const pending_prefix *first = NULL;
+    size_t emitted = 0;
+
+    for (size_t i = 0; i < list.size(); i++) {
+        pending_prefix *p = list[i];
+
+        if (p->done)
+            continue;
+
+        if (first != NULL and (p->attr != first->attr or p->withdrawn != first->withdrawn or
+                               p->timestamp_secs != first->timestamp_secs or
+                               p->timestamp_us != first->timestamp_us or
+                               memcmp(p->key.peer_hash, first->key.peer_hash, sizeof(p->key.peer_hash)) != 0)) {
+            send(mbus_ptr, first, rib);
+            rib.clear();
+        }
+
+        if (rib.size() == 0)
+            first = p;
+
+        p->rib.flap_count = p->updates;
+        rib.push_back(p->rib);
+
+        p->done = true;
+        table.erase(p->key);
+        ++emitted;
+    }
+
+    if (rib.size() > 0)
+        send(mbus_ptr, first, rib);
+
+    m_pending.fetch_sub(emitted, std::memory_order_relaxed);
+}
+
+/**
+ * Send a batch of rib entries to the message bus
+ */
+void PrefixCoalescer::send(MsgBusInterface *mbus_ptr, const pending_prefix *first,
+                           std::vector<MsgBusInterface::obj_rib> &rib) {
+    std::map<hash_key, MsgBusInterface::obj_bgp_peer>::iterator it = peers.find(hash_key(first->key.peer_hash));
+    if (it == peers.end()) {
+        LOG_WARN("Dropping %zu coalesced prefixes of an unknown peer", rib.size());
+        return;
+    }
+
+    MsgBusInterface::obj_bgp_peer peer = it->second;
+    peer.timestamp_secs = first->timestamp_secs;
+    peer.timestamp_us = first->timestamp_us;
+
+    m_emitted.fetch_add(rib.size(), std::memory_order_relaxed);
+
+    mbus_ptr->update_unicastPrefix(peer, rib, first->withdrawn ? NULL : first->attr.get(),
+                                   first->withdrawn ? mbus_ptr->UNICAST_PREFIX_ACTION_DEL :
+                                                      mbus_ptr->UNICAST_PREFIX_ACTION_ADD);
+}
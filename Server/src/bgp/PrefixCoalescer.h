@@ -0,0 +1,163 @@
+/*
+ * Copyright (c) 2013-2016 Cisco Systems, Inc. and others.  All rights reserved.
+ *
+ * This program and the accompanying materials are made available under the
+ * terms of the Eclipse Public License v1.0 which accompanies this distribution,
+ * and is available at http://www.eclipse.org/legal/epl-v10.html
+ *
+ */
+#ifndef PREFIXCOALESCER_H_
+#define PREFIXCOALESCER_H_
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+#include "MsgBusInterface.hpp"
+#include "Logger.h"
+#include "HashKey.h"
+
+#define COALESCE_WHEEL_SLOTS        256         // Number of timer wheel slots covering the window
+
+/**
+ * \class   PrefixCoalescer
+ *
+ * \brief   Per (peer, prefix) flap coalescing of unicast prefix updates
+ * \details
+ *      Holds unicast prefix advertisements and withdrawals for a short window and only
+ *      forwards the net final state of each (peer, prefix, path id) to the message bus,
+ *      with the number of updates received in the window as the flap count.
+ *
+ *      Pending prefixes are kept in a hash table keyed by the binary prefix and expire
+ *      from a timer wheel; a prefix is emitted one window after its first change, later
+ *      changes in the window replace its state but do not delay it.
+ *
+ *      One instance is used per router connection (BMP reader thread), it is not thread safe.
+ */
+class PrefixCoalescer {
+public:
+    /**
+     * Constructor for class
+     *
+     * \param [in] logPtr       Pointer to Logger instance
+     * \param [in] window_ms    Coalescing window in milliseconds
+     * \param [in] max_pending  Max prefixes held, updates of new prefixes bypass coalescing when reached
+     */
+    PrefixCoalescer(Logger *logPtr, int window_ms, size_t max_pending);
+    ~PrefixCoalescer();
+
+    /**
+     * Add prefix updates, emits any pending prefixes that are due
+     *
+     * \param [in] mbus_ptr     Message bus to emit to
+     * \param [in] peer         Peer the prefixes are from
+     * \param [in] rib          Rib entries
+     * \param [in] attr         Path attributes, NULL for withdrawn
+     * \param [in] withdrawn    True if the prefixes are withdrawn
+     */
+    void add(MsgBusInterface *mbus_ptr, MsgBusInterface::obj_bgp_peer &peer,
+             std::vector<MsgBusInterface::obj_rib> &rib, MsgBusInterface::obj_path_attr *attr, bool withdrawn);
+
+    /**
+     * Emit the pending prefixes that are due
+     *
+     * \param [in] mbus_ptr     Message bus to emit to
+     */
+    void expire(MsgBusInterface *mbus_ptr);
+
+    /**
+     * Emit all pending prefixes of a peer
+     *
+     * \param [in] mbus_ptr     Message bus to emit to
+     * \param [in] peer_hash    Peer hash_id
+     */
+    void flushPeer(MsgBusInterface *mbus_ptr, const u_char *peer_hash);
+
+    /**
+     * Emit all pending prefixes
+     *
+     * \param [in] mbus_ptr     Message bus to emit to
+     */
+    void flush(MsgBusInterface *mbus_ptr);
+
+    /**
+     * Number of pending prefixes
+     */
+    size_t pending() const {
+        return table.size();
+    }
+
+    /**
+     * Time until the next pending prefixes are due
+     *
+     * \return milliseconds, -1 if nothing is pending
+     */
+    int msUntilNextExpiry();
+
+private:
+    /**
+     * Pending prefix key
+     */
+    struct prefix_key {
+        u_char      peer_hash[16];              ///< Peer hash_id
+        u_char      prefix[16];                 ///< Prefix (binary, network byte order)
+        uint32_t    path_id;                    ///< Add path ID
+        u_char      prefix_len;
+        u_char      isIPv4;
+
+        bool operator==(const prefix_key &other) const;
+    };
+
+    struct prefix_key_hasher {
+        size_t operator()(const prefix_key &key) const;
+    };
+
+    /**
+     * Pending prefix state
+     */
+    struct pending_prefix {
+        prefix_key  key;
+        bool        done;                       ///< Already emitted by a flush, free when its slot expires
+        bool        withdrawn;                  ///< Final state is withdrawn
+        uint32_t    updates;                    ///< Number of updates received in the window
+        uint32_t    timestamp_secs;             ///< Time of the last update
+        uint32_t    timestamp_us;
+        MsgBusInterface::obj_rib rib;           ///< Last rib entry
+        std::shared_ptr<MsgBusInterface::obj_path_attr> attr;  ///< Last path attributes, NULL if withdrawn
+    };
+
+    Logger          *logger;                    ///< Logging class pointer
+    uint64_t        tick_ms;                    ///< Time covered by a wheel slot
+    uint64_t        window_ticks;               ///< Window in wheel slots
+    size_t          max_pending;                ///< Max pending prefixes
+
+    uint64_t        cur_tick;                   ///< Last expired tick
+    std::vector<std::vector<pending_prefix *>> wheel;      ///< Timer wheel, pending prefixes by expiry tick
+
+    std::unordered_map<prefix_key, pending_prefix *, prefix_key_hasher> table;     ///< Pending prefixes
+    std::map<hash_key, MsgBusInterface::obj_bgp_peer> peers;   ///< Last peer object by peer hash_id
+
+    /**
+     * Current time in ticks
+     */
+    uint64_t nowTick();
+
+    /**
+     * Emit pending prefixes, consecutive prefixes with the same peer, attributes and time are sent together
+     *
+     *      Entries are removed from the table and marked done; entries already done are skipped.
+     *
+     * \param [in] mbus_ptr     Message bus to emit to
+     * \param [in] list         Pending prefixes to emit
+     */
+    void emit(MsgBusInterface *mbus_ptr, std::vector<pending_prefix *> &list);
+
+    /**
+     * Send a batch of rib entries to the message bus
+     */
+    void send(MsgBusInterface *mbus_ptr, const pending_prefix *first, std::vector<MsgBusInterface::obj_rib> &rib);
+};
+
+#endif /* PREFIXCOALESCER_H_ */
@@ -18,6 +18,8 @@
 #include "MPReachAttr.h"
 #include "MPUnReachAttr.h"
 #include "MPLinkStateAttr.h"
+#include "StageStats.h"
+#include "Metrics.h"
 
 namespace bgp_msg {
 
@@ -32,11 +34,12 @@ namespace bgp_msg {
  * \param [in,out] peer_info   Persistent peer information
  * \param [in]     enable_debug     Debug true to enable, false to disable
  */
-UpdateMsg::UpdateMsg(Logger *logPtr, std::string peerAddr, std::string routerAddr, BMPReader::peer_info *peer_info,
+UpdateMsg::UpdateMsg(Logger *logPtr, std::string peerAddr, std::string routerAddr, bgp::peer_info *peer_info,
                      bool enable_debug)
         : debug(enable_debug),
           logger(logPtr),
-          peer_info(peer_info) {
+          peer_info(peer_info),
+          skip_attrs(0) {
 
     this->peer_addr = peerAddr;
     this->router_addr = routerAddr;
@@ -52,6 +55,16 @@ UpdateMsg::UpdateMsg(Logger *logPtr, std::string peerAddr, std::string routerAdd
 UpdateMsg::~UpdateMsg() {
 }
 
+/**
+ * Set the path attributes to skip
+ *
+ * \param [in]   skip_attrs     Attribute types to skip, bit N is type N
+ */
+void UpdateMsg::setSkipAttrs(uint64_t skip_attrs) {
+    this->skip_attrs = skip_attrs &
+            ~((1ULL << ATTR_TYPE_MP_REACH_NLRI) | (1ULL << ATTR_TYPE_MP_UNREACH_NLRI) | (1ULL << ATTR_TYPE_BGP_LS));
+}
+
 /**
  * Parses the update message
  *
@@ -184,6 +197,7 @@ void UpdateMsg::parseNlriData_v4(u_char *data, uint16_t len, std::list<bgp::pref
     // Set the type for all to be unicast V4
     tuple.type = bgp::PREFIX_UNICAST_V4;
     tuple.isIPv4 = true;
+    tuple.labels.count = 0;
 
     // Loop through all prefixes
     for (size_t read_size=0; read_size < len; read_size++) {
@@ -246,6 +260,8 @@ void UpdateMsg::parseNlriData_v4(u_char *data, uint16_t len, std::list<bgp::pref
  * \param [out]  parsed_data    Reference to parsed_update_data; will be updated with all parsed data
  */
 void UpdateMsg::parseAttributes(u_char *data, uint16_t len, parsed_update_data &parsed_data) {
+    StageStats::Scope stage(StageStats::STAGE_ATTR_DECODE);
+
     /*
      * Per RFC4271 Section 4.3, flat indicates if the length is 1 or 2 octets
      */
@@ -326,6 +342,13 @@ void UpdateMsg::parseAttrData(u_char attr_type, uint16_t attr_len, u_char *data,
     uint32_t    value32bit;
     uint16_t    value16bit;
 
+    // Attributes that don't feed any projected column or the base attribute hash are not decoded
+    if (attr_type < 64 and (skip_attrs >> attr_type) & 1) {
+        static Metrics::Counter &m_skipped = Metrics::get("bgp.attrs_skipped");
+        m_skipped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
     /*
      * Parse based on attribute type
      */
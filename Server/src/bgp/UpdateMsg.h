@@ -19,7 +19,7 @@
 #include <list>
 #include <array>
 #include <map>
-#include <bmp/BMPReader.h>
+#include "PeerInfo.h"
 
 namespace bgp_msg {
 /**
@@ -159,7 +159,7 @@ public:
      * \param [in,out] peer_info   Persistent peer information
      * \param [in]     enable_debug Debug true to enable, false to disable
      */
-     UpdateMsg(Logger *logPtr, std::string peerAddr, std::string routerAddr, BMPReader::peer_info *peer_info,
+     UpdateMsg(Logger *logPtr, std::string peerAddr, std::string routerAddr, bgp::peer_info *peer_info,
                 bool enable_debug=false);
      virtual ~UpdateMsg();
 
@@ -178,6 +178,17 @@ public:
       */
      size_t parseUpdateMsg(u_char *data, size_t size, parsed_update_data &parsed_data);
 
+     /**
+      * Set the path attributes to skip
+      *
+      * \details
+      *      Skipped attributes are not decoded, as if they were not in the update.  MP_REACH,
+      *      MP_UNREACH and BGP-LS attributes carry NLRI and are always decoded.
+      *
+      * \param [in]   skip_attrs     Attribute types to skip, bit N is type N
+      */
+     void setSkipAttrs(uint64_t skip_attrs);
+
 
 private:
     bool                    debug;                           ///< debug flag to indicate debugging
@@ -185,7 +196,8 @@ private:
     std::string             peer_addr;                       ///< Printed form of the peer address for logging
     std::string             router_addr;                     ///< Router IP address - used for logging
     bool                    four_octet_asn;                  ///< Indicates true if 4 octets or false if 2
-    BMPReader::peer_info    *peer_info;                      ///< Persistent Peer info pointer
+    bgp::peer_info          *peer_info;                      ///< Persistent Peer info pointer
+    uint64_t                skip_attrs;                      ///< Attribute types not decoded, bit N is type N
 
 
     /**
@@ -15,7 +15,9 @@
 #include <sstream>
 #include <cinttypes>
 #include <cstring>
+#include <cstdio>
 #include <sys/types.h>
+#include <arpa/inet.h>
 
 namespace bgp {
     #define BGP_MAX_MSG_SIZE        65535                   // Max payload size - Larger than RFC4271 of 4096
@@ -24,6 +26,9 @@ namespace bgp {
     #define BGP_VERSION             4
     #define BGP_CAP_PARAM_TYPE      2
     #define BGP_AS_TRANS            23456                   // BGP ASN when AS exceeds 16bits
+    #define BGP_MAX_LABELS          8                       // Max MPLS labels kept per NLRI, extra labels are skipped
+    #define BGP_LABELS_STRLEN       (BGP_MAX_LABELS * 8)    // Printed label stack size, 7 digits and delimiter per label
+    #define BGP_RD_SUBFIELD_STRLEN  16                      // Printed RD subfield size, fits an IPv4 address or uint32
 
 
     /**
@@ -109,6 +114,22 @@ namespace bgp {
                 // Add BGP-LS types
     };
 
+    /**
+     * MPLS label stack in binary form, printed only when serialized (see labelsToStr())
+     */
+    struct label_stack {
+        uint8_t       count;                ///< Number of labels, zero if the NLRI is not labeled
+        uint32_t      value[BGP_MAX_LABELS];///< 20 bit label values, top of stack first
+    };
+
+    /**
+     * Route distinguisher in binary form, printed only when serialized (see rdToStr())
+     */
+    struct route_distinguisher {
+        uint8_t       type;                 ///< RD type, RFC4364 Section 4.2
+        u_char        value[6];             ///< Administrator and assigned number subfields in network order
+    };
+
     /**
       * struct is used for nlri prefixes
       */
@@ -124,16 +145,14 @@ namespace bgp {
         uint32_t      path_id;              ///< Path ID (add path draft-ietf-idr-add-paths-15)
         bool          isIPv4;               ///< True if IPv4, false if IPv6
 
-        std::string   labels;               ///< Labels in the format of label, label, ...
+        label_stack   labels;               ///< MPLS labels, count is zero if not labeled
     };
 
     /**
     * Struct for Route Distinguisher
     */
     struct rd_tuple {
-        std::string    rd_administrator_subfield;
-        std::string    rd_assigned_number;
-        uint8_t        rd_type;
+        route_distinguisher rd;
     };
      
     /**
@@ -302,6 +321,62 @@ namespace bgp {
         return safi_string;
     }
 
+    /**
+     * Print a label stack in the format of label,label,...
+     *
+     * \param [in]  labels     Label stack
+     * \param [out] buf        Buffer for the printed labels, BGP_LABELS_STRLEN fits a full stack
+     * \param [in]  len        Size of buf
+     *
+     * \return length of the printed labels
+     */
+    inline size_t labelsToStr(const label_stack &labels, char *buf, size_t len) {
+        size_t buf_len = 0;
+
+        buf[0] = 0;
+
+        for (int i = 0; i < labels.count and buf_len < len; i++)
+            buf_len += snprintf(buf + buf_len, len - buf_len, i ? ",%" PRIu32 : "%" PRIu32, labels.value[i]);
+
+        return buf_len < len ? buf_len : len - 1;
+    }
+
+    /**
+     * Print the subfields of a route distinguisher
+     *
+     * \details Types 0 and 2 print the administrator as a number, type 1 as an IPv4 address.
+     *          Unknown types print empty subfields.
+     *
+     * \param [in]  rd         Route distinguisher
+     * \param [out] admin      Administrator subfield, BGP_RD_SUBFIELD_STRLEN in size
+     * \param [out] assigned   Assigned number subfield, BGP_RD_SUBFIELD_STRLEN in size
+     */
+    inline void rdToStr(const route_distinguisher &rd, char *admin, char *assigned) {
+        const u_char *v = rd.value;
+
+        admin[0] = 0;
+        assigned[0] = 0;
+
+        switch (rd.type) {
+            case 0:
+                snprintf(admin, BGP_RD_SUBFIELD_STRLEN, "%u", (unsigned)(v[0] << 8 | v[1]));
+                snprintf(assigned, BGP_RD_SUBFIELD_STRLEN, "%" PRIu32,
+                         (uint32_t)v[2] << 24 | (uint32_t)v[3] << 16 | (uint32_t)v[4] << 8 | v[5]);
+                break;
+
+            case 1:
+                inet_ntop(AF_INET, v, admin, BGP_RD_SUBFIELD_STRLEN);
+                snprintf(assigned, BGP_RD_SUBFIELD_STRLEN, "%u", (unsigned)(v[4] << 8 | v[5]));
+                break;
+
+            case 2:
+                snprintf(admin, BGP_RD_SUBFIELD_STRLEN, "%" PRIu32,
+                         (uint32_t)v[0] << 24 | (uint32_t)v[1] << 16 | (uint32_t)v[2] << 8 | v[3]);
+                snprintf(assigned, BGP_RD_SUBFIELD_STRLEN, "%u", (unsigned)(v[4] << 8 | v[5]));
+                break;
+        }
+    }
+
 }
 
 #endif /* BGPCOMMON_H */
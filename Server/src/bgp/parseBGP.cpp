@@ -25,10 +25,14 @@
 #include <algorithm>
 
 #include "MsgBusInterface.hpp"
+#include "Config.h"
 #include "NotificationMsg.h"
 #include "OpenMsg.h"
 #include "UpdateMsg.h"
 #include "bgp_common.h"
+#include "Tracepoint.h"
+#include "StageStats.h"
+#include "Metrics.h"
 
 using namespace std;
 
@@ -48,7 +52,7 @@ using namespace std;
  * \param [in,out] peer_info   Persistent peer information
  */
 parseBGP::parseBGP(Logger *logPtr, MsgBusInterface *mbus_ptr, MsgBusInterface::obj_bgp_peer *peer_entry, string routerAddr,
-                   BMPReader::peer_info *peer_info) {
+                   bgp::peer_info *peer_info) {
     debug = false;
 
     logger = logPtr;
@@ -60,6 +64,9 @@ parseBGP::parseBGP(Logger *logPtr, MsgBusInterface *mbus_ptr, MsgBusInterface::o
 
     // Set our mysql pointer
     this->mbus_ptr = mbus_ptr;
+    coalescer = NULL;
+    filter = NULL;
+    skip_attrs = 0;
 
     // Set our peer entry
     p_entry = peer_entry;
@@ -74,6 +81,33 @@ parseBGP::parseBGP(Logger *logPtr, MsgBusInterface *mbus_ptr, MsgBusInterface::o
 parseBGP::~parseBGP() {
 }
 
+/**
+ * Set the prefix flap coalescer to use for unicast prefixes
+ *
+ * \param [in] coalescer    Session prefix coalescer, NULL to send updates directly
+ */
+void parseBGP::setCoalescer(PrefixCoalescer *coalescer) {
+    this->coalescer = coalescer;
+}
+
+/**
+ * Set the ingest filter to apply to routes
+ *
+ * \param [in] filter       Ingest filter, NULL to accept all routes
+ */
+void parseBGP::setFilter(FilterEngine *filter) {
+    this->filter = filter;
+}
+
+/**
+ * Set the path attributes to skip when decoding updates
+ *
+ * \param [in] skip_attrs   Attribute types to skip, bit N is type N (Config::projection_skip_attrs)
+ */
+void parseBGP::setSkipAttrs(uint64_t skip_attrs) {
+    this->skip_attrs = skip_attrs;
+}
+
 /**
  * handle BGP update message and store in DB
  *
@@ -85,16 +119,28 @@ parseBGP::~parseBGP() {
  * \returns True if error, false if no error.
  */
 bool parseBGP::handleUpdate(u_char *data, size_t size) {
+    StageStats::Scope stage(StageStats::STAGE_BGP_PARSE);
+
     bgp_msg::UpdateMsg::parsed_update_data parsed_data;
     int read_size = 0;
 
     if (parseBgpHeader(data, size) == BGP_MSG_UPDATE) {
         data += BGP_MSG_HDR_LEN;
 
+        // Skip decoding updates of peers that are completely filtered
+        if (filter != NULL and size > BGP_MSG_HDR_LEN + FILTER_MIN_SKIP_SIZE and
+                filter->dropsAll(filter->peerRules(p_entry->peer_as))) {
+            static Metrics::Counter &m_skipped = Metrics::get("filter.updates_skipped");
+
+            m_skipped.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+
         /*
          * Parse the update message - stored results will be in parsed_data
          */
         bgp_msg::UpdateMsg uMsg(logger, p_entry->peer_addr, router_addr, p_info, debug);
+        uMsg.setSkipAttrs(skip_attrs);
 
         if ((read_size=uMsg.parseUpdateMsg(data, data_bytes_remaining, parsed_data)) != (size - BGP_MSG_HDR_LEN)) {
             LOG_NOTICE("%s: rtr=%s: Failed to parse the update message, read %d expected %d", p_entry->peer_addr,
@@ -104,6 +150,9 @@ bool parseBGP::handleUpdate(u_char *data, size_t size) {
 
         data_bytes_remaining -= read_size;
 
+        OBMP_TRACE4(bgp_update, p_entry->peer_addr, size, parsed_data.advertised.size(),
+                    parsed_data.withdrawn.size());
+
         /*
          * Update the DB with the update data
          */
@@ -347,6 +396,12 @@ u_char parseBGP::parseBgpHeader(u_char *data, size_t size) {
  * \param  parsed_data          Reference to the parsed update data
  */
 void parseBGP::UpdateDB(bgp_msg::UpdateMsg::parsed_update_data &parsed_data) {
+    /*
+     * Drop filtered routes, nothing is sent if all routes were filtered
+     */
+    if (filter != NULL and filterUpdate(parsed_data))
+        return;
+
     /*
      * Update the path attributes
      */
@@ -376,6 +431,90 @@ void parseBGP::UpdateDB(bgp_msg::UpdateMsg::parsed_update_data &parsed_data) {
 
 }
 
+/**
+ * Remove the routes dropped by the ingest filter from the parsed update data
+ *
+ * \param [in,out] parsed_data  Reference to the parsed update data
+ *
+ * \return true if routes were removed and none are left
+ */
+bool parseBGP::filterUpdate(bgp_msg::UpdateMsg::parsed_update_data &parsed_data) {
+    uint64_t peer_rules = filter->peerRules(p_entry->peer_as);
+    size_t   removed = 0;
+    size_t   left = 0;
+
+    std::list<bgp::prefix_tuple> *unicast[] = { &parsed_data.advertised, &parsed_data.withdrawn };
+    for (int i = 0; i < 2; i++) {
+        for (std::list<bgp::prefix_tuple>::iterator it = unicast[i]->begin(); it != unicast[i]->end(); ) {
+            uint32_t afi_safi;
+            if (it->type == bgp::PREFIX_LABEL_UNICAST_V4 or it->type == bgp::PREFIX_LABEL_UNICAST_V6)
+                afi_safi = it->isIPv4 ? Config::FILTER_IPV4_LABELED_UNICAST : Config::FILTER_IPV6_LABELED_UNICAST;
+            else
+                afi_safi = it->isIPv4 ? Config::FILTER_IPV4_UNICAST : Config::FILTER_IPV6_UNICAST;
+
+            if (filter->accept(peer_rules, afi_safi, it->prefix_bin, it->len, it->isIPv4)) {
+                ++it;
+                ++left;
+            } else {
+                it = unicast[i]->erase(it);
+                ++removed;
+            }
+        }
+    }
+
+    std::list<bgp::vpn_tuple> *vpn[] = { &parsed_data.vpn, &parsed_data.vpn_withdrawn };
+    for (int i = 0; i < 2; i++) {
+        for (std::list<bgp::vpn_tuple>::iterator it = vpn[i]->begin(); it != vpn[i]->end(); ) {
+            if (filter->accept(peer_rules, it->isIPv4 ? Config::FILTER_IPV4_VPN : Config::FILTER_IPV6_VPN,
+                               it->prefix_bin, it->len, it->isIPv4)) {
+                ++it;
+                ++left;
+            } else {
+                it = vpn[i]->erase(it);
+                ++removed;
+            }
+        }
+    }
+
+    std::list<bgp::evpn_tuple> *evpn[] = { &parsed_data.evpn, &parsed_data.evpn_withdrawn };
+    for (int i = 0; i < 2; i++) {
+        for (std::list<bgp::evpn_tuple>::iterator it = evpn[i]->begin(); it != evpn[i]->end(); ) {
+            if (filter->accept(peer_rules, Config::FILTER_EVPN, NULL, 0, false)) {
+                ++it;
+                ++left;
+            } else {
+                it = evpn[i]->erase(it);
+                ++removed;
+            }
+        }
+    }
+
+    // BGP-LS has no prefix to match, the decision is the same for all of its NLRIs
+    bgp_msg::UpdateMsg::parsed_data_ls *ls[] = { &parsed_data.ls, &parsed_data.ls_withdrawn };
+    for (int i = 0; i < 2; i++) {
+        size_t count = ls[i]->nodes.size() + ls[i]->links.size() + ls[i]->prefixes.size();
+
+        if (count == 0)
+            continue;
+
+        if (filter->accept(peer_rules, Config::FILTER_BGP_LS, NULL, 0, false)) {
+            left += count;
+        } else {
+            ls[i]->nodes.clear();
+            ls[i]->links.clear();
+            ls[i]->prefixes.clear();
+            removed += count;
+        }
+    }
+
+    if (removed > 0) {
+        static Metrics::Counter &m_dropped = Metrics::get("filter.routes_dropped");
+        m_dropped.fetch_add(removed, std::memory_order_relaxed);
+    }
+
+    return removed > 0 and left == 0;
+}
+
 /**
  * Update the Database path attributes
  *
@@ -483,16 +622,12 @@ void parseBGP::UpdateDBL3Vpn(bool remove, std::list<bgp::vpn_tuple> &prefixes,
         memcpy(rib_entry.path_attr_hash_id, path_hash_id, sizeof(rib_entry.path_attr_hash_id));
         memcpy(rib_entry.peer_hash_id, p_entry->hash_id, sizeof(rib_entry.peer_hash_id));
 
-        rib_entry.rd_type = tuple.rd_type;
-        rib_entry.rd_assigned_number = tuple.rd_assigned_number;
-        rib_entry.rd_administrator_subfield = tuple.rd_administrator_subfield;
+        rib_entry.rd = tuple.rd;
 
         strncpy(rib_entry.prefix, tuple.prefix.c_str(), sizeof(rib_entry.prefix));
         
         rib_entry.prefix_len = tuple.len;
 
-        snprintf(rib_entry.labels, sizeof(rib_entry.labels), "%s", tuple.labels.c_str());
-        
         rib_entry.isIPv4 = tuple.isIPv4 ? 1 : 0;
 
         memcpy(rib_entry.prefix_bin, tuple.prefix_bin, sizeof(rib_entry.prefix_bin));
@@ -542,7 +677,7 @@ void parseBGP::UpdateDBL3Vpn(bool remove, std::list<bgp::vpn_tuple> &prefixes,
         }
 
         rib_entry.path_id = tuple.path_id;
-        snprintf(rib_entry.labels, sizeof(rib_entry.labels), "%s", tuple.labels.c_str());
+        rib_entry.labels = tuple.labels;
 
         SELF_DEBUG("%s: %s vpn=%s len=%d", p_entry->peer_addr, remove ? "removing" : "adding",
                    rib_entry.prefix, rib_entry.prefix_len);
@@ -584,9 +719,7 @@ void parseBGP::UpdateDBeVPN(bool remove, std::list<bgp::evpn_tuple> &nlris,
         memcpy(rib_entry.path_attr_hash_id, path_hash_id, sizeof(rib_entry.path_attr_hash_id));
         memcpy(rib_entry.peer_hash_id, p_entry->hash_id, sizeof(rib_entry.peer_hash_id));
 
-        rib_entry.rd_type = tuple.rd_type;
-        rib_entry.rd_assigned_number = tuple.rd_assigned_number;
-        rib_entry.rd_administrator_subfield = tuple.rd_administrator_subfield;
+        rib_entry.rd = tuple.rd;
 
         strcpy(rib_entry.ethernet_tag_id_hex, tuple.ethernet_tag_id_hex.c_str());
         rib_entry.mpls_label_1 = tuple.mpls_label_1;
@@ -698,7 +831,8 @@ void parseBGP::UpdateDBAdvPrefixes(std::list<bgp::prefix_tuple> &adv_prefixes,
         }
 
         rib_entry.path_id = tuple.path_id;
-        snprintf(rib_entry.labels, sizeof(rib_entry.labels), "%s", tuple.labels.c_str());
+        rib_entry.labels = tuple.labels;
+        rib_entry.flap_count = 0;
 
         SELF_DEBUG("%s: Adding prefix=%s len=%d", p_entry->peer_addr, rib_entry.prefix, rib_entry.prefix_len);
 
@@ -707,8 +841,12 @@ void parseBGP::UpdateDBAdvPrefixes(std::list<bgp::prefix_tuple> &adv_prefixes,
     }
 
     // Update the DB
-    if (rib_list.size() > 0)
-        mbus_ptr->update_unicastPrefix(*p_entry, rib_list, &base_attr, mbus_ptr->UNICAST_PREFIX_ACTION_ADD);
+    if (rib_list.size() > 0) {
+        if (coalescer != NULL)
+            coalescer->add(mbus_ptr, *p_entry, rib_list, &base_attr, false);
+        else
+            mbus_ptr->update_unicastPrefix(*p_entry, rib_list, &base_attr, mbus_ptr->UNICAST_PREFIX_ACTION_ADD);
+    }
 
     rib_list.clear();
     adv_prefixes.clear();
@@ -744,7 +882,8 @@ void parseBGP::UpdateDBWdrawnPrefixes(std::list<bgp::prefix_tuple> &wdrawn_prefi
         memcpy(rib_entry.prefix_bin, tuple.prefix_bin, sizeof(rib_entry.prefix_bin));
 
         rib_entry.path_id = tuple.path_id;
-        snprintf(rib_entry.labels, sizeof(rib_entry.labels), "%s", tuple.labels.c_str());
+        rib_entry.labels = tuple.labels;
+        rib_entry.flap_count = 0;
 
         SELF_DEBUG("%s: Removing prefix=%s len=%d", p_entry->peer_addr, rib_entry.prefix, rib_entry.prefix_len);
 
@@ -753,8 +892,12 @@ void parseBGP::UpdateDBWdrawnPrefixes(std::list<bgp::prefix_tuple> &wdrawn_prefi
     }
 
     // Update the DB
-    if (rib_list.size() > 0)
-        mbus_ptr->update_unicastPrefix(*p_entry, rib_list, NULL, mbus_ptr->UNICAST_PREFIX_ACTION_DEL);
+    if (rib_list.size() > 0) {
+        if (coalescer != NULL)
+            coalescer->add(mbus_ptr, *p_entry, rib_list, NULL, true);
+        else
+            mbus_ptr->update_unicastPrefix(*p_entry, rib_list, NULL, mbus_ptr->UNICAST_PREFIX_ACTION_DEL);
+    }
 
     rib_list.clear();
     wdrawn_prefixes.clear();
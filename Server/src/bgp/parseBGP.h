@@ -12,12 +12,15 @@
 
 #include <vector>
 #include <list>
-#include <BMPReader.h>
+#include "PeerInfo.h"
 #include "MsgBusInterface.hpp"
 #include "Logger.h"
 #include "bgp_common.h"
 #include "UpdateMsg.h"
+#include "PrefixCoalescer.h"
+#include "FilterEngine.h"
 
+#define FILTER_MIN_SKIP_SIZE    16      // Updates up to this size (e.g. End-of-RIB) are parsed even if the peer is filtered
 
 using namespace std;
 
@@ -80,7 +83,7 @@ public:
      * \param [in,out] peer_info   Persistent peer information
      */
     parseBGP(Logger *logPtr, MsgBusInterface *mbus_ptr, MsgBusInterface::obj_bgp_peer *peer_entry, string routerAddr,
-             BMPReader::peer_info *peer_info);
+             bgp::peer_info *peer_info);
 
     virtual ~parseBGP();
 
@@ -125,6 +128,27 @@ public:
      */
     int handleUpEvent(u_char *data, size_t size, MsgBusInterface::obj_peer_up_event *up_event);
 
+    /**
+     * Set the prefix flap coalescer to use for unicast prefixes
+     *
+     * \param [in] coalescer    Session prefix coalescer, NULL to send updates directly
+     */
+    void setCoalescer(PrefixCoalescer *coalescer);
+
+    /**
+     * Set the ingest filter to apply to routes
+     *
+     * \param [in] filter       Ingest filter, NULL to accept all routes
+     */
+    void setFilter(FilterEngine *filter);
+
+    /**
+     * Set the path attributes to skip when decoding updates
+     *
+     * \param [in] skip_attrs   Attribute types to skip, bit N is type N (Config::projection_skip_attrs)
+     */
+    void setSkipAttrs(uint64_t skip_attrs);
+
     /*
      * Debug methods
      */
@@ -152,8 +176,11 @@ private:
     MsgBusInterface::obj_path_attr   base_attr;      ///< Base attribute object
 
     MsgBusInterface *mbus_ptr;                       ///< Pointer to open DB implementation
+    PrefixCoalescer *coalescer;                      ///< Unicast prefix flap coalescer, NULL if disabled
+    FilterEngine    *filter;                         ///< Ingest filter, NULL if disabled
+    uint64_t        skip_attrs;                      ///< Path attribute types not decoded, bit N is type N
     string                           router_addr;    ///< Router IP address - used for logging
-    BMPReader::peer_info             *p_info;        ///< Persistent Peer information
+    bgp::peer_info                   *p_info;        ///< Persistent Peer information
 
     unsigned char path_hash_id[16];                  ///< current path hash ID
 
@@ -184,6 +211,15 @@ private:
      */
     void UpdateDB(bgp_msg::UpdateMsg::parsed_update_data &parsed_data);
 
+    /**
+     * Remove the routes dropped by the ingest filter from the parsed update data
+     *
+     * \param [in,out] parsed_data  Reference to the parsed update data
+     *
+     * \return true if routes were removed and none are left
+     */
+    bool filterUpdate(bgp_msg::UpdateMsg::parsed_update_data &parsed_data);
+
     /**
      * Update the Database path attributes
      *
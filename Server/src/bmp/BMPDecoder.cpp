@@ -0,0 +1,247 @@
+/*
+ * Copyright (c) 2013-2016 Cisco Systems, Inc. and others.  All rights reserved.
+ *
+ * This program and the accompanying materials are made available under the
+ * terms of the Eclipse Public License v1.0 which accompanies this distribution,
+ * and is available at http://www.eclipse.org/legal/epl-v10.html
+ *
+ */
+
+#include <cstring>
+#include <map>
+
+#include "BMPDecoder.h"
+#include "BMPStream.h"
+#include "parseBGP.h"
+
+/**
+ * Decoder state of a session
+ *
+ *      Receives the decoded objects of parseBGP as the message bus and turns them into
+ *      decoder events.  Only unicast prefixes are passed on.
+ */
+struct BMPDecoder::session : public MsgBusInterface {
+    Logger          *logger;                            ///< Decoder logger
+    BMPStream       *stream;                            ///< Framing and header decoding
+    Callback        callback;                           ///< Event callback
+    bool            stopped;                            ///< Callback stopped the stream
+
+    std::map<std::string, bgp::peer_info> peers;        ///< Persistent peer info by peer address and RD
+
+    BMPStream::event *current;                          ///< Message being decoded
+    peer_hdr        peer;                               ///< Peer header of the current message
+    std::vector<prefix> prefixes;                       ///< Prefixes of the event
+    path_attrs      attrs;                              ///< Attributes of the event
+
+    /**
+     * Pass an event to the callback
+     *
+     * \param [in] type         Event type
+     * \param [in] has_peer     True if the message has a peer header
+     * \param [in] down_reason  BMP peer down reason
+     */
+    void emit(EVENT_TYPES type, bool has_peer, uint8_t down_reason = 0) {
+        if (stopped)
+            return;
+
+        event ev;
+        ev.type = type;
+        ev.bmp_type = current->type;
+        ev.peer = has_peer ? &peer : NULL;
+        ev.prefixes = type == EVENT_PREFIX_ADD or type == EVENT_PREFIX_DEL ? &prefixes : NULL;
+        ev.attrs = type == EVENT_PREFIX_ADD ? &attrs : NULL;
+        ev.down_reason = down_reason;
+        ev.msg = current->msg;
+        ev.len = current->len;
+
+        if (not callback(ev))
+            stopped = true;
+    }
+
+    /**
+     * Decode a BMP message of the stream
+     *
+     * \param [in] ev       Message, the rest is read with BMP_MSG_SOURCE
+     *
+     * \return false if the callback stopped the stream
+     */
+    bool decode(BMPStream::event &ev) {
+        parseBMP *pBMP = ev.parser;
+        MsgBusInterface::obj_bgp_peer &p_entry = *ev.peer;
+
+        current = &ev;
+
+        if (ev.type == parseBMP::TYPE_INIT_MSG) {
+            emit(EVENT_INIT, false);
+            return not stopped;
+
+        } else if (ev.type == parseBMP::TYPE_TERM_MSG) {
+            emit(EVENT_TERM, false);
+            return not stopped;
+        }
+
+        memcpy(peer.addr, p_entry.peer_addr, sizeof(peer.addr));
+        memcpy(peer.rd, p_entry.peer_rd, sizeof(peer.rd));
+        memcpy(peer.bgp_id, p_entry.peer_bgp_id, sizeof(peer.bgp_id));
+        peer.asn            = p_entry.peer_as;
+        peer.ipv4           = p_entry.isIPv4;
+        peer.l3vpn          = p_entry.isL3VPN;
+        peer.pre_policy     = p_entry.isPrePolicy;
+        peer.adj_in         = p_entry.isAdjIn;
+        peer.loc_rib        = p_entry.isLocRib;
+        peer.timestamp_secs = p_entry.timestamp_secs;
+        peer.timestamp_us   = p_entry.timestamp_us;
+
+        std::string peer_info_key = p_entry.peer_addr;
+        peer_info_key += p_entry.peer_rd;
+
+        bgp::peer_info *p_info = &peers[peer_info_key];
+
+        if (not p_info->using_2_octet_asn and p_entry.isTwoOctet)
+            p_info->using_2_octet_asn = true;
+
+        switch (ev.type) {
+            case parseBMP::TYPE_PEER_UP : {
+                MsgBusInterface::obj_peer_up_event up_event = {};
+
+                if (not pBMP->parsePeerUpEventHdr(BMP_MSG_SOURCE, up_event)) {
+                    LOG_NOTICE("%s: PEER UP Received but failed to parse the BMP header.", p_entry.peer_addr);
+                    break;
+                }
+
+                pBMP->bufferBMPMessage(BMP_MSG_SOURCE);
+
+                // Sent/received open messages set the ASN size and add-path of the peer
+                parseBGP pBGP(logger, this, &p_entry, "", p_info);
+                pBGP.handleUpEvent(pBMP->bmp_data, pBMP->bmp_data_len, &up_event);
+
+                emit(EVENT_PEER_UP, true);
+                break;
+            }
+
+            case parseBMP::TYPE_PEER_DOWN : {
+                MsgBusInterface::obj_peer_down_event down_event = {};
+
+                if (not pBMP->parsePeerDownEventHdr(BMP_MSG_SOURCE, down_event))
+                    throw "BMPDecoder: Invalid peer down message";
+
+                peers.erase(peer_info_key);
+
+                emit(EVENT_PEER_DOWN, true, down_event.bmp_reason);
+                break;
+            }
+
+            case parseBMP::TYPE_ROUTE_MON : {
+                pBMP->bufferBMPMessage(BMP_MSG_SOURCE);
+
+                // Prefixes are passed to the callback by update_unicastPrefix()
+                parseBGP pBGP(logger, this, &p_entry, "", p_info);
+                pBGP.handleUpdate(pBMP->bmp_data, pBMP->bmp_data_len);
+                break;
+            }
+
+            default :
+                emit(EVENT_OTHER, true);
+                break;
+        }
+
+        return not stopped;
+    }
+
+    /*
+     * Message bus methods, called by parseBGP
+     */
+    void update_unicastPrefix(obj_bgp_peer &p_entry, std::vector<obj_rib> &rib, obj_path_attr *attr,
+                              unicast_prefix_action_code code) {
+        prefixes.resize(rib.size());
+
+        for (size_t i = 0; i < rib.size(); i++) {
+            memcpy(prefixes[i].addr, rib[i].prefix_bin, sizeof(prefixes[i].addr));
+            prefixes[i].len     = rib[i].prefix_len;
+            prefixes[i].ipv4    = rib[i].isIPv4;
+            prefixes[i].path_id = rib[i].path_id;
+        }
+
+        if (code == UNICAST_PREFIX_ACTION_ADD and attr != NULL) {
+            attrs.origin            = attr->origin;
+            attrs.as_path           = attr->as_path;
+            attrs.origin_as         = attr->origin_as;
+            attrs.next_hop          = attr->next_hop;
+            attrs.med               = attr->med;
+            attrs.local_pref        = attr->local_pref;
+            attrs.communities       = attr->community_list;
+            attrs.ext_communities   = attr->ext_community_list;
+            attrs.large_communities = attr->large_community_list;
+
+            emit(EVENT_PREFIX_ADD, true);
+
+        } else if (code == UNICAST_PREFIX_ACTION_DEL) {
+            emit(EVENT_PREFIX_DEL, true);
+        }
+    }
+
+    void update_Collector(struct obj_collector &c_obj, collector_action_code action_code) { }
+    void update_Router(struct obj_router &r_object, router_action_code code) { }
+    void update_Peer(obj_bgp_peer &peer, obj_peer_up_event *up, obj_peer_down_event *down, peer_action_code code) { }
+    void update_baseAttribute(obj_bgp_peer &peer, obj_path_attr &attr, base_attr_action_code code) { }
+    void update_L3Vpn(obj_bgp_peer &peer, std::vector<obj_vpn> &vpn, obj_path_attr *attr, vpn_action_code code) { }
+    void update_eVPN(obj_bgp_peer &peer, std::vector<obj_evpn> &vpn, obj_path_attr *attr, vpn_action_code code) { }
+    void add_StatReport(obj_bgp_peer &peer, obj_stats_report &stats) { }
+    void update_LsNode(obj_bgp_peer &peer, obj_path_attr &attr, std::list<MsgBusInterface::obj_ls_node> &nodes,
+                       ls_action_code code) { }
+    void update_LsLink(obj_bgp_peer &peer, obj_path_attr &attr, std::list<MsgBusInterface::obj_ls_link> &links,
+                       ls_action_code code) { }
+    void update_LsPrefix(obj_bgp_peer &peer, obj_path_attr &attr, std::list<MsgBusInterface::obj_ls_prefix> &prefixes,
+                         ls_action_code code) { }
+    void send_bmp_raw(u_char *r_hash, obj_bgp_peer &peer, u_char *data, size_t data_len) { }
+};
+
+/**
+ * Constructor for class
+ *
+ * \param [in] callback         Called for each decoded event
+ * \param [in] log_filename     Decoder warnings/errors log file, NULL to discard
+ */
+BMPDecoder::BMPDecoder(Callback callback, const char *log_filename) {
+    const char *log = log_filename != NULL ? log_filename : "/dev/null";
+    Logger *logger = new Logger(log, log);
+
+    state = new session();
+    state->logger = logger;
+    state->callback = callback;
+    state->stopped = false;
+    state->current = NULL;
+
+    session *s = state;
+    state->stream = new BMPStream(state->logger, [s](BMPStream::event &ev) {
+        return s->decode(ev);
+    });
+}
+
+BMPDecoder::~BMPDecoder() {
+    delete state->stream;
+    delete state->logger;
+    delete state;
+}
+
+/**
+ * Push bytes of the session
+ *
+ * \param [in] data     Bytes, may hold partial messages
+ * \param [in] len      Number of bytes
+ *
+ * \return false if the callback stopped the stream, true otherwise
+ */
+bool BMPDecoder::feed(const uint8_t *data, size_t len) {
+    if (state->stopped)
+        return false;
+
+    return state->stream->feed(data, len);
+}
+
+/**
+ * Number of complete BMP messages decoded
+ */
+uint64_t BMPDecoder::messages() const {
+    return state->stream->messages();
+}
@@ -0,0 +1,149 @@
+/*
+ * Copyright (c) 2013-2016 Cisco Systems, Inc. and others.  All rights reserved.
+ *
+ * This program and the accompanying materials are made available under the
+ * terms of the Eclipse Public License v1.0 which accompanies this distribution,
+ * and is available at http://www.eclipse.org/legal/epl-v10.html
+ *
+ */
+#ifndef BMPDECODER_H_
+#define BMPDECODER_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+/**
+ * \class   BMPDecoder
+ *
+ * \brief   Parser library API, decodes the bytes of a BMP session to binary records
+ * \details
+ *      Bytes of a BMP session are pushed with feed() in chunks of any size.  For each complete
+ *      message the callback gets the decoded event: the peer header, and for route monitoring
+ *      the unicast prefixes in binary form with their main path attributes.  The peer state
+ *      needed to decode updates (4-octet ASN, add-path) is kept per session.
+ *
+ *      This is the only installed header of the parser library, the decoders behind it, the
+ *      message bus interface, logger and config of openbmpd are internal.  See docs/BUILD.md.
+ *
+ *      The event and the records it points to are only valid during the callback.  One
+ *      instance is used per BMP session, it is not thread safe.
+ */
+class BMPDecoder {
+public:
+    /**
+     * Event types
+     */
+    enum EVENT_TYPES {
+        EVENT_INIT = 0,                                 ///< Initiation message
+        EVENT_TERM,                                     ///< Termination message
+        EVENT_PEER_UP,                                  ///< Peer up, peer header is set
+        EVENT_PEER_DOWN,                                ///< Peer down, peer header and down_reason are set
+        EVENT_PREFIX_ADD,                               ///< Prefixes advertised with attrs
+        EVENT_PREFIX_DEL,                               ///< Prefixes withdrawn, attrs is NULL
+        EVENT_OTHER                                     ///< Stats report, route mirroring; only the raw message
+    };
+
+    /**
+     * Decoded BMP per-peer header
+     */
+    struct peer_hdr {
+        char        addr[46];                           ///< Peer IP address in printed form
+        char        rd[32];                             ///< Peer distinguisher in printed form
+        char        bgp_id[16];                         ///< Peer BGP ID in printed form
+        uint32_t    asn;                                ///< Peer ASN
+        bool        ipv4;                               ///< True if the peer address is IPv4
+        bool        l3vpn;                              ///< True if L3VPN peer, otherwise global
+        bool        pre_policy;                         ///< True if the routes are pre-policy
+        bool        adj_in;                             ///< True if Adj-RIB-In, false if Adj-RIB-Out
+        bool        loc_rib;                            ///< True if Loc-RIB
+        uint32_t    timestamp_secs;                     ///< Timestamp in seconds since epoch
+        uint32_t    timestamp_us;                       ///< Timestamp microseconds
+    };
+
+    /**
+     * Unicast prefix
+     */
+    struct prefix {
+        uint8_t     addr[16];                           ///< Prefix in binary form, network byte order
+        uint8_t     len;                                ///< Prefix length in bits
+        bool        ipv4;                               ///< True if IPv4, false if IPv6
+        uint32_t    path_id;                            ///< Add-path ID, zero if not used
+    };
+
+    /**
+     * Path attributes of advertised prefixes
+     */
+    struct path_attrs {
+        std::string origin;                             ///< Origin name (igp, egp, incomplete)
+        std::string as_path;                            ///< AS path in printed form
+        uint32_t    origin_as;                          ///< Origin ASN
+        std::string next_hop;                           ///< Next-hop IP in printed form
+        uint32_t    med;                                ///< MED
+        uint32_t    local_pref;                         ///< Local preference
+        std::string communities;                        ///< Standard communities, space separated
+        std::string ext_communities;                    ///< Extended communities, space separated
+        std::string large_communities;                  ///< Large communities, space separated
+    };
+
+    /**
+     * Decoded event
+     */
+    struct event {
+        EVENT_TYPES type;                               ///< Event type
+        uint8_t     bmp_type;                           ///< BMP message type (RFC 7854)
+        const peer_hdr *peer;                           ///< Peer header, NULL for init and term
+        const std::vector<prefix> *prefixes;            ///< Prefixes of EVENT_PREFIX_ADD/DEL, otherwise NULL
+        const path_attrs *attrs;                        ///< Attributes of EVENT_PREFIX_ADD, otherwise NULL
+        uint8_t     down_reason;                        ///< BMP peer down reason of EVENT_PEER_DOWN
+        const uint8_t *msg;                             ///< Complete raw BMP message
+        size_t      len;                                ///< Length of the raw message
+    };
+
+    /**
+     * Event callback
+     *
+     * \return true to continue, false to stop the stream (e.g. after a term message)
+     */
+    typedef std::function<bool (const event &ev)> Callback;
+
+    /**
+     * Constructor for class
+     *
+     * \param [in] callback         Called for each decoded event
+     * \param [in] log_filename     Decoder warnings/errors log file, NULL to discard
+     *
+     * \throws (const char *) if the log file cannot be opened
+     */
+    BMPDecoder(Callback callback, const char *log_filename = NULL);
+
+    ~BMPDecoder();
+
+    /**
+     * Push bytes of the session
+     *
+     * \param [in] data     Bytes, may hold partial messages
+     * \param [in] len      Number of bytes
+     *
+     * \return false if the callback stopped the stream, true otherwise
+     *
+     * \throws (const char *) on an invalid message
+     */
+    bool feed(const uint8_t *data, size_t len);
+
+    /**
+     * Number of complete BMP messages decoded
+     */
+    uint64_t messages() const;
+
+private:
+    struct session;                                     ///< Decoder state, internal
+    session     *state;
+
+    BMPDecoder(const BMPDecoder &);
+    BMPDecoder &operator=(const BMPDecoder &);
+};
+
+#endif /* BMPDECODER_H_ */
@@ -18,14 +18,20 @@
 #include <cstdlib>
 #include <string>
 #include <cerrno>
+#include <cinttypes>
+#include <poll.h>
 
 #include "BMPListener.h"
 #include "BMPReader.h"
 #include "parseBMP.h"
+#include "BMPStream.h"
 #include "parseBGP.h"
 #include "MsgBusInterface.hpp"
 #include "Logger.h"
 #include "md5.h"
+#include "StageStats.h"
+#include "Metrics.h"
+#include "RouterBaseline.h"
 
 using namespace std;
 
@@ -48,15 +54,61 @@ BMPReader::BMPReader(Logger *logPtr, Config *config) {
     
     hasPrevRIBdumpTime = false;
     maxRIBdumpRate = 0;
+    rib_dump = true;
+
+    bzero(&peer_hdr_cache, sizeof(peer_hdr_cache));
+    bzero(peer_hdr_states, sizeof(peer_hdr_states));
+    peer_hdr_hits_published = 0;
+    peer_hdr_misses_published = 0;
+
+    filter = NULL;
+    cfg_reader = NULL;
+    lag = NULL;
+    stream = NULL;
+
+    coalescer = NULL;
+    if (cfg->coalesce_window_ms > 0)
+        coalescer = new PrefixCoalescer(logger, cfg->coalesce_window_ms, cfg->coalesce_max_pending);
 }
 
 /**
  * Destructor
  */
 BMPReader::~BMPReader() {
+    if (coalescer != NULL)
+        delete coalescer;
+
+    if (stream != NULL)
+        delete stream;
+}
+
+
+/**
+ * Set the ingest filter to apply to routes
+ *
+ * \param [in] filter   Ingest filter shared by all routers, NULL to accept all routes
+ */
+void BMPReader::setFilter(FilterEngine *filter) {
+    this->filter = filter;
+}
 
+/**
+ * Set the reader of reloaded configs, the session switches to them between reads
+ *
+ * \param [in] reader   Config reader of the session, NULL to keep the config
+ */
+void BMPReader::setConfigReader(ConfigRcu::Reader *reader) {
+    cfg_reader = reader;
 }
 
+/**
+ * Set the lag estimator of the session
+ *
+ * \param [in] lag      Lag estimator, NULL to disable lag estimation
+ */
+void BMPReader::setLagEstimator(LagEstimator *lag) {
+    this->lag = lag;
+}
 
 /**
  * Read messages from BMP stream in a loop
@@ -66,9 +118,51 @@ BMPReader::~BMPReader() {
  * \param [in]  mbus_ptr     The database pointer referencer - DB should be already initialized
  */
 void BMPReader::readerThreadLoop(bool &run, BMPListener::ClientInfo *client, MsgBusInterface *mbus_ptr) {
+    uint64_t cfg_gen;
+
     while (run) {
 
         try {
+            // Switch to a reloaded config between reads, once per read chunk, see ConfigRcu
+            if (cfg_reader != NULL and cfg_reader->changed(cfg_gen)) {
+                cfg = ConfigRcu::current();
+                debug = cfg->debug_bmp;
+                mbus_ptr->setConfig(cfg);
+
+                cfg_reader->acknowledge(cfg_gen);
+            }
+
+            /*
+             * While prefixes are being coalesced or the message bus holds messages, only wait for
+             * the next message until they are due
+             */
+            int wait_ms = mbus_ptr->msUntilService();
+
+            if (coalescer != NULL and coalescer->pending() > 0) {
+                int expiry_ms = coalescer->msUntilNextExpiry();
+
+                if (wait_ms < 0 or expiry_ms < wait_ms)
+                    wait_ms = expiry_ms;
+            }
+
+            if (wait_ms >= 0) {
+                pollfd pfd;
+                pfd.fd = client->pipe_sock > 0 ? client->pipe_sock : client->c_sock;
+                pfd.events = POLLIN;
+                pfd.revents = 0;
+
+                if (poll(&pfd, 1, wait_ms) == 0) {
+                    if (coalescer != NULL and coalescer->pending() > 0)
+                        coalescer->expire(mbus_ptr);
+
+                    mbus_ptr->service();
+
+                    if (lag != NULL and lag->due())
+                        publishLag();
+                    continue;
+                }
+            }
+
             if (not ReadIncomingMsg(client, mbus_ptr))
                 break;
 
@@ -76,13 +170,38 @@ void BMPReader::readerThreadLoop(bool &run, BMPListener::ClientInfo *client, Msg
             run = false;
             break;
         }
+
+        if ((peer_hdr_cache.hits + peer_hdr_cache.misses)
+                - (peer_hdr_hits_published + peer_hdr_misses_published) >= 10000)
+            publishPeerHdrCacheStats();
+
+        if (lag != NULL and lag->due())
+            publishLag();
+    }
+
+    if (coalescer != NULL)
+        coalescer->flush(mbus_ptr);
+
+    publishPeerHdrCacheStats();
+
+    if (peer_hdr_cache.hits + peer_hdr_cache.misses > 0)
+        LOG_INFO("%s: Peer header cache hits=%" PRIu64 " misses=%" PRIu64 " (%.1f%% hit rate)", client->c_ip,
+                 peer_hdr_cache.hits, peer_hdr_cache.misses,
+                 peer_hdr_cache.hits * 100.0 / (peer_hdr_cache.hits + peer_hdr_cache.misses));
+
+    if (StageStats::enabled) {
+        uint64_t cpu_ns = StageStats::threadCpuNs();
+
+        Metrics::get("thread.bmp_reader.cpu_ns").fetch_add(cpu_ns, std::memory_order_relaxed);
+        LOG_INFO("%s: BMP reader thread used %.3f seconds of CPU", client->c_ip, cpu_ns / 1e9);
     }
 }
 
 /**
  * Read messages from BMP stream
  *
- * BMP routers send BMP/BGP messages, this method reads and parses those.
+ * BMP routers send BMP/BGP messages, this method reads the available bytes and parses the
+ * complete messages, see BMPStream.
  *
  * \param [in]  client      Client information pointer
  * \param [in]  mbus_ptr     The database pointer referencer - DB should be already initialized
@@ -92,25 +211,57 @@ void BMPReader::readerThreadLoop(bool &run, BMPListener::ClientInfo *client, Msg
  * \throw (char const *str) message indicate error
  */
 bool BMPReader::ReadIncomingMsg(BMPListener::ClientInfo *client, MsgBusInterface *mbus_ptr) {
-    bool rval = true;
-    string peer_info_key;
-
-    parseBGP *pBGP;                                 // Pointer to BGP parser
+    StageStats::Scope stage(StageStats::STAGE_BMP_FRAMING);
 
     int read_fd = client->pipe_sock > 0 ? client->pipe_sock : client->c_sock;
 
-    // Data storage structures
-    MsgBusInterface::obj_bgp_peer p_entry;
-
-    // Initialize the parser for BMP messages
-    parseBMP *pBMP = new parseBMP(logger, &p_entry);    // handler for BMP messages
+    if (stream == NULL) {
+        stream = new BMPStream(logger, [this, client, mbus_ptr](BMPStream::event &ev) {
+            return processMessage(client, mbus_ptr, ev);
+        });
+        stream->setPeerHdrCache(&peer_hdr_cache);
+    }
 
     if (cfg->debug_bmp) {
         enableDebug();
-        pBMP->enableDebug();
+        stream->enableDebug();
     }
 
-    char bmp_type = 0;
+    try {
+        return stream->read(read_fd);
+
+    } catch (char const *str) {
+        // Mark the router as disconnected and update the error to be a local disconnect (no term message received)
+        LOG_INFO("%s: Caught: %s", client->c_ip, str);
+        disconnect(client, mbus_ptr, parseBMP::TERM_REASON_OPENBMP_CONN_ERR, str);
+
+        throw str;
+    }
+}
+
+/**
+ * Process a BMP message
+ *
+ * \param [in]  client      Client information pointer
+ * \param [in]  mbus_ptr    The database pointer referencer - DB should be already initialized
+ * \param [in]  ev          Decoded message, the rest is read with BMP_MSG_SOURCE
+ *
+ * \return true if more to read, false if the connection is done/closed
+ *
+ * \throw (char const *str) message indicate error
+ */
+bool BMPReader::processMessage(BMPListener::ClientInfo *client, MsgBusInterface *mbus_ptr, BMPStream::event &ev) {
+    bool rval = true;
+    string peer_info_key;
+
+    parseBGP *pBGP;                                 // Pointer to BGP parser
+
+    parseBMP *pBMP = ev.parser;                     // handler for BMP messages, positioned after the headers
+    MsgBusInterface::obj_bgp_peer &p_entry = *ev.peer;
+
+    peer_info *p_info = NULL;                       // Persistent peer info for the message peer
+
+    char bmp_type = ev.type;
 
     MsgBusInterface::obj_router r_object;
     memcpy(router_hash_id, client->hash_id, sizeof(router_hash_id));    // Cache the router hash ID (hash is generated by BMPListener)
@@ -120,285 +271,371 @@ bool BMPReader::ReadIncomingMsg(BMPListener::ClientInfo *client, MsgBusInterface
     // Setup the router record table object
     memcpy(r_object.ip_addr, client->c_ip, sizeof(client->c_ip));
 
-    try {
-        bmp_type = pBMP->handleMessage(read_fd);
-
-        /*
-         * Now that we have parsed the BMP message...
-         *  add record to the database
-         */
-
-        /* Removed - We no longer add router entries to the DB unless we receive a router entry first
-        if (bmp_type != parseBMP::TYPE_INIT_MSG)
-            mbus_ptr->update_Router(r_object, mbus_ptr->ROUTER_ACTION_FIRST);              // add the router entry
-        */
-
-        // only process the peering info if the message includes it
-        if (bmp_type != parseBMP::TYPE_INIT_MSG && bmp_type != parseBMP::TYPE_TERM_MSG) {
-            // Update p_entry hash_id now that add_Router updated it.
-            memcpy(p_entry.router_hash_id, r_object.hash_id, sizeof(r_object.hash_id));
+    /*
+     * Now that we have parsed the BMP message...
+     *  add record to the database
+     */
+
+    /* Removed - We no longer add router entries to the DB unless we receive a router entry first
+    if (bmp_type != parseBMP::TYPE_INIT_MSG)
+        mbus_ptr->update_Router(r_object, mbus_ptr->ROUTER_ACTION_FIRST);              // add the router entry
+    */
+
+    // only process the peering info if the message includes it
+    if (bmp_type != parseBMP::TYPE_INIT_MSG && bmp_type != parseBMP::TYPE_TERM_MSG) {
+        // Update p_entry hash_id now that add_Router updated it.
+        memcpy(p_entry.router_hash_id, r_object.hash_id, sizeof(r_object.hash_id));
+
+        peer_hdr_state *hdr_state = pBMP->peer_hdr_idx >= 0 ? &peer_hdr_states[pBMP->peer_hdr_idx] : NULL;
+
+        if (hdr_state != NULL and pBMP->peer_hdr_hit and hdr_state->info != NULL) {
+            p_info = hdr_state->info;
+
+        } else {
             peer_info_key =  p_entry.peer_addr;
             peer_info_key += p_entry.peer_rd;
 
-            if (bmp_type != parseBMP::TYPE_PEER_UP)
+            p_info = &peer_info_map[peer_info_key];
+
+            if (hdr_state != NULL) {
+                hdr_state->info = p_info;
+                hdr_state->peer_sent = false;
+            }
+        }
+
+        if (bmp_type != parseBMP::TYPE_PEER_UP) {
+            // Cached peer already has the peer hash_id (copied by parseBMP) and has been sent
+            if (hdr_state == NULL or not hdr_state->peer_sent) {
                 mbus_ptr->update_Peer(p_entry, NULL, NULL, mbus_ptr->PEER_ACTION_FIRST);     // add the peer entry
 
-            if (not peer_info_map[peer_info_key].using_2_octet_asn and p_entry.isTwoOctet) {
-                peer_info_map[peer_info_key].using_2_octet_asn = true;
+                if (hdr_state != NULL) {
+                    memcpy(peer_hdr_cache.entries[pBMP->peer_hdr_idx].peer.hash_id, p_entry.hash_id,
+                           sizeof(p_entry.hash_id));
+                    hdr_state->peer_sent = true;
+                }
             }
         }
 
-        /*
-         * At this point we only have the BMP header message, what happens next depends
-         *      on the BMP message type.
-         */
-        switch (bmp_type) {
-            case parseBMP::TYPE_PEER_DOWN : { // Peer down type
-
-                MsgBusInterface::obj_peer_down_event down_event = {};
-
-                if (pBMP->parsePeerDownEventHdr(read_fd,down_event)) {
-                    pBMP->bufferBMPMessage(read_fd);
-
-
-                    // Prepare the BGP parser
-                    pBGP = new parseBGP(logger, mbus_ptr, &p_entry, (char *)r_object.ip_addr,
-                                        &peer_info_map[peer_info_key]);
-
-                    if (cfg->debug_bgp)
-                       pBGP->enableDebug();
-
-                    // Check if the reason indicates we have a BGP message that follows
-                    switch (down_event.bmp_reason) {
-                        case 1 : { // Local system close with BGP notify
-                            snprintf(down_event.error_text, sizeof(down_event.error_text),
-                                    "Local close by (%s) for peer (%s) : ", r_object.ip_addr,
-                                    p_entry.peer_addr);
-                            pBGP->handleDownEvent(pBMP->bmp_data, pBMP->bmp_data_len, down_event);
-                            break;
-                        }
-                        case 2 : // Local system close, no bgp notify
-                        {
-                            // Read two byte code corresponding to the FSM event
-                            uint16_t fsm_event = 0 ;
-                            memcpy(&fsm_event, pBMP->bmp_data, 2);
-                            bgp::SWAP_BYTES(&fsm_event);
-
-                            snprintf(down_event.error_text, sizeof(down_event.error_text),
-                                    "Local (%s) closed peer (%s) session: fsm_event=%d, No BGP notify message.",
-                                    r_object.ip_addr,p_entry.peer_addr, fsm_event);
-                            break;
-                        }
-                        case 3 : { // remote system close with bgp notify
-                            snprintf(down_event.error_text, sizeof(down_event.error_text),
-                                    "Remote peer (%s) closed local (%s) session: ", r_object.ip_addr,
-                                    p_entry.peer_addr);
-
-                            pBGP->handleDownEvent(pBMP->bmp_data, pBMP->bmp_data_len, down_event);
-                            break;
-                        }
-                    }
+        if (not p_info->using_2_octet_asn and p_entry.isTwoOctet) {
+            p_info->using_2_octet_asn = true;
+        }
 
-                    delete pBGP;            // Free the bgp parser after each use.
+        if (lag != NULL)
+            p_info->lag_ms = lag->sample(p_entry.timestamp_secs, p_entry.timestamp_us);
+    }
 
-                    // Add event to the database
-                    if (client->initRec) // Require router init first
-                        mbus_ptr->update_Peer(p_entry, NULL, &down_event, mbus_ptr->PEER_ACTION_DOWN);
+    /*
+     * At this point we only have the BMP header message, what happens next depends
+     *      on the BMP message type.
+     */
+    switch (bmp_type) {
+        case parseBMP::TYPE_PEER_DOWN : { // Peer down type
 
-                } else {
-                    LOG_ERR("Error with client socket %d", read_fd);
-                    // Make sure to free the resource
-                    throw "BMPReader: Unable to read from client socket";
+            MsgBusInterface::obj_peer_down_event down_event = {};
+
+            p_info->lag_ms = 0;                     // A down peer is not behind
+
+            if (pBMP->parsePeerDownEventHdr(BMP_MSG_SOURCE,down_event)) {
+                pBMP->bufferBMPMessage(BMP_MSG_SOURCE);
+
+
+                // Prepare the BGP parser
+                pBGP = new parseBGP(logger, mbus_ptr, &p_entry, (char *)r_object.ip_addr,
+                                    p_info);
+
+                if (cfg->debug_bgp)
+                   pBGP->enableDebug();
+
+                // Check if the reason indicates we have a BGP message that follows
+                switch (down_event.bmp_reason) {
+                    case 1 : { // Local system close with BGP notify
+                        snprintf(down_event.error_text, sizeof(down_event.error_text),
+                                "Local close by (%s) for peer (%s) : ", r_object.ip_addr,
+                                p_entry.peer_addr);
+                        pBGP->handleDownEvent(pBMP->bmp_data, pBMP->bmp_data_len, down_event);
+                        break;
+                    }
+                    case 2 : // Local system close, no bgp notify
+                    {
+                        // Read two byte code corresponding to the FSM event
+                        uint16_t fsm_event = 0 ;
+                        memcpy(&fsm_event, pBMP->bmp_data, 2);
+                        bgp::SWAP_BYTES(&fsm_event);
+
+                        snprintf(down_event.error_text, sizeof(down_event.error_text),
+                                "Local (%s) closed peer (%s) session: fsm_event=%d, No BGP notify message.",
+                                r_object.ip_addr,p_entry.peer_addr, fsm_event);
+                        break;
+                    }
+                    case 3 : { // remote system close with bgp notify
+                        snprintf(down_event.error_text, sizeof(down_event.error_text),
+                                "Remote peer (%s) closed local (%s) session: ", r_object.ip_addr,
+                                p_entry.peer_addr);
+
+                        pBGP->handleDownEvent(pBMP->bmp_data, pBMP->bmp_data_len, down_event);
+                        break;
+                    }
                 }
-                break;
-            }
 
-            case parseBMP::TYPE_PEER_UP : // Peer up type
-            {
-                MsgBusInterface::obj_peer_up_event up_event = {};
+                delete pBGP;            // Free the bgp parser after each use.
 
-                if (pBMP->parsePeerUpEventHdr(read_fd, up_event)) {
-                    LOG_INFO("%s: PEER UP Received, local addr=%s:%hu remote addr=%s:%hu", client->c_ip,
-                            up_event.local_ip, up_event.local_port, p_entry.peer_addr, up_event.remote_port);
+                // Send the coalesced prefixes of the peer before it's marked down
+                if (coalescer != NULL)
+                    coalescer->flushPeer(mbus_ptr, p_entry.hash_id);
 
-                    pBMP->bufferBMPMessage(read_fd);
+                // Add event to the database
+                if (client->initRec) // Require router init first
+                    mbus_ptr->update_Peer(p_entry, NULL, &down_event, mbus_ptr->PEER_ACTION_DOWN);
 
-                    // Prepare the BGP parser
-                    pBGP = new parseBGP(logger, mbus_ptr, &p_entry, (char *)r_object.ip_addr,
-                                        &peer_info_map[peer_info_key]);
+            } else {
+                LOG_ERR("Error with client socket %d", BMP_MSG_SOURCE);
+                // Make sure to free the resource
+                throw "BMPReader: Unable to read from client socket";
+            }
+            break;
+        }
 
-                    if (cfg->debug_bgp)
-                       pBGP->enableDebug();
+        case parseBMP::TYPE_PEER_UP : // Peer up type
+        {
+            MsgBusInterface::obj_peer_up_event up_event = {};
 
-                    // Parse the BGP sent/received open messages
-                    int read = pBGP->handleUpEvent(pBMP->bmp_data, pBMP->bmp_data_len, &up_event);
+            if (pBMP->parsePeerUpEventHdr(BMP_MSG_SOURCE, up_event)) {
+                LOG_INFO("%s: PEER UP Received, local addr=%s:%hu remote addr=%s:%hu", client->c_ip,
+                        up_event.local_ip, up_event.local_port, p_entry.peer_addr, up_event.remote_port);
 
-                                        // Free the bgp parser
-                    delete pBGP;
+                pBMP->bufferBMPMessage(BMP_MSG_SOURCE);
 
-                    // Read info TLV data
-                    if (((int)pBMP->bmp_data_len - read) > 0) {
-                        SELF_DEBUG("%s: PEER UP has info data, parsing %d bytes", p_entry.peer_addr, pBMP->bmp_data_len - read);
-                        pBMP->parsePeerUpInfo(pBMP->bmp_data + read, (int)pBMP->bmp_data_len - read);
-                    }
+                // Prepare the BGP parser
+                pBGP = new parseBGP(logger, mbus_ptr, &p_entry, (char *)r_object.ip_addr,
+                                    p_info);
 
-                    // Add the up event to the DB
-                    if (client->initRec) // Require router init first
-                        mbus_ptr->update_Peer(p_entry, &up_event, NULL, mbus_ptr->PEER_ACTION_UP);
+                if (cfg->debug_bgp)
+                   pBGP->enableDebug();
 
-                } else {
-                    LOG_NOTICE("%s: PEER UP Received but failed to parse the BMP header.", client->c_ip);
+                // Parse the BGP sent/received open messages
+                int read = pBGP->handleUpEvent(pBMP->bmp_data, pBMP->bmp_data_len, &up_event);
+
+                                    // Free the bgp parser
+                delete pBGP;
+
+                // Read info TLV data
+                if (((int)pBMP->bmp_data_len - read) > 0) {
+                    SELF_DEBUG("%s: PEER UP has info data, parsing %d bytes", p_entry.peer_addr, pBMP->bmp_data_len - read);
+                    pBMP->parsePeerUpInfo(pBMP->bmp_data + read, (int)pBMP->bmp_data_len - read);
                 }
-                break;
-            }
 
-            case parseBMP::TYPE_ROUTE_MIRROR: { // Route mirroring type
-                pBMP->bufferBMPMessage(read_fd);
-                u_char *bufPtr = pBMP->bmp_data;
+                // Add the up event to the DB
+                if (client->initRec) // Require router init first
+                    mbus_ptr->update_Peer(p_entry, &up_event, NULL, mbus_ptr->PEER_ACTION_UP);
 
-                parseBMP::route_mirror_tlv mirror_tlv;
+            } else {
+                LOG_NOTICE("%s: PEER UP Received but failed to parse the BMP header.", client->c_ip);
+            }
+            break;
+        }
 
+        case parseBMP::TYPE_ROUTE_MIRROR: { // Route mirroring type
+            pBMP->bufferBMPMessage(BMP_MSG_SOURCE);
+            u_char *bufPtr = pBMP->bmp_data;
 
-                // There could be 2 or more TLVs.
-                for (int i = 0; i < pBMP->bmp_data_len; i += BMP_MIRROR_TLV_HDR_LEN) {
-                    memcpy(&mirror_tlv, bufPtr, BMP_MIRROR_TLV_HDR_LEN);
-                    mirror_tlv.data = NULL;
-                    bgp::SWAP_BYTES(&mirror_tlv.len);
-                    bgp::SWAP_BYTES(&mirror_tlv.type);
+            parseBMP::route_mirror_tlv mirror_tlv;
 
-                    bufPtr += BMP_MIRROR_TLV_HDR_LEN;                // Move pointer past the tlv header
 
-                    SELF_DEBUG("%s: route mirror TLV type %hu and length %hu being parsed",
-                               p_entry.peer_addr, mirror_tlv.type, mirror_tlv.len);
+            // There could be 2 or more TLVs.
+            for (int i = 0; i < pBMP->bmp_data_len; i += BMP_MIRROR_TLV_HDR_LEN) {
+                memcpy(&mirror_tlv, bufPtr, BMP_MIRROR_TLV_HDR_LEN);
+                mirror_tlv.data = NULL;
+                bgp::SWAP_BYTES(&mirror_tlv.len);
+                bgp::SWAP_BYTES(&mirror_tlv.type);
 
-                    if (mirror_tlv.len <= (i - pBMP->bmp_data_len)) {
-                        mirror_tlv.data = bufPtr;
+                bufPtr += BMP_MIRROR_TLV_HDR_LEN;                // Move pointer past the tlv header
 
-                        if (mirror_tlv.type == 0 /* BGP message */) {
-                            /*
-                             * Read and parse the the BGP message from the client.
-                             *     parseBGP will update kafka directly
-                             */
-                            pBGP = new parseBGP(logger, mbus_ptr, &p_entry, (char *)r_object.ip_addr,
-                                                &peer_info_map[peer_info_key]);
+                SELF_DEBUG("%s: route mirror TLV type %hu and length %hu being parsed",
+                           p_entry.peer_addr, mirror_tlv.type, mirror_tlv.len);
 
-                            if (cfg->debug_bgp)
-                                pBGP->enableDebug();
+                if (mirror_tlv.len <= (i - pBMP->bmp_data_len)) {
+                    mirror_tlv.data = bufPtr;
 
-                            pBGP->handleUpdate(mirror_tlv.data, mirror_tlv.len);
-                            delete pBGP;
-                        }
+                    if (mirror_tlv.type == 0 /* BGP message */) {
+                        /*
+                         * Read and parse the the BGP message from the client.
+                         *     parseBGP will update kafka directly
+                         */
+                        pBGP = new parseBGP(logger, mbus_ptr, &p_entry, (char *)r_object.ip_addr,
+                                            p_info);
 
-                        bufPtr += mirror_tlv.len;
-                        i += mirror_tlv.len;
+                        if (cfg->debug_bgp)
+                            pBGP->enableDebug();
 
-                    } else {
-                        SELF_DEBUG("Dropping route mirror message due to length %hu > %d",
-                                   mirror_tlv.len, (i - pBMP->bmp_data_len));
-                        break;
+                        pBGP->setCoalescer(coalescer);
+                        pBGP->setFilter(filter);
+                        pBGP->setSkipAttrs(cfg->projection_skip_attrs);
+                        pBGP->handleUpdate(mirror_tlv.data, mirror_tlv.len);
+                        delete pBGP;
                     }
-                }
 
-                break;
+                    bufPtr += mirror_tlv.len;
+                    i += mirror_tlv.len;
+
+                } else {
+                    SELF_DEBUG("Dropping route mirror message due to length %hu > %d",
+                               mirror_tlv.len, (i - pBMP->bmp_data_len));
+                    break;
+                }
             }
 
-            case parseBMP::TYPE_ROUTE_MON : { // Route monitoring type
-                pBMP->bufferBMPMessage(read_fd);
+            break;
+        }
 
-                /*
-                 * Read and parse the the BGP message from the client.
-                 *     parseBGP will update kafka directly
-                 */
-                pBGP = new parseBGP(logger, mbus_ptr, &p_entry, (char *)r_object.ip_addr,
-                                    &peer_info_map[peer_info_key]);
+        case parseBMP::TYPE_ROUTE_MON : { // Route monitoring type
+            pBMP->bufferBMPMessage(BMP_MSG_SOURCE);
 
-                if (cfg->debug_bgp)
-                    pBGP->enableDebug();
+            /*
+             * Read and parse the the BGP message from the client.
+             *     parseBGP will update kafka directly
+             */
+            pBGP = new parseBGP(logger, mbus_ptr, &p_entry, (char *)r_object.ip_addr,
+                                p_info);
 
-                pBGP->handleUpdate(pBMP->bmp_data, pBMP->bmp_data_len);
+            if (cfg->debug_bgp)
+                pBGP->enableDebug();
+
+            pBGP->setCoalescer(coalescer);
+            pBGP->setFilter(filter);
+            pBGP->setSkipAttrs(cfg->projection_skip_attrs);
+            pBGP->handleUpdate(pBMP->bmp_data, pBMP->bmp_data_len);
    		
-                string str(reinterpret_cast<char*>(client->hash_id), 16);  //storing the client hash in a string
-                if(client->initRec && cfg->router_baseline_time.find(str) == cfg->router_baseline_time.end())
-                        //check if client has received init message and Baseline time is not already calculated
-                {
-                    peer_info_map_iter it = peer_info_map.begin();
-                    while (it != peer_info_map.end() && it->second.endOfRIB)
-                        ++it;
-
-                    if (it == peer_info_map.end() || checkRIBdumpRate(p_entry.timestamp_secs,mbus_ptr->ribSeq)) {  //End-Of-RIBs are received for all peers.
+            string str(reinterpret_cast<char*>(client->hash_id), 16);  //storing the client hash in a string
+            if(client->initRec && rib_dump)
+                    //check if client has received init message and is still in the initial RIB dump
+            {
+                peer_info_map_iter it = peer_info_map.begin();
+                while (it != peer_info_map.end() && it->second.endOfRIB)
+                    ++it;
+
+                if (it == peer_info_map.end() || checkRIBdumpRate(p_entry.timestamp_secs,mbus_ptr->ribSeq)) {  //End-Of-RIBs are received for all peers.
+                    rib_dump = false;
+
+                    if (not RouterBaseline::known(str)) {
+                        //Baseline time is not already calculated
                         timeval now;
                         gettimeofday(&now, NULL);
-                        cfg->router_baseline_time[str] = 1.2 * (now.tv_sec - client->startTime.tv_sec);  //20% buffer for baseline time
+                        RouterBaseline::set(str, 1.2 * (now.tv_sec - client->startTime.tv_sec));  //20% buffer for baseline time
                     }
                 }
+            }
 
-                delete pBGP;
+            mbus_ptr->setRibDump(rib_dump);
 
-                break;
-            }
+            delete pBGP;
 
-            case parseBMP::TYPE_STATS_REPORT : { // Stats Report
-                MsgBusInterface::obj_stats_report stats = {};
-                if (! pBMP->handleStatsReport(read_fd, stats))
+            break;
+        }
 
-                    // Add to mysql
-                    if (client->initRec) // Require router init first
-                        mbus_ptr->add_StatReport(p_entry, stats);
+        case parseBMP::TYPE_STATS_REPORT : { // Stats Report
+            MsgBusInterface::obj_stats_report stats = {};
+            if (! pBMP->handleStatsReport(BMP_MSG_SOURCE, stats))
 
-                break;
-            }
+                // Add to mysql
+                if (client->initRec) // Require router init first
+                    mbus_ptr->add_StatReport(p_entry, stats);
+
+            break;
+        }
 
-            case parseBMP::TYPE_INIT_MSG : { // Initiation Message
-                client->initRec = true; 		//indicating that init message is received for the router/client.
+        case parseBMP::TYPE_INIT_MSG : { // Initiation Message
+            client->initRec = true; 		//indicating that init message is received for the router/client.
 
-                LOG_INFO("%s: Init message received with length of %u", client->c_ip, pBMP->getBMPLength());
-                pBMP->handleInitMsg(read_fd, r_object);
+            LOG_INFO("%s: Init message received with length of %u", client->c_ip, pBMP->getBMPLength());
+            pBMP->handleInitMsg(BMP_MSG_SOURCE, r_object);
 		
-                if(cfg->pat_enabled && r_object.hash_type)
-                    hashRouter(client, r_object);
+            if(cfg->pat_enabled && r_object.hash_type)
+                hashRouter(client, r_object);
 
-                LOG_INFO("Router ID hashed with hash_type: %d", r_object.hash_type);
+            LOG_INFO("Router ID hashed with hash_type: %d", r_object.hash_type);
 
-                // Update the router entry with the details
-                mbus_ptr->update_Router(r_object, mbus_ptr->ROUTER_ACTION_INIT);
+            // Update the router entry with the details
+            mbus_ptr->update_Router(r_object, mbus_ptr->ROUTER_ACTION_INIT);
 
-                break;
-            }
+            break;
+        }
 
-            case parseBMP::TYPE_TERM_MSG : { // Termination Message
-                LOG_INFO("%s: Term message received with length of %u", client->c_ip, pBMP->getBMPLength());
+        case parseBMP::TYPE_TERM_MSG : { // Termination Message
+            LOG_INFO("%s: Term message received with length of %u", client->c_ip, pBMP->getBMPLength());
 
 
-                pBMP->handleTermMsg(read_fd, r_object);
+            pBMP->handleTermMsg(BMP_MSG_SOURCE, r_object);
 
-                LOG_INFO("Proceeding to disconnect router");
-                mbus_ptr->update_Router(r_object, mbus_ptr->ROUTER_ACTION_TERM);
-                close(client->c_sock);
+            LOG_INFO("Proceeding to disconnect router");
+            if (coalescer != NULL)
+                coalescer->flush(mbus_ptr);
 
-                rval = false;                           // Indicate connection is closed
-                break;
-            }
+            mbus_ptr->update_Router(r_object, mbus_ptr->ROUTER_ACTION_TERM);
+            close(client->c_sock);
 
+            rval = false;                           // Indicate connection is closed
+            break;
         }
-    } catch (char const *str) {
-        // Mark the router as disconnected and update the error to be a local disconnect (no term message received)
-        LOG_INFO("%s: Caught: %s", client->c_ip, str);
-        disconnect(client, mbus_ptr, parseBMP::TERM_REASON_OPENBMP_CONN_ERR, str);
 
-        delete pBMP;                    // Make sure to free the resource
-        throw str;
     }
     
     // Send BMP RAW packet data
     if (client->initRec) // Require router init first
-        mbus_ptr->send_bmp_raw(router_hash_id, p_entry, pBMP->bmp_packet, pBMP->bmp_packet_len);
+        mbus_ptr->send_bmp_raw(router_hash_id, p_entry, const_cast<u_char *>(ev.msg), ev.len);
 
-    // Free the bmp parser
-    delete pBMP;
+    // Peer and router state changes invalidate the cached peer headers
+    if (bmp_type == parseBMP::TYPE_PEER_UP or bmp_type == parseBMP::TYPE_PEER_DOWN or
+            bmp_type == parseBMP::TYPE_INIT_MSG or bmp_type == parseBMP::TYPE_TERM_MSG)
+        resetPeerHdrCache();
 
     return rval;
 }
 
+/**
+ * Reset the peer header cache
+ */
+void BMPReader::resetPeerHdrCache() {
+    for (int i = 0; i < BMP_PEER_HDR_CACHE_SIZE; i++)
+        peer_hdr_cache.entries[i].valid = false;
+
+    bzero(peer_hdr_states, sizeof(peer_hdr_states));
+}
+
+/**
+ * Add the peer header cache hits/misses since the last call to the metrics
+ */
+void BMPReader::publishPeerHdrCacheStats() {
+    static Metrics::Counter &hits = Metrics::get("bmp.peer_hdr_cache.hits");
+    static Metrics::Counter &misses = Metrics::get("bmp.peer_hdr_cache.misses");
+
+    hits.fetch_add(peer_hdr_cache.hits - peer_hdr_hits_published, std::memory_order_relaxed);
+    misses.fetch_add(peer_hdr_cache.misses - peer_hdr_misses_published, std::memory_order_relaxed);
+
+    peer_hdr_hits_published = peer_hdr_cache.hits;
+    peer_hdr_misses_published = peer_hdr_cache.misses;
+}
+
+/**
+ * Publish the router and peer lag to the lag estimator
+ */
+void BMPReader::publishLag() {
+    int64_t peer_max_ms = 0;
+    uint32_t peers_behind = 0;
+    const std::string *peer_max = NULL;
+
+    for (peer_info_map_iter it = peer_info_map.begin(); it != peer_info_map.end(); ++it) {
+        if (it->second.lag_ms > lag->thresholdMs())
+            ++peers_behind;
+
+        if (it->second.lag_ms > peer_max_ms) {
+            peer_max_ms = it->second.lag_ms;
+            peer_max = &it->first;
+        }
+    }
+
+    lag->publish(peer_max_ms, peers_behind, peer_max != NULL ? *peer_max : std::string());
+}
+
 bool BMPReader::checkRIBdumpRate(uint32_t timeStamp, int ribSeq) {
     int time, currRate;                                  
 
@@ -439,6 +676,9 @@ bool BMPReader::checkRIBdumpRate(uint32_t timeStamp, int ribSeq) {
  *
  */
 void BMPReader::disconnect(BMPListener::ClientInfo *client, MsgBusInterface *mbus_ptr, int reason_code, char const *reason_text) {
+    // Send the coalesced prefixes before the router is marked down
+    if (coalescer != NULL)
+        coalescer->flush(mbus_ptr);
 
     MsgBusInterface::obj_router r_object;
     bzero(&r_object, sizeof(r_object));
@@ -12,10 +12,16 @@
 
 #include "BMPListener.h"
 #include "BMPReader.h"
-#include "AddPathDataContainer.h"
+#include "parseBMP.h"
+#include "BMPStream.h"
+#include "PeerInfo.h"
 #include "MsgBusInterface.hpp"
 #include "Logger.h"
 #include "Config.h"
+#include "PrefixCoalescer.h"
+#include "FilterEngine.h"
+#include "ConfigRcu.h"
+#include "LagEstimator.h"
 
 #include <map>
 #include <memory>
@@ -30,17 +36,16 @@ class BMPReader {
 
 public:
     /**
-     * Persistent peer information structure
-     *
-     *   OPEN and other updates can add/change persistent peer information.
+     * Persistent peer information, see bgp::peer_info
      */
-    struct peer_info {
-        bool sent_four_octet_asn;                               ///< Indicates if 4 (true) or 2 (false) octet ASN is being used (sent cap)
-        bool recv_four_octet_asn;                               ///< Indicates if 4 (true) or 2 (false) octet ASN is being used (recv cap)
-        bool using_2_octet_asn;                                 ///< Indicates if peer is using two octet ASN format or not (true=2 octet, false=4 octet)
-        AddPathDataContainer add_path_capability;               ///< Stores data about Add Path capability
-        string peer_group;                                      ///< Peer group name of defined
-	bool endOfRIB;						///< Indicates if End-Of-RIB marker is received
+    typedef bgp::peer_info peer_info;
+
+    /**
+     * Session state for a cached peer header, indexed the same as parseBMP::peer_hdr_cache entries
+     */
+    struct peer_hdr_state {
+        peer_info   *info;                                      ///< Persistent peer info map entry, NULL if not looked up
+        bool        peer_sent;                                  ///< Peer hash is set and peer has been sent to the message bus
     };
 
 
@@ -58,7 +63,8 @@ public:
     /**
      * Read messages from BMP stream
      *
-     * BMP routers send BMP/BGP messages, this method reads and parses those.
+     * BMP routers send BMP/BGP messages, this method reads the available bytes and parses the
+     * complete messages, see BMPStream.
      *
      * \param [in]  client      Client information pointer
      * \param [in]  mbus_ptr     The database pointer referencer - DB should be already initialized
@@ -111,6 +117,32 @@ public:
 
     void hashRouter(BMPListener::ClientInfo *client, MsgBusInterface::obj_router &r_entry);
 
+    /**
+     * Set the ingest filter to apply to routes
+     *
+     * \param [in] filter   Ingest filter shared by all routers, NULL to accept all routes
+     */
+    void setFilter(FilterEngine *filter);
+
+    /**
+     * Number of BMP messages processed by the session
+     */
+    uint64_t messageCount() const { return stream != NULL ? stream->messages() : 0; }
+
+    /**
+     * Set the reader of reloaded configs, the session switches to them between reads
+     *
+     * \param [in] reader   Config reader of the session, NULL to keep the config
+     */
+    void setConfigReader(ConfigRcu::Reader *reader);
+
+    /**
+     * Set the lag estimator of the session
+     *
+     * \param [in] lag      Lag estimator, NULL to disable lag estimation
+     */
+    void setLagEstimator(LagEstimator *lag);
+
     // Debug methods
     void enableDebug();
     void disableDebug();
@@ -129,6 +161,47 @@ private:
     int32_t 	prevRIBdumpTime;            ///< Stores the time the previous message was received
     int32_t 	maxRIBdumpRate;             ///< Stores the maximum RIB dump rate
     int32_t     belowThresholdInitTime;     ///< Stores the time when the RIB dump rate has dropped below threshold
+    bool        rib_dump;                   ///< Router is in its initial RIB dump, until End-of-RIB of all peers or the dump rate dropped
+    parseBMP::peer_hdr_cache peer_hdr_cache;                    ///< Decoded peer header cache for the session
+    peer_hdr_state peer_hdr_states[BMP_PEER_HDR_CACHE_SIZE];    ///< Session state per peer header cache entry
+    uint64_t    peer_hdr_hits_published;                        ///< Cache hits already added to the metrics
+    uint64_t    peer_hdr_misses_published;                      ///< Cache misses already added to the metrics
+    PrefixCoalescer *coalescer;                                 ///< Unicast prefix flap coalescer, NULL if disabled
+    FilterEngine *filter;                                       ///< Ingest filter, NULL if disabled
+    ConfigRcu::Reader *cfg_reader;                              ///< Reloaded config reader, NULL if not reloaded
+    LagEstimator *lag;                                          ///< Lag estimator, NULL if disabled
+    BMPStream   *stream;                                        ///< Framing and header decoding of the session, created on first read
+
+    /**
+     * Process a BMP message
+     *
+     * \param [in]  client      Client information pointer
+     * \param [in]  mbus_ptr    The database pointer referencer - DB should be already initialized
+     * \param [in]  ev          Decoded message, the rest is read with BMP_MSG_SOURCE
+     *
+     * \return true if more to read, false if the connection is done/closed
+     *
+     * \throw (char const *str) message indicate error
+     */
+    bool processMessage(BMPListener::ClientInfo *client, MsgBusInterface *mbus_ptr, BMPStream::event &ev);
+
+    /**
+     * Reset the peer header cache
+     *
+     *      Called when peer state can change (peer up/down, router init/term)
+     */
+    void resetPeerHdrCache();
+
+    /**
+     * Add the peer header cache hits/misses since the last call to the metrics
+     */
+    void publishPeerHdrCacheStats();
+
+    /**
+     * Publish the router and peer lag to the lag estimator
+     */
+    void publishLag();
+
     /**
      * Persistent peer info map, Key is the peer_hash_id.
      */
@@ -0,0 +1,160 @@
+/*
+ * Copyright (c) 2013-2016 Cisco Systems, Inc. and others.  All rights reserved.
+ *
+ * This program and the accompanying materials are made available under the
+ * terms of the Eclipse Public License v1.0 which accompanies this distribution,
+ * and is available at http://www.eclipse.org/legal/epl-v10.html
+ *
+ */
+
+#include <cstring>
+#include <cerrno>
+#include <unistd.h>
+
+#include "BMPStream.h"
+
+/**
+ * Constructor for class
+ *
+ * \param [in] logPtr       Pointer to existing Logger for app logging
+ * \param [in] callback     Called for each complete message
+ */
+BMPStream::BMPStream(Logger *logPtr, Callback callback) : callback(callback) {
+    logger = logPtr;
+
+    parser = new parseBMP(logger, &peer);
+
+    buf.resize(BMP_STREAM_BUF_SIZE);
+    start = 0;
+    end = 0;
+    msgs = 0;
+}
+
+BMPStream::~BMPStream() {
+    delete parser;
+}
+
+/**
+ * Push bytes of the session
+ *
+ * \param [in] data     Bytes, may hold partial messages
+ * \param [in] len      Number of bytes
+ *
+ * \return false if the callback stopped the stream, true otherwise
+ *
+ * \throws (const char *) on an invalid message or an error from the callback
+ */
+bool BMPStream::feed(const u_char *data, size_t len) {
+    while (len > 0) {
+        if (buf.size() - end < len)
+            compact();
+
+        size_t n = buf.size() - end < len ? buf.size() - end : len;
+
+        memcpy(&buf[end], data, n);
+        end += n;
+        data += n;
+        len -= n;
+
+        if (not frame())
+            return false;
+    }
+
+    return true;
+}
+
+/**
+ * Read available bytes from a socket and push them, blocks until at least one byte is read
+ *
+ * \param [in] sock     Socket or pipe to read from
+ *
+ * \return false if the callback stopped the stream, true otherwise
+ *
+ * \throws (const char *) if the read fails or the connection is closed, on an invalid
+ *         message or an error from the callback
+ */
+bool BMPStream::read(int sock) {
+    if (buf.size() - end < BMP_STREAM_READ_SIZE)
+        compact();
+
+    ssize_t bytes_read;
+
+    do {
+        bytes_read = ::read(sock, &buf[end], buf.size() - end);
+    } while (bytes_read < 0 and errno == EINTR);
+
+    if (bytes_read < 0)
+        throw "(1) Failed to read from socket.";
+    else if (bytes_read == 0)
+        throw "(2) Connection closed";
+
+    end += bytes_read;
+
+    return frame();
+}
+
+/**
+ * Decode and emit the complete messages held
+ *
+ * \return false if the callback stopped the stream, true otherwise
+ */
+bool BMPStream::frame() {
+    size_t msg_len;
+
+    while ((msg_len = parseBMP::messageLength(&buf[start], end - start)) > 0) {
+        const u_char *msg = &buf[start];
+
+        // The next message starts at the framed length, whatever the callback reads
+        start += msg_len;
+
+        parser->setMessage(msg, msg_len);
+
+        event ev;
+        ev.type = parser->handleMessage(BMP_MSG_SOURCE);
+        ev.parser = parser;
+        ev.peer = &peer;
+        ev.msg = msg;
+        ev.len = msg_len;
+
+        ++msgs;
+
+        if (not callback(ev))
+            return false;
+    }
+
+    if (start == end)
+        start = end = 0;
+
+    return true;
+}
+
+/**
+ * Move the held bytes to the start of the buffer
+ */
+void BMPStream::compact() {
+    if (start == 0)
+        return;
+
+    memmove(&buf[0], &buf[start], end - start);
+    end -= start;
+    start = 0;
+}
+
+/**
+ * Set the decoded peer header cache to use
+ *
+ * \param [in] cache    Session peer header cache, NULL to disable caching
+ */
+void BMPStream::setPeerHdrCache(parseBMP::peer_hdr_cache *cache) {
+    parser->setPeerHdrCache(cache);
+}
+
+/**
+ * Enable/Disable debug
+ */
+void BMPStream::enableDebug() {
+    parser->enableDebug();
+}
+void BMPStream::disableDebug() {
+    parser->disableDebug();
+}
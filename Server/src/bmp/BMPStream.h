@@ -0,0 +1,147 @@
+/*
+ * Copyright (c) 2013-2016 Cisco Systems, Inc. and others.  All rights reserved.
+ *
+ * This program and the accompanying materials are made available under the
+ * terms of the Eclipse Public License v1.0 which accompanies this distribution,
+ * and is available at http://www.eclipse.org/legal/epl-v10.html
+ *
+ */
+
+#ifndef BMPSTREAM_H_
+#define BMPSTREAM_H_
+
+#include <cstdint>
+#include <functional>
+#include <vector>
+#include <sys/types.h>
+
+#include "parseBMP.h"
+#include "MsgBusInterface.hpp"
+#include "Logger.h"
+
+#define BMP_STREAM_BUF_SIZE     (4 * BMP_PACKET_BUF_SIZE)   // Stream buffer size, holds at least one max size message
+#define BMP_STREAM_READ_SIZE    65536                       // Max bytes read from the socket per read()
+
+/**
+ * \class   BMPStream
+ *
+ * \brief   Push based BMP parser
+ * \details
+ *      Bytes of a BMP session are pushed in chunks of any size, a message may be split over
+ *      any number of chunks.  The stream keeps the partial message and, for each complete
+ *      message, decodes the common and per-peer headers and calls the callback with the event.
+ *
+ *      The callback reads the rest of the message with the parser of the event, passing
+ *      BMP_MSG_SOURCE as the socket (e.g. parser->bufferBMPMessage(BMP_MSG_SOURCE)).  Bytes
+ *      the callback does not read are skipped, the next message starts at the framed length.
+ *
+ *      The event, the parser and the message are only valid during the callback.  One
+ *      instance is used per BMP session, it is not thread safe.
+ */
+class BMPStream {
+public:
+    /**
+     * Decoded BMP message
+     */
+    struct event {
+        char            type;                           ///< BMP message type, see parseBMP::BMP_TYPE
+        parseBMP        *parser;                        ///< Parser positioned after the headers
+        MsgBusInterface::obj_bgp_peer *peer;            ///< Decoded peer header, zero for init and term messages
+        const u_char    *msg;                           ///< Complete raw message
+        size_t          len;                            ///< Length of the raw message
+    };
+
+    /**
+     * Event callback
+     *
+     * \return true to continue, false to stop the stream (e.g. after a term message)
+     *
+     * \throws (const char *) to stop the stream on error, it is passed to the caller of feed()
+     */
+    typedef std::function<bool (event &ev)> Callback;
+
+    /**
+     * Constructor for class
+     *
+     * \param [in] logPtr       Pointer to existing Logger for app logging
+     * \param [in] callback     Called for each complete message
+     */
+    BMPStream(Logger *logPtr, Callback callback);
+
+    ~BMPStream();
+
+    /**
+     * Push bytes of the session
+     *
+     * \param [in] data     Bytes, may hold partial messages
+     * \param [in] len      Number of bytes
+     *
+     * \return false if the callback stopped the stream, true otherwise
+     *
+     * \throws (const char *) on an invalid message or an error from the callback
+     */
+    bool feed(const u_char *data, size_t len);
+
+    /**
+     * Read available bytes from a socket and push them, blocks until at least one byte is read
+     *
+     * \param [in] sock     Socket or pipe to read from
+     *
+     * \return false if the callback stopped the stream, true otherwise
+     *
+     * \throws (const char *) if the read fails or the connection is closed, on an invalid
+     *         message or an error from the callback
+     */
+    bool read(int sock);
+
+    /**
+     * Bytes of partial messages held
+     */
+    size_t pending() const { return end - start; }
+
+    /**
+     * Number of complete messages decoded and passed to the callback
+     */
+    uint64_t messages() const { return msgs; }
+
+    /**
+     * Drop held bytes, e.g. when the session is reconnected
+     */
+    void reset() { start = end = 0; }
+
+    /**
+     * Set the decoded peer header cache to use
+     *
+     * \param [in] cache    Session peer header cache, NULL to disable caching
+     */
+    void setPeerHdrCache(parseBMP::peer_hdr_cache *cache);
+
+    // Debug methods
+    void enableDebug();
+    void disableDebug();
+
+private:
+    Logger      *logger;                                ///< Logging class pointer
+    Callback    callback;                               ///< Event callback
+    parseBMP    *parser;                                ///< Parser, reused for each message
+    MsgBusInterface::obj_bgp_peer peer;                 ///< Peer entry of the parser
+
+    std::vector<u_char> buf;                            ///< Stream buffer
+    size_t      start;                                  ///< Offset of the first held byte
+    size_t      end;                                    ///< Offset after the last held byte
+    uint64_t    msgs;                                   ///< Messages passed to the callback
+
+    /**
+     * Decode and emit the complete messages held
+     *
+     * \return false if the callback stopped the stream, true otherwise
+     */
+    bool frame();
+
+    /**
+     * Move the held bytes to the start of the buffer
+     */
+    void compact();
+};
+
+#endif /* BMPSTREAM_H_ */
@@ -0,0 +1,157 @@
+/*
+ * Copyright (c) 2013-2016 Cisco Systems, Inc. and others.  All rights reserved.
+ *
+ * This program and the accompanying materials are made available under the
+ * terms of the Eclipse Public License v1.0 which accompanies this distribution,
+ * and is available at http://www.eclipse.org/legal/epl-v10.html
+ *
+ */
+
+#include <chrono>
+#include <cinttypes>
+#include <sys/time.h>
+
+#include "LagEstimator.h"
+
+/**
+ * Steady clock in milliseconds
+ */
+static uint64_t steadyMs() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/**
+ * Constructor for class
+ *
+ * \param [in] logPtr           Pointer to Logger instance
+ * \param [in] router_ip        Router IP address, used in the metric names
+ * \param [in] threshold_sec    Seconds of lag before the session is behind
+ */
+LagEstimator::LagEstimator(Logger *logPtr, const char *router_ip, int threshold_sec) :
+        logger(logPtr), router_ip(router_ip),
+        m_lag_ms(Metrics::get("lag.router." + std::string(router_ip) + ".ms")),
+        m_peer_max_ms(Metrics::get("lag.router." + std::string(router_ip) + ".peer_max_ms")),
+        m_peers_behind(Metrics::get("lag.router." + std::string(router_ip) + ".peers_behind")),
+        m_socket_bytes(Metrics::get("lag.router." + std::string(router_ip) + ".socket_bytes")),
+        m_buffer_bytes(Metrics::get("lag.router." + std::string(router_ip) + ".buffer_bytes")) {
+
+    threshold_ms = (int64_t)threshold_sec * 1000;
+    lag_ms = 0;
+    sampled = false;
+    next_publish_ms = steadyMs() + LAG_PUBLISH_INTERVAL_MS;
+    intervals_over = 0;
+    behind = false;
+
+    socket_bytes = 0;
+    buffer_bytes = 0;
+}
+
+/**
+ * Destructor, clears the gauges of the router
+ */
+LagEstimator::~LagEstimator() {
+    if (behind)
+        Metrics::get("lag.routers_behind").fetch_sub(1, std::memory_order_relaxed);
+
+    m_lag_ms.store(0, std::memory_order_relaxed);
+    m_peer_max_ms.store(0, std::memory_order_relaxed);
+    m_peers_behind.store(0, std::memory_order_relaxed);
+    m_socket_bytes.store(0, std::memory_order_relaxed);
+    m_buffer_bytes.store(0, std::memory_order_relaxed);
+}
+
+/**
+ * Lag of a message
+ *
+ * \param [in] ts_secs      BMP peer header timestamp seconds
+ * \param [in] ts_us        BMP peer header timestamp microseconds
+ *
+ * \return Lag in milliseconds, zero if the timestamp is ahead of the wall clock
+ */
+int64_t LagEstimator::sample(uint32_t ts_secs, uint32_t ts_us) {
+    timeval now;
+    gettimeofday(&now, NULL);
+
+    int64_t lag = ((int64_t)now.tv_sec - ts_secs) * 1000 + ((int64_t)now.tv_usec - ts_us) / 1000;
+
+    lag_ms = lag > 0 ? lag : 0;
+    sampled = true;
+
+    return lag_ms;
+}
+
+/**
+ * Set the bytes queued for the session
+ *
+ * \param [in] socket_bytes     Bytes in the kernel socket receive buffers
+ * \param [in] buffer_bytes     Bytes in the collector circular buffer
+ */
+void LagEstimator::setQueued(uint64_t socket_bytes, uint64_t buffer_bytes) {
+    this->socket_bytes.store(socket_bytes, std::memory_order_relaxed);
+    this->buffer_bytes.store(buffer_bytes, std::memory_order_relaxed);
+}
+
+/**
+ * Check if the lag should be published
+ *
+ * \return true if the publish interval has passed
+ */
+bool LagEstimator::due() {
+    uint64_t now_ms = steadyMs();
+
+    if (now_ms < next_publish_ms)
+        return false;
+
+    next_publish_ms = now_ms + LAG_PUBLISH_INTERVAL_MS;
+    return true;
+}
+
+/**
+ * Publish the lag metrics and log the session if it is or stops being behind
+ *
+ * \param [in] peer_max_ms      Max lag of the peers in milliseconds
+ * \param [in] peers_behind     Number of peers with a lag over the threshold
+ * \param [in] peer_max         Name of the peer with the max lag, for logging
+ */
+void LagEstimator::publish(int64_t peer_max_ms, uint32_t peers_behind, const std::string &peer_max) {
+    static Metrics::Counter &m_routers_behind = Metrics::get("lag.routers_behind");
+
+    uint64_t queued_socket = socket_bytes.load(std::memory_order_relaxed);
+    uint64_t queued_buffer = buffer_bytes.load(std::memory_order_relaxed);
+
+    // Nothing received and nothing queued, the router is idle and not behind
+    if (not sampled and queued_socket == 0 and queued_buffer == 0)
+        lag_ms = 0;
+
+    sampled = false;
+
+    m_lag_ms.store(lag_ms, std::memory_order_relaxed);
+    m_peer_max_ms.store(peer_max_ms, std::memory_order_relaxed);
+    m_peers_behind.store(peers_behind, std::memory_order_relaxed);
+    m_socket_bytes.store(queued_socket, std::memory_order_relaxed);
+    m_buffer_bytes.store(queued_buffer, std::memory_order_relaxed);
+
+    if (lag_ms > threshold_ms or peer_max_ms > threshold_ms) {
+        if (++intervals_over == LAG_BEHIND_INTERVALS) {
+            behind = true;
+            m_routers_behind.fetch_add(1, std::memory_order_relaxed);
+
+            LOG_WARN("%s: Router is behind, lag=%" PRId64 "ms peer max lag=%" PRId64 "ms (%s) peers behind=%u"
+                     " queued socket=%" PRIu64 " buffer=%" PRIu64 " bytes",
+                     router_ip.c_str(), lag_ms, peer_max_ms, peer_max.c_str(), peers_behind,
+                     queued_socket, queued_buffer);
+        }
+
+    } else {
+        if (behind) {
+            behind = false;
+            m_routers_behind.fetch_sub(1, std::memory_order_relaxed);
+
+            LOG_NOTICE("%s: Router caught up after %u seconds behind, lag=%" PRId64 "ms peer max lag=%" PRId64 "ms",
+                       router_ip.c_str(), intervals_over * LAG_PUBLISH_INTERVAL_MS / 1000, lag_ms, peer_max_ms);
+        }
+
+        intervals_over = 0;
+    }
+}
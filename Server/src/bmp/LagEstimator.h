@@ -0,0 +1,119 @@
+/*
+ * Copyright (c) 2013-2016 Cisco Systems, Inc. and others.  All rights reserved.
+ *
+ * This program and the accompanying materials are made available under the
+ * terms of the Eclipse Public License v1.0 which accompanies this distribution,
+ * and is available at http://www.eclipse.org/legal/epl-v10.html
+ *
+ */
+
+#ifndef LAGESTIMATOR_H_
+#define LAGESTIMATOR_H_
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+#include "Logger.h"
+#include "Metrics.h"
+
+#define LAG_PUBLISH_INTERVAL_MS     1000        // Interval between lag metric updates
+#define LAG_BEHIND_INTERVALS        10          // Consecutive intervals over the threshold before a session is behind
+
+/**
+ * \class   LagEstimator
+ *
+ * \brief   Ingest lag of a router session
+ * \details
+ *      The lag of a message is the wall clock at processing time minus the BMP per-peer header
+ *      timestamp.  The router lag is the lag of the last message, the peer lag is tracked by the
+ *      reader per peer and published as the max and the number of peers over the threshold.  The
+ *      bytes queued in the kernel socket buffer and the collector buffer are set by the client
+ *      thread.
+ *
+ *      Every interval the values are published in the lag.router.<ip>.* gauges.  A session that
+ *      stays over the threshold for LAG_BEHIND_INTERVALS intervals is logged and counted in the
+ *      lag.routers_behind gauge until it catches up.
+ *
+ *      Routers may stamp the routes of the initial RIB dump with the time they were learned, the
+ *      lag is then high until the dump is done.
+ *
+ *      One instance is used per router connection.  sample() and publish() are called by the BMP
+ *      reader thread, setQueued() by the client thread.
+ */
+class LagEstimator {
+public:
+    /**
+     * Constructor for class
+     *
+     * \param [in] logPtr           Pointer to Logger instance
+     * \param [in] router_ip        Router IP address, used in the metric names
+     * \param [in] threshold_sec    Seconds of lag before the session is behind
+     */
+    LagEstimator(Logger *logPtr, const char *router_ip, int threshold_sec);
+
+    /**
+     * Destructor, clears the gauges of the router
+     */
+    ~LagEstimator();
+
+    /**
+     * Lag of a message
+     *
+     * \param [in] ts_secs      BMP peer header timestamp seconds
+     * \param [in] ts_us        BMP peer header timestamp microseconds
+     *
+     * \return Lag in milliseconds, zero if the timestamp is ahead of the wall clock
+     */
+    int64_t sample(uint32_t ts_secs, uint32_t ts_us);
+
+    /**
+     * Set the bytes queued for the session
+     *
+     * \param [in] socket_bytes     Bytes in the kernel socket receive buffers
+     * \param [in] buffer_bytes     Bytes in the collector circular buffer
+     */
+    void setQueued(uint64_t socket_bytes, uint64_t buffer_bytes);
+
+    /**
+     * Check if the lag should be published
+     *
+     * \return true if the publish interval has passed
+     */
+    bool due();
+
+    /**
+     * Publish the lag metrics and log the session if it is or stops being behind
+     *
+     * \param [in] peer_max_ms      Max lag of the peers in milliseconds
+     * \param [in] peers_behind     Number of peers with a lag over the threshold
+     * \param [in] peer_max         Name of the peer with the max lag, for logging
+     */
+    void publish(int64_t peer_max_ms, uint32_t peers_behind, const std::string &peer_max);
+
+    /**
+     * Threshold in milliseconds
+     */
+    int64_t thresholdMs() const { return threshold_ms; }
+
+private:
+    Logger      *logger;                        ///< Logging class pointer
+    std::string router_ip;                      ///< Router IP address
+    int64_t     threshold_ms;                   ///< Lag before the session is behind
+    int64_t     lag_ms;                         ///< Lag of the last message
+    bool        sampled;                        ///< A message was sampled since the last publish
+    uint64_t    next_publish_ms;                ///< Steady clock time of the next publish
+    uint32_t    intervals_over;                 ///< Consecutive intervals over the threshold
+    bool        behind;                         ///< Session is logged as behind
+
+    std::atomic<uint64_t> socket_bytes;         ///< Bytes in the kernel socket receive buffers
+    std::atomic<uint64_t> buffer_bytes;         ///< Bytes in the collector circular buffer
+
+    Metrics::Counter &m_lag_ms;                 ///< lag.router.<ip>.ms
+    Metrics::Counter &m_peer_max_ms;            ///< lag.router.<ip>.peer_max_ms
+    Metrics::Counter &m_peers_behind;           ///< lag.router.<ip>.peers_behind
+    Metrics::Counter &m_socket_bytes;           ///< lag.router.<ip>.socket_bytes
+    Metrics::Counter &m_buffer_bytes;           ///< lag.router.<ip>.buffer_bytes
+};
+
+#endif /* LAGESTIMATOR_H_ */
@@ -14,6 +14,7 @@
 #include <sys/socket.h>
 #include <arpa/inet.h>
 #include "bgp_common.h"
+#include "Tracepoint.h"
 
 /**
  * Constructor for class
@@ -39,6 +40,14 @@ parseBMP::parseBMP(Logger *logPtr, MsgBusInterface::obj_bgp_peer *peer_entry) {
     bmp_packet_len = 0;
     bzero(bmp_packet, sizeof(bmp_packet));
 
+    hdr_cache = NULL;
+    peer_hdr_idx = -1;
+    peer_hdr_hit = false;
+
+    msg_data = NULL;
+    msg_len = 0;
+    msg_pos = 0;
+
     // Set the passed storage for the router entry items.
     p_entry = peer_entry;
     bzero(p_entry, sizeof(MsgBusInterface::obj_bgp_peer));
@@ -50,8 +59,22 @@ parseBMP::~parseBMP() {
 
 /**
  * Recv wrapper for recv() to enable packet buffering
+ *
+ *      Reads from the message set by setMessage() instead of the socket if one is set.
  */
 ssize_t parseBMP::Recv(int sockfd, void *buf, size_t len, int flags) {
+    if (msg_data != NULL) {
+        if (len > msg_len - msg_pos)
+            len = msg_len - msg_pos;
+
+        memcpy(buf, msg_data + msg_pos, len);
+
+        if (not (flags & MSG_PEEK))
+            msg_pos += len;
+
+        return len;
+    }
+
     ssize_t read = recv(sockfd, buf, len, flags);
 
     if (read > 0)
@@ -63,6 +86,131 @@ ssize_t parseBMP::Recv(int sockfd, void *buf, size_t len, int flags) {
     return read;
 }
 
+/**
+ * Parse a complete BMP message in memory instead of reading from a socket
+ *
+ * \details The parse methods then read the message, their socket argument is not used
+ *          (BMP_MSG_SOURCE).  The per message state and the peer entry are reset, so one
+ *          instance can parse a stream of messages.  The message is not copied into
+ *          bmp_packet, it must stay valid until the message has been handled.
+ *
+ * \param [in] msg      Complete BMP message, starting with the version
+ * \param [in] len      Length of the message
+ */
+void parseBMP::setMessage(const u_char *msg, size_t len) {
+    msg_data = msg;
+    msg_len = len;
+    msg_pos = 0;
+
+    bmp_type = -1;
+    bmp_len = 0;
+    bmp_data_len = 0;
+    bmp_packet_len = 0;
+
+    peer_hdr_idx = -1;
+    peer_hdr_hit = false;
+
+    bzero(p_entry, sizeof(MsgBusInterface::obj_bgp_peer));
+}
+
+/**
+ * Length of the BMP message at the start of the data
+ *
+ * \details Only the headers needed to frame the message are read.  v3 messages are framed
+ *          by the common header length, v1/v2 messages by their BGP message or stats
+ *          counters.
+ *
+ * \param [in] data     Data starting with the BMP version
+ * \param [in] len      Length of the data
+ *
+ * \return Total length of the message including the version, zero if more data is needed
+ *
+ * \throws (const char *) if the message is invalid or not supported
+ */
+size_t parseBMP::messageLength(const u_char *data, size_t len) {
+    size_t msg_len;
+
+    if (len < 1)
+        return 0;
+
+    if (data[0] == 3) {
+        if (len < 1 + BMP_HDRv3_LEN)
+            return 0;
+
+        uint32_t v3_len;
+        memcpy(&v3_len, data + 1, 4);
+        bgp::SWAP_BYTES(&v3_len);
+
+        if (v3_len < 1 + BMP_HDRv3_LEN)
+            throw "ERROR: BMP length is smaller than the common header";
+
+        msg_len = v3_len;
+
+    } else if (data[0] == 1 or data[0] == 2) {
+        size_t hdr_len = 1 + BMP_HDRv1v2_LEN;
+
+        if (len < hdr_len)
+            return 0;
+
+        switch (data[1]) {
+            case TYPE_ROUTE_MON:                        // BGP message follows the header
+                if (len < hdr_len + 18)
+                    return 0;
+
+                msg_len = hdr_len + (data[hdr_len + 16] << 8 | data[hdr_len + 17]);
+                break;
+
+            case TYPE_STATS_REPORT: {                   // Counter TLVs follow the header
+                if (len < hdr_len + 4)
+                    return 0;
+
+                uint32_t stats_cnt;
+                memcpy(&stats_cnt, data + hdr_len, 4);
+                bgp::SWAP_BYTES(&stats_cnt);
+
+                msg_len = hdr_len + 4;
+                for (uint32_t i = 0; i < stats_cnt; i++) {
+                    if (len < msg_len + 4)
+                        return 0;
+
+                    msg_len += 4 + (data[msg_len + 2] << 8 | data[msg_len + 3]);
+
+                    if (msg_len > BMP_PACKET_BUF_SIZE)
+                        break;
+                }
+                break;
+            }
+
+            case TYPE_PEER_DOWN:                        // Reason, then a BGP notify or FSM event code
+                if (len < hdr_len + 1)
+                    return 0;
+
+                msg_len = hdr_len + 1;
+
+                if (data[hdr_len] == 1 or data[hdr_len] == 3) {
+                    if (len < msg_len + 18)
+                        return 0;
+
+                    msg_len += data[msg_len + 16] << 8 | data[msg_len + 17];
+
+                } else if (data[hdr_len] == 2)
+                    msg_len += 2;
+
+                break;
+
+            default:
+                throw "ERROR: BMP v1/v2 message type is not supported";
+        }
+
+    } else
+        throw "ERROR: Unsupported BMP message version";
+
+    if (msg_len > BMP_PACKET_BUF_SIZE)
+        throw "BMP message length is too large for buffer, invalid BMP sender";
+
+    return len >= msg_len ? msg_len : 0;
+}
+
 /**
  * Process the incoming BMP message
  *
@@ -104,6 +252,8 @@ char parseBMP::handleMessage(int sock) {
 
     SELF_DEBUG("BMP version = %d\n", ver);
 
+    OBMP_TRACE3(bmp_msg, sock, (int)bmp_type, bmp_len);
+
     return bmp_type;
 }
 
@@ -432,6 +582,29 @@ void parseBMP::parsePeerHdr(int sock) {
     SELF_DEBUG("parsePeerHdr: sock=%d : Peer Type is %d", sock,
                p_hdr.peer_type);
 
+    /*
+     * Reuse the decoded peer if the header (other than the timestamp) was seen recently
+     */
+    if (hdr_cache != NULL) {
+        for (int n = 0; n < BMP_PEER_HDR_CACHE_SIZE; n++) {
+            int idx = (hdr_cache->last + n) % BMP_PEER_HDR_CACHE_SIZE;
+
+            if (hdr_cache->entries[idx].valid and
+                    memcmp(hdr_cache->entries[idx].key, &p_hdr, BMP_PEER_HDR_KEY_LEN) == 0) {
+                memcpy(p_entry, &hdr_cache->entries[idx].peer, sizeof(*p_entry));
+                strncpy(peer_addr, p_entry->peer_addr, sizeof(peer_addr));
+
+                hdr_cache->last = idx;
+                ++hdr_cache->hits;
+                peer_hdr_idx = idx;
+                peer_hdr_hit = true;
+
+                parsePeerTimestamp(p_hdr);
+                return;
+            }
+        }
+    }
+
     parsePeerFlags(p_hdr.peer_type, p_hdr.peer_flags);
 
     if (p_entry->isIPv4) {
@@ -491,6 +664,37 @@ void parseBMP::parsePeerHdr(int sock) {
     strncpy(p_entry->peer_bgp_id, peer_bgp_id, sizeof(p_entry->peer_bgp_id));
     strncpy(p_entry->peer_rd, peer_rd, sizeof(p_entry->peer_rd));
 
+    // Add the decoded peer to the cache, replacing the oldest entry
+    if (hdr_cache != NULL) {
+        int idx = hdr_cache->next;
+        hdr_cache->next = (idx + 1) % BMP_PEER_HDR_CACHE_SIZE;
+
+        hdr_cache->entries[idx].valid = true;
+        memcpy(hdr_cache->entries[idx].key, &p_hdr, BMP_PEER_HDR_KEY_LEN);
+        memcpy(&hdr_cache->entries[idx].peer, p_entry, sizeof(*p_entry));
+
+        hdr_cache->last = idx;
+        ++hdr_cache->misses;
+        peer_hdr_idx = idx;
+    }
+
+    parsePeerTimestamp(p_hdr);
+
+    SELF_DEBUG("sock=%d : Peer Address = %s", sock, peer_addr);
+    SELF_DEBUG("sock=%d : Peer AS = (%x-%x)%x:%x", sock,
+                p_hdr.peer_as[0], p_hdr.peer_as[1], p_hdr.peer_as[2],
+                p_hdr.peer_as[3]);
+    SELF_DEBUG("sock=%d : Peer RD = %s", sock, peer_rd);
+}
+
+/**
+ * Parse the v3 peer header timestamp
+ *
+ *  This method will update the instance variable "p_entry" timestamp
+ *
+ * \param [in] p_hdr     Peer header, timestamp in network byte order
+ */
+void parseBMP::parsePeerTimestamp(peer_hdr_v3 &p_hdr) {
     // Save the advertised timestamp
     bgp::SWAP_BYTES(&p_hdr.ts_secs);
     bgp::SWAP_BYTES(&p_hdr.ts_usecs);
@@ -510,13 +714,6 @@ void parseBMP::parsePeerHdr(int sock) {
         p_entry->timestamp_secs = tv.tv_sec;
         p_entry->timestamp_us = tv.tv_usec;
     }
-
-
-    SELF_DEBUG("sock=%d : Peer Address = %s", sock, peer_addr);
-    SELF_DEBUG("sock=%d : Peer AS = (%x-%x)%x:%x", sock,
-                p_hdr.peer_as[0], p_hdr.peer_as[1], p_hdr.peer_as[2],
-                p_hdr.peer_as[3]);
-    SELF_DEBUG("sock=%d : Peer RD = %s", sock, peer_rd);
 }
 
 /**
@@ -1035,6 +1232,15 @@ uint32_t parseBMP::getBMPLength() {
     return bmp_len;
 }
 
+/**
+ * Set the decoded peer header cache to use
+ *
+ * \param [in] cache    Session peer header cache, NULL to disable caching
+ */
+void parseBMP::setPeerHdrCache(peer_hdr_cache *cache) {
+    hdr_cache = cache;
+}
+
 /**
  * Enable/Disable debug
  */
@@ -26,13 +26,17 @@
 #define BMP_TERM_MSG_LEN 4          ///< BMP term message header length, does not count the info field
 #define BMP_PEER_UP_HDR_LEN 20      ///< BMP peer up event header size not including the recv/sent open param message
 #define BMP_PACKET_BUF_SIZE 68000   ///< Size of the BMP packet buffer (memory)
+#define BMP_PEER_HDR_KEY_LEN 34     ///< BMP peer header length without the timestamp, used as the cache key
+#define BMP_PEER_HDR_CACHE_SIZE 8   ///< Number of decoded peer headers cached per session
+#define BMP_MSG_SOURCE -1           ///< Socket argument of the parse methods when reading the message set by setMessage()
 
 /**
  * \class   parseBMP
  *
  * \brief   Parser for BMP messages
  * \details This class can be used as needed to parse BMP messages. This
- *          class will read directly from the socket to read the BMP message.
+ *          class will read directly from the socket to read the BMP message,
+ *          or from a complete message in memory, see setMessage() and BMPStream.
  */
 class parseBMP {
 public:
@@ -105,6 +109,30 @@ public:
 
      } __attribute__ ((__packed__));
 
+    /**
+     * Decoded peer header cache
+     *
+     *      Consecutive messages (e.g. during a RIB dump) carry the same peer header except
+     *      for the timestamp.  The cache is owned by the session (BMPReader) and is keyed on
+     *      the raw peer header bytes before the timestamp.  On a hit the decoded peer is
+     *      copied instead of decoding the flags, address, ASN, BGP ID and RD again.
+     */
+    struct peer_hdr_cache {
+        struct entry {
+            bool        valid;                          ///< Entry is in use
+            u_char      key[BMP_PEER_HDR_KEY_LEN];      ///< Raw peer header, timestamp excluded
+            MsgBusInterface::obj_bgp_peer peer;         ///< Decoded peer, timestamp is not used
+        } entries[BMP_PEER_HDR_CACHE_SIZE];
+
+        int         last;                               ///< Most recently used entry
+        int         next;                               ///< Next entry to replace on a miss
+        uint64_t    hits;                               ///< Number of peer headers found in the cache
+        uint64_t    misses;                             ///< Number of peer headers decoded
+    };
+
+    int             peer_hdr_idx;               ///< Cache entry of the parsed peer header, -1 if not cached
+    bool            peer_hdr_hit;               ///< True if the parsed peer header was found in the cache
+
 
      /**
      * BMP Info TLV
@@ -196,9 +224,40 @@ public:
 
     /**
      * Recv wrapper for recv() to enable packet buffering
+     *
+     *      Reads from the message set by setMessage() instead of the socket if one is set.
      */
     ssize_t Recv(int sockfd, void *buf, size_t len, int flags);
 
+    /**
+     * Parse a complete BMP message in memory instead of reading from a socket
+     *
+     * \details The parse methods then read the message, their socket argument is not used
+     *          (BMP_MSG_SOURCE).  The per message state and the peer entry are reset, so one
+     *          instance can parse a stream of messages.  The message is not copied into
+     *          bmp_packet, it must stay valid until the message has been handled.
+     *
+     * \param [in] msg      Complete BMP message, starting with the version
+     * \param [in] len      Length of the message
+     */
+    void setMessage(const u_char *msg, size_t len);
+
+    /**
+     * Length of the BMP message at the start of the data
+     *
+     * \details Only the headers needed to frame the message are read.  v3 messages are framed
+     *          by the common header length, v1/v2 messages by their BGP message or stats
+     *          counters.
+     *
+     * \param [in] data     Data starting with the BMP version
+     * \param [in] len      Length of the data
+     *
+     * \return Total length of the message including the version, zero if more data is needed
+     *
+     * \throws (const char *) if the message is invalid or not supported
+     */
+    static size_t messageLength(const u_char *data, size_t len);
+
     /**
      * Process the incoming BMP message
      *
@@ -295,6 +354,13 @@ public:
      */
     void parsePeerUpInfo(u_char *data, int len);
 
+    /**
+     * Set the decoded peer header cache to use
+     *
+     * \param [in] cache    Session peer header cache, NULL to disable caching
+     */
+    void setPeerHdrCache(peer_hdr_cache *cache);
+
     // Debug methods
     void enableDebug();
     void disableDebug();
@@ -313,6 +379,12 @@ private:
     char peer_rd[32];                           ///< Printed format of the peer RD
     char peer_bgp_id[16];                       ///< Printed format of the peer bgp ID
 
+    peer_hdr_cache  *hdr_cache;                 ///< Session peer header cache, NULL if not used
+
+    const u_char    *msg_data;                  ///< Message set by setMessage(), NULL to read from the socket
+    size_t          msg_len;                    ///< Length of the message
+    size_t          msg_pos;                    ///< Offset of the next byte to read in the message
+
     /**
      * Parse v1 and v2 BMP header
      *
@@ -342,6 +414,15 @@ private:
      */
     void parsePeerHdr(int sock);
 
+    /**
+     * Parse the v3 peer header timestamp
+     *
+     *  This method will update the instance variable "p_entry" timestamp
+     *
+     * \param [in] p_hdr     Peer header, timestamp in network byte order
+     */
+    void parsePeerTimestamp(peer_hdr_v3 &p_hdr);
+
     /**
      * Parse BMP peer header flags by peer type
      *
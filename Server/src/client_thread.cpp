@@ -8,15 +8,18 @@
  */
 
 #include <sys/socket.h>
+#include <sys/ioctl.h>
 
 #include <cstdlib>
 #include <cstring>
+#include <ctime>
 #include <thread>
 #include <unistd.h>
 
 #include "client_thread.h"
 #include "BMPReader.h"
 #include "Logger.h"
+#include "Tracepoint.h"
 
 
 #include <cxxabi.h>
@@ -38,6 +41,8 @@ void ClientThread_cancel(void *arg) {
 
         LOG_INFO("Closing client connection to %s:%s", cInfo->client->c_ip, cInfo->client->c_port);
 
+        OBMP_TRACE2(session_close, cInfo->client->c_ip, cInfo->client->c_sock);
+
         if (cInfo->client->c_sock) {
             shutdown(cInfo->client->c_sock, SHUT_RDWR);
             close(cInfo->client->c_sock);
@@ -60,6 +65,11 @@ void ClientThread_cancel(void *arg) {
             delete cInfo->mbus;
             cInfo->mbus = NULL;
         }
+
+        if (cInfo->lag != NULL) {
+            delete cInfo->lag;
+            cInfo->lag = NULL;
+        }
     }
 }
 
@@ -79,6 +89,7 @@ void *ClientThread(void *arg) {
     // Setup the client thread info struct
     ClientThreadInfo cInfo;
     cInfo.mbus = NULL;
+    cInfo.lag = NULL;
     cInfo.client = &thr->client;
     cInfo.log = thr->log;
     cInfo.closing = false;
@@ -87,6 +98,9 @@ void *ClientThread(void *arg) {
     pollfd pfd;
     unsigned char *sock_buf = NULL;
 
+    // thr->cfg may be freed after the reader switched to a reloaded config, see ConfigRcu
+    const int buffer_size = thr->cfg->bmp_buffer_size;
+
     /*
      * Setup the cleanup routine for when the thread is canceled.
      *  A thread is only canceled if openbmpd is terminated.
@@ -100,9 +114,20 @@ void *ClientThread(void *arg) {
         if (thr->cfg->debug_msgbus)
             cInfo.mbus->enableDebug();
 
+        cInfo.mbus->setLocalRib(thr->rib);
+
+        // Deleted after the reader thread is joined
+        if (thr->cfg->lag_threshold > 0)
+            cInfo.lag = new LagEstimator(logger, cInfo.client->c_ip, thr->cfg->lag_threshold);
+
         BMPReader rBMP(logger, thr->cfg);
+        rBMP.setFilter(thr->filter);
+        rBMP.setConfigReader(&thr->cfg_reader);
+        rBMP.setLagEstimator(cInfo.lag);
         LOG_INFO("Thread started to monitor BMP from router %s using socket %d buffer in bytes = %u",
-                cInfo.client->c_ip, cInfo.client->c_sock, thr->cfg->bmp_buffer_size);
+                cInfo.client->c_ip, cInfo.client->c_sock, buffer_size);
+
+        OBMP_TRACE2(session_open, cInfo.client->c_ip, cInfo.client->c_sock);
 
         // Buffer client socket using pipe
         socketpair(PF_LOCAL, SOCK_STREAM, 0, sock_fds);
@@ -118,21 +143,39 @@ void *ClientThread(void *arg) {
                                                                              (MsgBusInterface *)cInfo.mbus );
 
         // Variables to handle circular buffer
-        sock_buf = new unsigned char[thr->cfg->bmp_buffer_size];
+        sock_buf = new unsigned char[buffer_size];
         int bytes_read = 0;
         int write_buf_pos = 0;
         int read_buf_pos = 0;
         bool wrap_state = false;
         unsigned char *sock_buf_read_ptr = sock_buf;
         unsigned char *sock_buf_write_ptr = sock_buf;
+        time_t next_lag_check = 0;
 
         /*
          * monitor and buffer the client socket
          */
         while (bmp_run) {
 
+            if (cInfo.lag != NULL and time(NULL) >= next_lag_check) {
+                /*
+                 * Bytes not yet read from the router socket (FIONREAD is SIOCINQ on linux), and
+                 * in the circular buffer plus the pipe to the BMP reader
+                 */
+                int sock_queued = 0, pipe_queued = 0;
+
+                ioctl(cInfo.client->c_sock, FIONREAD, &sock_queued);
+                ioctl(sock_fds[0], FIONREAD, &pipe_queued);
+
+                int buf_queued = wrap_state ? buffer_size - read_buf_pos + write_buf_pos
+                                            : write_buf_pos - read_buf_pos;
+
+                cInfo.lag->setQueued(sock_queued, (uint64_t)buf_queued + pipe_queued);
+                next_lag_check = time(NULL) + 1;
+            }
+
             if ((wrap_state and (write_buf_pos + 1) < read_buf_pos) or
-                    (not wrap_state and write_buf_pos < thr->cfg->bmp_buffer_size)) {
+                    (not wrap_state and write_buf_pos < buffer_size)) {
 
                 pfd.fd = cInfo.client->c_sock;
                 pfd.events = POLLIN | POLLHUP | POLLERR;
@@ -146,7 +189,7 @@ void *ClientThread(void *arg) {
                     } else {
                             if (not wrap_state)     // write is ahead of read in terms of buffer pointer
                                 bytes_read = read(cInfo.client->c_sock, sock_buf_write_ptr,
-                                                  thr->cfg->bmp_buffer_size - write_buf_pos);
+                                                  buffer_size - write_buf_pos);
 
                             else if (read_buf_pos > write_buf_pos) // read is ahead of write in terms of buffer pointer
                                 bytes_read = read(cInfo.client->c_sock, sock_buf_write_ptr,
@@ -171,7 +214,7 @@ void *ClientThread(void *arg) {
 
                 }
 
-            } else if (write_buf_pos >= thr->cfg->bmp_buffer_size) { // if reached end of buffer space
+            } else if (write_buf_pos >= buffer_size) { // if reached end of buffer space
                 // Reached end of buffer, wrap to start
                 write_buf_pos = 0;
                 sock_buf_write_ptr = sock_buf;
@@ -191,7 +234,7 @@ void *ClientThread(void *arg) {
             **/
 
             if ((not wrap_state and read_buf_pos < write_buf_pos) or
-                    (wrap_state and read_buf_pos < thr->cfg->bmp_buffer_size)) {
+                    (wrap_state and read_buf_pos < buffer_size)) {
 
                 pfd.fd = cInfo.bmp_write_end_sock;
                 pfd.events = POLLOUT | POLLHUP | POLLERR;
@@ -219,8 +262,8 @@ void *ClientThread(void *arg) {
 
                     else // Read buffer is ahead of write in terms of buffer pointer
                         bytes_read = write(cInfo.bmp_write_end_sock, sock_buf_read_ptr,
-                                           (thr->cfg->bmp_buffer_size - read_buf_pos) > CLIENT_WRITE_BUFFER_BLOCK_SIZE ?
-                                           CLIENT_WRITE_BUFFER_BLOCK_SIZE : (thr->cfg->bmp_buffer_size - read_buf_pos));
+                                           (buffer_size - read_buf_pos) > CLIENT_WRITE_BUFFER_BLOCK_SIZE ?
+                                           CLIENT_WRITE_BUFFER_BLOCK_SIZE : (buffer_size - read_buf_pos));
 
                     if (bytes_read > 0) {
                         sock_buf_read_ptr += bytes_read;
@@ -234,7 +277,7 @@ void *ClientThread(void *arg) {
                     usleep(200000);
                 }
             }
-            else if (read_buf_pos >= thr->cfg->bmp_buffer_size) {
+            else if (read_buf_pos >= buffer_size) {
                 read_buf_pos = 0;
                 sock_buf_read_ptr = sock_buf;
                 wrap_state = false;
@@ -269,6 +312,8 @@ void *ClientThread(void *arg) {
     // Indicate that we are no longer running
     thr->running = false;
 
+    OBMP_TRACE2(session_close, cInfo.client->c_ip, cInfo.client->c_sock);
+
     if (not cInfo.closing) {
         cInfo.closing = true;
 
@@ -286,6 +331,11 @@ void *ClientThread(void *arg) {
             delete cInfo.mbus;
             cInfo.mbus = NULL;
         }
+
+        if (cInfo.lag != NULL) {
+            delete cInfo.lag;
+            cInfo.lag = NULL;
+        }
     }
 
     // Exit the thread
@@ -14,6 +14,10 @@
 #include "BMPListener.h"
 #include "Logger.h"
 #include "Config.h"
+#include "ConfigRcu.h"
+#include "LocalRib.h"
+#include "FilterEngine.h"
+#include "LagEstimator.h"
 #include <thread>
 
 #define CLIENT_WRITE_BUFFER_BLOCK_SIZE    8192        // Number of bytes to write to BMP reader from buffer
@@ -23,12 +27,16 @@ struct ThreadMgmt {
     BMPListener::ClientInfo client;
     Config *cfg;
     Logger *log;
+    LocalRib *rib;                      // Local RIB, NULL if disabled
+    FilterEngine *filter;               // Ingest filter, NULL if disabled
     bool running;                       // true if running, zero if not running
     bool baselineTimeout;		        // true if past the baseline time of the router
+    ConfigRcu::Reader cfg_reader;       // Reloaded config reader of the session, cfg is its config at start
 };
 
 struct ClientThreadInfo {
     msgBus_kafka *mbus;
+    LagEstimator *lag;                 // Ingest lag estimator, NULL if disabled.  Used by the reader thread
     BMPListener::ClientInfo *client;
     Logger *log;
 
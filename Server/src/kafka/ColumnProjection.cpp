@@ -0,0 +1,255 @@
+/*
+ * Copyright (c) 2013-2016 Cisco Systems, Inc. and others.  All rights reserved.
+ *
+ * This program and the accompanying materials are made available under the
+ * terms of the Eclipse Public License v1.0 which accompanies this distribution,
+ * and is available at http://www.eclipse.org/legal/epl-v10.html
+ *
+ */
+#include <cstring>
+#include <iostream>
+
+#include "ColumnProjection.h"
+#include "KafkaTopicSelector.h"
+#include "UpdateMsg.h"
+
+#define ATTR_BIT(type)      (1ULL << bgp_msg::type)
+
+/**
+ * Projectable columns and the path attributes that feed them
+ */
+enum projection_column {
+    COL_ORIGIN = 0,
+    COL_AS_PATH,
+    COL_AS_PATH_COUNT,
+    COL_ORIGIN_AS,
+    COL_NEXT_HOP,
+    COL_MED,
+    COL_LOCAL_PREF,
+    COL_AGGREGATOR,
+    COL_COMMUNITY_LIST,
+    COL_EXT_COMMUNITY_LIST,
+    COL_CLUSTER_LIST,
+    COL_ATOMIC_AGG,
+    COL_NEXT_HOP_ISIPV4,
+    COL_ORIGINATOR_ID,
+    COL_LABELS,
+    COL_LARGE_COMMUNITY_LIST,
+    COL_MAX
+};
+
+static const struct {
+    const char  *name;
+    uint64_t    attrs;                  ///< Attribute types decoded for the column, bit N is type N
+    bool        hashed;                 ///< Column is covered by the base_attribute hash
+} columns[COL_MAX] = {
+        { "origin",                 ATTR_BIT(ATTR_TYPE_ORIGIN),             true },
+        { "as_path",                ATTR_BIT(ATTR_TYPE_AS_PATH),            true },
+        { "as_path_count",          ATTR_BIT(ATTR_TYPE_AS_PATH),            true },
+        { "origin_as",              ATTR_BIT(ATTR_TYPE_AS_PATH),            true },
+        { "next_hop",               ATTR_BIT(ATTR_TYPE_NEXT_HOP),           true },
+        { "med",                    ATTR_BIT(ATTR_TYPE_MED),                true },
+        { "local_pref",             ATTR_BIT(ATTR_TYPE_LOCAL_PREF),         true },
+        { "aggregator",             ATTR_BIT(ATTR_TYPE_AGGEGATOR),          true },
+        { "community_list",         ATTR_BIT(ATTR_TYPE_COMMUNITIES),        true },
+        { "ext_community_list",     ATTR_BIT(ATTR_TYPE_EXT_COMMUNITY) | ATTR_BIT(ATTR_TYPE_IPV6_EXT_COMMUNITY), true },
+        { "cluster_list",           ATTR_BIT(ATTR_TYPE_CLUSTER_LIST),       false },
+        { "atomic_agg",             ATTR_BIT(ATTR_TYPE_ATOMIC_AGGREGATE),   false },
+        { "next_hop_isIPv4",        ATTR_BIT(ATTR_TYPE_NEXT_HOP),           true },
+        { "originator_id",          ATTR_BIT(ATTR_TYPE_ORIGINATOR_ID),      false },
+        { "labels",                 0,                                      false },    // From the NLRI, blanked only
+        { "large_community_list",   ATTR_BIT(ATTR_TYPE_LARGE_COMMUNITY),    false }
+};
+
+/**
+ * Topics with projectable columns, column numbers (first column is 1) by projection_column, zero if
+ * the topic doesn't have the column.  See MESSAGE_BUS_API.md for the topic columns.
+ */
+static const struct {
+    const char  *topic_var;
+    int         cols[COL_MAX];
+} topics[] = {
+        { MSGBUS_TOPIC_VAR_BASE_ATTRIBUTE,
+                { 10, 11, 12, 13, 14, 15, 16, 17, 18, 19, 20, 21, 22, 23,  0, 24 } },
+        { MSGBUS_TOPIC_VAR_UNICAST_PREFIX,
+                { 14, 15, 16, 17, 18, 19, 20, 21, 22, 23, 24, 25, 26, 27, 29, 32 } },
+        { MSGBUS_TOPIC_VAR_L3VPN,
+                { 14, 15, 16, 17, 18, 19, 20, 21, 22, 23, 24, 25, 26, 27, 29, 34 } },
+        { MSGBUS_TOPIC_VAR_EVPN,
+                { 11, 12, 13, 14, 15, 16, 17, 18, 19, 20, 21, 22, 23, 24,  0,  0 } },
+        { MSGBUS_TOPIC_VAR_LS_NODE,
+                {  0, 20,  0,  0, 23, 22, 21,  0,  0,  0,  0,  0,  0,  0,  0,  0 } },
+        { MSGBUS_TOPIC_VAR_LS_LINK,
+                {  0, 18,  0,  0, 21, 20, 19,  0,  0,  0,  0,  0,  0,  0,  0,  0 } },
+        { MSGBUS_TOPIC_VAR_LS_PREFIX,
+                {  0, 18,  0,  0, 21, 20, 19,  0,  0,  0,  0,  0,  0,  0,  0,  0 } },
+        { NULL, { 0 } }
+};
+
+/**
+ * Check if a column can be projected for a topic
+ *
+ * \param [in] topic_var    Topic variable name (MSGBUS_TOPIC_VAR_*) or PROJECTION_DEFAULT
+ * \param [in] name         Column name
+ *
+ * \return true if the topic has the column
+ */
+bool ColumnProjection::isColumn(const std::string &topic_var, const std::string &name) {
+    int col;
+
+    for (col = 0; col < COL_MAX; col++) {
+        if (name.compare(columns[col].name) == 0)
+            break;
+    }
+
+    if (col == COL_MAX)
+        return false;
+
+    if (topic_var.compare(PROJECTION_DEFAULT) == 0)
+        return true;
+
+    for (int t = 0; topics[t].topic_var != NULL; t++) {
+        if (topic_var.compare(topics[t].topic_var) == 0)
+            return topics[t].cols[col] != 0;
+    }
+
+    return false;
+}
+
+/**
+ * Compile the configured projections
+ *
+ *      Sets Config::projection_blank and Config::projection_skip_attrs from
+ *      Config::projection_map.  Must be called after the topics are loaded.
+ *      Disables Config::kafka_normalized_prefixes when base_attribute has projected columns.
+ *
+ * \param [in,out] cfg  Config instance
+ */
+void ColumnProjection::compile(Config &cfg) {
+    cfg.projection_blank.clear();
+    cfg.projection_skip_attrs = 0;
+
+    if (cfg.projection_map.size() == 0)
+        return;
+
+    std::map<std::string, std::list<std::string>>::iterator def = cfg.projection_map.find(PROJECTION_DEFAULT);
+    uint64_t projectable = 0;
+    uint64_t needed = 0;
+    uint64_t hashed = 0;                // Attributes of the base_attribute hash, never skipped
+
+    for (int t = 0; topics[t].topic_var != NULL; t++) {
+        std::map<std::string, std::list<std::string>>::iterator it = cfg.projection_map.find(topics[t].topic_var);
+        if (it == cfg.projection_map.end())
+            it = def;
+
+        uint64_t keep = it == cfg.projection_map.end() ? ~0ULL : 0;     // Columns kept, bit N is projection_column N
+        if (it != cfg.projection_map.end()) {
+            for (std::list<std::string>::iterator c_it = it->second.begin(); c_it != it->second.end(); ++c_it) {
+                for (int col = 0; col < COL_MAX; col++) {
+                    if (c_it->compare(columns[col].name) == 0)
+                        keep |= 1ULL << col;
+                }
+            }
+        }
+
+        uint64_t blank = 0;
+        uint64_t attrs = 0;
+
+        for (int col = 0; col < COL_MAX; col++) {
+            if (topics[t].cols[col] == 0)
+                continue;
+
+            projectable |= columns[col].attrs;
+
+            if (columns[col].hashed)
+                hashed |= columns[col].attrs;
+
+            if (keep & (1ULL << col))
+                attrs |= columns[col].attrs;
+            else
+                blank |= 1ULL << topics[t].cols[col];
+        }
+
+        if (blank != 0)
+            cfg.projection_blank[topics[t].topic_var] = blank;
+
+        // Unicast prefix rows are also used for the state topic
+        std::string topic_var = topics[t].topic_var;
+        bool enabled = cfg.topic_names_map[topic_var].length() > 0 or
+                       (topic_var.compare(MSGBUS_TOPIC_VAR_UNICAST_PREFIX) == 0 and
+                        cfg.topic_names_map[MSGBUS_TOPIC_VAR_UNICAST_PREFIX_STATE].length() > 0);
+
+        if (enabled)
+            needed |= attrs;
+    }
+
+    // The local RIB keeps all attributes of unicast prefixes
+    if (cfg.rib_enabled)
+        needed = projectable;
+
+    cfg.projection_skip_attrs = projectable & ~needed & ~hashed;
+
+    // Normalized prefixes reference base_attribute rows, which must have all columns
+    if (cfg.kafka_normalized_prefixes and cfg.projection_blank.count(MSGBUS_TOPIC_VAR_BASE_ATTRIBUTE) > 0) {
+        std::cout << "WARN: kafka.normalized_prefixes is disabled, the base_attribute topic has projected columns"
+                  << std::endl;
+        cfg.kafka_normalized_prefixes = false;
+    }
+
+    if (cfg.debug_general) {
+        std::cout << "   Config: projection blanks columns of " << cfg.projection_blank.size()
+                  << " topics, skipped attributes 0x" << std::hex << cfg.projection_skip_attrs << std::dec << std::endl;
+    }
+}
+
+/**
+ * Columns of a topic fed by path attributes covered by the base_attribute hash
+ *
+ * \param [in] topic_var    Topic variable name (MSGBUS_TOPIC_VAR_*)
+ *
+ * \return Columns, bit N is column N (first column is 1), see apply()
+ */
+uint64_t ColumnProjection::hashedColumns(const char *topic_var) {
+    uint64_t cols = 0;
+
+    for (int t = 0; topics[t].topic_var != NULL; t++) {
+        if (strcmp(topic_var, topics[t].topic_var) != 0)
+            continue;
+
+        for (int col = 0; col < COL_MAX; col++) {
+            if (topics[t].cols[col] != 0 and columns[col].hashed)
+                cols |= 1ULL << topics[t].cols[col];
+        }
+    }
+
+    return cols;
+}
+
+/**
+ * Blank columns of a TSV row in place
+ *
+ * \param [in,out] row      Row, NULL terminated
+ * \param [in]     len      Length of the row
+ * \param [in]     blank    Columns to blank, bit N is column N (first column is 1)
+ *
+ * \return New length of the row
+ */
+size_t ColumnProjection::apply(char *row, size_t len, uint64_t blank) {
+    if (blank == 0)
+        return len;
+
+    size_t  w = 0;
+    int     col = 1;
+
+    for (size_t r = 0; r < len; r++) {
+        if (row[r] == '\t' or row[r] == '\n') {
+            row[w++] = row[r];
+            col = row[r] == '\t' ? col + 1 : 1;
+
+        } else if (col >= 64 or not ((blank >> col) & 1))
+            row[w++] = row[r];
+    }
+
+    row[w] = 0;
+    return w;
+}
@@ -0,0 +1,80 @@
+/*
+ * Copyright (c) 2013-2016 Cisco Systems, Inc. and others.  All rights reserved.
+ *
+ * This program and the accompanying materials are made available under the
+ * terms of the Eclipse Public License v1.0 which accompanies this distribution,
+ * and is available at http://www.eclipse.org/legal/epl-v10.html
+ *
+ */
+#ifndef COLUMNPROJECTION_H_
+#define COLUMNPROJECTION_H_
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+
+#include "Config.h"
+
+#define PROJECTION_DEFAULT          "default"   // Projection used by topics without their own
+
+/**
+ * \class   ColumnProjection
+ *
+ * \brief   Per topic projection of the path attribute columns
+ * \details
+ *      Topics with path attribute columns (base_attribute, unicast_prefix, l3vpn, evpn and
+ *      ls_*) can be configured with the list of attribute columns to keep.  Other attribute
+ *      columns are emitted empty, keeping the TSV shape.
+ *
+ *      Path attributes that don't feed a column of any enabled topic are not decoded at all
+ *      (Config::projection_skip_attrs, applied by UpdateMsg), unless they feed the
+ *      base_attribute hash.
+ */
+class ColumnProjection {
+public:
+    /**
+     * Check if a column can be projected for a topic
+     *
+     * \param [in] topic_var    Topic variable name (MSGBUS_TOPIC_VAR_*) or PROJECTION_DEFAULT
+     * \param [in] name         Column name
+     *
+     * \return true if the topic has the column
+     */
+    static bool isColumn(const std::string &topic_var, const std::string &name);
+
+    /**
+     * Compile the configured projections
+     *
+     *      Sets Config::projection_blank and Config::projection_skip_attrs from
+     *      Config::projection_map.  Must be called after the topics are loaded.
+     *      Disables Config::kafka_normalized_prefixes when base_attribute has projected columns.
+     *
+     * \param [in,out] cfg  Config instance
+     */
+    static void compile(Config &cfg);
+
+    /**
+     * Columns of a topic fed by path attributes covered by the base_attribute hash
+     *
+     *      These are the columns left empty in normalized unicast_prefix rows
+     *      (Config::kafka_normalized_prefixes).
+     *
+     * \param [in] topic_var    Topic variable name (MSGBUS_TOPIC_VAR_*)
+     *
+     * \return Columns, bit N is column N (first column is 1), see apply()
+     */
+    static uint64_t hashedColumns(const char *topic_var);
+
+    /**
+     * Blank columns of a TSV row in place
+     *
+     * \param [in,out] row      Row, NULL terminated
+     * \param [in]     len      Length of the row
+     * \param [in]     blank    Columns to blank, bit N is column N (first column is 1)
+     *
+     * \return New length of the row
+     */
+    static size_t apply(char *row, size_t len, uint64_t blank);
+};
+
+#endif /* COLUMNPROJECTION_H_ */
@@ -0,0 +1,162 @@
+/*
+ * Copyright (c) 2013-2016 Cisco Systems, Inc. and others.  All rights reserved.
+ *
+ * This program and the accompanying materials are made available under the
+ * terms of the Eclipse Public License v1.0 which accompanies this distribution,
+ * and is available at http://www.eclipse.org/legal/epl-v10.html
+ *
+ */
+
+#include "KafkaAutotune.h"
+#include "Metrics.h"
+
+/**
+ * Add or remove a session setting to the gauges over all sessions
+ *
+ *      The average setting is the sum divided by kafka.autotune.sessions.
+ *
+ * \param [in] s        Setting
+ * \param [in] dump     Setting is the RIB dump setting
+ * \param [in] add      Add if true, remove if false
+ */
+static void publish(const KafkaAutotune::setting &s, bool dump, bool add) {
+    static Metrics::Counter &m_rib_dump   = Metrics::get("kafka.autotune.rib_dump");
+    static Metrics::Counter &m_linger_sum = Metrics::get("kafka.autotune.linger_ms_sum");
+    static Metrics::Counter &m_batch_sum  = Metrics::get("kafka.autotune.batch_msgs_sum");
+
+    if (add) {
+        if (dump)
+            m_rib_dump.fetch_add(1, std::memory_order_relaxed);
+        m_linger_sum.fetch_add(s.linger_ms, std::memory_order_relaxed);
+        m_batch_sum.fetch_add(s.batch_msgs, std::memory_order_relaxed);
+
+    } else {
+        if (dump)
+            m_rib_dump.fetch_sub(1, std::memory_order_relaxed);
+        m_linger_sum.fetch_sub(s.linger_ms, std::memory_order_relaxed);
+        m_batch_sum.fetch_sub(s.batch_msgs, std::memory_order_relaxed);
+    }
+}
+
+/**
+ * Constructor, the initial setting is the RIB dump setting
+ *
+ * \param [in] cfg      Pointer to the config instance
+ */
+KafkaAutotune::KafkaAutotune(Config *cfg) {
+    min.linger_ms  = cfg->autotune_linger_min_ms;
+    min.batch_msgs = cfg->autotune_batch_min_msgs;
+    max.linger_ms  = cfg->autotune_linger_max_ms;
+    max.batch_msgs = cfg->autotune_batch_max_msgs;
+
+    latency_target_us = (uint64_t)cfg->autotune_latency_ms * 1000;
+    interval_ms = cfg->autotune_interval * 1000;
+
+    // A session starts with the initial RIB dump
+    cur = prev = max;
+    rib_dump = prev_rib_dump = true;
+
+    Metrics::get("kafka.autotune.sessions").fetch_add(1, std::memory_order_relaxed);
+    publish(cur, rib_dump, true);
+}
+
+/**
+ * Destructor, removes the setting from the metrics
+ */
+KafkaAutotune::~KafkaAutotune() {
+    Metrics::get("kafka.autotune.sessions").fetch_sub(1, std::memory_order_relaxed);
+    publish(cur, rib_dump, false);
+}
+
+/**
+ * Change the current setting and update the setting gauges
+ *
+ * \param [in] next     New setting, within the bounds
+ * \param [in] dump     New setting is the RIB dump setting
+ */
+void KafkaAutotune::set(const setting &next, bool dump) {
+    publish(cur, rib_dump, false);
+    publish(next, dump, true);
+
+    prev = cur;
+    prev_rib_dump = rib_dump;
+
+    cur = next;
+    rib_dump = dump;
+}
+
+/**
+ * Decide the setting for the next interval
+ *
+ * \param [in] s        Sample of the last interval
+ *
+ * \return true if the setting changed, see current()
+ */
+bool KafkaAutotune::evaluate(const sample &s) {
+    static Metrics::Counter &m_to_dump   = Metrics::get("kafka.autotune.decisions.rib_dump");
+    static Metrics::Counter &m_to_steady = Metrics::get("kafka.autotune.decisions.end_of_rib");
+    static Metrics::Counter &m_raise     = Metrics::get("kafka.autotune.decisions.raise");
+    static Metrics::Counter &m_lower     = Metrics::get("kafka.autotune.decisions.lower");
+
+    setting next = cur;
+
+    if (s.rib_dump != rib_dump) {
+        // Initial RIB dump started (new session) or ended, start from the bound of the phase
+        set(s.rib_dump ? max : min, s.rib_dump);
+        (s.rib_dump ? m_to_dump : m_to_steady).fetch_add(1, std::memory_order_relaxed);
+        return true;
+    }
+
+    if (rib_dump)
+        return false;
+
+    if (s.produced > 0 and s.queue_msgs > 2 * (uint64_t)cur.batch_msgs) {
+        // Backlog, larger batches for throughput
+        next.linger_ms  = cur.linger_ms > 0 ? cur.linger_ms * 2 : 1;
+        next.batch_msgs = cur.batch_msgs * 2;
+
+        if (next.linger_ms > max.linger_ms)
+            next.linger_ms = max.linger_ms;
+        if (next.batch_msgs > max.batch_msgs)
+            next.batch_msgs = max.batch_msgs;
+
+        if (next.linger_ms == cur.linger_ms and next.batch_msgs == cur.batch_msgs)
+            return false;
+
+        set(next, false);
+        m_raise.fetch_add(1, std::memory_order_relaxed);
+        return true;
+    }
+
+    if (s.delivered > 0 and s.queue_msgs < cur.batch_msgs and
+            s.latency_sum_us / s.delivered > latency_target_us) {
+        // Drained but slow, smaller batches for latency
+        next.linger_ms  = cur.linger_ms / 2;
+        next.batch_msgs = cur.batch_msgs / 2;
+
+        if (next.linger_ms < min.linger_ms)
+            next.linger_ms = min.linger_ms;
+        if (next.batch_msgs < min.batch_msgs)
+            next.batch_msgs = min.batch_msgs;
+
+        if (next.linger_ms == cur.linger_ms and next.batch_msgs == cur.batch_msgs)
+            return false;
+
+        set(next, false);
+        m_lower.fetch_add(1, std::memory_order_relaxed);
+        return true;
+    }
+
+    return false;
+}
+
+/**
+ * Undo the last change, called if the new setting could not be applied
+ *
+ *      The change is decided again on the next sample.
+ */
+void KafkaAutotune::revert() {
+    setting last = prev;                        // set() overwrites prev
+
+    set(last, prev_rib_dump);
+}
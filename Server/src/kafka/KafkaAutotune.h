@@ -0,0 +1,113 @@
+/*
+ * Copyright (c) 2013-2016 Cisco Systems, Inc. and others.  All rights reserved.
+ *
+ * This program and the accompanying materials are made available under the
+ * terms of the Eclipse Public License v1.0 which accompanies this distribution,
+ * and is available at http://www.eclipse.org/legal/epl-v10.html
+ *
+ */
+
+#ifndef OPENBMP_KAFKAAUTOTUNE_H
+#define OPENBMP_KAFKAAUTOTUNE_H
+
+#include <cstdint>
+
+#include "Config.h"
+
+/**
+ * \class   KafkaAutotune
+ *
+ * \brief   Closed loop controller of the bulk producer batching (linger and batch size)
+ * \details
+ *      One instance per router session.  Every interval the session feeds a sample of its
+ *      produce rate, producer queue depth and delivery latency, and the controller returns the
+ *      batching setting to use, always within the configured bounds:
+ *
+ *          - Initial RIB dump: max linger and batch size, throughput over latency.
+ *          - After End-of-RIB: starts at min linger and batch size.  Doubles both while messages
+ *            are produced and the producer queue holds more than two batches (backlog), halves
+ *            both when the average delivery latency is above the target and the queue holds less
+ *            than a batch.
+ *
+ *      Holding otherwise avoids changing the setting, and replacing the producer, every interval.
+ *      Decisions are counted in the kafka.autotune.* metrics.
+ */
+class KafkaAutotune {
+public:
+    /**
+     * Batching setting of the bulk producer
+     */
+    struct setting {
+        uint32_t    linger_ms;                  ///< queue.buffering.max.ms
+        uint32_t    batch_msgs;                 ///< batch.num.messages
+    };
+
+    /**
+     * Sample of the last interval
+     */
+    struct sample {
+        bool        rib_dump;                   ///< Router is in its initial RIB dump
+        uint64_t    produced;                   ///< Messages produced by the bulk producer
+        uint64_t    queue_msgs;                 ///< Bulk producer queue depth (outq_len)
+        uint64_t    delivered;                  ///< Messages delivered
+        uint64_t    latency_sum_us;             ///< Sum of the delivery latency of those
+    };
+
+    /**
+     * Constructor, the initial setting is the RIB dump setting
+     *
+     * \param [in] cfg      Pointer to the config instance
+     */
+    explicit KafkaAutotune(Config *cfg);
+
+    /**
+     * Destructor, removes the setting from the metrics
+     */
+    ~KafkaAutotune();
+
+    /**
+     * Decide the setting for the next interval
+     *
+     * \param [in] s        Sample of the last interval
+     *
+     * \return true if the setting changed, see current()
+     */
+    bool evaluate(const sample &s);
+
+    /**
+     * Undo the last change, called if the new setting could not be applied
+     *
+     *      The change is decided again on the next sample.
+     */
+    void revert();
+
+    /**
+     * Current setting
+     */
+    const setting &current() const { return cur; }
+
+    /**
+     * Interval in milliseconds between samples
+     */
+    uint32_t intervalMs() const { return interval_ms; }
+
+private:
+    setting     min;                            ///< Lower bounds
+    setting     max;                            ///< Upper bounds
+    setting     cur;                            ///< Current setting
+    uint64_t    latency_target_us;              ///< Delivery latency target after the initial RIB dump
+    uint32_t    interval_ms;                    ///< Interval between samples
+    bool        rib_dump;                       ///< Current setting is the RIB dump setting
+    setting     prev;                           ///< Setting before the last change, see revert()
+    bool        prev_rib_dump;                  ///< RIB dump flag before the last change
+
+    /**
+     * Change the current setting and update the setting gauges
+     *
+     * \param [in] next     New setting, within the bounds
+     * \param [in] dump     New setting is the RIB dump setting
+     */
+    void set(const setting &next, bool dump);
+};
+
+#endif //OPENBMP_KAFKAAUTOTUNE_H
@@ -7,8 +7,61 @@
  *
  */
 
+#include <ctime>
+
 #include "KafkaDeliveryReportCallback.h"
+#include "Metrics.h"
+
+/**
+ * Current monotonic time in microseconds
+ */
+static uint64_t nowUs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+void *KafkaDeliveryReportCallback::enqueueTime() {
+    return (void *)(uintptr_t)nowUs();
+}
+
+KafkaDeliveryReportCallback::KafkaDeliveryReportCallback() : RdKafka::DeliveryReportCb() {
+    window_delivered = 0;
+    window_latency_us = 0;
+}
+
+void KafkaDeliveryReportCallback::takeWindow(uint64_t &delivered, uint64_t &latency_sum_us) {
+    delivered = window_delivered;
+    latency_sum_us = window_latency_us;
+
+    window_delivered = 0;
+    window_latency_us = 0;
+}
 
 void KafkaDeliveryReportCallback::dr_cb (RdKafka::Message &message) {
-    //std::cout << "Message delivery for (" << message.len() << " bytes): " << message.errstr() << std::endl;
-}
\ No newline at end of file
+    static Metrics::Counter &m_delivered   = Metrics::get("msgbus.delivery.delivered");
+    static Metrics::Counter &m_failed      = Metrics::get("msgbus.delivery.failed");
+    static Metrics::Counter &m_latency_us  = Metrics::get("msgbus.delivery.latency_us");
+    static Metrics::Counter &m_max_us      = Metrics::get("msgbus.delivery.latency_max_us");
+
+    if (message.err() != RdKafka::ERR_NO_ERROR) {
+        m_failed.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    m_delivered.fetch_add(1, std::memory_order_relaxed);
+
+    if (message.msg_opaque() == NULL)
+        return;
+
+    uint64_t latency = nowUs() - (uint64_t)(uintptr_t)message.msg_opaque();
+    m_latency_us.fetch_add(latency, std::memory_order_relaxed);
+
+    ++window_delivered;
+    window_latency_us += latency;
+
+    uint64_t max = m_max_us.load(std::memory_order_relaxed);
+    while (latency > max and not m_max_us.compare_exchange_weak(max, latency, std::memory_order_relaxed))
+        ;
+}
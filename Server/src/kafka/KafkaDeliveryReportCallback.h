@@ -10,12 +10,42 @@
 #ifndef OPENBMP_KAFKADELIVERYREPORTCALLBACK_H
 #define OPENBMP_KAFKADELIVERYREPORTCALLBACK_H
 
+#include <cstdint>
 #include <librdkafka/rdkafkacpp.h>
 #include "Logger.h"
 
+/**
+ * Delivery report callback
+ *
+ *      Counts delivered/failed messages and the delivery latency in the msgbus.delivery.* metrics.
+ *      The message opaque is expected to be the enqueue time from enqueueTime().
+ *
+ *      Also keeps the deliveries of its own producers since the last takeWindow(), for the
+ *      batching autotune.  Reports are served by poll(), so the window is only accessed by
+ *      the thread polling the producers.
+ */
 class KafkaDeliveryReportCallback : public RdKafka::DeliveryReportCb {
 public:
+    KafkaDeliveryReportCallback();
+
     void dr_cb (RdKafka::Message &message);
+
+    /**
+     * Get and reset the deliveries since the last call
+     *
+     * \param [out] delivered       Messages delivered
+     * \param [out] latency_sum_us  Sum of the delivery latency of those, with an enqueue time
+     */
+    void takeWindow(uint64_t &delivered, uint64_t &latency_sum_us);
+
+    /**
+     * Enqueue time to pass as the message opaque
+     */
+    static void *enqueueTime();
+
+private:
+    uint64_t    window_delivered;           ///< Messages delivered since the last takeWindow()
+    uint64_t    window_latency_us;          ///< Sum of their delivery latency
 };
 
 #endif //OPENBMP_KAFKADELIVERYREPORTCALLBACK_H
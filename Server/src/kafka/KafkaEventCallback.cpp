@@ -8,10 +8,22 @@
  */
 
 #include "KafkaEventCallback.h"
+#include "KafkaStats.h"
 
-KafkaEventCallback::KafkaEventCallback(bool *isConnectedRef, Logger *logPtr) : RdKafka::EventCb() {
+KafkaEventCallback::KafkaEventCallback(bool *isConnectedRef, Logger *logPtr, uint32_t batchLimit)
+        : RdKafka::EventCb() {
     isConnected = isConnectedRef;
     logger = logPtr;
+    batch_limit = batchLimit;
+}
+
+KafkaEventCallback::~KafkaEventCallback() {
+    for (std::set<std::string>::iterator it = stats_names.begin(); it != stats_names.end(); ++it)
+        KafkaStats::remove(*it);
+}
+
+void KafkaEventCallback::setBatchLimit(uint32_t batchLimit) {
+    batch_limit = batchLimit;
 }
 
 void KafkaEventCallback::event_cb (RdKafka::Event &event) {
@@ -26,9 +38,20 @@ void KafkaEventCallback::event_cb (RdKafka::Event &event) {
             }
             break;
 
-        case RdKafka::Event::EVENT_STATS:
-            LOG_INFO("Kafka stats: %s", event.str().c_str());
+        case RdKafka::Event::EVENT_STATS: {
+            std::string name;
+            KafkaStats::producer_stats stats;
+
+            try {
+                KafkaStats::parse(event.str(), batch_limit, name, stats);
+                KafkaStats::update(name, stats);
+                stats_names.insert(name);
+
+            } catch (char const *str) {
+                LOG_WARN("Kafka stats: %s", str);
+            }
             break;
+        }
 
         case RdKafka::Event::EVENT_LOG: {
             switch (event.severity()) {
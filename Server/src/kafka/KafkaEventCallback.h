@@ -10,6 +10,9 @@
 #ifndef OPENBMP_KAFKAEVENTCALLBACK_H
 #define OPENBMP_KAFKAEVENTCALLBACK_H
 
+#include <cstdint>
+#include <set>
+#include <string>
 #include <librdkafka/rdkafkacpp.h>
 #include "Logger.h"
 
@@ -21,16 +24,30 @@ public:
      *
      * \param isConnected[in,out]   Pointer to isConnected bool to indicate if connected or not
      * \param logPtr[in]            Pointer to the Logger class to use for logging
+     * \param batchLimit[in]        batch.num.messages of the producer(s), see KafkaStats
      */
-    KafkaEventCallback(bool *isConnectedRef, Logger *logPtr);
+    KafkaEventCallback(bool *isConnectedRef, Logger *logPtr, uint32_t batchLimit);
+
+    /**
+     * Destructor, removes the statistics of the producers using this callback
+     */
+    ~KafkaEventCallback();
 
     void event_cb (RdKafka::Event &event);
 
     void setLogger(Logger *logPtr);
 
+    /**
+     * Set the batch.num.messages of the producer(s), when the batching is changed
+     */
+    void setBatchLimit(uint32_t batchLimit);
+
 private:
     Logger *logger;
     bool   *isConnected;           // Indicates if connected to the broker or not.
+    uint32_t batch_limit;          // batch.num.messages of the producer(s)
+
+    std::set<std::string> stats_names;  // librdkafka instance names that reported statistics
 };
 
 
@@ -0,0 +1,269 @@
+/*
+ * Copyright (c) 2013-2016 Cisco Systems, Inc. and others.  All rights reserved.
+ *
+ * This program and the accompanying materials are made available under the
+ * terms of the Eclipse Public License v1.0 which accompanies this distribution,
+ * and is available at http://www.eclipse.org/legal/epl-v10.html
+ *
+ */
+
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <yaml-cpp/yaml.h>
+
+#include "KafkaStats.h"
+#include "Metrics.h"
+
+static std::mutex stats_mutex;                                      ///< Protects the producers map
+static std::map<std::string, KafkaStats::producer_stats> producers; ///< Stats of connected producers by name
+static uint64_t removed_tx_retries;                                 ///< Last tx_retries of removed producers
+static uint64_t removed_tx_errors;                                  ///< Last tx_errors of removed producers
+static uint64_t removed_req_timeouts;                               ///< Last req_timeouts of removed producers
+
+/**
+ * Child of a statistics object, a null node if missing
+ *
+ *      yaml-cpp throws on any access to a missing node, fields differ between librdkafka versions.
+ */
+static YAML::Node child(const YAML::Node &node, const char *key) {
+    if (node and node.IsMap()) {
+        const YAML::Node value = node[key];
+
+        if (value)
+            return value;
+    }
+
+    return YAML::Node();
+}
+
+/**
+ * Unsigned value of a statistics field, zero if missing or not a number
+ */
+static uint64_t num(const YAML::Node &node) {
+    if (not node or not node.IsScalar())
+        return 0;
+
+    try {
+        double value = node.as<double>();
+        return value > 0 ? (uint64_t)value : 0;
+
+    } catch (YAML::Exception &err) {
+        return 0;
+    }
+}
+
+/**
+ * Parse a librdkafka statistics JSON
+ *
+ *      JSON is a subset of YAML, so the yaml-cpp parser used for the config is used here as well.
+ *      See STATISTICS.md in librdkafka for the fields.  RTT is in microseconds, throttle in milliseconds.
+ *
+ * \param [in]  json         Statistics JSON from the event callback
+ * \param [in]  batch_limit  batch.num.messages of the producer, used for the batch fill ratio
+ * \param [out] name         librdkafka instance name
+ * \param [out] stats        Reduced statistics
+ *
+ * \throws char const * if the JSON is invalid or has no instance name
+ */
+void KafkaStats::parse(const std::string &json, uint32_t batch_limit, std::string &name, producer_stats &stats) {
+    YAML::Node root;
+
+    try {
+        root = YAML::Load(json);
+    } catch (YAML::Exception &err) {
+        throw "invalid statistics JSON";
+    }
+
+    const YAML::Node name_node = child(root, "name");
+    if (not name_node.IsScalar())
+        throw "statistics JSON has no instance name";
+
+    name = name_node.Scalar();
+
+    memset(&stats, 0, sizeof(stats));
+    stats.queue_msgs  = num(child(root, "msg_cnt"));
+    stats.queue_bytes = num(child(root, "msg_size"));
+
+    const YAML::Node brokers = child(root, "brokers");
+    if (brokers.IsMap()) {
+        for (YAML::const_iterator it = brokers.begin(); it != brokers.end(); ++it) {
+            const YAML::Node broker = it->second;
+
+            stats.outbuf_msgs   += num(child(broker, "outbuf_msg_cnt"));
+            stats.waitresp_msgs += num(child(broker, "waitresp_msg_cnt"));
+            stats.tx_retries    += num(child(broker, "txretries"));
+            stats.tx_errors     += num(child(broker, "txerrs"));
+            stats.req_timeouts  += num(child(broker, "req_timeouts"));
+
+            const YAML::Node rtt = child(broker, "rtt");
+            uint64_t cnt = num(child(rtt, "cnt"));
+            if (cnt > 0) {
+                stats.rtt_cnt        += cnt;
+                stats.rtt_sum_us     += num(child(rtt, "avg")) * cnt;
+                stats.rtt_p50_sum_us += num(child(rtt, "p50")) * cnt;
+
+                if (num(child(rtt, "p95")) > stats.rtt_p95_us)
+                    stats.rtt_p95_us = num(child(rtt, "p95"));
+                if (num(child(rtt, "p99")) > stats.rtt_p99_us)
+                    stats.rtt_p99_us = num(child(rtt, "p99"));
+            }
+
+            const YAML::Node throttle = child(broker, "throttle");
+            cnt = num(child(throttle, "cnt"));
+            if (cnt > 0) {
+                stats.throttle_cnt    += cnt;
+                stats.throttle_sum_ms += num(child(throttle, "avg")) * cnt;
+
+                if (num(child(throttle, "max")) > stats.throttle_max_ms)
+                    stats.throttle_max_ms = num(child(throttle, "max"));
+            }
+        }
+    }
+
+    const YAML::Node topics = child(root, "topics");
+    if (topics.IsMap()) {
+        for (YAML::const_iterator it = topics.begin(); it != topics.end(); ++it) {
+            const YAML::Node topic = it->second;
+
+            uint64_t cnt = num(child(child(topic, "batchcnt"), "cnt"));
+            if (cnt > 0) {
+                stats.batch_cnt        += cnt;
+                stats.batch_msgs       += num(child(child(topic, "batchcnt"), "avg")) * cnt;
+                stats.batch_bytes      += num(child(child(topic, "batchsize"), "avg")) * cnt;
+                stats.batch_limit_msgs += (uint64_t)batch_limit * cnt;
+            }
+
+            const YAML::Node partitions = child(topic, "partitions");
+            if (not partitions.IsMap())
+                continue;
+
+            for (YAML::const_iterator p_it = partitions.begin(); p_it != partitions.end(); ++p_it) {
+                const YAML::Node partition = p_it->second;
+                uint64_t depth = num(child(partition, "msgq_cnt")) + num(child(partition, "xmit_msgq_cnt"));
+
+                if (depth > stats.partition_max_msgs)
+                    stats.partition_max_msgs = depth;
+            }
+        }
+    }
+}
+
+/**
+ * Add or replace the statistics of a producer and update the metrics
+ *
+ * \param [in] name     librdkafka instance name
+ * \param [in] stats    Reduced statistics
+ */
+void KafkaStats::update(const std::string &name, const producer_stats &stats) {
+    std::lock_guard<std::mutex> lock(stats_mutex);
+
+    producers[name] = stats;
+    publish();
+}
+
+/**
+ * Remove the statistics of a destroyed producer and update the metrics
+ *
+ * \param [in] name     librdkafka instance name
+ */
+void KafkaStats::remove(const std::string &name) {
+    std::lock_guard<std::mutex> lock(stats_mutex);
+
+    std::map<std::string, producer_stats>::iterator it = producers.find(name);
+    if (it == producers.end())
+        return;
+
+    // Retry/error counts are cumulative, they must not go back when a producer is destroyed
+    removed_tx_retries   += it->second.tx_retries;
+    removed_tx_errors    += it->second.tx_errors;
+    removed_req_timeouts += it->second.req_timeouts;
+
+    producers.erase(it);
+    publish();
+}
+
+/**
+ * Recompute the kafka.* metrics over all producers, caller must hold the lock
+ */
+void KafkaStats::publish() {
+    static Metrics::Counter &m_producers     = Metrics::get("kafka.producers");
+    static Metrics::Counter &m_queue_msgs    = Metrics::get("kafka.queue.msgs");
+    static Metrics::Counter &m_queue_bytes   = Metrics::get("kafka.queue.bytes");
+    static Metrics::Counter &m_partition_max = Metrics::get("kafka.queue.partition_max_msgs");
+    static Metrics::Counter &m_outbuf_msgs   = Metrics::get("kafka.broker.outbuf_msgs");
+    static Metrics::Counter &m_waitresp_msgs = Metrics::get("kafka.broker.waitresp_msgs");
+    static Metrics::Counter &m_tx_retries    = Metrics::get("kafka.broker.tx_retries");
+    static Metrics::Counter &m_tx_errors     = Metrics::get("kafka.broker.tx_errors");
+    static Metrics::Counter &m_req_timeouts  = Metrics::get("kafka.broker.req_timeouts");
+    static Metrics::Counter &m_rtt_avg       = Metrics::get("kafka.rtt.avg_us");
+    static Metrics::Counter &m_rtt_p50       = Metrics::get("kafka.rtt.p50_us");
+    static Metrics::Counter &m_rtt_p95       = Metrics::get("kafka.rtt.p95_us");
+    static Metrics::Counter &m_rtt_p99       = Metrics::get("kafka.rtt.p99_us");
+    static Metrics::Counter &m_throttle_avg  = Metrics::get("kafka.throttle.avg_ms");
+    static Metrics::Counter &m_throttle_max  = Metrics::get("kafka.throttle.max_ms");
+    static Metrics::Counter &m_batch_msgs    = Metrics::get("kafka.batch.msgs_avg");
+    static Metrics::Counter &m_batch_bytes   = Metrics::get("kafka.batch.bytes_avg");
+    static Metrics::Counter &m_batch_fill    = Metrics::get("kafka.batch.fill_pct");
+
+    producer_stats total;
+    memset(&total, 0, sizeof(total));
+
+    total.tx_retries   = removed_tx_retries;
+    total.tx_errors    = removed_tx_errors;
+    total.req_timeouts = removed_req_timeouts;
+
+    for (std::map<std::string, producer_stats>::iterator it = producers.begin(); it != producers.end(); ++it) {
+        const producer_stats &s = it->second;
+
+        total.queue_msgs       += s.queue_msgs;
+        total.queue_bytes      += s.queue_bytes;
+        total.outbuf_msgs      += s.outbuf_msgs;
+        total.waitresp_msgs    += s.waitresp_msgs;
+        total.tx_retries       += s.tx_retries;
+        total.tx_errors        += s.tx_errors;
+        total.req_timeouts     += s.req_timeouts;
+        total.rtt_cnt          += s.rtt_cnt;
+        total.rtt_sum_us       += s.rtt_sum_us;
+        total.rtt_p50_sum_us   += s.rtt_p50_sum_us;
+        total.throttle_cnt     += s.throttle_cnt;
+        total.throttle_sum_ms  += s.throttle_sum_ms;
+        total.batch_cnt        += s.batch_cnt;
+        total.batch_msgs       += s.batch_msgs;
+        total.batch_bytes      += s.batch_bytes;
+        total.batch_limit_msgs += s.batch_limit_msgs;
+
+        if (s.partition_max_msgs > total.partition_max_msgs)
+            total.partition_max_msgs = s.partition_max_msgs;
+        if (s.rtt_p95_us > total.rtt_p95_us)
+            total.rtt_p95_us = s.rtt_p95_us;
+        if (s.rtt_p99_us > total.rtt_p99_us)
+            total.rtt_p99_us = s.rtt_p99_us;
+        if (s.throttle_max_ms > total.throttle_max_ms)
+            total.throttle_max_ms = s.throttle_max_ms;
+    }
+
+    m_producers.store(producers.size(), std::memory_order_relaxed);
+    m_queue_msgs.store(total.queue_msgs, std::memory_order_relaxed);
+    m_queue_bytes.store(total.queue_bytes, std::memory_order_relaxed);
+    m_partition_max.store(total.partition_max_msgs, std::memory_order_relaxed);
+    m_outbuf_msgs.store(total.outbuf_msgs, std::memory_order_relaxed);
+    m_waitresp_msgs.store(total.waitresp_msgs, std::memory_order_relaxed);
+    m_tx_retries.store(total.tx_retries, std::memory_order_relaxed);
+    m_tx_errors.store(total.tx_errors, std::memory_order_relaxed);
+    m_req_timeouts.store(total.req_timeouts, std::memory_order_relaxed);
+
+    m_rtt_avg.store(total.rtt_cnt ? total.rtt_sum_us / total.rtt_cnt : 0, std::memory_order_relaxed);
+    m_rtt_p50.store(total.rtt_cnt ? total.rtt_p50_sum_us / total.rtt_cnt : 0, std::memory_order_relaxed);
+    m_rtt_p95.store(total.rtt_p95_us, std::memory_order_relaxed);
+    m_rtt_p99.store(total.rtt_p99_us, std::memory_order_relaxed);
+
+    m_throttle_avg.store(total.throttle_cnt ? total.throttle_sum_ms / total.throttle_cnt : 0,
+                         std::memory_order_relaxed);
+    m_throttle_max.store(total.throttle_max_ms, std::memory_order_relaxed);
+
+    m_batch_msgs.store(total.batch_cnt ? total.batch_msgs / total.batch_cnt : 0, std::memory_order_relaxed);
+    m_batch_bytes.store(total.batch_cnt ? total.batch_bytes / total.batch_cnt : 0, std::memory_order_relaxed);
+    m_batch_fill.store(total.batch_limit_msgs ? total.batch_msgs * 100 / total.batch_limit_msgs : 0,
+                       std::memory_order_relaxed);
+}
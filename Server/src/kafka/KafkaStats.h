@@ -0,0 +1,96 @@
+/*
+ * Copyright (c) 2013-2016 Cisco Systems, Inc. and others.  All rights reserved.
+ *
+ * This program and the accompanying materials are made available under the
+ * terms of the Eclipse Public License v1.0 which accompanies this distribution,
+ * and is available at http://www.eclipse.org/legal/epl-v10.html
+ *
+ */
+
+#ifndef OPENBMP_KAFKASTATS_H
+#define OPENBMP_KAFKASTATS_H
+
+#include <cstdint>
+#include <string>
+
+/**
+ * \class   KafkaStats
+ *
+ * \brief   Aggregates the librdkafka statistics of all producers into the kafka.* metrics
+ * \details
+ *      Each producer emits a statistics JSON every statistics.interval.ms.  The JSON is reduced
+ *      to a producer_stats entry, keyed by the librdkafka instance name, and the kafka.* gauges
+ *      are recomputed over the entries of all connected producers (all router sessions and
+ *      lanes).  An entry is removed when its producer is destroyed, its last retry/error counts
+ *      stay in the totals so that these counters never go back.
+ *
+ *      Sums: queue, in-flight, retry/error counts.  Weighted by count: averages and the RTT p50.
+ *      Max: RTT p95/p99, throttle max and the deepest partition queue.
+ */
+class KafkaStats {
+public:
+    /**
+     * Statistics of one producer, reduced from the librdkafka statistics JSON
+     */
+    struct producer_stats {
+        uint64_t    queue_msgs;             ///< Messages in the producer queue (msg_cnt)
+        uint64_t    queue_bytes;            ///< Bytes in the producer queue (msg_size)
+        uint64_t    partition_max_msgs;     ///< Deepest partition queue, queued and ready to transmit
+
+        uint64_t    outbuf_msgs;            ///< Messages waiting to be sent to the brokers
+        uint64_t    waitresp_msgs;          ///< Messages sent and waiting for a response
+        uint64_t    tx_retries;             ///< Request retries
+        uint64_t    tx_errors;              ///< Transmit errors
+        uint64_t    req_timeouts;           ///< Request timeouts
+
+        uint64_t    rtt_cnt;                ///< Number of RTT samples in the window
+        uint64_t    rtt_sum_us;             ///< Sum of the average RTT in microseconds weighted by count
+        uint64_t    rtt_p50_sum_us;         ///< Sum of the RTT p50 in microseconds weighted by count
+        uint64_t    rtt_p95_us;             ///< Max of the broker RTT p95 in microseconds
+        uint64_t    rtt_p99_us;             ///< Max of the broker RTT p99 in microseconds
+
+        uint64_t    throttle_cnt;           ///< Number of throttle samples in the window
+        uint64_t    throttle_sum_ms;        ///< Sum of the average throttle time weighted by count
+        uint64_t    throttle_max_ms;        ///< Max throttle time
+
+        uint64_t    batch_cnt;              ///< Number of batches in the window
+        uint64_t    batch_msgs;             ///< Messages in those batches
+        uint64_t    batch_bytes;            ///< Bytes in those batches
+        uint64_t    batch_limit_msgs;       ///< Batch count times batch.num.messages
+    };
+
+    /**
+     * Parse a librdkafka statistics JSON
+     *
+     * \param [in]  json         Statistics JSON from the event callback
+     * \param [in]  batch_limit  batch.num.messages of the producer, used for the batch fill ratio
+     * \param [out] name         librdkafka instance name
+     * \param [out] stats        Reduced statistics
+     *
+     * \throws char const * if the JSON is invalid or has no instance name
+     */
+    static void parse(const std::string &json, uint32_t batch_limit, std::string &name, producer_stats &stats);
+
+    /**
+     * Add or replace the statistics of a producer and update the metrics
+     *
+     * \param [in] name     librdkafka instance name
+     * \param [in] stats    Reduced statistics
+     */
+    static void update(const std::string &name, const producer_stats &stats);
+
+    /**
+     * Remove the statistics of a destroyed producer and update the metrics
+     *
+     * \param [in] name     librdkafka instance name
+     */
+    static void remove(const std::string &name);
+
+private:
+    /**
+     * Recompute the kafka.* metrics over all producers, caller must hold the lock
+     */
+    static void publish();
+};
+
+#endif //OPENBMP_KAFKASTATS_H
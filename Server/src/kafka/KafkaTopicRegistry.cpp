@@ -0,0 +1,99 @@
+/*
+ * Copyright (c) 2013-2016 Cisco Systems, Inc. and others.  All rights reserved.
+ *
+ * This program and the accompanying materials are made available under the
+ * terms of the Eclipse Public License v1.0 which accompanies this distribution,
+ * and is available at http://www.eclipse.org/legal/epl-v10.html
+ *
+ */
+
+#include <map>
+#include <mutex>
+
+#include "KafkaTopicRegistry.h"
+#include "Metrics.h"
+
+/**
+ * Shared topic handle
+ */
+struct topic_handle {
+    RdKafka::Topic  *topic;                     ///< Topic handle
+    uint32_t        refs;                       ///< References from acquire()
+};
+
+typedef std::pair<RdKafka::Producer *, std::string> handle_key;
+
+static std::mutex registry_mutex;                           ///< Protects the handles map
+static std::map<handle_key, topic_handle> handles;          ///< Handles by producer and topic name
+
+/**
+ * Get a reference to the topic handle of a producer, created if it does not exist
+ *
+ * \param [in]  producer    Producer of the topic
+ * \param [in]  name        Topic name
+ * \param [in]  tconf       Topic configuration, only used if the handle is created
+ * \param [out] errstr      Error if the handle could not be created
+ *
+ * \return Topic handle or NULL if error
+ */
+RdKafka::Topic *KafkaTopicRegistry::acquire(RdKafka::Producer *producer, const std::string &name,
+                                            RdKafka::Conf *tconf, std::string &errstr) {
+    static Metrics::Counter &m_handles = Metrics::get("kafka.topics.handles");
+    static Metrics::Counter &m_refs    = Metrics::get("kafka.topics.references");
+    static Metrics::Counter &m_created = Metrics::get("kafka.topics.created");
+    static Metrics::Counter &m_shared  = Metrics::get("kafka.topics.shared");
+
+    std::lock_guard<std::mutex> lock(registry_mutex);
+
+    std::map<handle_key, topic_handle>::iterator it = handles.find(handle_key(producer, name));
+
+    if (it != handles.end()) {
+        ++it->second.refs;
+        m_refs.fetch_add(1, std::memory_order_relaxed);
+        m_shared.fetch_add(1, std::memory_order_relaxed);
+        return it->second.topic;
+    }
+
+    RdKafka::Topic *topic = RdKafka::Topic::create(producer, name, tconf, errstr);
+
+    if (topic == NULL)
+        return NULL;
+
+    topic_handle &handle = handles[handle_key(producer, name)];
+    handle.topic = topic;
+    handle.refs = 1;
+
+    m_handles.fetch_add(1, std::memory_order_relaxed);
+    m_refs.fetch_add(1, std::memory_order_relaxed);
+    m_created.fetch_add(1, std::memory_order_relaxed);
+
+    return topic;
+}
+
+/**
+ * Release a reference from acquire(), the handle is deleted with the last reference
+ *
+ * \param [in] producer     Producer of the topic
+ * \param [in] topic        Topic handle
+ */
+void KafkaTopicRegistry::release(RdKafka::Producer *producer, RdKafka::Topic *topic) {
+    static Metrics::Counter &m_handles = Metrics::get("kafka.topics.handles");
+    static Metrics::Counter &m_refs    = Metrics::get("kafka.topics.references");
+
+    std::lock_guard<std::mutex> lock(registry_mutex);
+
+    std::map<handle_key, topic_handle>::iterator it = handles.find(handle_key(producer, topic->name()));
+
+    if (it == handles.end() or it->second.topic != topic)
+        return;
+
+    m_refs.fetch_sub(1, std::memory_order_relaxed);
+
+    if (--it->second.refs > 0)
+        return;
+
+    delete it->second.topic;
+    handles.erase(it);
+
+    m_handles.fetch_sub(1, std::memory_order_relaxed);
+}
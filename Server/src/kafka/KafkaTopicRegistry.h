@@ -0,0 +1,53 @@
+/*
+ * Copyright (c) 2013-2016 Cisco Systems, Inc. and others.  All rights reserved.
+ *
+ * This program and the accompanying materials are made available under the
+ * terms of the Eclipse Public License v1.0 which accompanies this distribution,
+ * and is available at http://www.eclipse.org/legal/epl-v10.html
+ *
+ */
+
+#ifndef OPENBMP_KAFKATOPICREGISTRY_H
+#define OPENBMP_KAFKATOPICREGISTRY_H
+
+#include <string>
+#include <librdkafka/rdkafkacpp.h>
+
+/**
+ * \class   KafkaTopicRegistry
+ *
+ * \brief   Process wide registry of reference counted Kafka topic handles
+ * \details
+ *      A topic handle belongs to the librdkafka instance it was created with, so handles are
+ *      shared by (producer, topic name).  Topic selector keys that resolve to the same name,
+ *      e.g. peer groups of a topic name without {peer_group}, reference one handle instead of
+ *      creating one each.  The handle is created by the first acquire() and deleted by the
+ *      last release(), which must happen before the producer is deleted.
+ *
+ *      Counts are exposed in the kafka.topics.* metrics.
+ */
+class KafkaTopicRegistry {
+public:
+    /**
+     * Get a reference to the topic handle of a producer, created if it does not exist
+     *
+     * \param [in]  producer    Producer of the topic
+     * \param [in]  name        Topic name
+     * \param [in]  tconf       Topic configuration, only used if the handle is created
+     * \param [out] errstr      Error if the handle could not be created
+     *
+     * \return Topic handle or NULL if error
+     */
+    static RdKafka::Topic *acquire(RdKafka::Producer *producer, const std::string &name,
+                                   RdKafka::Conf *tconf, std::string &errstr);
+
+    /**
+     * Release a reference from acquire(), the handle is deleted with the last reference
+     *
+     * \param [in] producer     Producer of the topic
+     * \param [in] topic        Topic handle
+     */
+    static void release(RdKafka::Producer *producer, RdKafka::Topic *topic);
+};
+
+#endif //OPENBMP_KAFKATOPICREGISTRY_H
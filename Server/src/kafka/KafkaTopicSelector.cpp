@@ -11,6 +11,8 @@
 #include <boost/algorithm/string/replace.hpp>
 
 #include "KafkaTopicSelector.h"
+#include "KafkaTopicRegistry.h"
+#include "Metrics.h"
 #include "kafka/MsgBusImpl_kafka.h"
 
 /*********************************************************************//**
@@ -35,6 +37,7 @@ KafkaTopicSelector::KafkaTopicSelector(Logger *logPtr, Config *cfg,  RdKafka::Pr
     peer_partitioner_callback = new KafkaPeerPartitionerCallback();
     tconf = RdKafka::Conf::create(RdKafka::Conf::CONF_TOPIC);
 
+    next_evict_check = time(NULL) + cfg->topic_idle_timeout;
 }
 
 /*********************************************************************//**
@@ -74,7 +77,8 @@ RdKafka::Topic * KafkaTopicSelector::getTopic(const std::string &topic_var,
     topic_map::iterator t_it;
 
     if ( (t_it=topic.find(topic_key)) != topic.end()) {
-        return t_it->second;                                              // Return the existing initialized topic
+        t_it->second.used = true;
+        return t_it->second.topic;                                        // Return the existing initialized topic
     }
     else {
         SELF_DEBUG("Requesting to create topic for key=%s", topic_key.c_str());
@@ -84,6 +88,66 @@ RdKafka::Topic * KafkaTopicSelector::getTopic(const std::string &topic_var,
     return NULL;
 }
 
+/*********************************************************************//**
+ * Switch to a reloaded config
+ *
+ *      Topic names may have changed, so all topic handles are released and created again
+ *      on use.  The caller must not hold messages for a topic handle from getTopic().
+ *
+ * \param [in] cfg      Reloaded config
+ ***********************************************************************/
+void KafkaTopicSelector::setConfig(Config *cfg) {
+    freeTopicMap();
+    topic_flags_map.clear();
+
+    this->cfg = cfg;
+    debug = cfg->debug_msgbus;
+}
+
+/*********************************************************************//**
+ * Release the topic handles not used within the last kafka.topic_idle_timeout
+ *
+ *      Checked at most once per timeout, so a handle is released after being idle between one
+ *      and two timeouts.  The caller must not hold messages for a topic handle from getTopic()
+ *      across this call.
+ *
+ * \return number of released topic handles
+ ***********************************************************************/
+size_t KafkaTopicSelector::evictIdle() {
+    static Metrics::Counter &m_evicted = Metrics::get("kafka.topics.evicted");
+
+    if (cfg->topic_idle_timeout <= 0)
+        return 0;
+
+    time_t now = time(NULL);
+
+    if (now < next_evict_check)
+        return 0;
+
+    next_evict_check = now + cfg->topic_idle_timeout;
+
+    size_t evicted = 0;
+
+    for (topic_map::iterator it = topic.begin(); it != topic.end(); ) {
+        if (it->second.used) {
+            it->second.used = false;
+            ++it;
+            continue;
+        }
+
+        SELF_DEBUG("Releasing idle topic %s (map key=%s)", it->second.topic->name().c_str(), it->first.c_str());
+
+        KafkaTopicRegistry::release(producer, it->second.topic);
+        topic.erase(it++);
+        ++evicted;
+    }
+
+    if (evicted > 0)
+        m_evicted.fetch_add(evicted, std::memory_order_relaxed);
+
+    return evicted;
+}
+
 /*********************************************************************//**
  * Check if a topic is enabled
  *
@@ -368,8 +432,9 @@ RdKafka::Topic * KafkaTopicSelector::initTopic(const std::string &topic_var,
     // Delete topic if it already exists
     topic_map::iterator t_it;
 
-    if ( (t_it=topic.find(topic_key)) != topic.end() and t_it->second != NULL) {
-        delete t_it->second;
+    if ( (t_it=topic.find(topic_key)) != topic.end()) {
+        KafkaTopicRegistry::release(producer, t_it->second.topic);
+        topic.erase(t_it);
     }
 
     /*
@@ -380,14 +445,19 @@ RdKafka::Topic * KafkaTopicSelector::initTopic(const std::string &topic_var,
         throw "ERROR: Failed to configure kafka partitioner callback";
     }
 
-    topic[topic_key] = RdKafka::Topic::create(producer, topic_name.c_str(), tconf, errstr);
+    // Keys that resolve to the same topic name share the handle
+    RdKafka::Topic *handle = KafkaTopicRegistry::acquire(producer, topic_name, tconf, errstr);
 
-    if (topic[topic_key] == NULL) {
+    if (handle == NULL) {
         LOG_ERR("Failed to create '%s' topic: %s", topic_name.c_str(), errstr.c_str());
         throw "ERROR: Failed to create topic";
 
     } else {
-        return topic[topic_key];
+        topic_ref &ref = topic[topic_key];
+        ref.topic = handle;
+        ref.used = true;
+
+        return handle;
     }
 
     return NULL;
@@ -439,14 +509,12 @@ std::string KafkaTopicSelector::getTopicKey(const std::string &topic_var,
 }
 
 /**
- * Free allocated topic map pointers
+ * Release the topic map references
  */
 void KafkaTopicSelector::freeTopicMap() {
-    // Free topic pointers
-    for (topic_map::iterator it = topic.begin(); it != topic.end(); it++) {
-        if (it->second) {
-            delete it->second;
-            it->second = NULL;
-        }
-    }
+    // Handles are deleted with the last reference of the producer
+    for (topic_map::iterator it = topic.begin(); it != topic.end(); it++)
+        KafkaTopicRegistry::release(producer, it->second.topic);
+
+    topic.clear();
 }
\ No newline at end of file
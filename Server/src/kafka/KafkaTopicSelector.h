@@ -10,6 +10,7 @@
 #ifndef OPENBMP_KAFKATOPICSELECTOR_H
 #define OPENBMP_KAFKATOPICSELECTOR_H
 
+#include <ctime>
 #include <librdkafka/rdkafkacpp.h>
 #include "Config.h"
 #include "Logger.h"
@@ -25,6 +26,7 @@ public:
     #define MSGBUS_TOPIC_PEER                   "openbmp.parsed.peer"
     #define MSGBUS_TOPIC_BASE_ATTRIBUTE         "openbmp.parsed.base_attribute"
     #define MSGBUS_TOPIC_UNICAST_PREFIX         "openbmp.parsed.unicast_prefix"
+    #define MSGBUS_TOPIC_UNICAST_PREFIX_STATE   "openbmp.parsed.unicast_prefix_state"
     #define MSGBUS_TOPIC_L3VPN                  "openbmp.parsed.l3vpn"
     #define MSGBUS_TOPIC_EVPN                   "openbmp.parsed.evpn"
     #define MSGBUS_TOPIC_LS_NODE                "openbmp.parsed.ls_node"
@@ -42,6 +44,7 @@ public:
     #define MSGBUS_TOPIC_VAR_PEER               "peer"
     #define MSGBUS_TOPIC_VAR_BASE_ATTRIBUTE     "base_attribute"
     #define MSGBUS_TOPIC_VAR_UNICAST_PREFIX     "unicast_prefix"
+    #define MSGBUS_TOPIC_VAR_UNICAST_PREFIX_STATE "unicast_prefix_state"
     #define MSGBUS_TOPIC_VAR_L3VPN              "l3vpn"
     #define MSGBUS_TOPIC_VAR_EVPN               "evpn"
     #define MSGBUS_TOPIC_VAR_LS_NODE            "ls_node"
@@ -80,6 +83,26 @@ public:
                               const std::string *peer_group,
                               uint32_t peer_asn);
 
+    /*********************************************************************//**
+     * Switch to a reloaded config
+     *
+     *      Topic names may have changed, so all topic handles are released and created again
+     *      on use.  The caller must not hold messages for a topic handle from getTopic().
+     *
+     * \param [in] cfg      Reloaded config
+     ***********************************************************************/
+    void setConfig(Config *cfg);
+
+    /*********************************************************************//**
+     * Release the topic handles not used within the last kafka.topic_idle_timeout
+     *
+     *      Checked at most once per timeout.  The caller must not hold messages for a topic
+     *      handle from getTopic() across this call.
+     *
+     * \return number of released topic handles
+     ***********************************************************************/
+    size_t evictIdle();
+
     /*********************************************************************//**
      * Check if a topic is enabled
      *
@@ -127,7 +150,15 @@ private:
     KafkaPeerPartitionerCallback *peer_partitioner_callback;
 
     /**
-     * Topic name to rdkafka pointer map (key=Name, value=topic pointer)
+     * Topic handle of a map key, see KafkaTopicRegistry
+     */
+    struct topic_ref {
+        RdKafka::Topic  *topic;                 ///< Shared topic handle
+        bool            used;                   ///< Used by getTopic() since the last evictIdle() check
+    };
+
+    /**
+     * Topic name to rdkafka pointer map (key=Name, value=topic reference)
      *
      *      Key will be MSGBUS_TOPIC_VAR_<topic>_<router_group>_<peer_group>[_<peer_asn>]
      *          Keys will not contain the optional values unless topic_flags_map includes them.
@@ -138,8 +169,10 @@ private:
      *          unicast_prefix__peergrp1_ (router group is empty but peer group is defined)
      *          unicast_prefix_routergrp1_peergroup1_ (both router and peer groups are defiend)
      */
-    typedef std::map<std::string, RdKafka::Topic *> topic_map;
-    std::map<std::string, RdKafka::Topic*> topic;
+    typedef std::map<std::string, topic_ref> topic_map;
+    std::map<std::string, topic_ref> topic;
+
+    time_t          next_evict_check;           ///< Time of the next evictIdle() check
 
 
     /**
@@ -151,7 +184,7 @@ private:
     std::map<std::string, topic_flags> topic_flags_map;     ///< Map key is one of MSGBUS_TOPIC_VAR_<topic>
 
     /**
-     * Free allocated topic map pointers
+     * Release the topic map references
      */
     void freeTopicMap();
 
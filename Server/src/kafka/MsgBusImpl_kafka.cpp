@@ -16,6 +16,7 @@
 #include <netdb.h>
 #include <unistd.h>
 
+#include <chrono>
 #include <thread>
 #include <arpa/inet.h>
 
@@ -23,6 +24,8 @@
 #include "KafkaEventCallback.h"
 #include "KafkaDeliveryReportCallback.h"
 #include "KafkaTopicSelector.h"
+#include "KafkaStats.h"
+#include "ColumnProjection.h"
 
 #include <boost/algorithm/string/replace.hpp>
 
@@ -30,9 +33,114 @@
 
 
 #include "md5.h"
+#include "Tracepoint.h"
+#include "StageStats.h"
+#include "Metrics.h"
 
 using namespace std;
 
+/**
+ * Get the columns to blank for a topic
+ *
+ *      The config is shared by the router threads, so the map is only read.
+ *
+ * \param [in] cfg          Pointer to the config instance
+ * \param [in] topic_var    Topic var
+ */
+static uint64_t blankColumns(Config *cfg, const char *topic_var) {
+    std::map<std::string, uint64_t>::const_iterator it = cfg->projection_blank.find(topic_var);
+
+    return it != cfg->projection_blank.end() ? it->second : 0;
+}
+
+/**
+ * Digest of a unicast_prefix state row
+ *
+ *      Covers all columns except the sequence number (2), timestamp (10) and flap count (33),
+ *      which change without the state of the prefix changing.  The base attribute hash does
+ *      not cover all attribute columns, e.g. labels and large communities.
+ *
+ * \param [in] row      Row
+ * \param [in] len      Length of the row
+ *
+ * \return digest
+ */
+static hash_key stateDigest(const char *row, size_t len) {
+    MD5 hash;
+    int col = 1;
+    size_t start = 0;
+
+    for (size_t i = 0; i <= len; i++) {
+        if (i < len and row[i] != '\t')
+            continue;
+
+        if (col != 2 and col != 10 and col != 33)
+            hash.update((unsigned char *) row + start, i - start + (i < len ? 1 : 0));
+
+        start = i + 1;
+        ++col;
+    }
+
+    hash.finalize();
+
+    unsigned char *hash_raw = hash.raw_digest();
+    hash_key digest(hash_raw);
+    delete[] hash_raw;
+
+    return digest;
+}
+
+/**
+ * Check if a topic is produced by the control lane
+ *
+ * \param [in] topic_var    Topic var
+ */
+static bool isControlTopic(const char *topic_var) {
+    return strcmp(topic_var, MSGBUS_TOPIC_VAR_PEER) == 0 or strcmp(topic_var, MSGBUS_TOPIC_VAR_ROUTER) == 0 or
+           strcmp(topic_var, MSGBUS_TOPIC_VAR_COLLECTOR) == 0 or strcmp(topic_var, MSGBUS_TOPIC_VAR_BMP_STAT) == 0;
+}
+
+/**
+ * Current monotonic time in milliseconds
+ */
+static uint64_t steadyMs() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static std::atomic<uint64_t> shutdown_deadline_ms(0);    ///< Common drain deadline, zero if not shutting down
+
+/**
+ * Milliseconds to wait for a drain, bounded by the shutdown deadline
+ *
+ * \param [in] timeout_ms   Max time to wait
+ */
+static int drainWaitMs(int timeout_ms) {
+    uint64_t deadline = shutdown_deadline_ms.load(std::memory_order_relaxed);
+
+    if (deadline == 0)
+        return timeout_ms;
+
+    uint64_t now_ms = steadyMs();
+
+    if (now_ms >= deadline)
+        return 0;
+
+    return deadline - now_ms < (uint64_t)timeout_ms ? (int)(deadline - now_ms) : timeout_ms;
+}
+
+/**
+ * Add a 32 bit unsigned native header, in network byte order
+ *
+ * \param [in] headers      Headers to add to
+ * \param [in] key          Header key
+ * \param [in] value        Header value
+ */
+static void addHeader32(RdKafka::Headers *headers, const char *key, uint32_t value) {
+    value = htonl(value);
+    headers->add(key, &value, sizeof(value));
+}
+
 /******************************************************************//**
  * \brief This function will initialize and connect to Kafka.
  *
@@ -49,6 +157,7 @@ msgBus_kafka::msgBus_kafka(Logger *logPtr, Config *cfg, u_char *c_hash_id) {
     prep_buf = new char[MSGBUS_WORKING_BUF_SIZE];
 
     hash_toStr(c_hash_id, collector_hash);
+    memcpy(collector_hash_bin, c_hash_id, sizeof(collector_hash_bin));
 
     isConnected = false;
     conf = RdKafka::Conf::create(RdKafka::Conf::CONF_GLOBAL);
@@ -71,11 +180,32 @@ msgBus_kafka::msgBus_kafka(Logger *logPtr, Config *cfg, u_char *c_hash_id) {
 
     this->cfg           = cfg;
 
+    loadProjection();
+
     // Make the connection to the server
     event_callback       = NULL;
+    ctrl_event_callback  = NULL;
     delivery_callback    = NULL;
     producer             = NULL;
     topicSel             = NULL;
+    retired_producer     = NULL;
+    retired_topicSel     = NULL;
+    held_bulk_bytes      = 0;
+    ctrl_producer        = NULL;
+    ctrl_use_bulk        = false;
+    ctrl_wait_left_ms    = MSGBUS_CTRL_ORDER_WAIT_MS;
+    ctrl_topicSel        = NULL;
+    local_rib            = NULL;
+
+    autotune             = cfg->autotune_enabled ? new KafkaAutotune(cfg) : NULL;
+    autotune_produced    = 0;
+    batch_produce        = cfg->produce_batch_msgs > 1 and not cfg->kafka_native_headers;
+    batched_msgs         = 0;
+    next_service_ms      = 0;
+    service_poll         = false;
+    autotune_next_ms     = 0;
+    rib_dump             = true;
+    stat_due_ms          = 0;
 
     router_ip.assign("");
     bzero(router_hash, sizeof(router_hash));
@@ -90,6 +220,8 @@ msgBus_kafka::~msgBus_kafka() {
 
     SELF_DEBUG("Destroy msgBus Kafka instance");
 
+    produceStatReports();
+
     // Disconnect/term the router if not already done
     MsgBusInterface::obj_router r_object;
     bool router_defined = false;
@@ -111,48 +243,111 @@ msgBus_kafka::~msgBus_kafka() {
         update_Router(r_object, msgBus_kafka::ROUTER_ACTION_TERM);
     }
 
-    sleep(2);
-
     delete [] producer_buf;
     delete [] prep_buf;
 
     peer_list.clear();
+    peer_match.clear();
 
     disconnect(500);
 
     delete conf;
+
+    if (autotune != NULL)
+        delete autotune;
 }
 
 /**
  * Disconnect from Kafka
  */
 void msgBus_kafka::disconnect(int wait_ms) {
+    static Metrics::Counter &m_flushed = Metrics::get("msgbus.drain.flushed");
+    static Metrics::Counter &m_dropped = Metrics::get("msgbus.drain.dropped");
+
+    int queued = 0;
+    int dropped = 0;
+
+    // Replaced producer first, the held messages go after its queue
+    if (retired_producer != NULL) {
+        queued += retired_producer->outq_len();
+        retired_producer->flush(drainWaitMs(5000));
+        dropped += retired_producer->outq_len();
+
+        delete retired_topicSel;
+        delete retired_producer;
+        retired_topicSel = NULL;
+        retired_producer = NULL;
+    }
+
+    if (not held_bulk.empty()) {
+        if (isConnected and producer != NULL) {
+            releaseHeld();
+        } else {
+            queued += held_bulk.size();
+            dropped += held_bulk.size();
+            held_bulk.clear();
+            held_bulk_bytes = 0;
+        }
+    }
+
+    if (producer != NULL)
+        submitBatches();
+
+    queued += (producer != NULL ? producer->outq_len() : 0) +
+              (ctrl_producer != NULL ? ctrl_producer->outq_len() : 0);
 
     if (isConnected) {
         int i = 0;
-        while (producer->outq_len() > 0 and i < 30) {
+        int poll_ms;
+        while (producer->outq_len() > 0 and i < 30 and (poll_ms = drainWaitMs(500)) > 0) {
             LOG_INFO("Waiting for producer to finish before disconnecting: outq=%d", producer->outq_len());
-            producer->poll(500);
+            producer->poll(poll_ms);
             i++;
         }
     }
 
+    if (ctrl_producer != NULL) {
+        ctrl_producer->flush(drainWaitMs(5000));
+        dropped += ctrl_producer->outq_len();
+    }
+
+    if (ctrl_topicSel != NULL) delete ctrl_topicSel;
+    ctrl_topicSel = NULL;
+
+    if (ctrl_producer != NULL) delete ctrl_producer;
+    ctrl_producer = NULL;
+
+    if (producer != NULL) producer->flush(drainWaitMs(5000));
 
-    if (producer != NULL) producer->flush(5000);
+    if (producer != NULL)
+        dropped += producer->outq_len();
+
+    if (queued > 0) {
+        m_flushed.fetch_add(queued > dropped ? queued - dropped : 0, std::memory_order_relaxed);
+        m_dropped.fetch_add(dropped, std::memory_order_relaxed);
+
+        if (dropped > 0)
+            LOG_WARN("rtr=%s: Dropping %d undelivered messages on disconnect", router_ip.c_str(), dropped);
+    }
 
     if (topicSel != NULL) delete topicSel;
 
     topicSel = NULL;
+    batches.clear();
+    batched_msgs = 0;
 
     if (producer != NULL) delete producer;
     producer = NULL;
 
     // suggested by librdkafka to free memory
-    RdKafka::wait_destroyed(wait_ms);
+    RdKafka::wait_destroyed(drainWaitMs(wait_ms));
 
     if (event_callback != NULL) delete event_callback;
     event_callback = NULL;
 
+    if (ctrl_event_callback != NULL) delete ctrl_event_callback;
+    ctrl_event_callback = NULL;
+
     if (delivery_callback != NULL) delete delivery_callback;
     delivery_callback = NULL;
 
@@ -196,15 +391,20 @@ void msgBus_kafka::connect() {
     }*/
 
 
-    // Batch message number
-    value = "100";
+    // Batch message number, set by the autotune if enabled
+    uint32_t batch_num_msgs = autotune != NULL ? autotune->current().batch_msgs : MSGBUS_BATCH_NUM_MESSAGES;
+
+    value = std::to_string(batch_num_msgs);
     if (conf->set("batch.num.messages", value, errstr) != RdKafka::Conf::CONF_OK) {
         LOG_ERR("Failed to configure batch.num.messages for kafka: %s.", errstr.c_str());
         throw "ERROR: Failed to configure kafka batch.num.messages";
     }
 
     // Batch message max wait time (in ms)
-    q_buf_max_ms << cfg->q_buf_max_ms;
+    if (autotune != NULL)
+        q_buf_max_ms << autotune->current().linger_ms;
+    else
+        q_buf_max_ms << cfg->q_buf_max_ms;
     if (conf->set("queue.buffering.max.ms", q_buf_max_ms.str(), errstr) != RdKafka::Conf::CONF_OK) {
         LOG_ERR("Failed to configure queue.buffering.max.ms for kafka: %s.", errstr.c_str());
         throw "ERROR: Failed to configure kafka queue.buffer.max.ms";
@@ -224,6 +424,15 @@ void msgBus_kafka::connect() {
         throw "ERROR: Failed to configure kafka broker list";
     }
 
+    // In-process mock cluster, the broker list is ignored
+    if (cfg->kafka_mock_brokers > 0) {
+        value = std::to_string(cfg->kafka_mock_brokers);
+        if (conf->set("test.mock.num.brokers", value, errstr) != RdKafka::Conf::CONF_OK) {
+            LOG_ERR("Failed to configure the kafka mock cluster: %s", errstr.c_str());
+            throw "ERROR: Failed to configure the kafka mock cluster, librdkafka 1.4 or later is required";
+        }
+    }
+
     // Maximum transmit byte size
     tx_bytes << cfg->tx_max_bytes;
     if (conf->set("message.max.bytes", tx_bytes.str(), 
@@ -298,22 +507,29 @@ void msgBus_kafka::connect() {
              " failed messages ";
     } 
     
+    // Statistics interval, the statistics are parsed into the kafka.* metrics by the event callback
+    value = std::to_string(cfg->kafka_stats_interval_ms);
+    if (conf->set("statistics.interval.ms", value, errstr) != RdKafka::Conf::CONF_OK) {
+        LOG_ERR("Failed to configure statistics.interval.ms for kafka: %s", errstr.c_str());
+        throw "ERROR: Failed to configure kafka statistics.interval.ms";
+    }
+
     // Register event callback
-    event_callback = new KafkaEventCallback(&isConnected, logger);
+    event_callback = new KafkaEventCallback(&isConnected, logger, batch_num_msgs);
     if (conf->set("event_cb", event_callback, errstr) != RdKafka::Conf::CONF_OK) {
         LOG_ERR("Failed to configure kafka event callback: %s", errstr.c_str());
         throw "ERROR: Failed to configure kafka event callback";
     }
 
-    // Register delivery report callback
-    /*
-    delivery_callback = new KafkaDeliveryReportCallback();
+    // Register delivery report callback, the autotune needs the delivery latency
+    if (cfg->kafka_delivery_reports or autotune != NULL) {
+        delivery_callback = new KafkaDeliveryReportCallback();
 
-    if (conf->set("dr_cb", delivery_callback, errstr) != RdKafka::Conf::CONF_OK) {
-        LOG_ERR("Failed to configure kafka delivery report callback: %s", errstr.c_str());
-        throw "ERROR: Failed to configure kafka delivery report callback";
+        if (conf->set("dr_cb", delivery_callback, errstr) != RdKafka::Conf::CONF_OK) {
+            LOG_ERR("Failed to configure kafka delivery report callback: %s", errstr.c_str());
+            throw "ERROR: Failed to configure kafka delivery report callback";
+        }
     }
-    */
 
 
     // Create producer and connect
@@ -348,9 +564,381 @@ void msgBus_kafka::connect() {
         return;
     }
 
+    if (cfg->ctrl_lane_enabled)
+        connectControlLane();
+
     producer->poll(100);
 }
 
+/**
+ * Create the control lane producer, must be called after the bulk producer is connected
+ *
+ *      The control lane uses the same settings as the bulk producer except for a short buffering
+ *      time and a smaller queue.  If it can't be created, control topics use the bulk producer.
+ */
+void msgBus_kafka::connectControlLane() {
+    string errstr;
+    std::ostringstream q_buf_max_msgs, q_buf_max_ms, batch_num_msgs;
+
+    // Producer::create() copies the config, connect() sets these again for the bulk producer
+    q_buf_max_ms << cfg->ctrl_q_buf_max_ms;
+    q_buf_max_msgs << cfg->ctrl_q_buf_max_msgs;
+    batch_num_msgs << MSGBUS_CTRL_BATCH_NUM_MESSAGES;
+
+    // Own event callback so that the batch fill ratio of the lane is against its own batch limit
+    ctrl_event_callback = new KafkaEventCallback(&isConnected, logger, MSGBUS_CTRL_BATCH_NUM_MESSAGES);
+
+    if (conf->set("queue.buffering.max.ms", q_buf_max_ms.str(), errstr) != RdKafka::Conf::CONF_OK or
+        conf->set("queue.buffering.max.messages", q_buf_max_msgs.str(), errstr) != RdKafka::Conf::CONF_OK or
+        conf->set("batch.num.messages", batch_num_msgs.str(), errstr) != RdKafka::Conf::CONF_OK or
+        conf->set("event_cb", ctrl_event_callback, errstr) != RdKafka::Conf::CONF_OK) {
+        LOG_WARN("rtr=%s: Failed to configure the control lane, using the bulk producer: %s",
+                 router_ip.c_str(), errstr.c_str());
+        return;
+    }
+
+    ctrl_producer = RdKafka::Producer::create(conf, errstr);
+    if (ctrl_producer == NULL) {
+        LOG_WARN("rtr=%s: Failed to create the control lane producer, using the bulk producer: %s",
+                 router_ip.c_str(), errstr.c_str());
+        return;
+    }
+
+    try {
+        ctrl_topicSel = new KafkaTopicSelector(logger, cfg, ctrl_producer);
+
+    } catch (char const *str) {
+        LOG_WARN("rtr=%s: Failed to create the control lane topics, using the bulk producer: err=%s",
+                 router_ip.c_str(), str);
+        delete ctrl_producer;
+        ctrl_producer = NULL;
+    }
+}
+
+/**
+ * Order the next control message after the messages queued in the bulk lane
+ *
+ *      A peer down or router term must not overtake the rows of the peer still batched or
+ *      queued in the bulk lane, consumers clear the peer RIB on it.  The held batches are
+ *      submitted and the bulk producers are flushed, for up to MSGBUS_CTRL_ORDER_WAIT_MS in
+ *      total per session.  If they don't drain in time, control messages are produced on the
+ *      bulk lane after the rows instead (ctrl_use_bulk) until service() sees the bulk lane
+ *      empty, so that a later control message can't overtake them.
+ */
+void msgBus_kafka::orderAfterBulkLane() {
+    static Metrics::Counter &m_bulk = Metrics::get("msgbus.ctrl_lane.bulk_ordered");
+
+    if (ctrl_producer == NULL or producer == NULL or not isConnected or ctrl_use_bulk)
+        return;
+
+    submitBatches();
+
+    uint64_t start_ms = steadyMs();
+    uint64_t deadline_ms = start_ms + drainWaitMs(ctrl_wait_left_ms);
+    uint64_t now_ms;
+
+    // Held messages are produced once the replaced producer is drained
+    if (retired_producer != NULL and (now_ms = steadyMs()) < deadline_ms) {
+        retired_producer->flush(deadline_ms - now_ms);
+        drainRetiredProducer();
+    }
+
+    if ((now_ms = steadyMs()) < deadline_ms)
+        producer->flush(deadline_ms - now_ms);
+
+    now_ms = steadyMs();
+    ctrl_wait_left_ms -= now_ms - start_ms < (uint64_t)ctrl_wait_left_ms ? (int)(now_ms - start_ms) : ctrl_wait_left_ms;
+
+    if (producer->outq_len() > 0 or retired_producer != NULL) {
+        // Control messages already queued on the control lane go first
+        ctrl_producer->flush(drainWaitMs(MSGBUS_CTRL_ORDER_WAIT_MS));
+
+        ctrl_use_bulk = true;
+        m_bulk.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+/**
+ * Create the native Kafka headers of a parsed message, see kafka.native_headers
+ *
+ *      Same headers as the text preamble, counts are 32 bit in network byte order and hashes
+ *      are the 16 byte binary hash.  R_HASH is added once the router is known.
+ *
+ * \param [in] topic_var     Topic var (T header)
+ * \param [in] msg_size      Length in bytes of the message (L header)
+ * \param [in] rows          Number of rows in the message (R header)
+ *
+ * \return headers, the caller owns them until they are produced
+ */
+RdKafka::Headers *msgBus_kafka::parsedHeaders(const char *topic_var, size_t msg_size, int rows) {
+    RdKafka::Headers *headers = RdKafka::Headers::create();
+
+    headers->add("V", MSGBUS_API_VERSION);
+    headers->add("C_HASH_ID", collector_hash_bin, sizeof(collector_hash_bin));
+    headers->add("T", topic_var);
+    addHeader32(headers, "L", msg_size);
+    addHeader32(headers, "R", rows);
+
+    for (size_t i = 0; i < sizeof(router_hash); i++) {
+        if (router_hash[i] != 0) {
+            headers->add("R_HASH", router_hash, sizeof(router_hash));
+            break;
+        }
+    }
+
+    return headers;
+}
+
+/**
+ * Replace the bulk producer by one with the current autotune batching setting
+ *
+ *      librdkafka can't change linger or batch size of a running producer.  The replaced
+ *      producer is drained by service() without blocking the reader.  Until it is drained, new
+ *      bulk messages are held (holdBulk()) so that they are not delivered before the queued
+ *      ones, then produced in order to the new producer.  Nothing is dropped.  The current
+ *      producer is kept if the new one fails or the previous replaced one is still draining.
+ *
+ * \return true if replaced, false if the current producer is kept
+ */
+bool msgBus_kafka::replaceProducer() {
+    static Metrics::Counter &m_replaced = Metrics::get("kafka.autotune.producer_replaced");
+    static Metrics::Counter &m_failed   = Metrics::get("kafka.autotune.producer_replace_failed");
+
+    const KafkaAutotune::setting &tuned = autotune->current();
+    string errstr;
+
+    if (retired_producer != NULL) {
+        LOG_INFO("rtr=%s: Replaced kafka producer still draining, keeping the batching: outq=%d",
+                 router_ip.c_str(), retired_producer->outq_len());
+        m_failed.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+
+    submitBatches();
+
+    // Producer::create() copies the config, the control lane changed these
+    if (conf->set("queue.buffering.max.ms", std::to_string(tuned.linger_ms), errstr) != RdKafka::Conf::CONF_OK or
+        conf->set("queue.buffering.max.messages", std::to_string(cfg->q_buf_max_msgs), errstr) != RdKafka::Conf::CONF_OK or
+        conf->set("batch.num.messages", std::to_string(tuned.batch_msgs), errstr) != RdKafka::Conf::CONF_OK or
+        conf->set("event_cb", event_callback, errstr) != RdKafka::Conf::CONF_OK) {
+        LOG_WARN("rtr=%s: Failed to configure the kafka batching, keeping the producer: %s",
+                 router_ip.c_str(), errstr.c_str());
+        m_failed.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+
+    RdKafka::Producer *new_producer = RdKafka::Producer::create(conf, errstr);
+    if (new_producer == NULL) {
+        LOG_WARN("rtr=%s: Failed to create producer, keeping the batching: %s", router_ip.c_str(), errstr.c_str());
+        m_failed.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+
+    KafkaTopicSelector *new_topicSel;
+    try {
+        new_topicSel = new KafkaTopicSelector(logger, cfg, new_producer);
+
+    } catch (char const *str) {
+        LOG_WARN("rtr=%s: Failed to create topics, keeping the batching: err=%s", router_ip.c_str(), str);
+        delete new_producer;
+        m_failed.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+
+    // Batches hold topics of the replaced producer, they were submitted above
+    batches.clear();
+
+    retired_topicSel = topicSel;
+    retired_producer = producer;
+
+    topicSel = new_topicSel;
+    producer = new_producer;
+    event_callback->setBatchLimit(tuned.batch_msgs);
+    service_poll = true;
+
+    LOG_INFO("rtr=%s: Kafka batching changed: linger=%u ms batch=%u msgs", router_ip.c_str(),
+             tuned.linger_ms, tuned.batch_msgs);
+    m_replaced.fetch_add(1, std::memory_order_relaxed);
+
+    return true;
+}
+
+/**
+ * Poll the retired bulk producer, deleted once drained and the held messages are produced
+ */
+void msgBus_kafka::drainRetiredProducer() {
+    retired_producer->poll(0);
+
+    if (retired_producer->outq_len() > 0)
+        return;
+
+    std::string name = retired_producer->name();
+
+    delete retired_topicSel;
+    delete retired_producer;
+    KafkaStats::remove(name);
+
+    retired_topicSel = NULL;
+    retired_producer = NULL;
+
+    releaseHeld();
+}
+
+/**
+ * Hold a bulk message until the retired producer is drained
+ *
+ *      Past MSGBUS_HOLD_MAX_BYTES the reader waits for the retired producer, like it waits
+ *      on a full producer queue.
+ *
+ * \param [in] topic_var     Topic var
+ * \param [in] msg           Message, NULL for a tombstone
+ * \param [in] msg_size      Length in bytes of the message
+ * \param [in] rows          Number of rows
+ * \param [in] key           Hash key
+ * \param [in] peer_group    Peer group name - NULL if not set
+ * \param [in] peer_asn      Peer ASN
+ */
+void msgBus_kafka::holdBulk(const char *topic_var, const char *msg, size_t msg_size, int rows, const string &key,
+                            const string *peer_group, uint32_t peer_asn) {
+    static Metrics::Counter &m_held = Metrics::get("kafka.autotune.held_msgs");
+
+    held_bulk.push_back(held_bulk_msg());
+    held_bulk_msg &held = held_bulk.back();
+
+    held.topic_var      = topic_var;
+    held.tombstone      = msg == NULL;
+    held.rows           = rows;
+    held.key            = key;
+    held.has_peer_group = peer_group != NULL;
+    held.peer_asn       = peer_asn;
+
+    if (msg != NULL)
+        held.msg.assign(msg, msg_size);
+
+    if (peer_group != NULL)
+        held.peer_group = *peer_group;
+
+    held_bulk_bytes += msg_size + key.size();
+    m_held.fetch_add(1, std::memory_order_relaxed);
+
+    while (retired_producer != NULL and held_bulk_bytes >= MSGBUS_HOLD_MAX_BYTES and drainWaitMs(100) > 0) {
+        retired_producer->poll(100);
+        drainRetiredProducer();
+    }
+}
+
+/**
+ * Produce the held bulk messages, in order, to the bulk producer
+ */
+void msgBus_kafka::releaseHeld() {
+    std::deque<held_bulk_msg> held;
+    held.swap(held_bulk);
+    held_bulk_bytes = 0;
+
+    for (std::deque<held_bulk_msg>::iterator it = held.begin(); it != held.end(); ++it) {
+        const string *peer_group = it->has_peer_group ? &it->peer_group : NULL;
+
+        if (it->tombstone)
+            produceTombstone(it->topic_var.c_str(), it->key, peer_group, it->peer_asn);
+        else
+            produce(it->topic_var.c_str(), &it->msg[0], it->msg.size(), it->rows, it->key, peer_group, it->peer_asn);
+    }
+}
+
+/**
+ * Set the columns to blank from the projection of the config
+ *
+ *      Normalized prefixes reference base_attribute rows, so they are not used while
+ *      base_attribute has projected columns.
+ */
+void msgBus_kafka::loadProjection() {
+    blank_base_attr      = blankColumns(cfg, MSGBUS_TOPIC_VAR_BASE_ATTRIBUTE);
+    blank_unicast_prefix = blankColumns(cfg, MSGBUS_TOPIC_VAR_UNICAST_PREFIX);
+    blank_l3vpn          = blankColumns(cfg, MSGBUS_TOPIC_VAR_L3VPN);
+    blank_evpn           = blankColumns(cfg, MSGBUS_TOPIC_VAR_EVPN);
+    blank_ls_node        = blankColumns(cfg, MSGBUS_TOPIC_VAR_LS_NODE);
+    blank_ls_link        = blankColumns(cfg, MSGBUS_TOPIC_VAR_LS_LINK);
+    blank_ls_prefix      = blankColumns(cfg, MSGBUS_TOPIC_VAR_LS_PREFIX);
+    blank_normalized_prefix = ColumnProjection::hashedColumns(MSGBUS_TOPIC_VAR_UNICAST_PREFIX);
+    normalize_prefixes   = cfg->kafka_normalized_prefixes and blank_base_attr == 0;
+}
+
+/**
+ * Switch to a reloaded config, see MsgBusInterface
+ *
+ *      Held messages are submitted with the topics of the previous config first.  Column
+ *      projection is set from the new config.  Router and peer groups are matched again
+ *      without new DNS lookups.  The producers are kept, so the
+ *      kafka settings and the librdkafka debug do not change until the session reconnects.
+ *
+ * \param [in] cfg         Reloaded config
+ */
+void msgBus_kafka::setConfig(Config *cfg) {
+    produceStatReports();
+    submitBatches();
+    batches.clear();
+
+    this->cfg = cfg;
+    debug = cfg->debug_msgbus;
+
+    loadProjection();
+
+    if (ctrl_topicSel != NULL)
+        ctrl_topicSel->setConfig(cfg);
+
+    if (topicSel == NULL)
+        return;
+
+    topicSel->setConfig(cfg);
+
+    if (router_match.addr.size() > 0)
+        topicSel->lookupRouterGroup(router_match.hostname, router_match.addr, router_group_name);
+
+    for (std::map<std::string, group_match>::iterator it = peer_match.begin(); it != peer_match.end(); ++it)
+        topicSel->lookupPeerGroup(it->second.hostname, it->second.addr, it->second.asn, peer_list[it->first]);
+
+    LOG_INFO("rtr=%s: Using the reloaded config, router group '%s', %lu peers matched again",
+             router_ip.c_str(), router_group_name.c_str(), peer_match.size());
+}
+
+/**
+ * Set the initial RIB dump state of the router, runs the batching autotune when due
+ *
+ *      Called by the reader after each route monitoring message, so outside of produce() and
+ *      with no producer or topic in use.
+ *
+ * \param [in] active      True while the router is in its initial RIB dump
+ */
+void msgBus_kafka::setRibDump(bool active) {
+    rib_dump = active;
+
+    if (autotune == NULL or not isConnected or producer == NULL)
+        return;
+
+    uint64_t now_ms = steadyMs();
+
+    // The queue of the new producer doesn't show the backlog while the replaced one drains
+    if (now_ms < autotune_next_ms or retired_producer != NULL)
+        return;
+
+    autotune_next_ms = now_ms + autotune->intervalMs();
+
+    KafkaAutotune::sample sample;
+    sample.rib_dump = rib_dump;
+    sample.produced = autotune_produced;
+    sample.queue_msgs = producer->outq_len();
+    sample.delivered = 0;
+    sample.latency_sum_us = 0;
+
+    if (delivery_callback != NULL)
+        delivery_callback->takeWindow(sample.delivered, sample.latency_sum_us);
+
+    autotune_produced = 0;
+
+    if (autotune->evaluate(sample) and not replaceProducer())
+        autotune->revert();
+}
+
 /**
  * produce message to Kafka
  *
@@ -364,6 +952,8 @@ void msgBus_kafka::connect() {
  */
 void msgBus_kafka::produce(const char *topic_var, char *msg, size_t msg_size, int rows, string key,
                            const string *peer_group, uint32_t peer_asn) {
+    StageStats::Scope stage(StageStats::STAGE_PRODUCE);
+
     size_t len;
     RdKafka::Topic *topic = NULL;
 
@@ -375,55 +965,450 @@ void msgBus_kafka::produce(const char *topic_var, char *msg, size_t msg_size, in
             return;
         }*/
 
-        LOG_WARN("rtr=%s: Not connected to Kafka, attempting to reconnect", router_ip.c_str());
-        connect();
+        // No reconnect once shutting down, the message is dropped
+        if (shuttingDown())
+            return;
+
+        LOG_WARN("rtr=%s: Not connected to Kafka, attempting to reconnect", router_ip.c_str());
+        connect();
+
+        sleep(1);
+    }
+
+    // if topic is disabled, don't bother producing the message
+    // TODO: it would be more efficient to move this check to the top of the various update_* methods, but I'm not sure which parts of these methods have side-effects that need to be preserved.
+    if (!topicSel->topicEnabled(topic_var))
+        return;
+
+    OBMP_TRACE3(msgbus_serialized, topic_var, rows, msg_size);
+
+    // Control topics have their own producer and queue, see connectControlLane()
+    RdKafka::Producer *lane_producer = producer;
+    KafkaTopicSelector *lane_topicSel = topicSel;
+
+    bool control = ctrl_producer != NULL and isControlTopic(topic_var);
+
+    if (control and not ctrl_use_bulk) {
+        lane_producer = ctrl_producer;
+        lane_topicSel = ctrl_topicSel;
+    }
+
+    // Bulk messages wait for the queue of the replaced producer, see replaceProducer()
+    if (retired_producer != NULL and lane_producer == producer) {
+        holdBulk(topic_var, msg, msg_size, rows, key, peer_group, peer_asn);
+        serviceIfDue();
+        return;
+    }
+
+    topic = lane_topicSel->getTopic(topic_var, &router_group_name, peer_group, peer_asn);
+    if (topic != NULL) {
+        SELF_DEBUG("rtr=%s: Producing message: topic=%s key=%s, msg size = %lu", router_ip.c_str(),
+                   topic->name().c_str(), key.c_str(), msg_size);
+
+        RdKafka::ErrorCode resp;
+        void *opaque = delivery_callback != NULL ? KafkaDeliveryReportCallback::enqueueTime() : NULL;
+
+        char headers[256];
+        len = 0;
+
+        if (not cfg->kafka_native_headers)
+            len = snprintf(headers, sizeof(headers), "V: %s\nC_HASH_ID: %s\nT: %s\nL: %lu\nR: %d\n\n",
+                           MSGBUS_API_VERSION, collector_hash.c_str(), topic_var, msg_size, rows);
+
+        if (batch_produce and lane_producer == producer and not control) {
+            produceBatched(topic, topic_var, headers, len, msg, msg_size, key, opaque);
+            serviceIfDue();
+            return;
+        }
+
+        // Control messages on the bulk lane are not held, they follow the batched rows
+        if (control and lane_producer == producer)
+            submitBatches();
+
+        if (cfg->kafka_native_headers) {
+            // Value is only the rows.  Producing by name uses the topic handle created by getTopic()
+            RdKafka::Headers *native_headers = parsedHeaders(topic_var, msg_size, rows);
+
+            resp = lane_producer->produce(topic->name(), RdKafka::Topic::PARTITION_UA,
+                                          RdKafka::Producer::RK_MSG_COPY,
+                                          msg, msg_size, key.data(), key.size(), 0, native_headers, opaque);
+
+            // librdkafka owns the headers only if produced
+            if (resp != RdKafka::ERR_NO_ERROR)
+                delete native_headers;
+
+        } else {
+            memcpy(producer_buf, headers, len);
+            memcpy(producer_buf+len, msg, msg_size);
+
+            resp = lane_producer->produce(topic, RdKafka::Topic::PARTITION_UA,
+                                          RdKafka::Producer::RK_MSG_COPY,
+                                          producer_buf, msg_size + len,
+                                          (const std::string *) &key, opaque);
+        }
+
+        if (resp != RdKafka::ERR_NO_ERROR) {
+            if (resp == RdKafka::ERR__QUEUE_FULL) {
+              static Metrics::Counter &m_queue_full = Metrics::get("msgbus.queue_full");
+              m_queue_full.fetch_add(1, std::memory_order_relaxed);
+
+              OBMP_TRACE2(msgbus_queue_full, topic_var, lane_producer->outq_len());
+
+              // Past the shutdown deadline the message is dropped
+              if (drainWaitMs(100) == 0) {
+                  Metrics::get("msgbus.drain.dropped").fetch_add(1, std::memory_order_relaxed);
+                  return;
+              }
+
+              lane_producer->poll(100);
+              produce(topic_var, msg, msg_size, rows, key, peer_group, peer_asn);
+            } else {
+              LOG_ERR("rtr=%s: Failed to produce message: %s", router_ip.c_str(), RdKafka::err2str(resp).c_str());
+            }
+            lane_producer->poll(100);
+        } else {
+            static Metrics::Counter &m_produced = Metrics::get("msgbus.produced");
+            static Metrics::Counter &m_produced_bytes = Metrics::get("msgbus.produced_bytes");
+            m_produced.fetch_add(1, std::memory_order_relaxed);
+            m_produced_bytes.fetch_add(msg_size + len, std::memory_order_relaxed);
+
+            if (lane_producer == producer)
+                ++autotune_produced;
+
+            OBMP_TRACE3(msgbus_enqueue, topic_var, msg_size + len, lane_producer->outq_len());
+        }
+    } else {
+        LOG_NOTICE("rtr=%s: failed to produce message because topic couldn't be found: topic=%s key=%s, msg size = %lu", router_ip.c_str(),
+                   topic_var, key.c_str(), msg_size);
+    }
+
+    // Producers are polled at the service cadence when batching
+    if (batch_produce) {
+        serviceIfDue();
+        return;
+    }
+
+    if (stat_due_ms != 0 and steadyMs() >= stat_due_ms)
+        produceStatReports();
+
+    producer->poll(0);
+    topicSel->evictIdle();
+
+    if (ctrl_producer != NULL) {
+        ctrl_producer->poll(0);
+        ctrl_topicSel->evictIdle();
+    }
+}
+
+/**
+ * Hold a bulk message for batch submission
+ *
+ *      The value (text headers and message) and key are copied, the batch of the topic is
+ *      submitted when it reaches kafka.produce_batch messages or MSGBUS_PRODUCE_BATCH_BYTES,
+ *      otherwise by service() within MSGBUS_SERVICE_INTERVAL_MS.
+ *
+ * \param [in] topic         Topic of the bulk producer
+ * \param [in] topic_var     Topic var
+ * \param [in] hdr           Text headers
+ * \param [in] hdr_len       Length of the text headers
+ * \param [in] msg           Message
+ * \param [in] msg_size      Length of the message
+ * \param [in] key           Hash key
+ * \param [in] opaque        Message opaque
+ */
+void msgBus_kafka::produceBatched(RdKafka::Topic *topic, const char *topic_var, const char *hdr, size_t hdr_len,
+                                  const char *msg, size_t msg_size, const std::string &key, void *opaque) {
+    produce_batch &batch = batches[topic];
+    produce_batch::held_msg held;
+
+    held.offset  = batch.data.size();
+    held.len     = hdr_len + msg_size;
+    held.key_len = key.size();
+    held.opaque  = opaque;
+
+    batch.topic_var = topic_var;
+    batch.data.append(hdr, hdr_len);
+    batch.data.append(msg, msg_size);
+    batch.data.append(key);
+    batch.msgs.push_back(held);
+
+    ++batched_msgs;
+
+    if (batch.msgs.size() >= (size_t)cfg->produce_batch_msgs or batch.data.size() >= MSGBUS_PRODUCE_BATCH_BYTES)
+        submitBatch(topic, batch);
+}
+
+/**
+ * Submit a held batch to the bulk producer
+ *
+ *      Uses rd_kafka_produce_batch(), one enqueue for the batch instead of one per message.  The
+ *      partitioner is applied per message.  On a full queue librdkafka fails the remaining
+ *      messages as well; those are submitted again, in order, after a poll.
+ *
+ * \param [in] topic         Topic of the batch
+ * \param [in] batch         Batch, empty on return
+ */
+void msgBus_kafka::submitBatch(RdKafka::Topic *topic, produce_batch &batch) {
+    static Metrics::Counter &m_produced       = Metrics::get("msgbus.produced");
+    static Metrics::Counter &m_produced_bytes = Metrics::get("msgbus.produced_bytes");
+    static Metrics::Counter &m_batches        = Metrics::get("msgbus.produce_batches");
+    static Metrics::Counter &m_queue_full     = Metrics::get("msgbus.queue_full");
+
+    size_t cnt = batch.msgs.size();
+    if (cnt == 0)
+        return;
+
+    batch_rkmessages.resize(cnt);
+    memset(batch_rkmessages.data(), 0, cnt * sizeof(rd_kafka_message_t));
+
+    for (size_t i = 0; i < cnt; i++) {
+        const produce_batch::held_msg &held = batch.msgs[i];
+
+        batch_rkmessages[i].payload  = &batch.data[held.offset];
+        batch_rkmessages[i].len      = held.len;
+        batch_rkmessages[i].key      = &batch.data[held.offset + held.len];
+        batch_rkmessages[i].key_len  = held.key_len;
+        batch_rkmessages[i]._private = held.opaque;
+    }
+
+    uint64_t produced = 0, produced_bytes = 0;
+    size_t first = 0;
+
+    while (first < cnt) {
+        rd_kafka_produce_batch(topic->c_ptr(), RD_KAFKA_PARTITION_UA, RD_KAFKA_MSG_F_COPY,
+                               &batch_rkmessages[first], cnt - first);
+
+        // Keep the messages to submit again at the front, in order
+        size_t retry = first;
+        bool queue_full = false;
+
+        for (size_t i = first; i < cnt; i++) {
+            rd_kafka_message_t &rkmessage = batch_rkmessages[i];
+
+            if (rkmessage.err == RD_KAFKA_RESP_ERR_NO_ERROR) {
+                ++produced;
+                produced_bytes += rkmessage.len;
+
+            } else if (rkmessage.err == RD_KAFKA_RESP_ERR__QUEUE_FULL) {
+                queue_full = true;
+                rkmessage.err = RD_KAFKA_RESP_ERR_NO_ERROR;
+                batch_rkmessages[retry++] = rkmessage;
+
+            } else {
+                LOG_ERR("rtr=%s: Failed to produce message: %s", router_ip.c_str(),
+                        RdKafka::err2str((RdKafka::ErrorCode)rkmessage.err).c_str());
+            }
+        }
+
+        cnt = retry;
+
+        if (queue_full) {
+            m_queue_full.fetch_add(1, std::memory_order_relaxed);
+            OBMP_TRACE2(msgbus_queue_full, batch.topic_var, producer->outq_len());
+
+            // Past the shutdown deadline the rest of the batch is dropped
+            if (drainWaitMs(100) == 0) {
+                Metrics::get("msgbus.drain.dropped").fetch_add(cnt - first, std::memory_order_relaxed);
+                break;
+            }
+
+            producer->poll(100);
+        }
+    }
+
+    m_produced.fetch_add(produced, std::memory_order_relaxed);
+    m_produced_bytes.fetch_add(produced_bytes, std::memory_order_relaxed);
+    m_batches.fetch_add(1, std::memory_order_relaxed);
+    autotune_produced += produced;
+
+    OBMP_TRACE3(msgbus_enqueue, batch.topic_var, produced_bytes, producer->outq_len());
+
+    batched_msgs -= batch.msgs.size();
+    batch.msgs.clear();
+    batch.data.clear();
+}
+
+/**
+ * Submit all held batches, must be called before producing directly to the bulk producer
+ * or destroying it
+ */
+void msgBus_kafka::submitBatches() {
+    if (batched_msgs == 0)
+        return;
+
+    for (std::map<RdKafka::Topic *, produce_batch>::iterator it = batches.begin(); it != batches.end(); ++it)
+        submitBatch(it->first, it->second);
+}
+
+/**
+ * Submit the held batches of a topic var, for all topic handles it resolves to
+ *
+ * \param [in] topic_var     Topic var
+ */
+void msgBus_kafka::submitBatches(const char *topic_var) {
+    if (batched_msgs == 0)
+        return;
+
+    for (std::map<RdKafka::Topic *, produce_batch>::iterator it = batches.begin(); it != batches.end(); ++it) {
+        if (it->second.msgs.size() > 0 and strcmp(it->second.topic_var, topic_var) == 0)
+            submitBatch(it->first, it->second);
+    }
+}
+
+/**
+ * Time until service() is due, see MsgBusInterface
+ *
+ * \returns Milliseconds, zero if due now, -1 if nothing is held or queued
+ */
+int msgBus_kafka::msUntilService() {
+    if (batched_msgs == 0 and not service_poll and stat_due_ms == 0)
+        return -1;
+
+    uint64_t now_ms = steadyMs();
+    uint64_t due_ms = next_service_ms;
+
+    if (batched_msgs == 0 and not service_poll)
+        due_ms = stat_due_ms;
+    else if (stat_due_ms != 0 and stat_due_ms < due_ms)
+        due_ms = stat_due_ms;
+
+    return now_ms >= due_ms ? 0 : (int)(due_ms - now_ms);
+}
+
+/**
+ * Submit the held batches and poll the producers
+ *
+ *      Polling serves the delivery reports and events.  Producers are polled again at the next
+ *      interval while they have messages in flight.
+ */
+void msgBus_kafka::service() {
+    if (stat_due_ms != 0 and steadyMs() >= stat_due_ms)
+        produceStatReports();
+
+    if (producer != NULL) {
+        submitBatches();
+        producer->poll(0);
+
+        // Nothing is held, the batches of released topic handles are dropped
+        if (topicSel != NULL and topicSel->evictIdle() > 0)
+            batches.clear();
+    }
+
+    if (ctrl_producer != NULL) {
+        ctrl_producer->poll(0);
+        ctrl_topicSel->evictIdle();
+    }
+
+    if (retired_producer != NULL)
+        drainRetiredProducer();
+
+    // Control messages return to the control lane once those on the bulk lane are delivered
+    if (ctrl_use_bulk and producer != NULL and producer->outq_len() == 0 and batched_msgs == 0 and
+            retired_producer == NULL)
+        ctrl_use_bulk = false;
+
+    service_poll = (producer != NULL and producer->outq_len() > 0) or
+                   (ctrl_producer != NULL and ctrl_producer->outq_len() > 0) or
+                   retired_producer != NULL;
+
+    next_service_ms = steadyMs() + MSGBUS_SERVICE_INTERVAL_MS;
+}
+
+/**
+ * Run service() if due, otherwise mark the producers for the next poll
+ */
+void msgBus_kafka::serviceIfDue() {
+    service_poll = true;
+
+    if (steadyMs() >= next_service_ms)
+        service();
+}
+
+/**
+ * produce a tombstone (NULL payload) to Kafka
+ *
+ * \param [in] topic_var     Topic var to use in KafkaTopicSelector::getTopic() MSGBUS_TOPIC_VAR_*
+ * \param [in] key           Hash key to delete
+ * \param [in] peer_group    Peer group name - empty/NULL if not set or used
+ * \param [in] peer_asn      Peer ASN
+ */
+void msgBus_kafka::produceTombstone(const char *topic_var, const string &key, const string *peer_group,
+                                    uint32_t peer_asn) {
+    StageStats::Scope stage(StageStats::STAGE_PRODUCE);
+
+    if (isConnected == false or topicSel == NULL or !topicSel->topicEnabled(topic_var))
+        return;
+
+    // Tombstones wait for the queue of the replaced producer, see replaceProducer()
+    if (retired_producer != NULL) {
+        holdBulk(topic_var, NULL, 0, 0, key, peer_group, peer_asn);
+        return;
+    }
+
+    // Held state rows of the same keys go first
+    submitBatches();
+
+    RdKafka::Topic *topic = topicSel->getTopic(topic_var, &router_group_name, peer_group, peer_asn);
+    if (topic == NULL) {
+        LOG_NOTICE("rtr=%s: failed to produce tombstone because topic couldn't be found: topic=%s key=%s",
+                   router_ip.c_str(), topic_var, key.c_str());
+        return;
+    }
+
+    SELF_DEBUG("rtr=%s: Producing tombstone: topic=%s key=%s", router_ip.c_str(), topic->name().c_str(), key.c_str());
+
+    RdKafka::ErrorCode resp;
+    while ((resp = producer->produce(topic, RdKafka::Topic::PARTITION_UA, RdKafka::Producer::RK_MSG_COPY,
+                                     NULL, 0, &key, NULL)) == RdKafka::ERR__QUEUE_FULL) {
+        OBMP_TRACE2(msgbus_queue_full, topic_var, producer->outq_len());
+
+        if (drainWaitMs(100) == 0)
+            break;
 
-        sleep(1);
+        producer->poll(100);
     }
 
-    // if topic is disabled, don't bother producing the message
-    // TODO: it would be more efficient to move this check to the top of the various update_* methods, but I'm not sure which parts of these methods have side-effects that need to be preserved.
-    if (!topicSel->topicEnabled(topic_var))
-        return;
+    if (resp != RdKafka::ERR_NO_ERROR)
+        LOG_ERR("rtr=%s: Failed to produce tombstone: %s", router_ip.c_str(), RdKafka::err2str(resp).c_str());
 
-    char headers[256];
-    len = snprintf(headers, sizeof(headers), "V: %s\nC_HASH_ID: %s\nT: %s\nL: %lu\nR: %d\n\n",
-            MSGBUS_API_VERSION, collector_hash.c_str(), topic_var, msg_size, rows);
+    producer->poll(0);
+}
 
-    memcpy(producer_buf, headers, len);
-    memcpy(producer_buf+len, msg, msg_size);
+/**
+ * Withdraw the current prefix state of a peer
+ *
+ * \param [in] p_hash_str    Peer hash string
+ */
+void msgBus_kafka::clearPrefixState(const string &p_hash_str) {
+    static Metrics::Counter &tombstones = Metrics::get("msgbus.prefix_state.tombstones");
 
+    std::map<std::string, prefix_state_table>::iterator it = prefix_state.find(p_hash_str);
+    if (it == prefix_state.end())
+        return;
 
-    topic = topicSel->getTopic(topic_var, &router_group_name, peer_group, peer_asn);
-    if (topic != NULL) {
-        SELF_DEBUG("rtr=%s: Producing message: topic=%s key=%s, msg size = %lu", router_ip.c_str(),
-                   topic->name().c_str(), key.c_str(), msg_size);
+    peer_list_iter peer_it = peer_list.find(p_hash_str);
+    const string *peer_group = peer_it != peer_list.end() ? &peer_it->second : NULL;
 
-        RdKafka::ErrorCode resp = producer->produce(topic, RdKafka::Topic::PARTITION_UA,
-                                                    RdKafka::Producer::RK_MSG_COPY,
-                                                    producer_buf, msg_size + len,
-                                                    (const std::string *) &key, NULL);
-        if (resp != RdKafka::ERR_NO_ERROR) {
-            if (resp == RdKafka::ERR__QUEUE_FULL) {
-              producer->poll(100);
-              produce(topic_var, msg, msg_size, rows, key, peer_group, peer_asn);
-            } else {
-              LOG_ERR("rtr=%s: Failed to produce message: %s", router_ip.c_str(), RdKafka::err2str(resp).c_str());
-            }
-            producer->poll(100);
-        }
-    } else {
-        LOG_NOTICE("rtr=%s: failed to produce message because topic couldn't be found: topic=%s key=%s, msg size = %lu", router_ip.c_str(),
-                   topic_var, key.c_str(), msg_size);
+    SELF_DEBUG("rtr=%s: Withdrawing prefix state of peer %s: %lu prefixes", router_ip.c_str(),
+               p_hash_str.c_str(), it->second.prefixes.size());
+
+    string rib_hash_str;
+    for (auto &entry : it->second.prefixes) {
+        hash_toStr((u_char *)entry.first.v, rib_hash_str);
+        produceTombstone(MSGBUS_TOPIC_VAR_UNICAST_PREFIX_STATE, rib_hash_str, peer_group, it->second.peer_asn);
     }
 
-    producer->poll(0);
+    tombstones.fetch_add(it->second.prefixes.size(), std::memory_order_relaxed);
+
+    prefix_state.erase(it);
 }
 
 /**
  * Abstract method Implementation - See MsgBusInterface.hpp for details
  */
 void msgBus_kafka::update_Collector(obj_collector &c_object, collector_action_code action_code) {
+    StageStats::Scope stage(StageStats::STAGE_SERIALIZE);
+
     char buf[4096]; // Misc working buffer
 
     string ts;
@@ -460,6 +1445,8 @@ void msgBus_kafka::update_Collector(obj_collector &c_object, collector_action_co
  * Abstract method Implementation - See MsgBusInterface.hpp for details
  */
 void msgBus_kafka::update_Router(obj_router &r_object, router_action_code code) {
+    StageStats::Scope stage(StageStats::STAGE_SERIALIZE);
+
     char buf[4096]; // Misc working buffer
 
     // Convert binary hash to string
@@ -481,9 +1468,20 @@ void msgBus_kafka::update_Router(obj_router &r_object, router_action_code code)
             break;
 
         case ROUTER_ACTION_TERM:
+            // Held stats reports of the router go before the term message
+            produceStatReports();
+
             skip_if_defined = false;
             action.assign("term");
             bzero(router_hash, sizeof(router_hash));
+
+            // All peers of the router are gone, withdraw their current prefix state
+            while (not prefix_state.empty())
+                clearPrefixState(prefix_state.begin()->first);
+
+            if (local_rib != NULL)
+                local_rib->removeRouter(hash_key(r_object.hash_id));
+
             break;
     }
 
@@ -523,15 +1521,23 @@ void msgBus_kafka::update_Router(obj_router &r_object, router_action_code code)
         snprintf((char *)r_object.name, sizeof(r_object.name)-1, "%s", hostname.c_str());
     }
 
-    if (topicSel != NULL)
+    if (topicSel != NULL) {
         topicSel->lookupRouterGroup((char *)r_object.name, (char *)r_object.ip_addr, router_group_name);
 
+        router_match.hostname = (char *)r_object.name;
+        router_match.addr = (char *)r_object.ip_addr;
+        router_match.asn = 0;
+    }
+
     size_t size = snprintf(buf, sizeof(buf),
              "%s\t%" PRIu64 "\t%s\t%s\t%s\t%s\t%" PRIu16 "\t%s\t%s\t%s\t%s\t%s\n", action.c_str(),
              router_seq, r_object.name, r_hash_str.c_str(), r_object.ip_addr, descr.c_str(),
              r_object.term_reason_code, r_object.term_reason_text,
              initData.c_str(), termData.c_str(), ts.c_str(), r_object.bgp_id);
 
+    if (code == ROUTER_ACTION_TERM)
+        orderAfterBulkLane();
+
     produce(MSGBUS_TOPIC_VAR_ROUTER, buf, size, 1, r_hash_str, NULL, 0);
 
     router_seq++;
@@ -541,6 +1547,7 @@ void msgBus_kafka::update_Router(obj_router &r_object, router_action_code code)
  * Abstract method Implementation - See MsgBusInterface.hpp for details
  */
 void msgBus_kafka::update_Peer(obj_bgp_peer &peer, obj_peer_up_event *up, obj_peer_down_event *down, peer_action_code code) {
+    StageStats::Scope stage(StageStats::STAGE_SERIALIZE);
 
     char buf[4096]; // Misc working buffer
 
@@ -548,42 +1555,46 @@ void msgBus_kafka::update_Peer(obj_bgp_peer &peer, obj_peer_up_event *up, obj_pe
     hash_toStr(peer.router_hash_id, r_hash_str);
 
     // Generate the hash
-    MD5 hash;
-    unsigned char peer_type = 0;
+    {
+        StageStats::Scope hash_stage(StageStats::STAGE_HASHING);
+
+        MD5 hash;
+        unsigned char peer_type = 0;
 
 
-    hash.update((unsigned char *) peer.peer_addr,
-                strlen(peer.peer_addr));
-    hash.update((unsigned char *) peer.peer_rd, strlen(peer.peer_rd));
-    hash.update((unsigned char *)r_hash_str.c_str(), r_hash_str.length());
+        hash.update((unsigned char *) peer.peer_addr,
+                    strlen(peer.peer_addr));
+        hash.update((unsigned char *) peer.peer_rd, strlen(peer.peer_rd));
+        hash.update((unsigned char *)r_hash_str.c_str(), r_hash_str.length());
 
-    if (peer.isLocRib) { // Local-RIB, include in hash to make it different
-      peer_type |= 0x80;
-      hash.update((unsigned char *) &peer_type, 1);
-    }
+        if (peer.isLocRib) { // Local-RIB, include in hash to make it different
+          peer_type |= 0x80;
+          hash.update((unsigned char *) &peer_type, 1);
+        }
 
-    /* Note: RFC7854 doesn't indicate if PEER_UP should be sent for each flag type, such as Adj-RIB-In pre, post, ...
-     *   It is assumed that only one peer up will be sent regardless of pre/post policy. Therefore,
-     *   pre/post and in/out is hashed at the route monitor/mirror level.
-     *
-     * TODO: Change this when bis or new RFC updates 7854.
-     */
+        /* Note: RFC7854 doesn't indicate if PEER_UP should be sent for each flag type, such as Adj-RIB-In pre, post, ...
+         *   It is assumed that only one peer up will be sent regardless of pre/post policy. Therefore,
+         *   pre/post and in/out is hashed at the route monitor/mirror level.
+         *
+         * TODO: Change this when bis or new RFC updates 7854.
+         */
 
-    /* TODO: Uncomment once this is fixed in XR
-     * Disable hashing the bgp peer ID since XR has an issue where it sends 0.0.0.0 on subsequent PEER_UP's
-     *    This will be fixed in XR, but for now we can disable hashing on it.
-     * To Re-enable, need to add a configuration option to support existing deployments without this in the hash
-     *
-    hash.update((unsigned char *) p_object.peer_bgp_id,
-            strlen(p_object.peer_bgp_id));
-    */
+        /* TODO: Uncomment once this is fixed in XR
+         * Disable hashing the bgp peer ID since XR has an issue where it sends 0.0.0.0 on subsequent PEER_UP's
+         *    This will be fixed in XR, but for now we can disable hashing on it.
+         * To Re-enable, need to add a configuration option to support existing deployments without this in the hash
+         *
+        hash.update((unsigned char *) p_object.peer_bgp_id,
+                strlen(p_object.peer_bgp_id));
+        */
 
-    hash.finalize();
+        hash.finalize();
 
-    // Save the hash
-    unsigned char *hash_raw = hash.raw_digest();
-    memcpy(peer.hash_id, hash_raw, 16);
-    delete[] hash_raw;
+        // Save the hash
+        unsigned char *hash_raw = hash.raw_digest();
+        memcpy(peer.hash_id, hash_raw, 16);
+        delete[] hash_raw;
+    }
 
     // Convert binary hash to string
     string p_hash_str;
@@ -610,9 +1621,17 @@ void msgBus_kafka::update_Peer(obj_bgp_peer &peer, obj_peer_up_event *up, obj_pe
             action.assign("down");
             add_to_cache = false;
 
+            clearPrefixState(p_hash_str);              // Before peer group is removed from the cache
+
+            if (local_rib != NULL)
+                local_rib->removePeer(hash_key(peer.hash_id));
+
             if (peer_list.find(p_hash_str) != peer_list.end())
                 peer_list.erase(p_hash_str);
 
+            peer_match.erase(p_hash_str);
+            stat_last.erase(p_hash_str);
+
             break;
     }
 
@@ -630,8 +1649,14 @@ void msgBus_kafka::update_Peer(obj_bgp_peer &peer, obj_peer_up_event *up, obj_pe
 
     // Insert/Update map entry
     if (add_to_cache) {
-        if (topicSel != NULL)
+        if (topicSel != NULL) {
             topicSel->lookupPeerGroup(hostname, peer.peer_addr, peer.peer_as, peer_list[p_hash_str]);
+
+            group_match &match = peer_match[p_hash_str];
+            match.hostname = hostname;
+            match.addr = peer.peer_addr;
+            match.asn = peer.peer_as;
+        }
     }
 
     switch (code) {
@@ -690,10 +1715,16 @@ void msgBus_kafka::update_Peer(obj_bgp_peer &peer, obj_peer_up_event *up, obj_pe
             if (peer_list.find(p_hash_str) != peer_list.end())
                 peer_list.erase(p_hash_str);
 
+            peer_match.erase(p_hash_str);
+            stat_last.erase(p_hash_str);
+
             break;
         }
     }
 
+    if (code == PEER_ACTION_DOWN)
+        orderAfterBulkLane();
+
     produce(MSGBUS_TOPIC_VAR_PEER, buf, strlen(buf), 1, p_hash_str, &peer_list[p_hash_str], peer.peer_as);
 
     peer_seq++;
@@ -703,6 +1734,7 @@ void msgBus_kafka::update_Peer(obj_bgp_peer &peer, obj_peer_up_event *up, obj_pe
  * Abstract method Implementation - See MsgBusInterface.hpp for details
  */
 void msgBus_kafka::update_baseAttribute(obj_bgp_peer &peer, obj_path_attr &attr, base_attr_action_code code) {
+    StageStats::Scope stage(StageStats::STAGE_SERIALIZE);
 
     prep_buf[0] = 0;
     size_t  buf_len;                    // size of the message in buf
@@ -715,30 +1747,34 @@ void msgBus_kafka::update_baseAttribute(obj_bgp_peer &peer, obj_path_attr &attr,
 
 
     // Generate the hash
-    MD5 hash;
+    {
+        StageStats::Scope hash_stage(StageStats::STAGE_HASHING);
 
-    //hash.update(path_object.peer_hash_id, HASH_SIZE);
-    hash.update((unsigned char *) attr.as_path.c_str(), attr.as_path.length());
-    hash.update((unsigned char *) attr.next_hop,
-                strlen(attr.next_hop));
-    hash.update((unsigned char *) attr.aggregator,
-                strlen(attr.aggregator));
-    hash.update((unsigned char *) attr.origin,
-                strlen(attr.origin));
-    hash.update((unsigned char *) &attr.med, sizeof(attr.med));
-    hash.update((unsigned char *) &attr.local_pref,
-                sizeof(attr.local_pref));
-
-    hash.update((unsigned char *) attr.community_list.c_str(), attr.community_list.length());
-    hash.update((unsigned char *) attr.ext_community_list.c_str(), attr.ext_community_list.length());
-    hash.update((unsigned char *) p_hash_str.c_str(), p_hash_str.length());
+        MD5 hash;
 
-    hash.finalize();
+        //hash.update(path_object.peer_hash_id, HASH_SIZE);
+        hash.update((unsigned char *) attr.as_path.c_str(), attr.as_path.length());
+        hash.update((unsigned char *) attr.next_hop,
+                    strlen(attr.next_hop));
+        hash.update((unsigned char *) attr.aggregator,
+                    strlen(attr.aggregator));
+        hash.update((unsigned char *) attr.origin,
+                    strlen(attr.origin));
+        hash.update((unsigned char *) &attr.med, sizeof(attr.med));
+        hash.update((unsigned char *) &attr.local_pref,
+                    sizeof(attr.local_pref));
+
+        hash.update((unsigned char *) attr.community_list.c_str(), attr.community_list.length());
+        hash.update((unsigned char *) attr.ext_community_list.c_str(), attr.ext_community_list.length());
+        hash.update((unsigned char *) p_hash_str.c_str(), p_hash_str.length());
 
-    // Save the hash
-    unsigned char *hash_raw = hash.raw_digest();
-    memcpy(attr.hash_id, hash_raw, 16);
-    delete[] hash_raw;
+        hash.finalize();
+
+        // Save the hash
+        unsigned char *hash_raw = hash.raw_digest();
+        memcpy(attr.hash_id, hash_raw, 16);
+        delete[] hash_raw;
+    }
 
     hash_toStr(attr.hash_id, path_hash_str);
 
@@ -755,6 +1791,8 @@ void msgBus_kafka::update_baseAttribute(obj_bgp_peer &peer, obj_path_attr &attr,
                      attr.local_pref, attr.aggregator, attr.community_list.c_str(), attr.ext_community_list.c_str(), attr.cluster_list.c_str(),
                      attr.atomic_agg, attr.nexthop_isIPv4, attr.originator_id,attr.large_community_list.c_str());
 
+    buf_len = ColumnProjection::apply(prep_buf, buf_len, blank_base_attr);
+
     produce(MSGBUS_TOPIC_VAR_BASE_ATTRIBUTE, prep_buf, buf_len, 1, p_hash_str, &peer_list[p_hash_str], peer.peer_as);
 
     ++base_attr_seq;
@@ -765,11 +1803,15 @@ void msgBus_kafka::update_baseAttribute(obj_bgp_peer &peer, obj_path_attr &attr,
  */
 void msgBus_kafka::update_L3Vpn(obj_bgp_peer &peer, std::vector<obj_vpn> &vpn,
                                 obj_path_attr *attr, vpn_action_code code) {
+    StageStats::Scope stage(StageStats::STAGE_SERIALIZE);
 
     prep_buf[0] = 0;
 
     char    buf2[80000];                         // Second working buffer
     size_t  buf_len = 0;                         // query buffer length
+    char    labels[BGP_LABELS_STRLEN];           // Printed labels
+    char    rd_admin[BGP_RD_SUBFIELD_STRLEN];    // Printed RD administrator subfield
+    char    rd_assigned[BGP_RD_SUBFIELD_STRLEN]; // Printed RD assigned number subfield
 
     string vpn_hash_str;
     string path_hash_str;
@@ -789,52 +1831,58 @@ void msgBus_kafka::update_L3Vpn(obj_bgp_peer &peer, std::vector<obj_vpn> &vpn,
     // Loop through the vector array of vpn entries
     for (size_t i = 0; i < vpn.size(); i++) {
 
-        // Generate the hash
-        MD5 hash;
-
-        hash.update((unsigned char *) vpn[i].prefix, strlen(vpn[i].prefix));
-        hash.update(&vpn[i].prefix_len, sizeof(vpn[i].prefix_len));
-        hash.update((unsigned char *) vpn[i].rd_administrator_subfield.c_str(),
-                    vpn[i].rd_administrator_subfield.length());
-        hash.update((unsigned char *) vpn[i].rd_assigned_number.c_str(),
-                    vpn[i].rd_assigned_number.length());
+        // RD is printed once, it's part of the hash and the row
+        bgp::rdToStr(vpn[i].rd, rd_admin, rd_assigned);
 
-        hash.update((unsigned char *) p_hash_str.c_str(), p_hash_str.length());
+        // Generate the hash
+        {
+            StageStats::Scope hash_stage(StageStats::STAGE_HASHING);
+
+            MD5 hash;
+
+            hash.update((unsigned char *) vpn[i].prefix, strlen(vpn[i].prefix));
+            hash.update(&vpn[i].prefix_len, sizeof(vpn[i].prefix_len));
+            hash.update((unsigned char *) rd_admin, strlen(rd_admin));
+            hash.update((unsigned char *) rd_assigned, strlen(rd_assigned));
+
+            hash.update((unsigned char *) p_hash_str.c_str(), p_hash_str.length());
+
+            // Add path ID to hash only if exists
+            if (vpn[i].path_id > 0)
+                hash.update((unsigned char *)&vpn[i].path_id, sizeof(vpn[i].path_id));
+
+            /*
+             * Add constant "1" to hash if labels are present
+             *      Withdrawn and updated NLRI's do not carry the original label, therefore we cannot
+             *      hash on the label string.  Instead, we has on a constant value of 1.
+             */
+            if (vpn[i].labels.count > 0) {
+                buf2[0] = 1;
+                hash.update((unsigned char *) buf2, 1);
+                buf2[0] = 0;
+            }
 
-        // Add path ID to hash only if exists
-        if (vpn[i].path_id > 0)
-            hash.update((unsigned char *)&vpn[i].path_id, sizeof(vpn[i].path_id));
+            /*
+             * Support backwards compatibility with NLRI hashing by not including rib type. Current did not hash
+             *    if adj-rib-in and pre-policy.  If it's anything else, then add an extra byte/type to hash.
+             */
+            if (not (peer.isAdjIn and peer.isPrePolicy)) {
+              buf2[0] |= peer.isAdjIn ? 0 : 0x01;
+              buf2[0] |= peer.isPrePolicy ? 0 : 0x02;
+              hash.update((unsigned char *) buf2, 1);
+            }
 
-        /*
-         * Add constant "1" to hash if labels are present
-         *      Withdrawn and updated NLRI's do not carry the original label, therefore we cannot
-         *      hash on the label string.  Instead, we has on a constant value of 1.
-         */
-        if (vpn[i].labels[0] != 0) {
-            buf2[0] = 1;
-            hash.update((unsigned char *) buf2, 1);
-            buf2[0] = 0;
-        }
+            hash.finalize();
 
-        /*
-         * Support backwards compatibility with NLRI hashing by not including rib type. Current did not hash
-         *    if adj-rib-in and pre-policy.  If it's anything else, then add an extra byte/type to hash.
-         */
-        if (not (peer.isAdjIn and peer.isPrePolicy)) {
-          buf2[0] |= peer.isAdjIn ? 0 : 0x01;
-          buf2[0] |= peer.isPrePolicy ? 0 : 0x02;
-          hash.update((unsigned char *) buf2, 1);
+            // Save the hash
+            unsigned char *hash_raw = hash.raw_digest();
+            memcpy(vpn[i].hash_id, hash_raw, 16);
+            delete[] hash_raw;
         }
 
-        hash.finalize();
-
-        // Save the hash
-        unsigned char *hash_raw = hash.raw_digest();
-        memcpy(vpn[i].hash_id, hash_raw, 16);
-        delete[] hash_raw;
-
         // Build the query
         hash_toStr(vpn[i].hash_id, vpn_hash_str);
+        bgp::labelsToStr(vpn[i].labels, labels, sizeof(labels));
 
         switch (code) {
 
@@ -842,7 +1890,7 @@ void msgBus_kafka::update_L3Vpn(obj_bgp_peer &peer, std::vector<obj_vpn> &vpn,
                 if (attr == NULL)
                     return;
 
-                buf_len += snprintf(buf2, sizeof(buf2),
+                snprintf(buf2, sizeof(buf2),
                                     "add\t%" PRIu64 "\t%s\t%s\t%s\t%s\t%s\t%s\t%" PRIu32 "\t%s\t%s\t%d\t%d\t%s\t%s\t%" PRIu16
                                             "\t%" PRIu32 "\t%s\t%" PRIu32 "\t%" PRIu32 "\t%s\t%s\t%s\t%s\t%d\t%d\t%s\t%" PRIu32
                                             "\t%s\t%d\t%d\t%s:%s\t%d\t%s\n",
@@ -854,35 +1902,39 @@ void msgBus_kafka::update_L3Vpn(obj_bgp_peer &peer, std::vector<obj_vpn> &vpn,
                                     attr->aggregator,
                                     attr->community_list.c_str(), attr->ext_community_list.c_str(), attr->cluster_list.c_str(),
                                     attr->atomic_agg, attr->nexthop_isIPv4,
-                                    attr->originator_id, vpn[i].path_id, vpn[i].labels, peer.isPrePolicy, peer.isAdjIn,
-                                    vpn[i].rd_administrator_subfield.c_str(), vpn[i].rd_assigned_number.c_str(), vpn[i].rd_type,
+                                    attr->originator_id, vpn[i].path_id, labels, peer.isPrePolicy, peer.isAdjIn,
+                                    rd_admin, rd_assigned, vpn[i].rd.type,
                                     attr->large_community_list.c_str());
 
                 break;
 
             case VPN_ACTION_DEL:
-                buf_len += snprintf(buf2, sizeof(buf2),
+                snprintf(buf2, sizeof(buf2),
                                     "del\t%" PRIu64 "\t%s\t%s\t%s\t\t%s\t%s\t%" PRIu32 "\t%s\t%s\t%d\t%d\t\t\t"
                                             "\t\t\t\t\t\t\t\t\t\t\t\t%" PRIu32
                                             "\t%s\t%d\t%d\t%s:%s\t%d\t\n",
                                     l3vpn_seq, vpn_hash_str.c_str(), r_hash_str.c_str(),
                                     router_ip.c_str(), p_hash_str.c_str(),
                                     peer.peer_addr, peer.peer_as, ts.c_str(), vpn[i].prefix, vpn[i].prefix_len,
-                                    vpn[i].isIPv4, vpn[i].path_id, vpn[i].labels, peer.isPrePolicy, peer.isAdjIn,
-                                    vpn[i].rd_administrator_subfield.c_str(), vpn[i].rd_assigned_number.c_str(),
-                                    vpn[i].rd_type);
+                                    vpn[i].isIPv4, vpn[i].path_id, labels, peer.isPrePolicy, peer.isAdjIn,
+                                    rd_admin, rd_assigned, vpn[i].rd.type);
                 break;
 
         }
 
-        // Cat the entry to the query buff
-        if (buf_len < MSGBUS_WORKING_BUF_SIZE /* size of buf */)
-            strcat(prep_buf, buf2);
+        // Blank the columns not projected, the row keeps its shape
+        size_t row_len = ColumnProjection::apply(buf2, strlen(buf2), blank_l3vpn);
+
+        // Append the entry at the end of the query buff, strcat would rescan all previous rows
+        if (buf_len + row_len < MSGBUS_WORKING_BUF_SIZE /* size of buf */) {
+            memcpy(prep_buf + buf_len, buf2, row_len + 1);
+            buf_len += row_len;
+        }
 
         ++l3vpn_seq;
     }
 
-    produce(MSGBUS_TOPIC_VAR_L3VPN, prep_buf, strlen(prep_buf), vpn.size(), p_hash_str,
+    produce(MSGBUS_TOPIC_VAR_L3VPN, prep_buf, buf_len, vpn.size(), p_hash_str,
             &peer_list[p_hash_str], peer.peer_as);
 }
 
@@ -892,11 +1944,14 @@ void msgBus_kafka::update_L3Vpn(obj_bgp_peer &peer, std::vector<obj_vpn> &vpn,
  */
 void msgBus_kafka::update_eVPN(obj_bgp_peer &peer, std::vector<obj_evpn> &vpn,
                               obj_path_attr *attr, vpn_action_code code) {
+    StageStats::Scope stage(StageStats::STAGE_SERIALIZE);
 
     prep_buf[0] = 0;
 
     char    buf2[80000];                         // Second working buffer
     size_t  buf_len = 0;                         // query buffer length
+    char    rd_admin[BGP_RD_SUBFIELD_STRLEN];    // Printed RD administrator subfield
+    char    rd_assigned[BGP_RD_SUBFIELD_STRLEN]; // Printed RD assigned number subfield
 
     string vpn_hash_str;
     string path_hash_str;
@@ -916,41 +1971,46 @@ void msgBus_kafka::update_eVPN(obj_bgp_peer &peer, std::vector<obj_evpn> &vpn,
     // Loop through the vector array of vpn entries
     for (size_t i = 0; i < vpn.size(); i++) {
 
-        // Generate the hash
-        MD5 hash;
-
-        hash.update((unsigned char *) p_hash_str.c_str(), p_hash_str.length());
-
-        hash.update((unsigned char *) vpn[i].mac, strlen(vpn[i].mac));
-        hash.update((unsigned char *) vpn[i].ip, strlen(vpn[i].ip));
-        hash.update(&vpn[i].ip_len, sizeof(vpn[i].ip_len));
-        hash.update((unsigned char *) vpn[i].ethernet_segment_identifier, strlen(vpn[i].ethernet_segment_identifier));
-        hash.update((unsigned char *) vpn[i].rd_administrator_subfield.c_str(),
-                    vpn[i].rd_administrator_subfield.length());
-        hash.update((unsigned char *) vpn[i].rd_assigned_number.c_str(),
-                    vpn[i].rd_assigned_number.length());
+        // RD is printed once, it's part of the hash and the row
+        bgp::rdToStr(vpn[i].rd, rd_admin, rd_assigned);
 
-        // Add path ID to hash only if exists
-        if (vpn[i].path_id > 0)
-            hash.update((unsigned char *)&vpn[i].path_id, sizeof(vpn[i].path_id));
-
-      /*
-       * Support backwards compatibility with NLRI hashing by not including rib type. Current did not hash
-       *    if adj-rib-in and pre-policy.  If it's anything else, then add an extra byte/type to hash.
-       */
-      if (not (peer.isAdjIn and peer.isPrePolicy)) {
-        buf2[0] |= peer.isAdjIn ? 0 : 0x01;
-        buf2[0] |= peer.isPrePolicy ? 0 : 0x02;
-        hash.update((unsigned char *) buf2, 1);
-      }
+        // Generate the hash
+        {
+            StageStats::Scope hash_stage(StageStats::STAGE_HASHING);
+
+            MD5 hash;
+
+            hash.update((unsigned char *) p_hash_str.c_str(), p_hash_str.length());
+
+            hash.update((unsigned char *) vpn[i].mac, strlen(vpn[i].mac));
+            hash.update((unsigned char *) vpn[i].ip, strlen(vpn[i].ip));
+            hash.update(&vpn[i].ip_len, sizeof(vpn[i].ip_len));
+            hash.update((unsigned char *) vpn[i].ethernet_segment_identifier, strlen(vpn[i].ethernet_segment_identifier));
+            hash.update((unsigned char *) rd_admin, strlen(rd_admin));
+            hash.update((unsigned char *) rd_assigned, strlen(rd_assigned));
+
+            // Add path ID to hash only if exists
+            if (vpn[i].path_id > 0)
+                hash.update((unsigned char *)&vpn[i].path_id, sizeof(vpn[i].path_id));
+
+          /*
+           * Support backwards compatibility with NLRI hashing by not including rib type. Current did not hash
+           *    if adj-rib-in and pre-policy.  If it's anything else, then add an extra byte/type to hash.
+           */
+          if (not (peer.isAdjIn and peer.isPrePolicy)) {
+            buf2[0] |= peer.isAdjIn ? 0 : 0x01;
+            buf2[0] |= peer.isPrePolicy ? 0 : 0x02;
+            hash.update((unsigned char *) buf2, 1);
+          }
 
 
-      hash.finalize();
+          hash.finalize();
 
-        // Save the hash
-        unsigned char *hash_raw = hash.raw_digest();
-        memcpy(vpn[i].hash_id, hash_raw, 16);
-        delete[] hash_raw;
+            // Save the hash
+            unsigned char *hash_raw = hash.raw_digest();
+            memcpy(vpn[i].hash_id, hash_raw, 16);
+            delete[] hash_raw;
+        }
 
         // Build the query
         hash_toStr(vpn[i].hash_id, vpn_hash_str);
@@ -961,7 +2021,7 @@ void msgBus_kafka::update_eVPN(obj_bgp_peer &peer, std::vector<obj_evpn> &vpn,
                 if (attr == NULL)
                     return;
 
-                buf_len += snprintf(buf2, sizeof(buf2),
+                snprintf(buf2, sizeof(buf2),
                                     "add\t%" PRIu64 "\t%s\t%s\t%s\t%s\t%s\t%s\t%" PRIu32 "\t%s\t%s\t%s\t%" PRIu16
                                         "\t%" PRIu32 "\t%s\t%" PRIu32 "\t%" PRIu32 "\t%s\t%s\t%s\t%s\t%d\t%d\t%s\t%" PRIu32
                                         "\t%d\t%d\t%s:%s\t%d\t%d\t%s\t%s\t%s\t%d\t%s\t%d\t%s\t%" PRIu32 "\t%" PRIu32 "\n",
@@ -974,7 +2034,7 @@ void msgBus_kafka::update_eVPN(obj_bgp_peer &peer, std::vector<obj_evpn> &vpn,
                                     attr->community_list.c_str(), attr->ext_community_list.c_str(), attr->cluster_list.c_str(),
                                     attr->atomic_agg, attr->nexthop_isIPv4,
                                     attr->originator_id, vpn[i].path_id, peer.isPrePolicy, peer.isAdjIn,
-                                    vpn[i].rd_administrator_subfield.c_str(), vpn[i].rd_assigned_number.c_str(), vpn[i].rd_type,
+                                    rd_admin, rd_assigned, vpn[i].rd.type,
                                     vpn[i].originating_router_ip_len, vpn[i].originating_router_ip, vpn[i].ethernet_tag_id_hex,
                                     vpn[i].ethernet_segment_identifier, vpn[i].mac_len,
                                     vpn[i].mac, vpn[i].ip_len, vpn[i].ip, vpn[i].mpls_label_1, vpn[i].mpls_label_2);
@@ -982,7 +2042,7 @@ void msgBus_kafka::update_eVPN(obj_bgp_peer &peer, std::vector<obj_evpn> &vpn,
                 break;
 
             case VPN_ACTION_DEL:
-                buf_len += snprintf(buf2, sizeof(buf2),
+                snprintf(buf2, sizeof(buf2),
                                     "del\t%" PRIu64 "\t%s\t%s\t%s\t%s\t%s\t%s\t%" PRIu32 "\t%s\t\t\t"
                                             "\t\t\t\t\t\t\t\t\t\t\t\t%" PRIu32
                                             "\t%d\t%d\t%s:%s\t%d\t%d\t%s\t%s\t%s\t%d\t%s\t%d\t%s\t%" PRIu32 "\t%" PRIu32 "\n",
@@ -990,7 +2050,7 @@ void msgBus_kafka::update_eVPN(obj_bgp_peer &peer, std::vector<obj_evpn> &vpn,
                                     router_ip.c_str(),path_hash_str.c_str(), p_hash_str.c_str(),
                                     peer.peer_addr, peer.peer_as, ts.c_str(),
                                     vpn[i].path_id, peer.isPrePolicy, peer.isAdjIn,
-                                    vpn[i].rd_administrator_subfield.c_str(), vpn[i].rd_assigned_number.c_str(), vpn[i].rd_type,
+                                    rd_admin, rd_assigned, vpn[i].rd.type,
                                     vpn[i].originating_router_ip_len, vpn[i].originating_router_ip, vpn[i].ethernet_tag_id_hex,
                                     vpn[i].ethernet_segment_identifier, vpn[i].mac_len,
                                     vpn[i].mac, vpn[i].ip_len, vpn[i].ip, vpn[i].mpls_label_1, vpn[i].mpls_label_2);
@@ -999,14 +2059,19 @@ void msgBus_kafka::update_eVPN(obj_bgp_peer &peer, std::vector<obj_evpn> &vpn,
 
         }
 
-        // Cat the entry to the query buff
-        if (buf_len < MSGBUS_WORKING_BUF_SIZE /* size of buf */)
-            strcat(prep_buf, buf2);
+        // Blank the columns not projected, the row keeps its shape
+        size_t row_len = ColumnProjection::apply(buf2, strlen(buf2), blank_evpn);
+
+        // Append the entry at the end of the query buff, strcat would rescan all previous rows
+        if (buf_len + row_len < MSGBUS_WORKING_BUF_SIZE /* size of buf */) {
+            memcpy(prep_buf + buf_len, buf2, row_len + 1);
+            buf_len += row_len;
+        }
 
         ++evpn_seq;
     }
 
-    produce(MSGBUS_TOPIC_VAR_EVPN, prep_buf, strlen(prep_buf), vpn.size(), p_hash_str,
+    produce(MSGBUS_TOPIC_VAR_EVPN, prep_buf, buf_len, vpn.size(), p_hash_str,
             &peer_list[p_hash_str], peer.peer_as);
 }
 
@@ -1016,11 +2081,14 @@ void msgBus_kafka::update_eVPN(obj_bgp_peer &peer, std::vector<obj_evpn> &vpn,
  */
 void msgBus_kafka::update_unicastPrefix(obj_bgp_peer &peer, std::vector<obj_rib> &rib,
                                         obj_path_attr *attr, unicast_prefix_action_code code) {
+    StageStats::Scope stage(StageStats::STAGE_SERIALIZE);
+
     //bzero(prep_buf, MSGBUS_WORKING_BUF_SIZE);
     prep_buf[0] = 0;
 
     char    buf2[80000];                         // Second working buffer
     size_t  buf_len = 0;                         // query buffer length
+    char    labels[BGP_LABELS_STRLEN];           // Printed labels
 
     string rib_hash_str;
     string path_hash_str;
@@ -1047,51 +2115,76 @@ void msgBus_kafka::update_unicastPrefix(obj_bgp_peer &peer, std::vector<obj_rib>
     string ts;
     getTimestamp(peer.timestamp_secs, peer.timestamp_us, ts);
 
+    /*
+     * Current state table is only maintained when the compacted state topic is enabled
+     */
+    static Metrics::Counter &m_state_updates    = Metrics::get("msgbus.prefix_state.updates");
+    static Metrics::Counter &m_state_tombstones = Metrics::get("msgbus.prefix_state.tombstones");
+    static Metrics::Counter &m_state_suppressed = Metrics::get("msgbus.prefix_state.suppressed");
+    uint64_t state_updates = 0, state_tombstones = 0, state_suppressed = 0;
+
+    prefix_state_table *state_table = NULL;
+    if (topicSel != NULL and topicSel->topicEnabled(MSGBUS_TOPIC_VAR_UNICAST_PREFIX_STATE)) {
+        state_table = &prefix_state[p_hash_str];
+        state_table->peer_asn = peer.peer_as;
+    }
+
+    /*
+     * Normalized add rows reference the base attribute by hash only, so it has to be produced
+     */
+    bool normalized = normalize_prefixes and code == UNICAST_PREFIX_ACTION_ADD and
+                      topicSel != NULL and topicSel->topicEnabled(MSGBUS_TOPIC_VAR_BASE_ATTRIBUTE);
+
     // Loop through the vector array of rib entries
     for (size_t i = 0; i < rib.size(); i++) {
 
         // Generate the hash
-        MD5 hash;
-
-        hash.update((unsigned char *) rib[i].prefix, strlen(rib[i].prefix));
-        hash.update(&rib[i].prefix_len, sizeof(rib[i].prefix_len));
-        hash.update((unsigned char *) p_hash_str.c_str(), p_hash_str.length());
-
-        // Add path ID to hash only if exists
-        if (rib[i].path_id > 0)
-            hash.update((unsigned char *)&rib[i].path_id, sizeof(rib[i].path_id));
+        {
+            StageStats::Scope hash_stage(StageStats::STAGE_HASHING);
+
+            MD5 hash;
+
+            hash.update((unsigned char *) rib[i].prefix, strlen(rib[i].prefix));
+            hash.update(&rib[i].prefix_len, sizeof(rib[i].prefix_len));
+            hash.update((unsigned char *) p_hash_str.c_str(), p_hash_str.length());
+
+            // Add path ID to hash only if exists
+            if (rib[i].path_id > 0)
+                hash.update((unsigned char *)&rib[i].path_id, sizeof(rib[i].path_id));
+
+            /*
+             * Add constant "1" to hash if labels are present
+             *      Withdrawn and updated NLRI's do not carry the original label, therefore we cannot
+             *      hash on the label string.  Instead, we has on a constant value of 1.
+             */
+            if (rib[i].labels.count > 0) {
+                buf2[0] = 1;
+                hash.update((unsigned char *) buf2, 1);
+                buf2[0] = 0;
+            }
 
-        /*
-         * Add constant "1" to hash if labels are present
-         *      Withdrawn and updated NLRI's do not carry the original label, therefore we cannot
-         *      hash on the label string.  Instead, we has on a constant value of 1.
-         */
-        if (rib[i].labels[0] != 0) {
-            buf2[0] = 1;
+          /*
+           * Support backwards compatibility with NLRI hashing by not including rib type. Current did not hash
+           *    if adj-rib-in and pre-policy.  If it's anything else, then add an extra byte/type to hash.
+           */
+          if (not (peer.isAdjIn and peer.isPrePolicy)) {
+            buf2[0] |= peer.isAdjIn ? 0 : 0x01;
+            buf2[0] |= peer.isPrePolicy ? 0 : 0x02;
             hash.update((unsigned char *) buf2, 1);
-            buf2[0] = 0;
-        }
-
-      /*
-       * Support backwards compatibility with NLRI hashing by not including rib type. Current did not hash
-       *    if adj-rib-in and pre-policy.  If it's anything else, then add an extra byte/type to hash.
-       */
-      if (not (peer.isAdjIn and peer.isPrePolicy)) {
-        buf2[0] |= peer.isAdjIn ? 0 : 0x01;
-        buf2[0] |= peer.isPrePolicy ? 0 : 0x02;
-        hash.update((unsigned char *) buf2, 1);
-      }
+          }
 
 
-        hash.finalize();
+            hash.finalize();
 
-        // Save the hash
-        unsigned char *hash_raw = hash.raw_digest();
-        memcpy(rib[i].hash_id, hash_raw, 16);
-        delete[] hash_raw;
+            // Save the hash
+            unsigned char *hash_raw = hash.raw_digest();
+            memcpy(rib[i].hash_id, hash_raw, 16);
+            delete[] hash_raw;
+        }
 
         // Build the query
         hash_toStr(rib[i].hash_id, rib_hash_str);
+        bgp::labelsToStr(rib[i].labels, labels, sizeof(labels));
 
         switch (code) {
 
@@ -1099,10 +2192,10 @@ void msgBus_kafka::update_unicastPrefix(obj_bgp_peer &peer, std::vector<obj_rib>
                 if (attr == NULL)
                     return;
 
-                buf_len += snprintf(buf2, sizeof(buf2),
+                snprintf(buf2, sizeof(buf2),
                                     "%s\t%" PRIu64 "\t%s\t%s\t%s\t%s\t%s\t%s\t%" PRIu32 "\t%s\t%s\t%d\t%d\t%s\t%s\t%" PRIu16
                                             "\t%" PRIu32 "\t%s\t%" PRIu32 "\t%" PRIu32 "\t%s\t%s\t%s\t%s\t%d\t%d\t%s\t%" PRIu32
-                                            "\t%s\t%d\t%d\t%s\n",
+                                            "\t%s\t%d\t%d\t%s\t%" PRIu32 "\n",
                                     action.c_str(), unicast_prefix_seq, rib_hash_str.c_str(), r_hash_str.c_str(),
                                     router_ip.c_str(),path_hash_str.c_str(), p_hash_str.c_str(),
                                     peer.peer_addr, peer.peer_as, ts.c_str(), rib[i].prefix, rib[i].prefix_len,
@@ -1111,31 +2204,76 @@ void msgBus_kafka::update_unicastPrefix(obj_bgp_peer &peer, std::vector<obj_rib>
                                     attr->aggregator,
                                     attr->community_list.c_str(), attr->ext_community_list.c_str(), attr->cluster_list.c_str(),
                                     attr->atomic_agg, attr->nexthop_isIPv4,
-                                    attr->originator_id, rib[i].path_id, rib[i].labels, peer.isPrePolicy, peer.isAdjIn,
-                                    attr->large_community_list.c_str());
+                                    attr->originator_id, rib[i].path_id, labels, peer.isPrePolicy, peer.isAdjIn,
+                                    attr->large_community_list.c_str(), rib[i].flap_count);
                 break;
 
             case UNICAST_PREFIX_ACTION_DEL:
-                buf_len += snprintf(buf2, sizeof(buf2),
+                snprintf(buf2, sizeof(buf2),
                                     "%s\t%" PRIu64 "\t%s\t%s\t%s\t\t%s\t%s\t%" PRIu32 "\t%s\t%s\t%d\t%d\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t%" PRIu32
-                                            "\t%s\t%d\t%d\t\n",
+                                            "\t%s\t%d\t%d\t\t%" PRIu32 "\n",
                                     action.c_str(), unicast_prefix_seq, rib_hash_str.c_str(), r_hash_str.c_str(),
                                     router_ip.c_str(), p_hash_str.c_str(),
                                     peer.peer_addr, peer.peer_as, ts.c_str(), rib[i].prefix, rib[i].prefix_len,
-                                    rib[i].isIPv4, rib[i].path_id, rib[i].labels, peer.isPrePolicy, peer.isAdjIn);
+                                    rib[i].isIPv4, rib[i].path_id, labels, peer.isPrePolicy, peer.isAdjIn,
+                                    rib[i].flap_count);
                 break;
         }
 
-        // Cat the entry to the query buff
-        if (buf_len < MSGBUS_WORKING_BUF_SIZE /* size of buf */)
-            strcat(prep_buf, buf2);
+        // Blank the columns not projected, the row keeps its shape
+        size_t row_len = ColumnProjection::apply(buf2, strlen(buf2), blank_unicast_prefix);
+
+        // Append the entry at the end of the query buff, strcat would rescan all previous rows
+        if (buf_len + row_len < MSGBUS_WORKING_BUF_SIZE /* size of buf */) {
+            memcpy(prep_buf + buf_len, buf2, row_len + 1);
+
+            // Normalized rows keep the prefix columns and the base attribute hash, state rows keep all
+            buf_len += normalized ? ColumnProjection::apply(prep_buf + buf_len, row_len, blank_normalized_prefix)
+                                  : row_len;
+        }
+
+        // Produce the entry to the state topic only if the prefix state changed
+        if (state_table != NULL) {
+            hash_key rib_key(rib[i].hash_id);
+
+            if (code == UNICAST_PREFIX_ACTION_ADD) {
+                hash_key state_key = stateDigest(buf2, row_len);
+                auto entry = state_table->prefixes.insert(std::make_pair(rib_key, state_key));
+
+                if (entry.second or entry.first->second != state_key) {   // new prefix or state changed
+                    entry.first->second = state_key;
+                    produce(MSGBUS_TOPIC_VAR_UNICAST_PREFIX_STATE, buf2, row_len, 1, rib_hash_str,
+                            &peer_list[p_hash_str], peer.peer_as);
+                    ++state_updates;
+                } else
+                    ++state_suppressed;
+
+            } else if (state_table->prefixes.erase(rib_key) > 0) {
+                produceTombstone(MSGBUS_TOPIC_VAR_UNICAST_PREFIX_STATE, rib_hash_str, &peer_list[p_hash_str],
+                                 peer.peer_as);
+                ++state_tombstones;
+            } else
+                ++state_suppressed;
+        }
 
         ++unicast_prefix_seq;
       	++ribSeq;
     }
 
+    if (local_rib != NULL)
+        local_rib->update(peer, router_ip, rib, attr, code == UNICAST_PREFIX_ACTION_DEL);
+
+    if (state_table != NULL) {
+        m_state_updates.fetch_add(state_updates, std::memory_order_relaxed);
+        m_state_tombstones.fetch_add(state_tombstones, std::memory_order_relaxed);
+        m_state_suppressed.fetch_add(state_suppressed, std::memory_order_relaxed);
+    }
+
+    // Held batches are submitted by topic, the base attribute of the prefixes has to be enqueued first
+    if (normalized and batch_produce)
+        submitBatches(MSGBUS_TOPIC_VAR_BASE_ATTRIBUTE);
 
-    produce(MSGBUS_TOPIC_VAR_UNICAST_PREFIX, prep_buf, strlen(prep_buf), rib.size(), p_hash_str,
+    produce(MSGBUS_TOPIC_VAR_UNICAST_PREFIX, prep_buf, buf_len, rib.size(), p_hash_str,
             &peer_list[p_hash_str], peer.peer_as);
 }
 
@@ -1143,7 +2281,12 @@ void msgBus_kafka::update_unicastPrefix(obj_bgp_peer &peer, std::vector<obj_rib>
  * Abstract method Implementation - See MsgBusInterface.hpp for details
  */
 void msgBus_kafka::add_StatReport(obj_bgp_peer &peer, obj_stats_report &stats) {
+    StageStats::Scope stage(StageStats::STAGE_SERIALIZE);
+
+    static Metrics::Counter &m_suppressed = Metrics::get("msgbus.bmp_stat.suppressed");
+
     char buf[4096];                 // Misc working buffer
+    char counters[256];
 
     // Build the query
     string p_hash_str;
@@ -1151,31 +2294,147 @@ void msgBus_kafka::add_StatReport(obj_bgp_peer &peer, obj_stats_report &stats) {
     hash_toStr(peer.hash_id, p_hash_str);
     hash_toStr(peer.router_hash_id, r_hash_str);
 
+    snprintf(counters, sizeof(counters),
+             "%" PRIu32 "\t%" PRIu32 "\t%" PRIu32 "\t%" PRIu32 "\t%" PRIu32 "\t%" PRIu32 "\t%" PRIu32 "\t%" PRIu64 "\t%" PRIu64,
+             stats.prefixes_rej,stats.known_dup_prefixes, stats.known_dup_withdraws, stats.invalid_cluster_list,
+             stats.invalid_as_path_loop, stats.invalid_originator_id, stats.invalid_as_confed_loop,
+             stats.routes_adj_rib_in, stats.routes_loc_rib);
+
+    if (cfg->stat_report_suppress) {
+        string &last = stat_last[p_hash_str];
+
+        if (last.compare(counters) == 0) {
+            m_suppressed.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+
+        last.assign(counters);
+    }
+
     string ts;
     getTimestamp(peer.timestamp_secs, peer.timestamp_us, ts);
 
-    snprintf(buf, sizeof(buf),
-             "add\t%" PRIu64 "\t%s\t%s\t%s\t%s\t%" PRIu32 "\t%s\t%" PRIu32 "\t%" PRIu32 "\t%" PRIu32 "\t%" PRIu32 "\t%" PRIu32
-                     "\t%" PRIu32 "\t%" PRIu32 "\t%" PRIu64 "\t%" PRIu64 "\n",
+    size_t len = snprintf(buf, sizeof(buf),
+             "add\t%" PRIu64 "\t%s\t%s\t%s\t%s\t%" PRIu32 "\t%s\t%s\n",
              bmp_stat_seq, r_hash_str.c_str(), router_ip.c_str(),p_hash_str.c_str(), peer.peer_addr, peer.peer_as, ts.c_str(),
-             stats.prefixes_rej,stats.known_dup_prefixes, stats.known_dup_withdraws, stats.invalid_cluster_list,
-             stats.invalid_as_path_loop, stats.invalid_originator_id, stats.invalid_as_confed_loop,
-             stats.routes_adj_rib_in, stats.routes_loc_rib);
+             counters);
 
+    if (not holdStatReport(peer, p_hash_str, buf, len))
+        produce(MSGBUS_TOPIC_VAR_BMP_STAT, buf, len, 1, p_hash_str, &peer_list[p_hash_str], peer.peer_as);
 
-    produce(MSGBUS_TOPIC_VAR_BMP_STAT, buf, strlen(buf), 1, p_hash_str, &peer_list[p_hash_str], peer.peer_as);
     ++bmp_stat_seq;
 }
 
+/**
+ * Hold a stats report row for the multi-row message of its topic
+ *
+ *      Rows are held by topic name, the topic handle may be released before they are produced.
+ *      The held rows are produced kafka.stats_report.window_ms after the first one, or when the
+ *      message would exceed message.max.bytes.
+ *
+ * \param [in] peer          Peer of the report
+ * \param [in] p_hash_str    Peer hash string
+ * \param [in] row           Stats report row
+ * \param [in] row_len       Length of the row
+ *
+ * \return true if held, false if the row has to be produced on its own
+ */
+bool msgBus_kafka::holdStatReport(obj_bgp_peer &peer, const string &p_hash_str, const char *row, size_t row_len) {
+    if (cfg->stat_report_window_ms <= 0 or isConnected == false or topicSel == NULL)
+        return false;
+
+    // Same lane as produce()
+    KafkaTopicSelector *lane_topicSel = ctrl_producer != NULL ? ctrl_topicSel : topicSel;
+
+    if (!lane_topicSel->topicEnabled(MSGBUS_TOPIC_VAR_BMP_STAT))
+        return false;
+
+    string &peer_group = peer_list[p_hash_str];
+    RdKafka::Topic *topic = lane_topicSel->getTopic(MSGBUS_TOPIC_VAR_BMP_STAT, &router_group_name, &peer_group,
+                                                    peer.peer_as);
+    if (topic == NULL)
+        return false;
+
+    string topic_name = topic->name();
+
+    // Room for the text headers
+    size_t max_bytes = (cfg->tx_max_bytes < MSGBUS_WORKING_BUF_SIZE ? cfg->tx_max_bytes : MSGBUS_WORKING_BUF_SIZE) - 256;
+
+    std::map<std::string, stat_report_batch>::iterator it = stat_batches.find(topic_name);
+
+    if (it != stat_batches.end() and it->second.rows.size() + row_len > max_bytes) {
+        // Full, produce the held rows first.  produce() can run service(), so not from the map
+        stat_report_batch full;
+        full.rows.swap(it->second.rows);
+        full.key.swap(it->second.key);
+        full.peer_group.swap(it->second.peer_group);
+        full.count = it->second.count;
+        full.peer_asn = it->second.peer_asn;
+
+        stat_batches.erase(it);
+
+        produce(MSGBUS_TOPIC_VAR_BMP_STAT, &full.rows[0], full.rows.size(), full.count, full.key,
+                &full.peer_group, full.peer_asn);
+
+        it = stat_batches.end();
+    }
+
+    if (it == stat_batches.end()) {
+        if (stat_batches.empty())
+            stat_due_ms = steadyMs() + cfg->stat_report_window_ms;
+
+        stat_report_batch &batch = stat_batches[topic_name];
+        batch.count = 0;
+        batch.peer_group = peer_group;
+        batch.peer_asn = peer.peer_as;
+        hash_toStr(peer.router_hash_id, batch.key);
+
+        it = stat_batches.find(topic_name);
+    }
+
+    it->second.rows.append(row, row_len);
+    ++it->second.count;
+
+    return true;
+}
+
+/**
+ * Produce the held stats reports, one message per topic
+ */
+void msgBus_kafka::produceStatReports() {
+    static Metrics::Counter &m_messages = Metrics::get("msgbus.bmp_stat.coalesced_msgs");
+    static Metrics::Counter &m_rows     = Metrics::get("msgbus.bmp_stat.coalesced_rows");
+
+    if (stat_batches.empty())
+        return;
+
+    // produce() can run service(), which must not see these rows
+    std::map<std::string, stat_report_batch> held;
+    held.swap(stat_batches);
+    stat_due_ms = 0;
+
+    for (std::map<std::string, stat_report_batch>::iterator it = held.begin(); it != held.end(); ++it) {
+        stat_report_batch &batch = it->second;
+
+        produce(MSGBUS_TOPIC_VAR_BMP_STAT, &batch.rows[0], batch.rows.size(), batch.count, batch.key,
+                &batch.peer_group, batch.peer_asn);
+
+        m_messages.fetch_add(1, std::memory_order_relaxed);
+        m_rows.fetch_add(batch.count, std::memory_order_relaxed);
+    }
+}
+
 /**
  * Abstract method Implementation - See MsgBusInterface.hpp for details
  */
 void msgBus_kafka::update_LsNode(obj_bgp_peer &peer, obj_path_attr &attr, std::list<MsgBusInterface::obj_ls_node> &nodes,
                                   ls_action_code code) {
+    StageStats::Scope stage(StageStats::STAGE_SERIALIZE);
+
     bzero(prep_buf, MSGBUS_WORKING_BUF_SIZE);
 
     char    buf2[8192];                          // Second working buffer
-    int     buf_len = 0;                         // query buffer length
+    size_t  buf_len = 0;                         // query buffer length
     int     i;
 
     string hash_str;
@@ -1261,7 +2520,7 @@ void msgBus_kafka::update_LsNode(obj_bgp_peer &peer, obj_path_attr &attr, std::l
                 }
         }
 
-        buf_len += snprintf(buf2, sizeof(buf2),
+        snprintf(buf2, sizeof(buf2),
                         "%s\t%" PRIu64 "\t%s\t%s\t%s\t%s\t%s\t%s\t%" PRIu32 "\t%s\t%s\t%s\t%" PRIx64 "\t%" PRIx32 "\t%s"
                                 "\t%s\t%s\t%s\t%s\t%s\t%" PRIu32 "\t%" PRIu32 "\t%s\t%s\t%d\t%d\t%s\n",
                         action.c_str(),ls_node_seq, hash_str.c_str(),path_hash_str.c_str(), r_hash_str.c_str(),
@@ -1270,9 +2529,14 @@ void msgBus_kafka::update_LsNode(obj_bgp_peer &peer, obj_path_attr &attr, std::l
                         node.protocol, node.flags, attr.as_path.c_str(), attr.local_pref, attr.med, attr.next_hop, node.name,
                         peer.isPrePolicy, peer.isAdjIn, node.sr_capabilities_tlv);
 
-        // Cat the entry to the query buff
-        if (buf_len < MSGBUS_WORKING_BUF_SIZE /* size of buf */)
-            strcat(prep_buf, buf2);
+        // Blank the columns not projected, the row keeps its shape
+        size_t row_len = ColumnProjection::apply(buf2, strlen(buf2), blank_ls_node);
+
+        // Append the entry at the end of the query buff, strcat would rescan all previous rows
+        if (buf_len + row_len < MSGBUS_WORKING_BUF_SIZE /* size of buf */) {
+            memcpy(prep_buf + buf_len, buf2, row_len + 1);
+            buf_len += row_len;
+        }
 
         ++ls_node_seq;
     }
@@ -1286,10 +2550,12 @@ void msgBus_kafka::update_LsNode(obj_bgp_peer &peer, obj_path_attr &attr, std::l
  */
 void msgBus_kafka::update_LsLink(obj_bgp_peer &peer, obj_path_attr &attr, std::list<MsgBusInterface::obj_ls_link> &links,
                                  ls_action_code code) {
+    StageStats::Scope stage(StageStats::STAGE_SERIALIZE);
+
     bzero(prep_buf, MSGBUS_WORKING_BUF_SIZE);
 
     char    buf2[8192];                          // Second working buffer
-    int     buf_len = 0;                         // query buffer length
+    size_t  buf_len = 0;                         // query buffer length
     int     i;
 
     string hash_str;
@@ -1335,23 +2601,27 @@ void msgBus_kafka::update_LsLink(obj_bgp_peer &peer, obj_path_attr &attr, std::l
         ++rows;
         MsgBusInterface::obj_ls_link &link = (*it);
 
-        MD5 hash;
-
-        hash.update(link.intf_addr, sizeof(link.intf_addr));
-        hash.update(link.nei_addr, sizeof(link.nei_addr));
-        hash.update((unsigned char *)&link.id, sizeof(link.id));
-        hash.update(link.local_node_hash_id, sizeof(link.local_node_hash_id));
-        hash.update(link.remote_node_hash_id, sizeof(link.remote_node_hash_id));
-        hash.update((unsigned char *)&link.local_link_id, sizeof(link.local_link_id));
-        hash.update((unsigned char *)&link.remote_link_id, sizeof(link.remote_link_id));
-        hash.update((unsigned char *)peer_hash_str.c_str(), peer_hash_str.length());
-        hash.update((unsigned char *)&link.mt_id, sizeof(link.mt_id));
-        hash.finalize();
-
-        // Save the hash
-        unsigned char *hash_bin = hash.raw_digest();
-        memcpy(link.hash_id, hash_bin, 16);
-        delete[] hash_bin;
+        {
+            StageStats::Scope hash_stage(StageStats::STAGE_HASHING);
+
+            MD5 hash;
+
+            hash.update(link.intf_addr, sizeof(link.intf_addr));
+            hash.update(link.nei_addr, sizeof(link.nei_addr));
+            hash.update((unsigned char *)&link.id, sizeof(link.id));
+            hash.update(link.local_node_hash_id, sizeof(link.local_node_hash_id));
+            hash.update(link.remote_node_hash_id, sizeof(link.remote_node_hash_id));
+            hash.update((unsigned char *)&link.local_link_id, sizeof(link.local_link_id));
+            hash.update((unsigned char *)&link.remote_link_id, sizeof(link.remote_link_id));
+            hash.update((unsigned char *)peer_hash_str.c_str(), peer_hash_str.length());
+            hash.update((unsigned char *)&link.mt_id, sizeof(link.mt_id));
+            hash.finalize();
+
+            // Save the hash
+            unsigned char *hash_bin = hash.raw_digest();
+            memcpy(link.hash_id, hash_bin, 16);
+            delete[] hash_bin;
+        }
 
         hash_toStr(link.hash_id, hash_str);
         hash_toStr(link.local_node_hash_id, local_node_hash_id);
@@ -1423,7 +2693,7 @@ void msgBus_kafka::update_LsLink(obj_bgp_peer &peer, obj_path_attr &attr, std::l
         }
 
 
-        buf_len += snprintf(buf2, sizeof(buf2),
+        snprintf(buf2, sizeof(buf2),
                 "%s\t%" PRIu64 "\t%s\t%s\t%s\t%s\t%s\t%s\t%" PRIu32 "\t%s\t%s\t%s\t%" PRIx64 "\t%" PRIx32 "\t%s\t%s\t%s\t%s\t%"
                         PRIu32 "\t%" PRIu32 "\t%s\t%" PRIx32 "\t%" PRIu32 "\t%" PRIu32 "\t%s\t%s\t%" PRIu32 "\t%" PRIu32
                         "\t%" PRIu32 "\t%" PRIu32 "\t%s\t%" PRIu32 "\t%s\t%s\t%s\t%s\t%s\t%s\t%s\t%s\t%" PRIu32 ""
@@ -1439,14 +2709,19 @@ void msgBus_kafka::update_LsLink(obj_bgp_peer &peer, obj_path_attr &attr, std::l
                             link.local_node_asn,link.remote_node_asn, link.peer_node_sid, peer.isPrePolicy, peer.isAdjIn,
                             link.peer_adj_sid);
 
-        // Cat the entry to the query buff
-        if (buf_len < MSGBUS_WORKING_BUF_SIZE /* size of buf */)
-            strcat(prep_buf, buf2);
+        // Blank the columns not projected, the row keeps its shape
+        size_t row_len = ColumnProjection::apply(buf2, strlen(buf2), blank_ls_link);
+
+        // Append the entry at the end of the query buff, strcat would rescan all previous rows
+        if (buf_len + row_len < MSGBUS_WORKING_BUF_SIZE /* size of buf */) {
+            memcpy(prep_buf + buf_len, buf2, row_len + 1);
+            buf_len += row_len;
+        }
 
         ++ls_link_seq;
     }
 
-    produce(MSGBUS_TOPIC_VAR_LS_LINK, prep_buf, strlen(prep_buf), rows, peer_hash_str,
+    produce(MSGBUS_TOPIC_VAR_LS_LINK, prep_buf, buf_len, rows, peer_hash_str,
             &peer_list[peer_hash_str], peer.peer_as);
 }
 
@@ -1455,10 +2730,12 @@ void msgBus_kafka::update_LsLink(obj_bgp_peer &peer, obj_path_attr &attr, std::l
  */
 void msgBus_kafka::update_LsPrefix(obj_bgp_peer &peer, obj_path_attr &attr, std::list<MsgBusInterface::obj_ls_prefix> &prefixes,
                                    ls_action_code code) {
+    StageStats::Scope stage(StageStats::STAGE_SERIALIZE);
+
     bzero(prep_buf, MSGBUS_WORKING_BUF_SIZE);
 
     char    buf2[8192];                          // Second working buffer
-    int     buf_len = 0;                         // query buffer length
+    size_t  buf_len = 0;                         // query buffer length
     int     i;
 
     string hash_str;
@@ -1503,20 +2780,24 @@ void msgBus_kafka::update_LsPrefix(obj_bgp_peer &peer, obj_path_attr &attr, std:
         ++rows;
         MsgBusInterface::obj_ls_prefix &prefix = (*it);
 
-        MD5 hash;
+        {
+            StageStats::Scope hash_stage(StageStats::STAGE_HASHING);
 
-        hash.update(prefix.prefix_bin, sizeof(prefix.prefix_bin));
-        hash.update(&prefix.prefix_len, 1);
-        hash.update((unsigned char *)&prefix.id, sizeof(prefix.id));
-        hash.update(prefix.local_node_hash_id, sizeof(prefix.local_node_hash_id));
-        hash.update((unsigned char *)prefix.ospf_route_type, sizeof(prefix.ospf_route_type));
-        hash.update((unsigned char *)&prefix.mt_id, sizeof(prefix.mt_id));
-        hash.finalize();
+            MD5 hash;
 
-        // Save the hash
-        unsigned char *hash_bin = hash.raw_digest();
-        memcpy(prefix.hash_id, hash_bin, 16);
-        delete[] hash_bin;
+            hash.update(prefix.prefix_bin, sizeof(prefix.prefix_bin));
+            hash.update(&prefix.prefix_len, 1);
+            hash.update((unsigned char *)&prefix.id, sizeof(prefix.id));
+            hash.update(prefix.local_node_hash_id, sizeof(prefix.local_node_hash_id));
+            hash.update((unsigned char *)prefix.ospf_route_type, sizeof(prefix.ospf_route_type));
+            hash.update((unsigned char *)&prefix.mt_id, sizeof(prefix.mt_id));
+            hash.finalize();
+
+            // Save the hash
+            unsigned char *hash_bin = hash.raw_digest();
+            memcpy(prefix.hash_id, hash_bin, 16);
+            delete[] hash_bin;
+        }
 
         // Build the query
         hash_toStr(prefix.hash_id, hash_str);
@@ -1569,7 +2850,7 @@ void msgBus_kafka::update_LsPrefix(obj_bgp_peer &peer, obj_path_attr &attr, std:
         }
 
 
-        buf_len += snprintf(buf2, sizeof(buf2),
+        snprintf(buf2, sizeof(buf2),
                 "%s\t%" PRIu64 "\t%s\t%s\t%s\t%s\t%s\t%s\t%" PRIu32 "\t%s\t%s\t%s\t%" PRIx64 "\t%" PRIx32
                         "\t%s\t%s\t%s\t%s\t%" PRIu32 "\t%" PRIu32 "\t%s\t%s\t%" PRIx32 "\t%s\t%s\t%" PRIu32 "\t%" PRIx64
                             "\t%s\t%" PRIu32 "\t%s\t%d\t%d\t%d\t%s\n",
@@ -1581,14 +2862,19 @@ void msgBus_kafka::update_LsPrefix(obj_bgp_peer &peer, obj_path_attr &attr, std:
                             ospf_fwd_addr, prefix.metric, prefix_ip, prefix.prefix_len, peer.isPrePolicy, peer.isAdjIn,
                             prefix.sid_tlv);
 
-        // Cat the entry to the query buff
-        if (buf_len < MSGBUS_WORKING_BUF_SIZE /* size of buf */)
-            strcat(prep_buf, buf2);
+        // Blank the columns not projected, the row keeps its shape
+        size_t row_len = ColumnProjection::apply(buf2, strlen(buf2), blank_ls_prefix);
+
+        // Append the entry at the end of the query buff, strcat would rescan all previous rows
+        if (buf_len + row_len < MSGBUS_WORKING_BUF_SIZE /* size of buf */) {
+            memcpy(prep_buf + buf_len, buf2, row_len + 1);
+            buf_len += row_len;
+        }
 
         ++ls_prefix_seq;
     }
 
-    produce(MSGBUS_TOPIC_VAR_LS_PREFIX, prep_buf, strlen(prep_buf), rows, peer_hash_str,
+    produce(MSGBUS_TOPIC_VAR_LS_PREFIX, prep_buf, buf_len, rows, peer_hash_str,
             &peer_list[peer_hash_str], peer.peer_as);
 }
 
@@ -1598,6 +2884,8 @@ void msgBus_kafka::update_LsPrefix(obj_bgp_peer &peer, obj_path_attr &attr, std:
  * TODO: Consolidate this to single produce method
  */
 void msgBus_kafka::send_bmp_raw(u_char *r_hash, obj_bgp_peer &peer, u_char *data, size_t data_len) {
+    StageStats::Scope stage(StageStats::STAGE_PRODUCE);
+
     string r_hash_str;
     string p_hash_str;
     RdKafka::Topic *topic = NULL;
@@ -1619,22 +2907,42 @@ void msgBus_kafka::send_bmp_raw(u_char *r_hash, obj_bgp_peer &peer, u_char *data
     if (!topicSel->topicEnabled(MSGBUS_TOPIC_VAR_BMP_RAW))
         return;
 
-    char headers[256];
-    size_t hdr_len = snprintf(headers, sizeof(headers), "V: %s\nC_HASH_ID: %s\nR_HASH: %s\nR_IP: %s\nL: %lu\n\n",
-             MSGBUS_API_VERSION, collector_hash.c_str(), r_hash_str.c_str(), router_ip.c_str(), data_len);
-
-    memcpy(producer_buf, headers, hdr_len);
-    memcpy(producer_buf+hdr_len, data, data_len);
-
     topic = topicSel->getTopic(MSGBUS_TOPIC_VAR_BMP_RAW, &router_group_name, &peer_list[p_hash_str], peer.peer_as);
     if (topic != NULL) {
         SELF_DEBUG("rtr=%s: Producing bmp raw message: topic=%s key=%s, msg size = %lu", router_ip.c_str(),
                    topic->name().c_str(), r_hash_str.c_str(), data_len);
 
-        RdKafka::ErrorCode resp = producer->produce(topic, RdKafka::Topic::PARTITION_UA,
-                                                    RdKafka::Producer::RK_MSG_COPY /* Copy payload */,
-                                                    producer_buf, data_len + hdr_len,
-                                                    (const std::string *)&r_hash_str, NULL);
+        RdKafka::ErrorCode resp;
+
+        if (cfg->kafka_native_headers) {
+            RdKafka::Headers *headers = RdKafka::Headers::create();
+            headers->add("V", MSGBUS_API_VERSION);
+            headers->add("C_HASH_ID", collector_hash_bin, sizeof(collector_hash_bin));
+            headers->add("R_HASH", r_hash, 16);
+            headers->add("R_IP", router_ip);
+            addHeader32(headers, "L", data_len);
+
+            resp = producer->produce(topic->name(), RdKafka::Topic::PARTITION_UA,
+                                     RdKafka::Producer::RK_MSG_COPY /* Copy payload */,
+                                     data, data_len, r_hash_str.data(), r_hash_str.size(), 0, headers, NULL);
+
+            // librdkafka owns the headers only if produced
+            if (resp != RdKafka::ERR_NO_ERROR)
+                delete headers;
+
+        } else {
+            char headers[256];
+            size_t hdr_len = snprintf(headers, sizeof(headers), "V: %s\nC_HASH_ID: %s\nR_HASH: %s\nR_IP: %s\nL: %lu\n\n",
+                     MSGBUS_API_VERSION, collector_hash.c_str(), r_hash_str.c_str(), router_ip.c_str(), data_len);
+
+            memcpy(producer_buf, headers, hdr_len);
+            memcpy(producer_buf+hdr_len, data, data_len);
+
+            resp = producer->produce(topic, RdKafka::Topic::PARTITION_UA,
+                                     RdKafka::Producer::RK_MSG_COPY /* Copy payload */,
+                                     producer_buf, data_len + hdr_len,
+                                     (const std::string *)&r_hash_str, NULL);
+        }
 
         if (resp != RdKafka::ERR_NO_ERROR) {
             LOG_ERR("rtr=%s: Failed to produce bmp raw message: %s", router_ip.c_str(), RdKafka::err2str(resp).c_str());
@@ -1675,6 +2983,51 @@ bool msgBus_kafka::resolveIp(string name, string &hostname) {
     return true;
 }
 
+/**
+ * Set the local RIB to maintain from unicast prefix updates
+ *
+ * \param [in] rib     Local RIB, NULL to disable
+ */
+void msgBus_kafka::setLocalRib(LocalRib *rib) {
+    local_rib = rib;
+}
+
+/**
+ * Wait for the queued messages to be delivered
+ *
+ * \param [in] timeout_ms   Max time to wait per producer
+ */
+void msgBus_kafka::flush(int timeout_ms) {
+    produceStatReports();
+
+    if (producer != NULL) {
+        submitBatches();
+        producer->flush(timeout_ms);
+    }
+
+    if (ctrl_producer != NULL)
+        ctrl_producer->flush(timeout_ms);
+}
+
+/**
+ * Start the process shutdown, all producers drain until a common deadline
+ *
+ *      Sessions disconnecting after the deadline drop their queued messages instead of
+ *      waiting, so the shutdown time does not grow with the number of routers.
+ *
+ * \param [in] timeout_ms   Time from now until the deadline
+ */
+void msgBus_kafka::beginShutdown(uint32_t timeout_ms) {
+    shutdown_deadline_ms.store(steadyMs() + timeout_ms, std::memory_order_relaxed);
+}
+
+/**
+ * Check if the process shutdown started, see beginShutdown()
+ */
+bool msgBus_kafka::shuttingDown() {
+    return shutdown_deadline_ms.load(std::memory_order_relaxed) != 0;
+}
+
 /*
  * Enable/disable debugs
  */
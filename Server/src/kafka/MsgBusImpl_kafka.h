@@ -16,18 +16,24 @@
 #include "Logger.h"
 #include <string>
 #include <map>
+#include <deque>
+#include <unordered_map>
 #include <vector>
 #include <ctime>
 
 #include <librdkafka/rdkafkacpp.h>
+#include <librdkafka/rdkafka.h>
 
 #include <thread>
 #include "safeQueue.hpp"
 #include "KafkaEventCallback.h"
 #include "KafkaDeliveryReportCallback.h"
 #include "KafkaTopicSelector.h"
+#include "KafkaAutotune.h"
 
 #include "Config.h"
+#include "HashKey.h"
+#include "LocalRib.h"
 
 /**
  * \class   msgBus_kafka
@@ -37,7 +43,13 @@
 class msgBus_kafka: public MsgBusInterface {
 public:
     #define MSGBUS_WORKING_BUF_SIZE         1800000
-    #define MSGBUS_API_VERSION              "1.7"
+    #define MSGBUS_API_VERSION              "1.8"
+    #define MSGBUS_BATCH_NUM_MESSAGES       100         // batch.num.messages of the bulk producer
+    #define MSGBUS_CTRL_BATCH_NUM_MESSAGES  10          // batch.num.messages of the control lane producer
+    #define MSGBUS_CTRL_ORDER_WAIT_MS       1000        // Max total wait per session for the bulk lane to drain before peer downs/router term
+    #define MSGBUS_HOLD_MAX_BYTES           67108864    // Bulk bytes held while a replaced producer drains before the reader waits
+    #define MSGBUS_SERVICE_INTERVAL_MS      10          // Max time messages are held in batches, and poll cadence
+    #define MSGBUS_PRODUCE_BATCH_BYTES      1048576     // Batch is submitted when it holds this many bytes
 
     /******************************************************************//**
      * \brief This function will initialize and connect to Kafka.
@@ -75,10 +87,79 @@ public:
 
     void send_bmp_raw(u_char *r_hash, obj_bgp_peer &peer, u_char *data, size_t data_len);
 
+    /**
+     * Time until service() is due, see MsgBusInterface
+     *
+     * \returns Milliseconds, zero if due now, -1 if nothing is held or queued
+     */
+    int msUntilService();
+
+    /**
+     * Submit the held batches and poll the producers
+     */
+    void service();
+
+    /**
+     * Switch to a reloaded config, see MsgBusInterface
+     *
+     * \param [in] cfg         Reloaded config
+     */
+    void setConfig(Config *cfg);
+
+    /**
+     * Set the initial RIB dump state of the router, runs the batching autotune when due
+     *
+     * \param [in] active      True while the router is in its initial RIB dump
+     */
+    void setRibDump(bool active);
+
+    /**
+     * Set the local RIB to maintain from unicast prefix updates
+     *
+     * \param [in] rib     Local RIB, NULL to disable
+     */
+    void setLocalRib(LocalRib *rib);
+
+    /**
+     * Wait for the queued messages to be delivered
+     *
+     * \param [in] timeout_ms   Max time to wait per producer
+     */
+    void flush(int timeout_ms);
+
+    /**
+     * Start the process shutdown, all producers drain until a common deadline
+     *
+     * \param [in] timeout_ms   Time from now until the deadline
+     */
+    static void beginShutdown(uint32_t timeout_ms);
+
+    /**
+     * Check if the process shutdown started, see beginShutdown()
+     */
+    static bool shuttingDown();
+
     // Debug methods
     void enableDebug();
     void disableDebug();
 
+protected:
+    /**
+     * produce message to Kafka
+     *
+     * \param [in] topic_var     Topic var to use in KafkaTopicSelector::getTopic()
+     * \param [in] msg           message to produce
+     * \param [in] msg_size      Length in bytes of the message
+     * \param [in] rows          Number of rows in data
+     * \param [in] key           Hash key
+     * \param [in] peer_group    Peer group name - empty/NULL if not set or used
+     * \param [in] peer_asn      Peer ASN
+     *
+     * Virtual so that benchmarks can serialize without producing (see benchmark_worstcase.cpp)
+     */
+    virtual void produce(const char *topic_var, char *msg, size_t msg_size, int rows,
+                         std::string key, const std::string *peer_group, uint32_t);
+
 private:
     char            *prep_buf;                  ///< Large working buffer for message preparation
     unsigned char   *producer_buf;              ///< Producer message buffer
@@ -86,6 +167,7 @@ private:
     Logger          *logger;                    ///< Logging class pointer
 
     std::string     collector_hash;             ///< collector hash string value
+    u_char          collector_hash_bin[16];     ///< collector hash in binary format, for native headers
 
     uint64_t        router_seq;                 ///< Router add/del sequence
     uint64_t        collector_seq;              ///< Collector add/del sequence
@@ -108,6 +190,16 @@ private:
 
     RdKafka::Producer *producer;                ///< Kafka Producer instance
 
+    /**
+     * Control lane, producer for the control topics (collector, router, peer and bmp_stat) so that
+     * they are not queued behind bulk messages.  NULL if disabled, control topics then use producer.
+     */
+    RdKafka::Producer   *ctrl_producer;
+    KafkaTopicSelector  *ctrl_topicSel;
+    KafkaEventCallback  *ctrl_event_callback;   ///< Event callback of the control lane, for its own batch limit
+    bool                ctrl_use_bulk;          ///< Control messages go to the bulk lane, see orderAfterBulkLane()
+    int                 ctrl_wait_left_ms;      ///< Remaining time orderAfterBulkLane() may wait this session
+
     /**
      * Callback handlers
      */
@@ -124,34 +216,277 @@ private:
     u_char      router_hash[16];                ///< Router Hash in binary format
     std::string router_group_name;              ///< Router group name - if matched
 
+    /**
+     * Values a router or peer group was matched on, matched again after a config reload
+     */
+    struct group_match {
+        std::string hostname;                   ///< Hostname/fqdn
+        std::string addr;                       ///< IP address (printed form)
+        uint32_t    asn;                        ///< Peer ASN, zero for the router
+    };
+
+    group_match router_match;                   ///< Router group match, empty addr if not matched yet
+    std::map<std::string, group_match> peer_match;     ///< Peer group matches, key is the peer hash
+
 
     std::map<std::string, RdKafka::Topic*> topic;
 
+    /**
+     * Current unicast prefix state of a peer
+     *
+     *      Maps the rib hash_id of every prefix currently advertised by the peer to the
+     *      digest of the state row it was last produced with, see stateDigest().  Used to
+     *      only write real state changes to the compacted unicast_prefix_state topic.
+     */
+    struct prefix_state_table {
+        uint32_t    peer_asn;                   ///< Peer ASN, used for topic selection of tombstones
+        std::unordered_map<hash_key, hash_key, hash_key_hasher> prefixes;
+    };
+
+    std::map<std::string, prefix_state_table> prefix_state;    ///< Prefix state tables, key is the peer hash string
+
     KafkaTopicSelector *topicSel;               ///< Kafka topic selector/handler
 
+    /**
+     * Bulk producer replaced by the autotune, drained by service().  NULL if none.
+     */
+    RdKafka::Producer   *retired_producer;
+    KafkaTopicSelector  *retired_topicSel;
+
+    /**
+     * Bulk message held until the retired producer is drained, see holdBulk()
+     */
+    struct held_bulk_msg {
+        std::string     topic_var;              ///< Topic var
+        std::string     msg;                    ///< Message, empty for a tombstone
+        int             rows;                   ///< Number of rows
+        std::string     key;                    ///< Hash key
+        std::string     peer_group;             ///< Peer group name
+        bool            has_peer_group;         ///< Indicates if the peer group was set
+        uint32_t        peer_asn;               ///< Peer ASN
+        bool            tombstone;              ///< Indicates if the message is a tombstone
+    };
+
+    std::deque<held_bulk_msg> held_bulk;        ///< Held bulk messages, oldest first
+    size_t      held_bulk_bytes;                ///< Bytes of the held bulk messages
+
+    /**
+     * Bulk messages of a topic held for submission in one batch, see produceBatched()
+     */
+    struct produce_batch {
+        /**
+         * Held message, the value and key are in data
+         */
+        struct held_msg {
+            size_t      offset;                 ///< Offset of the value in data, the key follows it
+            size_t      len;                    ///< Length of the value
+            size_t      key_len;                ///< Length of the key
+            void        *opaque;                ///< Message opaque (delivery report enqueue time)
+        };
+
+        const char              *topic_var;     ///< Topic var, for tracing and submitBatches(topic_var)
+        std::string             data;           ///< Values and keys of the held messages
+        std::vector<held_msg>   msgs;           ///< Held messages in produce order
+    };
+
+    std::map<RdKafka::Topic *, produce_batch> batches;     ///< Held batches by topic, of the bulk producer
+    std::vector<rd_kafka_message_t> batch_rkmessages;      ///< Working array for rd_kafka_produce_batch()
+    bool        batch_produce;                  ///< Bulk messages are submitted in batches, see produceBatched()
+    size_t      batched_msgs;                   ///< Messages held in batches
+    uint64_t    next_service_ms;                ///< Monotonic time in ms of the next service()
+    bool        service_poll;                   ///< Producers need a poll for callbacks
+
+    KafkaAutotune   *autotune;                  ///< Bulk producer batching controller, NULL if disabled
+    uint64_t    autotune_produced;              ///< Messages produced by the bulk producer since the last sample
+    uint64_t    autotune_next_ms;               ///< Monotonic time in ms of the next sample
+    bool        rib_dump;                       ///< Router is in its initial RIB dump, see setRibDump()
+
+    /**
+     * Stats report rows of a topic held for one message, see kafka.stats_report
+     */
+    struct stat_report_batch {
+        std::string     rows;                   ///< Held rows
+        int             count;                  ///< Number of held rows
+        std::string     key;                    ///< Message key, the router hash
+        std::string     peer_group;             ///< Peer group of the first row, selects the topic
+        uint32_t        peer_asn;               ///< Peer ASN of the first row, selects the topic
+    };
+
+    std::map<std::string, stat_report_batch> stat_batches; ///< Held stats reports by topic name
+    uint64_t    stat_due_ms;                    ///< Monotonic time in ms the held stats reports are produced
+    std::map<std::string, std::string> stat_last;          ///< Counters of the last report sent, key is the peer hash
+
+    LocalRib    *local_rib;                     ///< Local RIB, NULL if disabled
+
+    /**
+     * Columns to blank by topic, see ColumnProjection::apply()
+     */
+    uint64_t    blank_base_attr;
+    uint64_t    blank_unicast_prefix;
+    uint64_t    blank_l3vpn;
+    uint64_t    blank_evpn;
+    uint64_t    blank_ls_node;
+    uint64_t    blank_ls_link;
+    uint64_t    blank_ls_prefix;
+    uint64_t    blank_normalized_prefix;        ///< Hashed attribute columns of unicast_prefix, see Config::kafka_normalized_prefixes
+
+    bool        normalize_prefixes;             ///< Normalized prefixes enabled and base_attribute has all columns
+
+    /**
+     * Set the columns to blank from the projection of the config
+     */
+    void loadProjection();
+
     /**
      * Connects to kafka broker
      */
     void connect();
 
+    /**
+     * Create the control lane producer, must be called after the bulk producer is connected
+     */
+    void connectControlLane();
+
+    /**
+     * Order the next control message after the messages queued in the bulk lane
+     *
+     *      Waits for the bulk lane to drain, or sets ctrl_use_bulk if it doesn't in time.
+     *      service() clears ctrl_use_bulk once the bulk lane is empty.
+     */
+    void orderAfterBulkLane();
+
+    /**
+     * Hold a bulk message for batch submission
+     *
+     * \param [in] topic         Topic of the bulk producer
+     * \param [in] topic_var     Topic var
+     * \param [in] hdr           Text headers
+     * \param [in] hdr_len       Length of the text headers
+     * \param [in] msg           Message
+     * \param [in] msg_size      Length of the message
+     * \param [in] key           Hash key
+     * \param [in] opaque        Message opaque
+     */
+    void produceBatched(RdKafka::Topic *topic, const char *topic_var, const char *hdr, size_t hdr_len,
+                        const char *msg, size_t msg_size, const std::string &key, void *opaque);
+
+    /**
+     * Submit a held batch to the bulk producer
+     *
+     * \param [in] topic         Topic of the batch
+     * \param [in] batch         Batch, empty on return
+     */
+    void submitBatch(RdKafka::Topic *topic, produce_batch &batch);
+
+    /**
+     * Submit all held batches, must be called before producing directly to the bulk producer
+     * or destroying it
+     */
+    void submitBatches();
+
+    /**
+     * Submit the held batches of a topic var, for all topic handles it resolves to
+     *
+     * \param [in] topic_var     Topic var
+     */
+    void submitBatches(const char *topic_var);
+
+    /**
+     * Run service() if due, otherwise mark the producers for the next poll
+     */
+    void serviceIfDue();
+
+    /**
+     * Hold a stats report row for the multi-row message of its topic
+     *
+     * \param [in] peer          Peer of the report
+     * \param [in] p_hash_str    Peer hash string
+     * \param [in] row           Stats report row
+     * \param [in] row_len       Length of the row
+     *
+     * \return true if held, false if the row has to be produced on its own
+     */
+    bool holdStatReport(obj_bgp_peer &peer, const std::string &p_hash_str, const char *row, size_t row_len);
+
+    /**
+     * Produce the held stats reports, one message per topic
+     */
+    void produceStatReports();
+
+    /**
+     * Create the native Kafka headers of a parsed message, see kafka.native_headers
+     *
+     * \param [in] topic_var     Topic var (T header)
+     * \param [in] msg_size      Length in bytes of the message (L header)
+     * \param [in] rows          Number of rows in the message (R header)
+     *
+     * \return headers, the caller owns them until they are produced
+     */
+    RdKafka::Headers *parsedHeaders(const char *topic_var, size_t msg_size, int rows);
+
+    /**
+     * Replace the bulk producer by one with the current autotune batching setting
+     *
+     * \return true if replaced, false if the current producer is kept
+     */
+    bool replaceProducer();
+
+    /**
+     * Poll the retired bulk producer, deleted once drained and the held messages are produced
+     */
+    void drainRetiredProducer();
+
+    /**
+     * Hold a bulk message until the retired producer is drained
+     *
+     * \param [in] topic_var     Topic var
+     * \param [in] msg           Message, NULL for a tombstone
+     * \param [in] msg_size      Length in bytes of the message
+     * \param [in] rows          Number of rows
+     * \param [in] key           Hash key
+     * \param [in] peer_group    Peer group name - NULL if not set
+     * \param [in] peer_asn      Peer ASN
+     */
+    void holdBulk(const char *topic_var, const char *msg, size_t msg_size, int rows, const std::string &key,
+                  const std::string *peer_group, uint32_t peer_asn);
+
+    /**
+     * Produce the held bulk messages, in order, to the bulk producer
+     */
+    void releaseHeld();
+
     /**
      * Disconnects from kafka broker
+     *
+     *      Queued messages are delivered for up to 15 seconds, or until the shutdown deadline.
+     *      Messages flushed and dropped are counted in the msgbus.drain.* metrics.
+     *
+     * \param [in] wait_ms      Max time to wait for librdkafka to free its resources
      */
     void disconnect(int wait_ms=2000);
 
     /**
-     * produce message to Kafka
+     * produce a tombstone (NULL payload) to Kafka
+     *
+     *      Tombstones delete the key from log compacted topics.
      *
      * \param [in] topic_var     Topic var to use in KafkaTopicSelector::getTopic()
-     * \param [in] msg           message to produce
-     * \param [in] msg_size      Length in bytes of the message
-     * \param [in] rows          Number of rows in data
-     * \param [in] key           Hash key
+     * \param [in] key           Hash key to delete
      * \param [in] peer_group    Peer group name - empty/NULL if not set or used
      * \param [in] peer_asn      Peer ASN
      */
-    void produce(const char *topic_var, char *msg, size_t msg_size, int rows,
-                 std::string key, const std::string *peer_group, uint32_t);
+    void produceTombstone(const char *topic_var, const std::string &key, const std::string *peer_group,
+                          uint32_t peer_asn);
+
+    /**
+     * Withdraw the current prefix state of a peer
+     *
+     *      A tombstone is produced to the unicast_prefix_state topic for every prefix in the
+     *      peer state table and the table is removed.
+     *
+     * \param [in] p_hash_str    Peer hash string
+     */
+    void clearPrefixState(const std::string &p_hash_str);
 
     /**
     * \brief Method to resolve the IP address to a hostname
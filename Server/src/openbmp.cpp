@@ -21,6 +21,14 @@
 #include "client_thread.h"
 #include "openbmpd_version.h"
 #include "Config.h"
+#include "Metrics.h"
+#include "StageStats.h"
+#include "benchmark.h"
+#include "LocalRib.h"
+#include "RibQueryServer.h"
+#include "FilterEngine.h"
+#include "ConfigRcu.h"
+#include "RouterBaseline.h"
 
 #include <unistd.h>
 #include <fstream>
@@ -31,6 +39,8 @@
 
 using namespace std;
 
+#define SHUTDOWN_JOIN_GRACE_SEC     5               // Seconds to wait for the sessions after the drain deadline
+
 /*
  * Global parameters
  */
@@ -38,8 +48,16 @@ const char *cfg_filename    = NULL;                 // Configuration file name t
 const char *log_filename    = NULL;                 // Output file to log messages to
 const char *debug_filename  = NULL;                 // Debug file to log messages to
 const char *pid_filename    = NULL;                 // PID file to record the daemon pid
-bool        run             = true;                 // Indicates if server should run
+const char *bench_filename  = NULL;                 // Recorded BMP stream to replay in benchmark mode
+uint64_t    bench_synthetic = 0;                    // Prefixes of the synthetic stream in benchmark mode
+int         bench_mock_brokers = 0;                 // Brokers of the kafka mock cluster in benchmark mode
+uint32_t    bench_decoders_ms = 0;                  // Minimum run time per case of the decoder benchmark
+const char *bench_filter    = NULL;                 // Decoder benchmark case name filter
+uint32_t    bench_worst_ms  = 0;                    // Minimum run time per case size of the worst case benchmark
+volatile bool run           = true;                 // Indicates if server should run
 bool        run_foreground  = false;                // Indicates if server should run in forground
+volatile sig_atomic_t report_metrics = 0;           // Set by SIGUSR1 to request a metrics report
+volatile sig_atomic_t reload_config = 0;            // Set by SIGHUP to request a config reload
 
 
 // Global thread list
@@ -67,6 +85,18 @@ void Usage(char *prog) {
     cout << endl << "  OTHER OPTIONS:" << endl;
     cout << "     -v                   Version" << endl;
     cout << "     -h                   Help" << endl;
+    cout << "     -bench <filename>    Benchmark mode. Replay a recorded BMP stream and print a per stage" << endl;
+    cout << "                          allocation/CPU breakdown per million prefixes, then exit" << endl;
+    cout << "     -bench-synthetic <prefixes>" << endl;
+    cout << "                          Benchmark mode using a synthetic BMP stream advertising <prefixes>" << endl;
+    cout << "     -bench-mock <brokers>    Produce to an in-process kafka mock cluster with <brokers> brokers" << endl;
+    cout << "                          instead of the configured brokers (benchmark mode only)" << endl;
+    cout << "     -bench-decoders <ms> Decoder benchmark mode. Run each BMP/BGP decoder for at least <ms> milliseconds" << endl;
+    cout << "                          per case and print ns/op, bytes/s and allocations/op, then exit" << endl;
+    cout << "     -bench-filter <name> Only run decoder benchmark cases with names containing <name>" << endl;
+    cout << "     -bench-worst <ms>    Worst case benchmark mode. Parse and serialize pathological UPDATEs at two" << endl;
+    cout << "                          sizes for at least <ms> milliseconds each and fail if the time per byte" << endl;
+    cout << "                          grows more than " << BENCHMARK_WORST_MAX_SCALING << "x, then exit" << endl;
 
 
     cout << endl << "  DEBUG OPTIONS:" << endl;
@@ -135,6 +165,86 @@ void daemonize() {
     }
 }
 
+/**
+ * Stop all router sessions at once
+ *
+ *      All session threads are canceled before any is joined, so they close their sockets and
+ *      drain their producers concurrently until the common deadline set by
+ *      msgBus_kafka::beginShutdown().
+ *
+ * \param [in] timeout_sec  Drain timeout in seconds
+ *
+ * \returns number of sessions that did not end in time
+ */
+static size_t stopRouters(int timeout_sec) {
+    size_t stuck = 0;
+
+    LOG_INFO("Stopping %lu router sessions", thr_list.size());
+
+    for (size_t i=0; i < thr_list.size(); i++) {
+        if (thr_list.at(i)->running)
+            pthread_cancel(thr_list.at(i)->thr);
+    }
+
+    // librdkafka teardown continues after the drain deadline, allow it a grace period
+    timespec join_deadline;
+    clock_gettime(CLOCK_REALTIME, &join_deadline);
+    join_deadline.tv_sec += timeout_sec + SHUTDOWN_JOIN_GRACE_SEC;
+
+    for (size_t i=0; i < thr_list.size(); i++) {
+#ifdef __APPLE__
+        pthread_join(thr_list.at(i)->thr, NULL);
+#else
+        if (pthread_timedjoin_np(thr_list.at(i)->thr, NULL, &join_deadline) != 0) {
+            ++stuck;                            // Still uses its entry, not freed
+            continue;
+        }
+#endif
+        delete thr_list.at(i);
+    }
+
+    thr_list.clear();
+
+    return stuck;
+}
+
+/**
+ * Reload the configuration file and publish it to the router sessions
+ *
+ *      The file is parsed, and the group matching regular expressions and prefixes compiled,
+ *      here in the server thread.  Sessions switch to the new config between BMP messages,
+ *      see ConfigRcu.
+ *
+ * \param [in] kafka    Message bus of the collector
+ */
+static void reloadConfig(msgBus_kafka *kafka) {
+    if (cfg_filename == NULL) {
+        LOG_WARN("Ignoring config reload, no configuration file (-c) is used");
+        return;
+    }
+
+    LOG_NOTICE("Reloading configuration file %s", cfg_filename);
+
+    Config loaded;
+
+    try {
+        loaded.load(cfg_filename);
+
+    } catch (char const *str) {
+        LOG_ERR("Failed to reload the configuration file, keeping the running config: %s", str);
+        return;
+    }
+
+    // Settings that need a restart keep their running value
+    Config *next = new Config(*ConfigRcu::current());
+    next->applyReloadable(loaded);
+
+    ConfigRcu::publish(next);
+    kafka->setConfig(next);
+
+    LOG_NOTICE("Configuration reloaded: debug, topics, mapping and projection changes are applied");
+}
+
 /**
  * Signal handler
  *
@@ -154,20 +264,24 @@ void signal_handler(int signum)
         case SIGINT  :
         case SIGCHLD : // Handle the child cleanup
 
-            for (size_t i=0; i < thr_list.size(); i++) {
-                if (thr_list.at(i)->running) {
-                    pthread_cancel(thr_list.at(i)->thr);
-                    thr_list.at(i)->running = false;
-                    pthread_join(thr_list.at(i)->thr, NULL);
+            // Sessions are stopped and drained by the server loop, see stopRouters()
+            if (not run) {
+                if (signum == SIGTERM or signum == SIGINT or signum == SIGQUIT) {
+                    LOG_WARN("Shutdown forced, exiting without draining");
+                    _exit(EXIT_FAILURE);
                 }
+                break;
             }
 
-            thr_list.clear();
+            run = false;
+            break;
 
-            LOG_INFO("Done closing all active BMP connections");
+        case SIGUSR1 : // Metrics report, logged by the server loop
+            report_metrics = 1;
+            break;
 
-            run = false;
-            exit(0);
+        case SIGHUP : // Config reload, done by the server loop
+            reload_config = 1;
             break;
 
         default:
@@ -353,6 +467,71 @@ bool ReadCmdArgs(int argc, char **argv, Config &cfg) {
             // Set the new filename
             pid_filename = argv[++i];
         }
+
+        // Benchmark mode
+        else if (!strcmp(argv[i], "-bench")) {
+            // We expect the next arg to be the filename
+            if (i + 1 >= argc) {
+                cout << "INVALID ARG: -bench expects the recorded BMP stream filename to be specified" << endl;
+                return true;
+            }
+
+            bench_filename = argv[++i];
+            run_foreground = true;
+        }
+
+        else if (!strcmp(argv[i], "-bench-synthetic")) {
+            // We expect the next arg to be the number of prefixes
+            if (i + 1 >= argc or strtoull(argv[i + 1], NULL, 10) == 0) {
+                cout << "INVALID ARG: -bench-synthetic expects the number of prefixes to be specified" << endl;
+                return true;
+            }
+
+            bench_synthetic = strtoull(argv[++i], NULL, 10);
+            run_foreground = true;
+        }
+
+        else if (!strcmp(argv[i], "-bench-mock")) {
+            // We expect the next arg to be the number of brokers
+            if (i + 1 >= argc or atoi(argv[i + 1]) < 1 or atoi(argv[i + 1]) > 16) {
+                cout << "INVALID ARG: -bench-mock expects the number of brokers (1 - 16) to be specified" << endl;
+                return true;
+            }
+
+            bench_mock_brokers = atoi(argv[++i]);
+        }
+
+        else if (!strcmp(argv[i], "-bench-decoders")) {
+            // We expect the next arg to be the minimum run time
+            if (i + 1 >= argc or atoi(argv[i + 1]) < 1) {
+                cout << "INVALID ARG: -bench-decoders expects the minimum run time per case in milliseconds" << endl;
+                return true;
+            }
+
+            bench_decoders_ms = atoi(argv[++i]);
+            run_foreground = true;
+        }
+
+        else if (!strcmp(argv[i], "-bench-filter")) {
+            // We expect the next arg to be the case name filter
+            if (i + 1 >= argc) {
+                cout << "INVALID ARG: -bench-filter expects the case name to be specified" << endl;
+                return true;
+            }
+
+            bench_filter = argv[++i];
+        }
+
+        else if (!strcmp(argv[i], "-bench-worst")) {
+            // We expect the next arg to be the minimum run time
+            if (i + 1 >= argc or atoi(argv[i + 1]) < 1) {
+                cout << "INVALID ARG: -bench-worst expects the minimum run time per case size in milliseconds" << endl;
+                return true;
+            }
+
+            bench_worst_ms = atoi(argv[++i]);
+            run_foreground = true;
+        }
     }
 
     return false;
@@ -393,6 +572,22 @@ void collector_update_msg(msgBus_kafka *kafka, Config &cfg,
     kafka->update_Collector(oc, code);
 }
 
+/**
+ * Generate the collector hash
+ *
+ * \param [in,out] cfg    Reference to the config options, c_hash_id is updated
+ */
+void hashCollector(Config &cfg) {
+    MD5 hash;
+    hash.update((unsigned char *)cfg.admin_id, strlen(cfg.admin_id));
+    hash.finalize();
+
+    // Save the hash
+    unsigned char *hash_raw = hash.raw_digest();
+    memcpy(cfg.c_hash_id, hash_raw, 16);
+    delete[] hash_raw;
+}
+
 /**
  * Run Server loop
  *
@@ -403,26 +598,36 @@ void runServer(Config &cfg) {
     int active_connections = 0;                 // Number of active connections/threads
     int concurrent_routers = 0;			// Number of concurrent routers
     time_t last_heartbeat_time = 0;
+    time_t last_metrics_time = time(NULL);
    
     LOG_INFO("Initializing server");
 
     try {
         // Define the collector hash
-        MD5 hash;
-        hash.update((unsigned char *)cfg.admin_id, strlen(cfg.admin_id));
-        hash.finalize();
-
-        // Save the hash
-        unsigned char *hash_raw = hash.raw_digest();
-        memcpy(cfg.c_hash_id, hash_raw, 16);
-        delete[] hash_raw;
+        hashCollector(cfg);
 
         // Kafka connection
+        ConfigRcu::init(&cfg);
         kafka = new msgBus_kafka(logger, &cfg, cfg.c_hash_id);
 
         // allocate and start a new bmp server
         BMPListener *bmp_svr = new BMPListener(logger, &cfg);
 
+        // Local RIB and query service
+        LocalRib *local_rib = NULL;
+        RibQueryServer *rib_svr = NULL;
+
+        if (cfg.rib_enabled) {
+            local_rib = new LocalRib(logger);
+            rib_svr = new RibQueryServer(logger, &cfg, local_rib);
+            rib_svr->start();
+        }
+
+        // Ingest filter, shared by all router threads
+        FilterEngine *filter = NULL;
+        if (cfg.filter_rules.size() > 0 or cfg.filter_default_drop)
+            filter = new FilterEngine(logger, &cfg);
+
         collector_update_msg(kafka, cfg, MsgBusInterface::COLLECTOR_ACTION_STARTED);
         last_heartbeat_time = time(NULL);
 
@@ -460,8 +665,9 @@ void runServer(Config &cfg) {
                     string hash(reinterpret_cast<char*>(thr_list.at(i)->client.hash_id), 16);
 
                     //if calculate_baseline is true and the baseline time for the router is calculated, use the baseline time
-                    if (cfg.calculate_baseline && cfg.router_baseline_time.find(hash) != cfg.router_baseline_time.end())
-                        initial_time = cfg.router_baseline_time[hash];
+                    float baseline_time;
+                    if (cfg.calculate_baseline && RouterBaseline::get(hash, baseline_time))
+                        initial_time = baseline_time;
 
                     timeval now;
                     gettimeofday(&now, NULL);
@@ -476,6 +682,26 @@ void runServer(Config &cfg) {
                 //TODO: Add code to check for a socket that is open, but not really connected/half open
             }
 
+            /*
+             * Log the metrics report if requested (SIGUSR1) or at the configured interval
+             */
+            if (report_metrics or (cfg.metrics_interval > 0 and
+                                   (time(NULL) - last_metrics_time) >= cfg.metrics_interval)) {
+                report_metrics = 0;
+                Metrics::report(logger);
+                last_metrics_time = time(NULL);
+            }
+
+            /*
+             * Reload the config if requested (SIGHUP), free the configs no session uses anymore
+             */
+            if (reload_config) {
+                reload_config = 0;
+                reloadConfig(kafka);
+            }
+
+            ConfigRcu::reclaim();
+
             /*
              * Create a new client thread if we aren't at the max number of active sessions
              */
@@ -483,8 +709,10 @@ void runServer(Config &cfg) {
             {
                 if (active_connections <= MAX_THREADS) {
                     ThreadMgmt *thr = new ThreadMgmt;
-                    thr->cfg = &cfg;
+                    thr->cfg = ConfigRcu::current();
                     thr->log = logger;
+                    thr->rib = local_rib;
+                    thr->filter = filter;
 
                     // wait for a new connection and accept
                     if (bmp_svr->wait_and_accept_connection(thr->client, 500)) {
@@ -542,9 +770,35 @@ void runServer(Config &cfg) {
 	        }
 	    }
 
+        /*
+         * Shutdown: all sessions stop at once and all producers drain until one deadline
+         */
+        LOG_NOTICE("Shutting down, draining producers for up to %d seconds", cfg.shutdown_drain_timeout);
+
+        uint64_t flushed = Metrics::get("msgbus.drain.flushed").load(std::memory_order_relaxed);
+        uint64_t dropped = Metrics::get("msgbus.drain.dropped").load(std::memory_order_relaxed);
+        timeval start, end;
+        gettimeofday(&start, NULL);
+
+        msgBus_kafka::beginShutdown(cfg.shutdown_drain_timeout * 1000);
+
+        size_t stuck = stopRouters(cfg.shutdown_drain_timeout);
+        if (stuck > 0)
+            LOG_WARN("%lu router sessions did not end in time", stuck);
+
         collector_update_msg(kafka, cfg, MsgBusInterface::COLLECTOR_ACTION_STOPPED);
         delete kafka;
 
+        gettimeofday(&end, NULL);
+        LOG_NOTICE("Shutdown done in %ld ms: flushed %lu messages, dropped %lu messages",
+                   (end.tv_sec - start.tv_sec) * 1000 + (end.tv_usec - start.tv_usec) / 1000,
+                   Metrics::get("msgbus.drain.flushed").load(std::memory_order_relaxed) - flushed,
+                   Metrics::get("msgbus.drain.dropped").load(std::memory_order_relaxed) - dropped);
+
+        // Local RIB and ingest filter are not freed since router threads may still be using them
+        if (rib_svr != NULL)
+            delete rib_svr;
+
     } catch (char const *str) {
         LOG_WARN(str);
     }
@@ -571,8 +825,8 @@ int main(int argc, char **argv) {
         }
     }
 
-    // Make sure we have the required ARGS
-    if (strlen(cfg.admin_id) <= 0) {
+    // Make sure we have the required ARGS, the decoder benchmark doesn't use the collector identity
+    if (strlen(cfg.admin_id) <= 0 and bench_decoders_ms == 0) {
         cout << "ERROR: Missing required 'admin ID', use -c <config> or -a <string> to set the collector admin ID" << endl;
         return 2;
     }
@@ -589,6 +843,27 @@ int main(int argc, char **argv) {
     logger->setWidthFilename(15);
     logger->setWidthFunction(18);
 
+    // Benchmark modes run in the foreground and exit
+    if (bench_decoders_ms > 0)
+        return runDecoderBenchmark(logger, bench_decoders_ms, bench_filter);
+
+    if (bench_filename != NULL or bench_synthetic > 0) {
+        if (cfg.debug_general)
+            logger->enableDebug();
+
+        cfg.kafka_mock_brokers = bench_mock_brokers;
+
+        hashCollector(cfg);
+        return runBenchmark(cfg, logger, bench_filename, bench_synthetic);
+    }
+
+    if (bench_worst_ms > 0) {
+        cfg.kafka_mock_brokers = bench_mock_brokers;
+
+        hashCollector(cfg);
+        return runWorstCaseBenchmark(cfg, logger, bench_worst_ms);
+    }
+
     if (cfg.debug_general)
         logger->enableDebug();
 
@@ -616,6 +891,9 @@ int main(int argc, char **argv) {
     sigaction(SIGUSR1, &sigact, NULL);
     sigaction(SIGUSR2, &sigact, NULL);
 
+    if (cfg.stage_accounting)
+        StageStats::enable();
+
     // Run the server (loop)
     runServer(cfg);
 